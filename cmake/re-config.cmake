@@ -113,6 +113,22 @@ if(UNIX)
   if(HAVE_KQUEUE)
     list(APPEND RE_DEFINITIONS HAVE_KQUEUE)
   endif()
+  check_symbol_exists(IORING_FEAT_EXT_ARG "linux/io_uring.h" HAVE_IO_URING)
+  if(HAVE_IO_URING)
+    list(APPEND RE_DEFINITIONS HAVE_IO_URING)
+  endif()
+  check_symbol_exists(timerfd_create "sys/timerfd.h" HAVE_TIMERFD)
+  if(HAVE_TIMERFD)
+    list(APPEND RE_DEFINITIONS HAVE_TIMERFD)
+  endif()
+  check_symbol_exists(eventfd "sys/eventfd.h" HAVE_EVENTFD)
+  if(HAVE_EVENTFD)
+    list(APPEND RE_DEFINITIONS HAVE_EVENTFD)
+  endif()
+  check_symbol_exists(SYS_set_mempolicy "sys/syscall.h" HAVE_SET_MEMPOLICY)
+  if(HAVE_SET_MEMPOLICY)
+    list(APPEND RE_DEFINITIONS HAVE_SET_MEMPOLICY)
+  endif()
 endif()
 
 check_include_file(sys/prctl.h HAVE_PRCTL)
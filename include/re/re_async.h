@@ -8,12 +8,36 @@
 #define RE_H_ASYNC__
 struct re_async;
 
+/** Async work priority, higher priority work is started first */
+enum re_async_prio {
+	RE_ASYNC_PRIO_LOW = 0,
+	RE_ASYNC_PRIO_NORMAL,
+	RE_ASYNC_PRIO_HIGH,
+};
+
 typedef int(re_async_work_h)(void *arg);
 typedef void(re_async_h)(int err, void *arg);
 
 int re_async_alloc(struct re_async **asyncp, uint16_t workers);
+int re_async_alloc_pin(struct re_async **asyncp, uint16_t workers, bool pin);
 int re_async(struct re_async *a, intptr_t id, re_async_work_h *workh,
 	     re_async_h *cb, void *arg);
+int re_async_prio(struct re_async *a, intptr_t id, enum re_async_prio prio,
+		  re_async_work_h *workh, re_async_h *cb, void *arg);
 void re_async_cancel(struct re_async *async, intptr_t id);
 
+
+/* Job graphs */
+struct re_async_graph;
+struct re_async_job;
+
+int re_async_graph_alloc(struct re_async_graph **graphp,
+			 struct re_async *async);
+int re_async_graph_job(struct re_async_graph *graph,
+		       struct re_async_job **jobp, re_async_work_h *workh,
+		       void *arg);
+int re_async_graph_depend(struct re_async_job *job, struct re_async_job *req);
+int re_async_graph_run(struct re_async_graph *graph, re_async_h *cb,
+		       void *arg);
+
 #endif
@@ -7,9 +7,22 @@
 
 struct hash;
 struct pl;
+struct mem_arena;
 
 
+/**
+ * Defines the hash key handler of a growing hashmap table
+ *
+ * @param data Element data
+ *
+ * @return Hash key the element was added with
+ */
+typedef uint32_t (hash_key_h)(const void *data);
+
 int  hash_alloc(struct hash **hp, uint32_t bsize);
+int  hash_alloc_autogrow(struct hash **hp, uint32_t bsize, hash_key_h *keyh);
+int  hash_alloc_arena(struct hash **hp, uint32_t bsize,
+		      struct mem_arena *arena);
 void hash_append(struct hash *h, uint32_t key, struct le *le, void *data);
 void hash_unlink(struct le *le);
 struct le *hash_lookup(const struct hash *h, uint32_t key, list_apply_h *ah,
@@ -24,6 +37,30 @@ uint32_t hash_valid_size(uint32_t size);
 int hash_debug(struct re_printf *pf, struct hash *h);
 
 
+/* Open-addressing hash map */
+struct hmap;
+
+/**
+ * Defines the hash map apply handler
+ *
+ * @param data Element data
+ * @param arg  Handler argument
+ *
+ * @return True to stop traversing, False to continue
+ */
+typedef bool (hmap_apply_h)(void *data, void *arg);
+
+int   hmap_alloc(struct hmap **mp, uint32_t size);
+int   hmap_insert(struct hmap *m, uint32_t key, void *data);
+bool  hmap_remove(struct hmap *m, uint32_t key, const void *data);
+void *hmap_lookup(const struct hmap *m, uint32_t key, hmap_apply_h *ah,
+		  void *arg);
+void *hmap_apply(const struct hmap *m, hmap_apply_h *ah, void *arg);
+uint32_t hmap_count(const struct hmap *m);
+void  hmap_flush(struct hmap *m);
+void  hmap_clear(struct hmap *m);
+
+
 /* Hash functions */
 uint32_t hash_joaat(const uint8_t *key, size_t len);
 uint32_t hash_joaat_ci(const char *str, size_t len);
@@ -33,3 +70,9 @@ uint32_t hash_joaat_pl(const struct pl *pl);
 uint32_t hash_joaat_pl_ci(const struct pl *pl);
 uint32_t hash_fast(const char *k, size_t len);
 uint32_t hash_fast_str(const char *str);
+uint32_t hash_wy(const uint8_t *key, size_t len);
+uint32_t hash_wy_ci(const char *str, size_t len);
+uint32_t hash_wy_str(const char *str);
+uint32_t hash_wy_str_ci(const char *str);
+uint32_t hash_wy_pl(const struct pl *pl);
+uint32_t hash_wy_pl_ci(const struct pl *pl);
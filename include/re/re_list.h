@@ -109,3 +109,93 @@ static inline void list_move(struct le *le, struct list *list)
 	list_unlink(le);
 	list_append(list, le, le->data);
 }
+
+
+/** Red-black tree node */
+struct rbnode {
+	struct rbnode *parent;  /**< Parent node                         */
+	struct rbnode *left;    /**< Left child                          */
+	struct rbnode *right;   /**< Right child                         */
+	struct rbtree *tree;    /**< Parent tree (NULL if not linked-in) */
+	void *data;             /**< User-data                           */
+	bool red;               /**< Node color                          */
+};
+
+/** Red-black tree node Initializer */
+#define RBNODE_INIT {NULL, NULL, NULL, NULL, NULL, false}
+
+
+/**
+ * Defines the red-black tree compare handler
+ *
+ * @param n1  First tree node
+ * @param n2  Second tree node
+ *
+ * @return Less than, equal to or greater than zero if n1 is ordered
+ *         before, equal to or after n2
+ */
+typedef int (rbtree_cmp_h)(const struct rbnode *n1, const struct rbnode *n2);
+
+/**
+ * Defines the red-black tree apply handler
+ *
+ * @param node Tree node
+ * @param arg  Handler argument
+ *
+ * @return true to stop traversing, false to continue
+ */
+typedef bool (rbtree_apply_h)(struct rbnode *node, void *arg);
+
+
+/** Defines an ordered red-black tree */
+struct rbtree {
+	struct rbnode *root;  /**< Root node                 */
+	struct rbnode *min;   /**< First node in tree order  */
+	rbtree_cmp_h *cmph;   /**< Compare handler           */
+	uint32_t count;       /**< Number of nodes           */
+};
+
+/** Red-black tree Initializer */
+#define RBTREE_INIT(cmph) {NULL, NULL, (cmph), 0}
+
+
+void rbtree_init(struct rbtree *tree, rbtree_cmp_h *cmph);
+void rbtree_flush(struct rbtree *tree);
+void rbtree_clear(struct rbtree *tree);
+void rbtree_insert(struct rbtree *tree, struct rbnode *node, void *data);
+void rbtree_unlink(struct rbnode *node);
+struct rbnode *rbtree_next(const struct rbnode *node);
+struct rbnode *rbtree_prev(const struct rbnode *node);
+struct rbnode *rbtree_max(const struct rbtree *tree);
+struct rbnode *rbtree_apply(const struct rbtree *tree, bool fwd,
+			    rbtree_apply_h *ah, void *arg);
+
+
+/**
+ * Get the first node of a red-black tree, in O(1)
+ *
+ * @param tree Red-black tree
+ *
+ * @return First tree node (NULL if empty)
+ */
+static inline struct rbnode *rbtree_min(const struct rbtree *tree)
+{
+	return tree ? tree->min : NULL;
+}
+
+
+static inline uint32_t rbtree_count(const struct rbtree *tree)
+{
+	return tree ? tree->count : 0;
+}
+
+
+static inline bool rbtree_isempty(const struct rbtree *tree)
+{
+	return tree ? tree->root == NULL : true;
+}
+
+
+#define RBTREE_FOREACH(tree, node)					\
+	for ((node) = rbtree_min((tree)); (node);			\
+	     (node) = rbtree_next((node)))
@@ -40,6 +40,7 @@ int   fd_listen(struct re_fhs **fhs, re_sock_t fd, int flags, fd_h *fh,
 		void *arg);
 struct re_fhs *fd_close(struct re_fhs *fhs);
 int   fd_setsize(int maxfds);
+int   fd_changelist_set(bool enable);
 
 int   libre_init(void);
 void  libre_close(void);
@@ -69,23 +70,94 @@ int re_thread_async_main_id(intptr_t id, re_async_work_h *work, re_async_h *cb,
 			    void *arg);
 void re_thread_async_cancel(intptr_t id);
 void re_thread_async_main_cancel(intptr_t id);
+int  re_thread_async_graph(struct re_async_graph **graphp);
 
 void re_set_mutex(void *mutexp);
 
+int      re_busy_poll_set(uint32_t usec);
+uint32_t re_busy_poll_get(void);
+int      re_busy_poll_stats(uint64_t *spin_us, uint64_t *block_us);
+
 struct tmrl *re_tmrl_get(void);
 
+
+/* Handler latency statistics */
+enum {
+	RE_HSTAT_BUCKETS = 24
+};
+
+/** Statistics types */
+enum re_hstat_type {
+	RE_HSTAT_FD = 0,   /**< File descriptor handler duration [us] */
+	RE_HSTAT_TMR,      /**< Timer handler duration [us]           */
+	RE_HSTAT_LOOP,     /**< Main loop iteration, without wait [us] */
+	RE_HSTAT_EVENTS,   /**< Events per wakeup                     */
+};
+
+/** Generic handler function, used as statistics key */
+typedef void (re_fn_h)(void);
+
+/**
+ * Defines a histogram of samples. Bucket 0 counts zero samples, bucket i
+ * counts samples in [2^(i-1), 2^i), the last bucket counts the rest.
+ */
+struct re_hstat {
+	enum re_hstat_type type;   /**< Statistics type                   */
+	re_fn_h *h;                /**< Handler, NULL for loop/overflow   */
+	uint64_t count;            /**< Number of samples                 */
+	uint64_t total;            /**< Sum of samples                    */
+	uint64_t max;              /**< Largest sample                    */
+	uint64_t bucketv[RE_HSTAT_BUCKETS]; /**< Log2 histogram           */
+};
+
+/**
+ * Statistics apply handler
+ *
+ * @param st  Statistics entry
+ * @param arg Handler argument
+ *
+ * @return true to stop, false to continue
+ */
+typedef bool (re_hstat_h)(const struct re_hstat *st, void *arg);
+
+int      re_hstat_apply(re_hstat_h *h, void *arg);
+void     re_hstat_reset(void);
+uint64_t re_hstat_percentile(const struct re_hstat *st, unsigned pct);
+
+
+/* Reactor group */
+struct re_group;
+
+/**
+ * Reactor group work handler, called from the thread of the target loop
+ *
+ * @param arg Handler argument
+ */
+typedef void (re_group_h)(void *arg);
+
+int      re_group_alloc(struct re_group **grpp, unsigned n, bool pin);
+unsigned re_group_count(const struct re_group *grp);
+unsigned re_group_next(struct re_group *grp);
+int      re_group_index(const struct re_group *grp, unsigned *idx);
+int      re_group_post(struct re_group *grp, unsigned idx, re_group_h *h,
+		       void *arg);
+int      re_group_call(struct re_group *grp, unsigned idx, re_group_h *h,
+		       void *arg);
+
 /** Polling methods */
 enum poll_method {
 	METHOD_NULL = 0,
 	METHOD_SELECT,
 	METHOD_EPOLL,
 	METHOD_KQUEUE,
+	METHOD_IOURING,
 	/* sep */
 	METHOD_MAX
 };
 
 int              poll_method_set(enum poll_method method);
 enum poll_method poll_method_get(void);
+void             poll_fault_set(int err);
 enum poll_method poll_method_best(void);
 const char      *poll_method_name(enum poll_method method);
 int poll_method_type(enum poll_method *method, const struct pl *name);
@@ -54,6 +54,7 @@ struct re_printf;
 struct mbuf *mbuf_alloc(size_t size);
 struct mbuf *mbuf_dup(struct mbuf *mbd);
 struct mbuf *mbuf_alloc_ref(struct mbuf *mbr);
+struct mbuf *mbuf_alloc_slice(struct mbuf *mbr, size_t len);
 void     mbuf_init(struct mbuf *mb);
 void     mbuf_reset(struct mbuf *mb);
 int      mbuf_resize(struct mbuf *mb, size_t size);
@@ -93,6 +94,40 @@ int      mbuf_fill(struct mbuf *mb, uint8_t c, size_t n);
 void     mbuf_set_posend(struct mbuf *mb, size_t pos, size_t end);
 int      mbuf_debug(struct re_printf *pf, const struct mbuf *mb);
 
+/* Pool of fixed-size memory buffers */
+struct mbuf_pool;
+
+int          mbuf_pool_alloc(struct mbuf_pool **poolp, size_t bufsz,
+			     size_t max);
+struct mbuf *mbuf_pool_get(struct mbuf_pool *pool);
+size_t       mbuf_pool_count(const struct mbuf_pool *pool);
+
+/* Chain of memory buffer segments */
+enum { MBUF_CHAIN_MAX = 8 };
+
+/** Defines a segment of a memory buffer chain */
+struct mbuf_seg {
+	struct mbuf *mb;    /**< Referenced memory buffer  */
+	size_t pos;         /**< Start of segment          */
+	size_t end;         /**< End of segment            */
+};
+
+/**
+ * Defines a memory buffer chain. The segments reference their buffers, so
+ * headers can be prepended to a payload without copying it.
+ */
+struct mbuf_chain {
+	struct mbuf_seg segv[MBUF_CHAIN_MAX];  /**< Segments          */
+	size_t segc;                           /**< Number of segments */
+	size_t len;                            /**< Total length       */
+};
+
+void     mbuf_chain_init(struct mbuf_chain *ch);
+void     mbuf_chain_reset(struct mbuf_chain *ch);
+int      mbuf_chain_append(struct mbuf_chain *ch, struct mbuf *mb);
+int      mbuf_chain_prepend(struct mbuf_chain *ch, struct mbuf *mb);
+int      mbuf_write_chain(struct mbuf *mb, const struct mbuf_chain *ch);
+
 
 /**
  * Get the buffer from the current position
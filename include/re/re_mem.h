@@ -23,6 +23,8 @@ struct memstat {
 
 void    *mem_alloc(size_t size, mem_destroy_h *dh);
 void    *mem_zalloc(size_t size, mem_destroy_h *dh);
+void    *mem_alloc_local(size_t size, mem_destroy_h *dh);
+void    *mem_zalloc_local(size_t size, mem_destroy_h *dh);
 void    *mem_realloc(void *data, size_t size);
 void    *mem_reallocarray(void *ptr, size_t nmemb,
 			  size_t membsize, mem_destroy_h *dh);
@@ -36,6 +38,16 @@ void     mem_threshold_set(ssize_t n);
 struct re_printf;
 int      mem_status(struct re_printf *pf, void *unused);
 int      mem_get_stat(struct memstat *mstat);
+void     mem_pool_enable(bool enable);
+void     mem_prof_enable(size_t interval);
+int      mem_prof_folded(struct re_printf *pf, void *unused);
+int      mem_prof_pprof(struct re_printf *pf, void *unused);
+
+/* Memory arena */
+struct mem_arena;
+int      mem_arena_alloc(struct mem_arena **arenap, size_t size);
+void    *mem_arena_zalloc(struct mem_arena *arena, size_t size,
+			  mem_destroy_h *dh);
 
 
 /* Secure memory functions */
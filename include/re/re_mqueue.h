@@ -8,5 +8,14 @@ struct mqueue;
 
 typedef void (mqueue_h)(int id, void *data, void *arg);
 
+/** Message Queue Statistics */
+struct mqueue_stat {
+	unsigned depth;  /**< Messages waiting to be handled  */
+	unsigned hwm;    /**< High-watermark of the depth     */
+	unsigned full;   /**< Messages refused on a full queue */
+};
+
 int mqueue_alloc(struct mqueue **mqp, mqueue_h *h, void *arg);
 int mqueue_push(struct mqueue *mq, int id, void *data);
+void mqueue_drain(struct mqueue *mq);
+int mqueue_get_stat(const struct mqueue *mq, struct mqueue_stat *mstat);
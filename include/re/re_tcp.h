@@ -6,6 +6,9 @@
 struct sa;
 struct tcp_sock;
 struct tcp_conn;
+struct tcp_group;
+struct mbuf_chain;
+struct re_group;
 
 
 /**
@@ -16,6 +19,16 @@ struct tcp_conn;
  */
 typedef void (tcp_conn_h)(const struct sa *peer, void *arg);
 
+/**
+ * Defines the incoming TCP connection handler of a TCP Socket group
+ *
+ * @param ts   TCP Socket holding the connection, valid during the call
+ * @param peer Network address of peer
+ * @param arg  Handler argument
+ */
+typedef void (tcp_group_conn_h)(struct tcp_sock *ts, const struct sa *peer,
+				void *arg);
+
 /**
  * Defines the TCP connection established handler
  *
@@ -70,6 +83,7 @@ int  tcp_conn_alloc(struct tcp_conn **tcp, const struct sa *peer,
 int  tcp_conn_bind(struct tcp_conn *tc, const struct sa *local);
 int  tcp_conn_connect(struct tcp_conn *tc, const struct sa *peer);
 int  tcp_send(struct tcp_conn *tc, struct mbuf *mb);
+int  tcp_send_chain(struct tcp_conn *tc, const struct mbuf_chain *ch);
 int  tcp_set_send(struct tcp_conn *tc, tcp_send_h *sendh);
 void tcp_set_handlers(struct tcp_conn *tc, tcp_estab_h *eh, tcp_recv_h *rh,
 		      tcp_close_h *ch, void *arg);
@@ -89,6 +103,9 @@ int  tcp_connect_bind(struct tcp_conn **tcp, const struct sa *peer,
 		tcp_estab_h *eh, tcp_recv_h *rh, tcp_close_h *ch,
 		const struct sa *local, void *arg);
 int  tcp_local_get(const struct tcp_sock *ts, struct sa *local);
+int  tcp_listen_group(struct tcp_group **tgp, struct re_group *grp,
+		      const struct sa *local, tcp_group_conn_h *ch, void *arg);
+struct tcp_sock *tcp_group_sock(const struct tcp_group *tg);
 
 
 /* Helper API */
@@ -307,4 +307,74 @@ int mutex_alloc_tp(mtx_t **mtx, int type);
 int thread_create_name(thrd_t *thr, const char *name, thrd_start_t func,
 		     void *arg);
 
+
+/** Kinds of library threads, each with its own placement policy */
+enum thread_kind {
+	THREAD_KIND_DEFAULT = 0,  /**< thread_create_name() threads */
+	THREAD_KIND_ASYNC,        /**< re_async workers, trace flush */
+	THREAD_KIND_LOOP,         /**< re_group loop threads         */
+	THREAD_KIND_AUMIX,        /**< Audio mixer thread            */
+	THREAD_KIND_VIDMIX,       /**< Video mixer source threads    */
+	THREAD_KIND_MAX,
+};
+
+
+/**
+ * Creates a new thread with name, placed by the policy of its kind
+ *
+ * @param thr   Pointer to new thread
+ * @param kind  Thread kind
+ * @param name  Unique name for a thread
+ * @param func  Function to execute
+ * @param arg   Argument to pass to the function
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int thread_create_kind(thrd_t *thr, enum thread_kind kind, const char *name,
+		       thrd_start_t func, void *arg);
+
+
+/**
+ * Set the placement policy of a thread kind. It applies to threads of
+ * this kind that are started afterwards. Sets are lists of numbers and
+ * ranges like "0-3,8".
+ *
+ * @param kind   Thread kind
+ * @param cpus   CPUs the threads may run on, NULL for all
+ * @param nodes  Memory nodes the threads allocate from, NULL for all
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note thread_pin() narrows the CPU set of a thread to one CPU of it
+ */
+int thread_policy_set(enum thread_kind kind, const char *cpus,
+		      const char *nodes);
+
+
+/**
+ * Pin the calling thread to one CPU of the policy of its kind: the
+ * idx-th CPU of the set, wrapping around. Without a CPU set the CPU is
+ * idx modulo the number of online CPUs. The pin replaces the CPU set
+ * applied at thread start, but never leaves it; memory nodes are kept.
+ *
+ * @param kind  Thread kind
+ * @param idx   Index of the thread within its kind
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int thread_pin(enum thread_kind kind, unsigned idx);
+
+
+struct re_printf;
+
+/**
+ * Print the placement policy and statistics of all thread kinds
+ *
+ * @param pf      Print handler for debug output
+ * @param unused  Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int thread_debug(struct re_printf *pf, void *unused);
+
 #endif /* RE_H_THREAD__ */
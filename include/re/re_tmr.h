@@ -25,6 +25,9 @@ struct tmr {
 	tmr_h *th;          /**< Timeout handler     */
 	void *arg;          /**< Handler argument    */
 	uint64_t jfs;       /**< Jiffies for timeout */
+	uint16_t usec;      /**< Sub-millisecond part of timeout [us] */
+	bool prec;          /**< Microsecond precision timer         */
+	struct tmr *qnext;  /**< Next timer in the list inbox        */
 	const char *file;
 	int line;
 };
@@ -36,6 +39,7 @@ uint64_t tmr_jiffies(void);
 uint64_t tmr_jiffies_rt_usec(void);
 int      tmr_timespec_get(struct timespec *tp, uint64_t offset);
 uint64_t tmr_next_timeout(struct tmrl *tmrl);
+uint64_t tmrl_next_expire_us(struct tmrl *tmrl, bool *prec);
 void     tmr_debug(void);
 int      tmr_status(struct re_printf *pf, void *unused);
 
@@ -45,6 +49,12 @@ void     tmr_start_dbg(struct tmr *tmr, uint64_t delay, tmr_h *th, void *arg,
 void     tmr_continue_dbg(struct tmr *tmr, uint64_t delay,
                    tmr_h *th, void *arg,
 		   const char *file, int line);
+void     tmr_start_slack_dbg(struct tmr *tmr, uint64_t delay, uint64_t slack,
+			     tmr_h *th, void *arg, const char *file, int line);
+void     tmr_start_us_dbg(struct tmr *tmr, uint64_t delay, tmr_h *th,
+			  void *arg, const char *file, int line);
+void     tmr_continue_us_dbg(struct tmr *tmr, uint64_t delay, tmr_h *th,
+			     void *arg, const char *file, int line);
 uint32_t tmrl_count(struct tmrl *tmrl);
 
 
@@ -74,8 +84,51 @@ uint32_t tmrl_count(struct tmrl *tmrl);
 #define tmr_continue(tmr, delay, th, arg)                                     \
 	tmr_continue_dbg(tmr, delay, th, arg, __FILE__, __LINE__)
 
+/**
+ * @def tmr_start_slack(tmr, delay, slack, th, arg)
+ *
+ * Start a timer that may expire up to slack later than the delay. Timers
+ * with overlapping windows are grouped to expire in one wakeup.
+ *
+ * @param tmr   Timer to start
+ * @param delay Timer delay in [ms]
+ * @param slack Tolerated additional delay in [ms]
+ * @param th    Timeout handler
+ * @param arg   Handler argument
+ */
+#define tmr_start_slack(tmr, delay, slack, th, arg)                           \
+	tmr_start_slack_dbg(tmr, delay, slack, th, arg, __FILE__, __LINE__)
+
+/**
+ * @def tmr_start_us(tmr, delay, th, arg)
+ *
+ * Start a timer with microsecond precision
+ *
+ * @param tmr   Timer to start
+ * @param delay Timer delay in [us]
+ * @param th    Timeout handler
+ * @param arg   Handler argument
+ */
+#define tmr_start_us(tmr, delay, th, arg)                                     \
+	tmr_start_us_dbg(tmr, delay, th, arg, __FILE__, __LINE__)
+
+/**
+ * @def tmr_continue_us(tmr, delay, th, arg)
+ *
+ * Continue a previously started timer with exactly added delay, with
+ * microsecond precision
+ *
+ * @param tmr   Timer to start
+ * @param delay Timer delay in [us]
+ * @param th    Timeout handler
+ * @param arg   Handler argument
+ */
+#define tmr_continue_us(tmr, delay, th, arg)                                  \
+	tmr_continue_us_dbg(tmr, delay, th, arg, __FILE__, __LINE__)
+
 void     tmr_cancel(struct tmr *tmr);
 uint64_t tmr_get_expire(const struct tmr *tmr);
+uint64_t tmr_get_expire_us(const struct tmr *tmr);
 
 
 /**
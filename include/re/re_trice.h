@@ -63,6 +63,7 @@ struct ice_rcand {
 /** Defines a candidate pair */
 struct ice_candpair {
 	struct le le;                /**< List element                       */
+	struct rbnode rn;            /**< Node in the list priority index    */
 	struct ice_lcand *lcand;     /**< Local candidate                    */
 	struct ice_rcand *rcand;     /**< Remote candidate                   */
 	enum ice_candpair_state state;/**< Candidate pair state              */
@@ -7,6 +7,9 @@
 
 struct sa;
 struct udp_sock;
+struct udp_group;
+struct mbuf_chain;
+struct re_group;
 
 typedef int (udp_send_h)(const struct sa *dst,
 			 struct mbuf *mb, void *arg);
@@ -31,6 +34,8 @@ int  udp_alloc_fd(struct udp_sock **usp, re_sock_t fd,
 int  udp_connect(struct udp_sock *us, const struct sa *peer);
 int  udp_open(struct udp_sock **usp, int af);
 int  udp_send(struct udp_sock *us, const struct sa *dst, struct mbuf *mb);
+int  udp_send_chain(struct udp_sock *us, const struct sa *dst,
+		    const struct mbuf_chain *ch);
 int  udp_local_get(const struct udp_sock *us, struct sa *local);
 int  udp_setsockopt(struct udp_sock *us, int level, int optname,
 		    const void *optval, uint32_t optlen);
@@ -42,6 +47,9 @@ void udp_error_handler_set(struct udp_sock *us, udp_error_h *eh);
 int  udp_thread_attach(struct udp_sock *us);
 void udp_thread_detach(struct udp_sock *us);
 re_sock_t udp_sock_fd(const struct udp_sock *us, int af);
+int  udp_listen_group(struct udp_group **ugp, struct re_group *grp,
+		      const struct sa *local, udp_recv_h *rh, void *arg);
+struct udp_sock *udp_group_sock(const struct udp_group *ug, unsigned idx);
 
 int  udp_multicast_join(struct udp_sock *us, const struct sa *group);
 int  udp_multicast_leave(struct udp_sock *us, const struct sa *group);
@@ -17,7 +17,7 @@
 
 /** Locked audio-buffer with almost zero-copy */
 struct aubuf {
-	struct list afl;
+	struct rbtree aft;       /**< Frames ordered by timestamp            */
 	mtx_t *lock;
 	size_t wish_sz;
 	size_t cur_sz;
@@ -41,7 +41,7 @@ struct aubuf {
 
 
 struct frame {
-	struct le le;
+	struct rbnode rn;
 	struct mbuf *mb;
 	struct auframe af;
 };
@@ -51,7 +51,7 @@ static void frame_destructor(void *arg)
 {
 	struct frame *f = arg;
 
-	list_unlink(&f->le);
+	rbtree_unlink(&f->rn);
 	mem_deref(f->mb);
 }
 
@@ -60,25 +60,45 @@ static void aubuf_destructor(void *arg)
 {
 	struct aubuf *ab = arg;
 
-	list_flush(&ab->afl);
+	rbtree_flush(&ab->aft);
 	mem_deref(ab->lock);
 	mem_deref(ab->ajb);
 }
 
 
+static struct frame *frame_first(const struct aubuf *ab)
+{
+	const struct rbnode *rn = rbtree_min(&ab->aft);
+
+	return rn ? rn->data : NULL;
+}
+
+
+static int frame_cmp(const struct rbnode *n1, const struct rbnode *n2)
+{
+	const struct frame *frame1 = n1->data;
+	const struct frame *frame2 = n2->data;
+
+	if (frame1->af.timestamp < frame2->af.timestamp)
+		return -1;
+
+	return frame1->af.timestamp > frame2->af.timestamp;
+}
+
+
 static void read_auframe(struct aubuf *ab, struct auframe *af)
 {
-	struct le *le = ab->afl.head;
+	struct rbnode *rn = rbtree_min(&ab->aft);
 	size_t sample_size = aufmt_sample_size(af->fmt);
 	size_t sz = auframe_size(af);
 	uint8_t *p = af->sampv;
 	bool first = true;
 
-	while (le) {
-		struct frame *f = le->data;
+	while (rn) {
+		struct frame *f = rn->data;
 		size_t n;
 
-		le = le->next;
+		rn = rbtree_next(rn);
 
 		n = min(mbuf_get_left(f->mb), sz);
 
@@ -137,6 +157,8 @@ int aubuf_alloc(struct aubuf **abp, size_t min_sz, size_t max_sz)
 	if (err)
 		goto out;
 
+	rbtree_init(&ab->aft, frame_cmp);
+
 	ab->wish_sz = min_sz;
 	ab->max_sz  = max_sz;
 	ab->fill_sz = min_sz;
@@ -218,16 +240,6 @@ int aubuf_resize(struct aubuf *ab, size_t min_sz, size_t max_sz)
 }
 
 
-static bool frame_less_equal(struct le *le1, struct le *le2, void *arg)
-{
-	struct frame *frame1 = le1->data;
-	struct frame *frame2 = le2->data;
-	(void)arg;
-
-	return frame1->af.timestamp <= frame2->af.timestamp;
-}
-
-
 /**
  * Append a PCM-buffer to the end of the audio buffer
  *
@@ -266,7 +278,7 @@ int aubuf_append_auframe(struct aubuf *ab, struct mbuf *mb,
 			auframe_bytes_to_timestamp(&f->af, ab->wr_sz);
 	}
 
-	list_insert_sorted(&ab->afl, frame_less_equal, NULL, &f->le, f);
+	rbtree_insert(&ab->aft, &f->rn, f);
 	ab->cur_sz += sz;
 	ab->wr_sz += sz;
 
@@ -276,7 +288,7 @@ int aubuf_append_auframe(struct aubuf *ab, struct mbuf *mb,
 		(void)re_printf("aubuf: %p overrun (cur=%zu/%zu)\n",
 				ab, ab->cur_sz, ab->max_sz);
 #endif
-		f = list_ledata(ab->afl.head);
+		f = frame_first(ab);
 		if (f) {
 			ab->cur_sz -= mbuf_get_left(f->mb);
 			mem_deref(f);
@@ -393,7 +405,7 @@ void aubuf_read_auframe(struct aubuf *ab, struct auframe *af)
 	/* on first read drop old frames */
 	drop = ab->live && !ab->started && ab->wish_sz;
 	while (drop && ab->cur_sz > ab->wish_sz) {
-		struct frame *f = list_ledata(ab->afl.head);
+		struct frame *f = frame_first(ab);
 		if (f) {
 			ab->cur_sz -= mbuf_get_left(f->mb);
 			mem_deref(f);
@@ -480,7 +492,7 @@ void aubuf_flush(struct aubuf *ab)
 
 	mtx_lock(ab->lock);
 
-	list_flush(&ab->afl);
+	rbtree_flush(&ab->aft);
 	ab->fill_sz = ab->wish_sz;
 	ab->cur_sz  = 0;
 	ab->wr_sz   = 0;
@@ -592,10 +604,26 @@ bool aubuf_started(const struct aubuf *ab)
  */
 void aubuf_sort_auframe(struct aubuf *ab)
 {
+	struct rbtree tmp = RBTREE_INIT(frame_cmp);
+	struct rbnode *rn;
+
 	if (!ab)
 		return;
 
-	list_sort(&ab->afl, frame_less_equal, NULL);
+	mtx_lock(ab->lock);
+
+	/* Reading moves the timestamp of the first frame, insert again */
+	while ((rn = rbtree_min(&ab->aft))) {
+		rbtree_unlink(rn);
+		rbtree_insert(&tmp, rn, rn->data);
+	}
+
+	while ((rn = rbtree_min(&tmp))) {
+		rbtree_unlink(rn);
+		rbtree_insert(&ab->aft, rn, rn->data);
+	}
+
+	mtx_unlock(ab->lock);
 }
 
 
@@ -123,8 +123,14 @@ static int aumix_thread(void *arg)
 			ts = 0;
 		}
 		else {
+			/* Sleep until the next frame is due */
+			const uint64_t due = ts * 1000;
+
+			now = tmr_jiffies_usec();
+
 			mtx_unlock(&mix->mutex);
-			sys_usleep(4000);
+			if (due > now)
+				sys_usleep((unsigned)(due - now));
 			mtx_lock(&mix->mutex);
 		}
 
@@ -301,7 +307,8 @@ int aumix_alloc(struct aumix **mixp, uint32_t srate,
 
 	mix->run = true;
 
-	err = thread_create_name(&mix->thread, "aumix", aumix_thread, mix);
+	err = thread_create_kind(&mix->thread, THREAD_KIND_AUMIX, "aumix",
+				 aumix_thread, mix);
 	if (err) {
 		mix->run = false;
 		goto out;
@@ -189,8 +189,12 @@ static int vidmix_thread(void *arg)
 		struct le *le;
 		uint64_t now;
 
+		/* Sleep until the next frame is due */
+		now = tmr_jiffies_usec();
+
 		mtx_unlock(&src->mutex);
-		sys_usleep(4000);
+		if (ts > now)
+			sys_usleep((unsigned)min(ts - now, (uint64_t)src->fint));
 		mtx_lock(&src->mutex);
 
 		now = tmr_jiffies_usec();
@@ -272,8 +276,12 @@ static int content_thread(void *arg)
 		struct le *le;
 		uint64_t now;
 
+		/* Sleep until the next frame is due */
+		now = tmr_jiffies_usec();
+
 		mtx_unlock(&src->mutex);
-		sys_usleep(4000);
+		if (ts > now)
+			sys_usleep((unsigned)min(ts - now, (uint64_t)src->fint));
 		mtx_lock(&src->mutex);
 
 		now = tmr_jiffies_usec();
@@ -533,7 +541,7 @@ int vidmix_source_start(struct vidmix_source *src)
 
 	src->run = true;
 
-	err = thread_create_name(&src->thread, "vidmix",
+	err = thread_create_kind(&src->thread, THREAD_KIND_VIDMIX, "vidmix",
 				 src->content ? content_thread : vidmix_thread,
 				 src);
 	if (err)
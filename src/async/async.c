@@ -3,164 +3,462 @@
  *
  * Copyright (C) 2022 Sebastian Reimers
  */
-
 #include <re/re_types.h>
+#include <re/re_fmt.h>
 #include <re/re_mem.h>
 #include <re/re_list.h>
+#include <re/re_hash.h>
+#include <re/re_atomic.h>
 #include <re/re_thread.h>
 #include <re/re_async.h>
-#include <re/re_tmr.h>
 #include <re/re_mqueue.h>
+#include "async.h"
 
 #define DEBUG_MODULE "async"
 #define DEBUG_LEVEL 5
 #include <re/re_dbg.h>
 
+
+/*
+ * Every worker owns a queue per priority. New work goes round-robin to
+ * the workers, which take the oldest work of their own queues first. A
+ * worker without work of its own steals the newest work of another
+ * worker, highest priority first, and only sleeps when all queues are
+ * empty. Idle workers are woken up directly by the submitter.
+ *
+ * Work with a non-zero id is serialized: while one work of an id is
+ * queued or running, later work of the same id waits in the id table
+ * and is queued by the worker that completes its predecessor.
+ *
+ * Finished work is pushed to a lock-free stack. Only the push onto an
+ * empty stack posts a message to the owning loop, which then runs the
+ * callbacks of the whole batch. Graph jobs skip the loop, the worker
+ * recycles them itself.
+ */
+
+enum {
+	PRIO_N   = RE_ASYNC_PRIO_HIGH + 1,
+	ID_HSIZE = 16,
+};
+
+enum work_state {
+	WORK_FREE = 0,
+	WORK_WAITING,   /**< Waits for work with the same id */
+	WORK_QUEUED,    /**< In a worker queue               */
+	WORK_RUNNING,   /**< Handler is running              */
+	WORK_DONE,      /**< Waits for the callback          */
+};
+
 struct async_work {
-	struct le le;
+	struct le le;               /**< Worker queue or free list      */
+	struct le he;               /**< Id table, non-zero id only     */
+	struct async_work *next;    /**< Next finished work             */
 	mtx_t *mtx;
 	re_async_work_h *workh;
 	re_async_h *cb;
 	void *arg;
 	int err;
 	intptr_t id;
+	enum re_async_prio prio;
+	enum work_state state;
+	enum async_origin origin;
+	bool serial;                /**< In the id table                */
+};
+
+struct async_worker {
+	struct re_async *a;
+	thrd_t thrd;
+	unsigned idx;
+	mtx_t mtx;                  /**< Protects all fields below      */
+	cnd_t cnd;
+	struct list qv[PRIO_N];     /**< Queued work per priority       */
+	struct async_work *cur;     /**< Running work                   */
+	bool idle;                  /**< Out of work, about to sleep    */
+	bool kick;                  /**< Woken up for new work          */
 };
 
 struct re_async {
-	thrd_t *thrd;
+	struct async_worker *wv;
 	uint16_t workers;
-	volatile bool run;
-	cnd_t wait;
-	mtx_t mtx;
+	bool pin;
+	RE_ATOMIC bool run;
+	RE_ATOMIC unsigned rr;      /**< Round-robin counter            */
+	RE_ATOMIC unsigned nidle;   /**< Number of idle workers         */
+	RE_ATOMIC uintptr_t done;   /**< Stack of finished work         */
+	mtx_t mtx;                  /**< Protects freel and idh         */
 	struct list freel;
-	struct list workl;
-	struct list curl;
-	struct tmr tmr;
+	struct hash *idh;           /**< Queued work with non-zero id   */
 	struct mqueue *mqueue;
 };
 
 
-static int worker_thread(void *arg)
+static inline uint32_t id_key(intptr_t id)
 {
-	struct re_async *a = arg;
-	struct le *le;
-	struct async_work *work;
+	return (uint32_t)id ^ (uint32_t)((uint64_t)id >> 32);
+}
 
-	for (;;) {
-		mtx_lock(&a->mtx);
-		if (!a->run) {
-			mtx_unlock(&a->mtx);
-			break;
-		}
 
-		if (list_isempty(&a->workl)) {
-			cnd_wait(&a->wait, &a->mtx);
+/*
+ * Take the oldest (or newest if stolen) work of a worker, called with
+ * w->mtx held. The work is set as current work of its new owner before
+ * the lock is released, so re_async_cancel() always finds it.
+ */
+static struct async_work *queue_pop(struct async_worker *w,
+				    struct async_worker *owner)
+{
+	const bool steal = w != owner;
 
-			if (list_isempty(&a->workl) || !a->run) {
-				mtx_unlock(&a->mtx);
-				continue;
-			}
-		}
+	for (int p = PRIO_N - 1; p >= 0; p--) {
 
-		le = list_head(&a->workl);
-		list_move(le, &a->curl);
-		mtx_unlock(&a->mtx);
+		struct le *le = steal ? w->qv[p].tail : w->qv[p].head;
+		struct async_work *work;
+
+		if (!le)
+			continue;
 
 		work = le->data;
-		mtx_lock(work->mtx);
-		if (work->workh) {
-			work->err = work->workh(work->arg);
-			work->workh = NULL;
+		list_unlink(le);
+
+		work->state = WORK_RUNNING;
+		owner->cur  = work;
+		return work;
+	}
+
+	return NULL;
+}
+
+
+/* Take work of another worker, the caller is the new owner */
+static struct async_work *steal(struct async_worker *self)
+{
+	struct re_async *a = self->a;
+
+	for (unsigned i = 1; i < a->workers; i++) {
+
+		struct async_worker *w = &a->wv[(self->idx + i) % a->workers];
+		struct async_work *work;
+
+		mtx_lock(&w->mtx);
+		work = queue_pop(w, self);
+		mtx_unlock(&w->mtx);
+
+		if (work)
+			return work;
+	}
+
+	return NULL;
+}
+
+
+/* Wake up one idle worker, it steals the new work */
+static void wake_idle(struct re_async *a)
+{
+	for (unsigned i = 0; i < a->workers; i++) {
+
+		struct async_worker *w = &a->wv[i];
+		bool woken = false;
+
+		mtx_lock(&w->mtx);
+		if (w->idle && !w->kick) {
+			w->kick = true;
+			cnd_signal(&w->cnd);
+			woken = true;
 		}
-		mtx_unlock(work->mtx);
+		mtx_unlock(&w->mtx);
+
+		if (woken)
+			return;
+	}
+}
+
+
+static void work_queue(struct async_worker *w, struct async_work *work)
+{
+	struct re_async *a = w->a;
+	bool busy;
+
+	mtx_lock(&w->mtx);
+
+	work->state = WORK_QUEUED;
+	list_append(&w->qv[work->prio], &work->le, work);
+
+	busy = !w->idle;
+	if (!busy) {
+		w->kick = true;
+		cnd_signal(&w->cnd);
+	}
+
+	mtx_unlock(&w->mtx);
+
+	if (busy && re_atomic_seq(&a->nidle))
+		wake_idle(a);
+}
+
+
+/* Post finished work to the owning loop, one message per batch */
+static void done_push(struct re_async *a, struct async_work *work)
+{
+	uintptr_t head = re_atomic_rlx(&a->done);
+
+	work->state = WORK_DONE;
+
+	do {
+		work->next = (struct async_work *)head;
+	} while (!re_atomic_compare_exchange_weak(&a->done, &head,
+						  (uintptr_t)work,
+						  re_memory_order_release,
+						  re_memory_order_relaxed));
+
+	if (!head) {
+		int err = mqueue_push(a->mqueue, 0, NULL);
+		if (err)
+			DEBUG_WARNING("completion post failed (%m)\n", err);
+	}
+}
+
+
+/* The next waiting work with the same id, called with a->mtx held */
+static struct async_work *id_next(struct re_async *a,
+				  struct async_work *work)
+{
+	struct le *le;
+
+	hash_unlink(&work->he);
+	work->serial = false;
+
+	LIST_FOREACH(hash_list(a->idh, id_key(work->id)), le) {
+		struct async_work *next = le->data;
+
+		if (next->id == work->id)
+			return next->state == WORK_WAITING ? next : NULL;
+	}
+
+	return NULL;
+}
+
+
+static void work_run(struct async_worker *w, struct async_work *work)
+{
+	struct re_async *a = w->a;
+
+	mtx_lock(work->mtx);
+	if (work->workh) {
+		work->err   = work->workh(work->arg);
+		work->workh = NULL;
+	}
+	mtx_unlock(work->mtx);
+
+	if (work->serial) {
+		struct async_work *next;
+
+		mtx_lock(&a->mtx);
+		next = id_next(a, work);
+		if (next)
+			work_queue(w, next);
+		mtx_unlock(&a->mtx);
+	}
+
+	if (work->origin == ASYNC_JOB) {
+		mtx_lock(&w->mtx);
+		w->cur = NULL;
+		mtx_unlock(&w->mtx);
 
 		mtx_lock(&a->mtx);
-		mqueue_push(a->mqueue, 0, work);
+		work->state = WORK_FREE;
+		list_append(&a->freel, &work->le, work);
 		mtx_unlock(&a->mtx);
+		return;
+	}
+
+	/* Always visible to re_async_cancel(), running or done */
+	mtx_lock(&w->mtx);
+	w->cur = NULL;
+	done_push(a, work);
+	mtx_unlock(&w->mtx);
+}
+
+
+static int worker_thread(void *arg)
+{
+	struct async_worker *w = arg;
+	struct re_async *a = w->a;
+
+	if (a->pin) {
+		int err = thread_pin(THREAD_KIND_ASYNC, w->idx);
+		if (err) {
+			DEBUG_WARNING("worker %u: could not pin to cpu (%m)\n",
+				      w->idx, err);
+		}
+	}
+
+	while (re_atomic_acq(&a->run)) {
+
+		struct async_work *work;
+
+		mtx_lock(&w->mtx);
+		work = queue_pop(w, w);
+		mtx_unlock(&w->mtx);
+
+		if (!work)
+			work = steal(w);
+
+		if (!work) {
+			/* Announce idle before the last look at the queues */
+			mtx_lock(&w->mtx);
+			w->idle = true;
+			mtx_unlock(&w->mtx);
+			re_atomic_seq_add(&a->nidle, 1u);
+
+			work = steal(w);
+
+			mtx_lock(&w->mtx);
+			if (!work)
+				work = queue_pop(w, w);
+
+			while (!work && !w->kick && re_atomic_acq(&a->run))
+				cnd_wait(&w->cnd, &w->mtx);
+
+			w->idle = false;
+			w->kick = false;
+			mtx_unlock(&w->mtx);
+			re_atomic_seq_sub(&a->nidle, 1u);
+
+			if (!work)
+				continue;
+		}
+
+		work_run(w, work);
 	}
 
 	return 0;
 }
 
 
+static void work_cancel_cb(struct async_work *work)
+{
+	if (work->cb) {
+		work->cb(ECANCELED, work->arg);
+		work->cb = NULL;
+	}
+}
+
+
 static void async_destructor(void *data)
 {
 	struct re_async *async = data;
+	struct async_work *work;
+	struct le *le;
 
-	tmr_cancel(&async->tmr);
-
-	mtx_lock(&async->mtx);
-	async->run = false;
-	cnd_broadcast(&async->wait);
-	mtx_unlock(&async->mtx);
+	re_atomic_rls_set(&async->run, false);
 
 	for (int i = 0; i < async->workers; i++) {
-		thrd_join(async->thrd[i], NULL);
+		struct async_worker *w = &async->wv[i];
+
+		mtx_lock(&w->mtx);
+		cnd_broadcast(&w->cnd);
+		mtx_unlock(&w->mtx);
 	}
 
+	for (int i = 0; i < async->workers; i++)
+		thrd_join(async->wv[i].thrd, NULL);
+
 	/* Notify worker callbacks (so they can call destructors) */
-	struct le *le;
-	LIST_FOREACH(&async->workl, le)
-	{
-		struct async_work *work = le->data;
-		if (work->cb) {
-			work->cb(ECANCELED, work->arg);
-			work->cb = NULL;
+	for (uint32_t i = 0; async->idh && i < hash_bsize(async->idh); i++) {
+
+		le = list_head(hash_list_idx(async->idh, i));
+		while (le) {
+			work = le->data;
+			le = le->next;
+
+			hash_unlink(&work->he);
+
+			if (work->state != WORK_WAITING)
+				continue;
+
+			work_cancel_cb(work);
+			list_append(&async->freel, &work->le, work);
 		}
 	}
-	LIST_FOREACH(&async->curl, le)
-	{
-		struct async_work *work = le->data;
-		if (work->cb) {
-			work->cb(ECANCELED, work->arg);
-			work->cb = NULL;
+
+	for (int i = 0; async->wv && i < async->workers; i++) {
+		struct async_worker *w = &async->wv[i];
+
+		for (int p = 0; p < PRIO_N; p++) {
+			LIST_FOREACH(&w->qv[p], le)
+			{
+				work_cancel_cb(le->data);
+			}
+
+			list_flush(&w->qv[p]);
 		}
+
+		cnd_destroy(&w->cnd);
+		mtx_destroy(&w->mtx);
+	}
+
+	work = (struct async_work *)re_atomic_exchange(&async->done,
+						       (uintptr_t)0,
+						       re_memory_order_acquire);
+	while (work) {
+		struct async_work *next = work->next;
+
+		work_cancel_cb(work);
+		mem_deref(work);
+		work = next;
 	}
 
-	list_flush(&async->workl);
-	list_flush(&async->curl);
 	list_flush(&async->freel);
-	cnd_destroy(&async->wait);
 	mtx_destroy(&async->mtx);
+	mem_deref(async->idh);
 	mem_deref(async->mqueue);
-	mem_deref(async->thrd);
+	mem_deref(async->wv);
 }
 
 
-static void worker_check(void *arg)
+/* called by re main event loop */
+static void queueh(int id, void *data, void *arg)
 {
 	struct re_async *async = arg;
+	struct async_work *work;
+	struct list donel = LIST_INIT;
+	struct le *le;
+	(void)id;
+	(void)data;
 
-	mtx_lock(&async->mtx);
-	if (!list_isempty(&async->workl)) {
-		if (async->workers == list_count(&async->curl))
-			DEBUG_WARNING("all async workers are busy\n");
-		else
-			cnd_broadcast(&async->wait);
-	}
-	mtx_unlock(&async->mtx);
+	work = (struct async_work *)re_atomic_exchange(&async->done,
+						       (uintptr_t)0,
+						       re_memory_order_acquire);
 
-	tmr_start(&async->tmr, 100, worker_check, async);
-}
+	/* Restore completion order, the stack itself is left intact for
+	 * re_async_cancel() */
+	for (; work; work = work->next)
+		list_prepend(&donel, &work->le, work);
 
+	if (list_isempty(&donel))
+		return;
 
-/* called by re main event loop */
-static void queueh(int id, void *data, void *arg)
-{
-	struct async_work *work = data;
-	struct re_async *async	= arg;
-	(void)id;
+	/* A callback may release the last reference, e.g. a job graph */
+	mem_ref(async);
 
-	mtx_lock(work->mtx);
-	if (work->cb) {
-		work->cb(work->err, work->arg);
-		work->cb =NULL;
+	LIST_FOREACH(&donel, le) {
+		work = le->data;
+
+		mtx_lock(work->mtx);
+		if (work->cb) {
+			work->cb(work->err, work->arg);
+			work->cb = NULL;
+		}
+		mtx_unlock(work->mtx);
+
+		work->state = WORK_FREE;
 	}
-	mtx_unlock(work->mtx);
 
 	mtx_lock(&async->mtx);
-	list_move(&work->le, &async->freel);
+	while (donel.head)
+		list_move(donel.head, &async->freel);
 	mtx_unlock(&async->mtx);
+
+	mem_deref(async);
 }
 
 
@@ -197,14 +495,17 @@ static int work_alloc(struct async_work **workp)
 
 
 /**
- * Allocate a new async object
+ * Allocate a new async object with optional CPU affinity. Worker i is
+ * pinned to CPU core i of the THREAD_KIND_ASYNC policy if requested, see
+ * thread_pin().
  *
  * @param asyncp  Pointer to allocated async object
  * @param workers Number of worker threads
+ * @param pin     True to pin each worker thread to a CPU core
  *
  * @return 0 if success, otherwise errorcode
  */
-int re_async_alloc(struct re_async **asyncp, uint16_t workers)
+int re_async_alloc_pin(struct re_async **asyncp, uint16_t workers, bool pin)
 {
 	int err;
 	struct re_async *async;
@@ -221,29 +522,48 @@ int re_async_alloc(struct re_async **asyncp, uint16_t workers)
 	if (err)
 		goto err;
 
-	async->thrd = mem_zalloc(sizeof(thrd_t) * workers, NULL);
-	if (!async->thrd) {
+	err = hash_alloc(&async->idh, ID_HSIZE);
+	if (err) {
+		mem_deref(async->mqueue);
+		goto err;
+	}
+
+	async->wv = mem_zalloc(sizeof(*async->wv) * workers, NULL);
+	if (!async->wv) {
 		err = ENOMEM;
+		mem_deref(async->idh);
 		mem_deref(async->mqueue);
 		goto err;
 	}
 
+	for (int i = 0; i < workers; i++) {
+		struct async_worker *w = &async->wv[i];
+
+		w->a   = async;
+		w->idx = i;
+		mtx_init(&w->mtx, mtx_plain);
+		cnd_init(&w->cnd);
+	}
+
 	mtx_init(&async->mtx, mtx_plain);
-	cnd_init(&async->wait);
-	tmr_init(&async->tmr);
+	async->pin = pin;
+
+	/* Workers see the full worker array when they steal */
+	async->workers = workers;
 
 	mem_destructor(async, async_destructor);
 
-	async->run = true;
+	re_atomic_rls_set(&async->run, true);
 
 	for (int i = 0; i < workers; i++) {
-		err = thread_create_name(&async->thrd[i],
+		err = thread_create_kind(&async->wv[i].thrd, THREAD_KIND_ASYNC,
 					 "async worker thread", worker_thread,
-					 async);
-		if (err)
+					 &async->wv[i]);
+		if (err) {
+			/* Only the started workers are joined */
+			async->workers = (uint16_t)i;
 			goto err;
-
-		async->workers++;
+		}
 
 		/* preallocate */
 		err = work_alloc(&work);
@@ -253,8 +573,6 @@ int re_async_alloc(struct re_async **asyncp, uint16_t workers)
 		list_append(&async->freel, &work->le, work);
 	}
 
-	tmr_start(&async->tmr, 10, worker_check, async);
-
 	*asyncp = async;
 
 	return 0;
@@ -266,24 +584,26 @@ err:
 
 
 /**
- * Execute work handler async and get a callback from re main thread
+ * Allocate a new async object
  *
- * @param async Pointer to async object
- * @param id    Work identifier
- * @param workh Work handler
- * @param cb    Callback handler (called by re main thread)
- * @param arg   Handler argument (has to be thread-safe)
+ * @param asyncp  Pointer to allocated async object
+ * @param workers Number of worker threads
  *
  * @return 0 if success, otherwise errorcode
  */
-int re_async(struct re_async *async, intptr_t id, re_async_work_h *workh,
-	     re_async_h *cb, void *arg)
+int re_async_alloc(struct re_async **asyncp, uint16_t workers)
+{
+	return re_async_alloc_pin(asyncp, workers, false);
+}
+
+
+static int work_submit(struct re_async *async, intptr_t id,
+		       enum re_async_prio prio, enum async_origin origin,
+		       re_async_work_h *workh, re_async_h *cb, void *arg)
 {
 	int err = 0;
 	struct async_work *work;
-
-	if (unlikely(!async))
-		return EINVAL;
+	bool waiting = false;
 
 	mtx_lock(&async->mtx);
 	if (unlikely(list_isempty(&async->freel))) {
@@ -297,13 +617,37 @@ int re_async(struct re_async *async, intptr_t id, re_async_work_h *workh,
 		list_unlink(&work->le);
 	}
 
-	work->workh = workh;
-	work->cb    = cb;
-	work->arg   = arg;
-	work->id    = id;
+	work->workh  = workh;
+	work->cb     = cb;
+	work->arg    = arg;
+	work->id     = id;
+	work->prio   = prio;
+	work->origin = origin;
+	work->err    = 0;
+	work->serial = id != 0;
+	if (id) {
+		struct le *le;
+
+		LIST_FOREACH(hash_list(async->idh, id_key(id)), le) {
+			const struct async_work *w = le->data;
+
+			if (w->id == id) {
+				waiting = true;
+				break;
+			}
+		}
 
-	list_append(&async->workl, &work->le, work);
-	cnd_signal(&async->wait);
+		hash_append(async->idh, id_key(id), &work->he, work);
+	}
+
+	if (waiting) {
+		work->state = WORK_WAITING;
+	}
+	else {
+		unsigned i = re_atomic_rlx_add(&async->rr, 1u);
+
+		work_queue(&async->wv[i % async->workers], work);
+	}
 
 out:
 	mtx_unlock(&async->mtx);
@@ -312,6 +656,99 @@ out:
 }
 
 
+/**
+ * Execute work handler async with a priority and get a callback from re
+ * main thread. Work with the same non-zero identifier runs one at a time,
+ * in the order it was submitted.
+ *
+ * @param async Pointer to async object
+ * @param id    Work identifier
+ * @param prio  Work priority
+ * @param workh Work handler
+ * @param cb    Callback handler (called by re main thread)
+ * @param arg   Handler argument (has to be thread-safe)
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_async_prio(struct re_async *async, intptr_t id,
+		  enum re_async_prio prio, re_async_work_h *workh,
+		  re_async_h *cb, void *arg)
+{
+	if (unlikely(!async))
+		return EINVAL;
+
+	if (unlikely((unsigned)prio >= PRIO_N))
+		return EINVAL;
+
+	return work_submit(async, id, prio, ASYNC_USER, workh, cb, arg);
+}
+
+
+/**
+ * Submit internal work that re_async_cancel() does not match. Job work
+ * is recycled by the worker, its callback is only called with ECANCELED
+ * if the async object is destroyed before the job ran.
+ *
+ * @param async  Pointer to async object
+ * @param origin Origin of the work
+ * @param workh  Work handler
+ * @param cb     Callback handler
+ * @param arg    Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int async_submit(struct re_async *async, enum async_origin origin,
+		 re_async_work_h *workh, re_async_h *cb, void *arg)
+{
+	if (unlikely(!async))
+		return EINVAL;
+
+	return work_submit(async, 0, RE_ASYNC_PRIO_NORMAL, origin, workh,
+			   cb, arg);
+}
+
+
+/**
+ * Execute work handler async and get a callback from re main thread
+ *
+ * @param async Pointer to async object
+ * @param id    Work identifier
+ * @param workh Work handler
+ * @param cb    Callback handler (called by re main thread)
+ * @param arg   Handler argument (has to be thread-safe)
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_async(struct re_async *async, intptr_t id, re_async_work_h *workh,
+	     re_async_h *cb, void *arg)
+{
+	return re_async_prio(async, id, RE_ASYNC_PRIO_NORMAL, workh, cb, arg);
+}
+
+
+static void work_clear(struct async_work *w)
+{
+	mtx_lock(w->mtx);
+	w->workh = NULL;
+	w->cb	 = NULL;
+	w->arg	 = mem_deref(w->arg);
+	mtx_unlock(w->mtx);
+}
+
+
+/* Drop queued or waiting work, called with async->mtx held */
+static void work_free(struct async_work *work)
+{
+	if (work->serial) {
+		hash_unlink(&work->he);
+		work->serial = false;
+	}
+
+	work_clear(work);
+	work->state = WORK_FREE;
+}
+
+
 /**
  * Cancel pending async work and callback
  *
@@ -320,6 +757,7 @@ out:
  */
 void re_async_cancel(struct re_async *async, intptr_t id)
 {
+	struct async_work *work;
 	struct le *le;
 
 	if (unlikely(!async))
@@ -327,41 +765,58 @@ void re_async_cancel(struct re_async *async, intptr_t id)
 
 	mtx_lock(&async->mtx);
 
-	le = list_head(&async->workl);
-	while (le) {
-		struct async_work *w = le->data;
+	/* Hold all workers, so no work is between two workers */
+	for (int i = 0; i < async->workers; i++)
+		mtx_lock(&async->wv[i].mtx);
 
-		le = le->next;
+	for (int i = 0; i < async->workers; i++) {
+		struct async_worker *w = &async->wv[i];
 
-		if (w->id != id)
-			continue;
+		for (int p = 0; p < PRIO_N; p++) {
+
+			le = list_head(&w->qv[p]);
+			while (le) {
+				work = le->data;
+				le = le->next;
+
+				if (work->id != id ||
+				    work->origin != ASYNC_USER)
+					continue;
+
+				work_free(work);
+				list_move(&work->le, &async->freel);
+			}
+		}
 
-		mtx_lock(w->mtx);
-		w->id	 = 0;
-		w->workh = NULL;
-		w->cb	 = NULL;
-		w->arg	 = mem_deref(w->arg);
-		list_move(&w->le, &async->freel);
-		mtx_unlock(w->mtx);
+		/* No move to free list since queueh must always handled if
+		 * the work is running */
+		if (w->cur && w->cur->id == id &&
+		    w->cur->origin == ASYNC_USER)
+			work_clear(w->cur);
 	}
 
-	le = list_head(&async->curl);
-	while (le) {
-		struct async_work *w = le->data;
+	/* Finished work waiting for queueh, no worker can push now */
+	work = (struct async_work *)re_atomic_acq(&async->done);
+	for (; work; work = work->next) {
+		if (work->id == id && work->origin == ASYNC_USER)
+			work_clear(work);
+	}
 
-		le = le->next;
+	for (int i = async->workers - 1; i >= 0; i--)
+		mtx_unlock(&async->wv[i].mtx);
 
-		if (w->id != id)
-			continue;
+	if (id) {
+		le = list_head(hash_list(async->idh, id_key(id)));
+		while (le) {
+			work = le->data;
+			le = le->next;
 
-		mtx_lock(w->mtx);
-		w->id	 = 0;
-		w->workh = NULL;
-		w->cb	 = NULL;
-		w->arg	 = mem_deref(w->arg);
-		/* No move to free list since queueh must always handled if
-		 * mqueue_push is called */
-		mtx_unlock(w->mtx);
+			if (work->id != id || work->state != WORK_WAITING)
+				continue;
+
+			work_free(work);
+			list_append(&async->freel, &work->le, work);
+		}
 	}
 
 	mtx_unlock(&async->mtx);
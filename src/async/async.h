@@ -0,0 +1,16 @@
+/**
+ * @file async.h  Internal async interface
+ *
+ * Copyright (C) 2022 Sebastian Reimers
+ */
+
+
+/** Origin of async work */
+enum async_origin {
+	ASYNC_USER = 0,  /**< re_async() work                           */
+	ASYNC_JOB,       /**< Graph job, recycled by the worker         */
+	ASYNC_RESULT,    /**< Graph result, called back on the loop     */
+};
+
+int async_submit(struct re_async *async, enum async_origin origin,
+		 re_async_work_h *workh, re_async_h *cb, void *arg);
@@ -0,0 +1,370 @@
+/**
+ * @file graph.c  Async job graphs
+ *
+ * Copyright (C) 2022 Sebastian Reimers
+ */
+#include <re/re_types.h>
+#include <re/re_fmt.h>
+#include <re/re_mem.h>
+#include <re/re_list.h>
+#include <re/re_atomic.h>
+#include <re/re_thread.h>
+#include <re/re_async.h>
+#include "async.h"
+
+#define DEBUG_MODULE "async_graph"
+#define DEBUG_LEVEL 5
+#include <re/re_dbg.h>
+
+
+/*
+ * A graph is a set of jobs where a job may depend on other jobs. Jobs
+ * without dependencies are started when the graph runs. The worker that
+ * finishes the last dependency of a job starts it directly, so a chain
+ * of jobs never passes through the event loop. When all jobs are done,
+ * the graph callback is called once from the event loop.
+ *
+ * If a job fails, the jobs that depend on it are skipped and the graph
+ * callback gets the first error. Jobs that do not depend on the failed
+ * job still run.
+ */
+
+/** Defines an async job */
+struct re_async_job {
+	struct le le;
+	struct re_async_graph *graph;
+	re_async_work_h *workh;
+	void *arg;
+	struct re_async_job **depv;   /**< Jobs that depend on this job   */
+	uint32_t depc;                /**< Number of dependent jobs       */
+	uint32_t depsz;               /**< Size of dependent job vector   */
+	uint32_t nreq;                /**< Number of required jobs        */
+	RE_ATOMIC uint32_t pending;   /**< Unfinished required jobs       */
+	RE_ATOMIC bool skip;          /**< A required job failed          */
+};
+
+/** Defines an async job graph */
+struct re_async_graph {
+	struct list jobl;
+	struct re_async *async;
+	re_async_h *cb;
+	void *arg;
+	RE_ATOMIC uint32_t remaining; /**< Jobs not finished or skipped   */
+	RE_ATOMIC int err;            /**< First job error                */
+	bool running;
+};
+
+
+static void job_finish(struct re_async_job *job, int err, bool direct);
+
+
+static void graph_destructor(void *data)
+{
+	struct re_async_graph *graph = data;
+
+	list_flush(&graph->jobl);
+	mem_deref(graph->async);
+}
+
+
+static void job_destructor(void *data)
+{
+	struct re_async_job *job = data;
+
+	list_unlink(&job->le);
+	mem_deref(job->depv);
+}
+
+
+/* called by re main event loop */
+static void graph_done(int err, void *arg)
+{
+	struct re_async_graph *graph = arg;
+	int gerr = re_atomic_acq(&graph->err);
+
+	graph->running = false;
+
+	if (graph->cb)
+		graph->cb(gerr ? gerr : err, graph->arg);
+
+	mem_deref(graph);
+}
+
+
+static int job_work(void *arg)
+{
+	struct re_async_job *job = arg;
+	int err = 0;
+
+	if (job->workh)
+		err = job->workh(job->arg);
+
+	job_finish(job, err, false);
+
+	return 0;
+}
+
+
+/* The async object was destroyed before the job ran */
+static void job_cancel(int err, void *arg)
+{
+	job_finish(arg, err, true);
+}
+
+
+static void job_start(struct re_async_job *job)
+{
+	int err;
+
+	err = async_submit(job->graph->async, ASYNC_JOB, job_work, job_cancel,
+			   job);
+	if (err)
+		job_finish(job, err, false);
+}
+
+
+/*
+ * Called once per job, after it ran or if it was skipped. With direct
+ * set, no more work can be submitted and the graph callback is called
+ * from here.
+ */
+static void job_finish(struct re_async_job *job, int err, bool direct)
+{
+	struct re_async_graph *graph = job->graph;
+
+	if (err) {
+		int none = 0;
+
+		(void)re_atomic_compare_exchange_strong(
+			&graph->err, &none, err, re_memory_order_acq_rel,
+			re_memory_order_relaxed);
+	}
+
+	for (uint32_t i = 0; i < job->depc; i++) {
+		struct re_async_job *dep = job->depv[i];
+
+		if (err)
+			re_atomic_rlx_set(&dep->skip, true);
+
+		if (re_atomic_acq_sub(&dep->pending, 1u) != 1)
+			continue;
+
+		if (direct || re_atomic_rlx(&dep->skip))
+			job_finish(dep, ECANCELED, direct);
+		else
+			job_start(dep);
+	}
+
+	if (re_atomic_acq_sub(&graph->remaining, 1u) != 1)
+		return;
+
+	if (direct) {
+		graph_done(ECANCELED, graph);
+		return;
+	}
+
+	err = async_submit(graph->async, ASYNC_RESULT, NULL, graph_done,
+			   graph);
+	if (err) {
+		/* The callback is still due once, from this worker */
+		DEBUG_WARNING("graph result could not be posted (%m)\n", err);
+		graph_done(err, graph);
+	}
+}
+
+
+/* Kahn's algorithm, every job must be reachable from a root job */
+static int graph_check(struct re_async_graph *graph)
+{
+	struct re_async_job **queuev;
+	uint32_t n = list_count(&graph->jobl);
+	uint32_t head = 0, tail = 0;
+	struct le *le;
+
+	queuev = mem_zalloc(n * sizeof(*queuev), NULL);
+	if (!queuev)
+		return ENOMEM;
+
+	LIST_FOREACH(&graph->jobl, le) {
+		struct re_async_job *job = le->data;
+
+		re_atomic_rlx_set(&job->pending, job->nreq);
+		if (!job->nreq)
+			queuev[tail++] = job;
+	}
+
+	while (head < tail) {
+		struct re_async_job *job = queuev[head++];
+
+		for (uint32_t i = 0; i < job->depc; i++) {
+			struct re_async_job *dep = job->depv[i];
+
+			if (re_atomic_rlx_sub(&dep->pending, 1u) == 1)
+				queuev[tail++] = dep;
+		}
+	}
+
+	mem_deref(queuev);
+
+	return tail == n ? 0 : ELOOP;
+}
+
+
+/**
+ * Allocate a new async job graph
+ *
+ * @param graphp Pointer to allocated graph
+ * @param async  Async object that runs the jobs, referenced by the graph
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_async_graph_alloc(struct re_async_graph **graphp,
+			 struct re_async *async)
+{
+	struct re_async_graph *graph;
+
+	if (!graphp || !async)
+		return EINVAL;
+
+	graph = mem_zalloc(sizeof(*graph), graph_destructor);
+	if (!graph)
+		return ENOMEM;
+
+	graph->async = mem_ref(async);
+
+	*graphp = graph;
+
+	return 0;
+}
+
+
+/**
+ * Add a job to an async job graph
+ *
+ * @param graph Async job graph
+ * @param jobp  Optional pointer to the new job, owned by the graph
+ * @param workh Work handler (called by a worker thread)
+ * @param arg   Handler argument (has to be thread-safe)
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_async_graph_job(struct re_async_graph *graph,
+		       struct re_async_job **jobp, re_async_work_h *workh,
+		       void *arg)
+{
+	struct re_async_job *job;
+
+	if (!graph || !workh)
+		return EINVAL;
+
+	if (graph->running)
+		return EBUSY;
+
+	job = mem_zalloc(sizeof(*job), job_destructor);
+	if (!job)
+		return ENOMEM;
+
+	job->graph = graph;
+	job->workh = workh;
+	job->arg   = arg;
+
+	list_append(&graph->jobl, &job->le, job);
+
+	if (jobp)
+		*jobp = job;
+
+	return 0;
+}
+
+
+/**
+ * Let a job depend on another job of the same graph. The job is started
+ * after the required job has finished successfully.
+ *
+ * @param job Async job
+ * @param req Required job
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_async_graph_depend(struct re_async_job *job, struct re_async_job *req)
+{
+	if (!job || !req || job == req || job->graph != req->graph)
+		return EINVAL;
+
+	if (job->graph->running)
+		return EBUSY;
+
+	if (req->depc == req->depsz) {
+		uint32_t sz = req->depsz ? req->depsz * 2 : 4;
+		struct re_async_job **depv;
+
+		depv = mem_reallocarray(req->depv, sz, sizeof(*depv), NULL);
+		if (!depv)
+			return ENOMEM;
+
+		req->depv  = depv;
+		req->depsz = sz;
+	}
+
+	req->depv[req->depc++] = job;
+	++job->nreq;
+
+	return 0;
+}
+
+
+/**
+ * Run all jobs of an async job graph. The callback is called once from the
+ * re main thread when all jobs are done, with the first job error if a
+ * job failed. If the result cannot be posted to the main thread, it is
+ * called from the worker that finished the last job. The graph is kept
+ * alive until then and can be run again afterwards.
+ *
+ * @param graph Async job graph
+ * @param cb    Callback handler (called by re main thread)
+ * @param arg   Callback argument
+ *
+ * @return 0 if success, ELOOP if the jobs depend on each other in a
+ *         cycle, otherwise errorcode
+ */
+int re_async_graph_run(struct re_async_graph *graph, re_async_h *cb,
+		       void *arg)
+{
+	struct le *le;
+	int err;
+
+	if (!graph || list_isempty(&graph->jobl))
+		return EINVAL;
+
+	if (graph->running)
+		return EBUSY;
+
+	err = graph_check(graph);
+	if (err)
+		return err;
+
+	graph->cb  = cb;
+	graph->arg = arg;
+	re_atomic_rlx_set(&graph->err, 0);
+	re_atomic_rlx_set(&graph->remaining, list_count(&graph->jobl));
+
+	LIST_FOREACH(&graph->jobl, le) {
+		struct re_async_job *job = le->data;
+
+		re_atomic_rlx_set(&job->pending, job->nreq);
+		re_atomic_rlx_set(&job->skip, false);
+	}
+
+	graph->running = true;
+	mem_ref(graph);
+
+	/* The result is posted to this loop, so the list stays valid */
+	LIST_FOREACH(&graph->jobl, le) {
+		struct re_async_job *job = le->data;
+
+		if (!job->nreq)
+			job_start(job);
+	}
+
+	return 0;
+}
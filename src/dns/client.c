@@ -123,6 +123,22 @@ static int  send_tcp(struct dns_query *q);
 static void udp_timeout_handler(void *arg);
 
 
+static uint32_t query_key(const void *data)
+{
+	const struct dns_query *q = data;
+
+	return q->name ? hash_wy_str_ci(q->name) : 0;
+}
+
+
+static uint32_t tcpconn_key(const void *data)
+{
+	const struct tcpconn *tc = data;
+
+	return sa_hash(&tc->srv, SA_ALL);
+}
+
+
 static bool rr_unlink_handler(struct le *le, void *arg)
 {
 	struct dnsrr *rr = le->data;
@@ -262,7 +278,7 @@ static int reply_recv(struct dnsc *dnsc, struct mbuf *mb)
 	dq.type     = ntohs(mbuf_read_u16(mb));
 	dq.dnsclass = ntohs(mbuf_read_u16(mb));
 
-	q = list_ledata(hash_lookup(dnsc->ht_query, hash_joaat_str_ci(dq.name),
+	q = list_ledata(hash_lookup(dnsc->ht_query, hash_wy_str_ci(dq.name),
 				    query_cmp_handler, &dq));
 	if (!q) {
 		err = ENOENT;
@@ -355,7 +371,7 @@ static int reply_recv(struct dnsc *dnsc, struct mbuf *mb)
 	}
 
 	/* Cache DNS query with TTL timeout */
-	hash_append(dnsc->ht_query_cache, hash_joaat_str_ci(q->name), &q->le,
+	hash_append(dnsc->ht_query_cache, hash_wy_str_ci(q->name), &q->le,
 		    q);
 	DEBUG_INFO("cache %s. (id: %d) %d secs\n", q->name, q->id, ttl);
 	/* Fallback to 100ms for faster unit tests */
@@ -753,7 +769,7 @@ static bool query_cache_handler(struct dns_query *q)
 	dq.cache    = true;
 
 	qc = list_ledata(hash_lookup(q->dnsc->ht_query_cache,
-				     hash_joaat_str_ci(q->name),
+				     hash_wy_str_ci(q->name),
 				     query_cmp_handler, &dq));
 	if (!qc)
 		return false;
@@ -874,7 +890,7 @@ static void getaddrinfo_h(int err, void *arg)
 	struct dns_query *q;
 
 	q = list_ledata(hash_lookup(dq->dnsc->ht_query,
-				    hash_joaat_str_ci(dq->name),
+				    hash_wy_str_ci(dq->name),
 				    query_cmp_handler, dq));
 	if (!q) {
 		DEBUG_WARNING("getaddrinfo_h: no query found\n");
@@ -909,7 +925,7 @@ static void getaddrinfo_h(int err, void *arg)
 		goto out;
 	}
 
-	hash_append(q->dnsc->ht_query_cache, hash_joaat_str_ci(q->name),
+	hash_append(q->dnsc->ht_query_cache, hash_wy_str_ci(q->name),
 		    &q->le, q);
 	tmr_start(&q->tmr_ttl, GETADDRINFO_TTL * 1000, ttl_timeout_handler, q);
 
@@ -985,7 +1001,7 @@ static int query(struct dns_query **qp, struct dnsc *dnsc, uint8_t opcode,
 	if (!q)
 		goto nmerr;
 
-	hash_append(dnsc->ht_query, hash_joaat_str_ci(name), &q->le, q);
+	hash_append(dnsc->ht_query, hash_wy_str_ci(name), &q->le, q);
 	tmr_init(&q->tmr);
 	tmr_init(&q->tmr_ttl);
 	mbuf_init(&q->mb);
@@ -1248,15 +1264,18 @@ int dnsc_alloc(struct dnsc **dcpp, const struct dnsc_conf *conf,
 	if (err)
 		goto out;
 
-	err = hash_alloc(&dnsc->ht_query, dnsc->conf.query_hash_size);
+	err = hash_alloc_autogrow(&dnsc->ht_query,
+				  dnsc->conf.query_hash_size, query_key);
 	if (err)
 		goto out;
 
-	err = hash_alloc(&dnsc->ht_query_cache, dnsc->conf.query_hash_size);
+	err = hash_alloc_autogrow(&dnsc->ht_query_cache,
+				  dnsc->conf.query_hash_size, query_key);
 	if (err)
 		goto out;
 
-	err = hash_alloc(&dnsc->ht_tcpconn, dnsc->conf.tcp_hash_size);
+	err = hash_alloc_autogrow(&dnsc->ht_tcpconn,
+				  dnsc->conf.tcp_hash_size, tcpconn_key);
 	if (err)
 		goto out;
 
@@ -1303,15 +1322,18 @@ int dnsc_conf_set(struct dnsc *dnsc, const struct dnsc_conf *conf)
 	dnsc->ht_query_cache = mem_deref(dnsc->ht_query_cache);
 	dnsc->ht_tcpconn = mem_deref(dnsc->ht_tcpconn);
 
-	err = hash_alloc(&dnsc->ht_query, dnsc->conf.query_hash_size);
+	err = hash_alloc_autogrow(&dnsc->ht_query,
+				  dnsc->conf.query_hash_size, query_key);
 	if (err)
 		return err;
 
-	err = hash_alloc(&dnsc->ht_query_cache, dnsc->conf.query_hash_size);
+	err = hash_alloc_autogrow(&dnsc->ht_query_cache,
+				  dnsc->conf.query_hash_size, query_key);
 	if (err)
 		return err;
 
-	err = hash_alloc(&dnsc->ht_tcpconn, dnsc->conf.tcp_hash_size);
+	err = hash_alloc_autogrow(&dnsc->ht_tcpconn,
+				  dnsc->conf.tcp_hash_size, tcpconn_key);
 	return err;
 }
 
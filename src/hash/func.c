@@ -4,6 +4,12 @@
  * Copyright (C) 2010 Creytiv.com
  */
 #include <ctype.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 #include <re/re_types.h>
 #include <re/re_fmt.h>
 #include <re/re_list.h>
@@ -185,3 +191,274 @@ uint32_t hash_fast_str(const char *str)
 
 	return h;
 }
+
+
+/*
+ * wyhash-style hash: the key is read 8 bytes at a time and mixed with
+ * 64x64->128 bit multiplications. The case-insensitive variants convert
+ * ASCII upper case to lower case, so they give the same value as the
+ * case-sensitive hash of the lower case key. Blocks of 16 bytes are
+ * converted with SSE2 or NEON where available, other reads use 8 bytes at
+ * once (SWAR).
+ */
+
+#define WY_P0 UINT64_C(0xa0761d6478bd642f)
+#define WY_P1 UINT64_C(0xe7037ed1a0b428db)
+#define WY_P2 UINT64_C(0x8ebc6af09c88c6e3)
+#define WY_P3 UINT64_C(0x589965cc75374cc3)
+
+#define WY_LSBS UINT64_C(0x0101010101010101)
+#define WY_MSBS UINT64_C(0x8080808080808080)
+
+
+static inline void wy_mum(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = *a;
+
+	r *= *b;
+	*a = (uint64_t)r;
+	*b = (uint64_t)(r >> 64);
+#else
+	const uint64_t ha = *a >> 32, hb = *b >> 32;
+	const uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+	const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la;
+	const uint64_t rl = la * lb, t = rl + (rm0 << 32);
+	uint64_t lo, hi;
+
+	hi = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl);
+	lo = t + (rm1 << 32);
+	hi += (lo < t);
+
+	*a = lo;
+	*b = hi;
+#endif
+}
+
+
+static inline uint64_t wy_mix(uint64_t a, uint64_t b)
+{
+	wy_mum(&a, &b);
+
+	return a ^ b;
+}
+
+
+/* Lower case of 8 ASCII characters, other bytes are unchanged */
+static inline uint64_t wy_lower(uint64_t x)
+{
+	const uint64_t h = x & ~WY_MSBS;
+	const uint64_t ge_a = h + (0x80 - 'A') * WY_LSBS;
+	const uint64_t gt_z = h + (0x80 - 'Z' - 1) * WY_LSBS;
+	const uint64_t upper = (ge_a ^ gt_z) & ~x & WY_MSBS;
+
+	return x | (upper >> 2);
+}
+
+
+static inline uint64_t wy_r8(const uint8_t *p, bool ci)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return ci ? wy_lower(v) : v;
+}
+
+
+static inline uint64_t wy_r4(const uint8_t *p, bool ci)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return ci ? wy_lower(v) : v;
+}
+
+
+/* Read 16 bytes, case-insensitive keys are converted in a SIMD register */
+static inline void wy_r16(const uint8_t *p, bool ci, uint64_t *a,
+			  uint64_t *b)
+{
+#if defined(__SSE2__) || defined(__ARM_NEON)
+	if (ci) {
+		uint64_t w[2];
+#if defined(__SSE2__)
+		__m128i v = _mm_loadu_si128((const void *)p);
+		const __m128i upper = _mm_and_si128(
+			_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+			_mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+
+		/* Bytes from 0x80 are negative and never upper case */
+		v = _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+		_mm_storeu_si128((void *)w, v);
+#else
+		uint8x16_t v = vld1q_u8(p);
+		const uint8x16_t upper = vandq_u8(vcgeq_u8(v, vdupq_n_u8('A')),
+						  vcleq_u8(v, vdupq_n_u8('Z')));
+
+		v = vorrq_u8(v, vandq_u8(upper, vdupq_n_u8(0x20)));
+		vst1q_u8((uint8_t *)w, v);
+#endif
+		*a = w[0];
+		*b = w[1];
+		return;
+	}
+#endif
+
+	*a = wy_r8(p, ci);
+	*b = wy_r8(p + 8, ci);
+}
+
+
+static inline uint64_t wy_r3(const uint8_t *p, size_t k, bool ci)
+{
+	const uint64_t v = ((uint64_t)p[0] << 16) |
+		((uint64_t)p[k >> 1] << 8) | p[k - 1];
+
+	return ci ? wy_lower(v) : v;
+}
+
+
+static inline uint32_t wy_hash(const uint8_t *p, size_t len, bool ci)
+{
+	uint64_t seed = wy_mix(WY_P0, WY_P1);
+	uint64_t a, b;
+
+	if (len <= 16) {
+		if (len >= 4) {
+			const size_t o = (len >> 3) << 2;
+
+			a = (wy_r4(p, ci) << 32) | wy_r4(p + o, ci);
+			b = (wy_r4(p + len - 4, ci) << 32) |
+				wy_r4(p + len - 4 - o, ci);
+		}
+		else if (len > 0) {
+			a = wy_r3(p, len, ci);
+			b = 0;
+		}
+		else {
+			a = b = 0;
+		}
+	}
+	else {
+		size_t i = len;
+
+		if (i > 48) {
+			uint64_t s1 = seed, s2 = seed;
+
+			do {
+				wy_r16(p, ci, &a, &b);
+				seed = wy_mix(a ^ WY_P1, b ^ seed);
+				wy_r16(p + 16, ci, &a, &b);
+				s1 = wy_mix(a ^ WY_P2, b ^ s1);
+				wy_r16(p + 32, ci, &a, &b);
+				s2 = wy_mix(a ^ WY_P3, b ^ s2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+
+			seed ^= s1 ^ s2;
+		}
+
+		while (i > 16) {
+			wy_r16(p, ci, &a, &b);
+			seed = wy_mix(a ^ WY_P1, b ^ seed);
+			p += 16;
+			i -= 16;
+		}
+
+		wy_r16(p + i - 16, ci, &a, &b);
+	}
+
+	a ^= WY_P1;
+	b ^= seed;
+	wy_mum(&a, &b);
+
+	a = wy_mix(a ^ WY_P0 ^ len, b ^ WY_P1);
+
+	return (uint32_t)(a ^ (a >> 32));
+}
+
+
+/**
+ * Calculate hash-value using a wyhash-style algorithm, which processes
+ * 8 bytes at a time
+ *
+ * @param key  Pointer to key
+ * @param len  Key length
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wy(const uint8_t *key, size_t len)
+{
+	return key ? wy_hash(key, len, false) : 0;
+}
+
+
+/**
+ * Calculate wyhash-style hash-value for a case-insensitive string
+ *
+ * @param str  String
+ * @param len  Length of string
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wy_ci(const char *str, size_t len)
+{
+	return str ? wy_hash((const uint8_t *)str, len, true) : 0;
+}
+
+
+/**
+ * Calculate wyhash-style hash-value for a NULL-terminated string
+ *
+ * @param str  String
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wy_str(const char *str)
+{
+	return str ? wy_hash((const uint8_t *)str, strlen(str), false) : 0;
+}
+
+
+/**
+ * Calculate wyhash-style hash-value for a case-insensitive NULL-terminated
+ * string
+ *
+ * @param str  String
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wy_str_ci(const char *str)
+{
+	return str ? wy_hash((const uint8_t *)str, strlen(str), true) : 0;
+}
+
+
+/**
+ * Calculate wyhash-style hash-value for a pointer-length object
+ *
+ * @param pl Pointer-length object
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wy_pl(const struct pl *pl)
+{
+	return pl ? hash_wy((const uint8_t *)pl->p, pl->l) : 0;
+}
+
+
+/**
+ * Calculate wyhash-style hash-value for a case-insensitive pointer-length
+ * object
+ *
+ * @param pl Pointer-length object
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wy_pl_ci(const struct pl *pl)
+{
+	return pl ? hash_wy_ci(pl->p, pl->l) : 0;
+}
@@ -11,10 +11,29 @@
 #include <re/re_hash.h>
 
 
+/*
+ * A growing table uses linear hashing. It splits one bucket at a time
+ * into the bucket at the same index in the upper half, so a lookup always
+ * maps to one bucket and no operation moves more than one chain. Buckets
+ * beyond the initial size live in segments of doubling size, so the
+ * lists never move in memory.
+ */
+
+enum {
+	HASH_SEGS = 32,          /**< Maximum number of bucket segments   */
+	HASH_LOAD = 2,           /**< Average chain length before growing */
+	HASH_MAX  = 1u << 24,    /**< Maximum number of buckets to grow to */
+};
+
 /** Defines a hashmap table */
 struct hash {
 	struct list *bucket;  /**< Bucket with linked lists */
+	struct list **segv;   /**< Bucket segments, if growing  */
+	hash_key_h *keyh;     /**< Element key handler, if growing */
 	uint32_t bsize;       /**< Bucket size              */
+	uint32_t n;           /**< Buckets before splitting */
+	uint32_t split;       /**< Next bucket to split     */
+	uint32_t load;        /**< Sampled chain length x16 */
 };
 
 
@@ -22,10 +41,122 @@ static void hash_destructor(void *data)
 {
 	struct hash *h = data;
 
+	if (h->segv) {
+		for (uint32_t k = 1; k < HASH_SEGS; k++)
+			mem_deref(h->segv[k]);
+
+		mem_deref(h->segv);
+	}
+
 	mem_deref(h->bucket);
 }
 
 
+static inline uint32_t fls32(uint32_t v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return 32 - (uint32_t)__builtin_clz(v);
+#else
+	uint32_t n = 0;
+
+	while (v) {
+		v >>= 1;
+		++n;
+	}
+
+	return n;
+#endif
+}
+
+
+static inline struct list *bucket(const struct hash *h, uint32_t i)
+{
+	uint32_t k;
+
+	if (i < h->bsize)
+		return &h->bucket[i];
+
+	k = fls32(i / h->bsize);
+
+	return &h->segv[k][i - (h->bsize << (k - 1))];
+}
+
+
+static inline uint32_t bucket_idx(const struct hash *h, uint32_t key)
+{
+	uint32_t i = key & (h->n - 1);
+
+	if (i < h->split)
+		i = key & (2 * h->n - 1);
+
+	return i;
+}
+
+
+static inline uint32_t active(const struct hash *h)
+{
+	return h->n + h->split;
+}
+
+
+static void split(struct hash *h)
+{
+	const uint32_t n = h->n;
+	struct list *src, *dst;
+	struct le *le;
+
+	if (!h->split) {
+		const uint32_t k = fls32(n / h->bsize);
+
+		if (k >= HASH_SEGS)
+			return;
+
+		if (!h->segv[k]) {
+			h->segv[k] = mem_zalloc(n * sizeof(struct list), NULL);
+			if (!h->segv[k])
+				return;
+		}
+	}
+
+	src = bucket(h, h->split);
+	dst = bucket(h, h->split + n);
+
+	le = src->head;
+	while (le) {
+		struct le *next = le->next;
+
+		if (h->keyh(le->data) & n) {
+			list_unlink(le);
+			list_append(dst, le, le->data);
+		}
+
+		le = next;
+	}
+
+	if (++h->split == n) {
+		h->n     = 2 * n;
+		h->split = 0;
+	}
+}
+
+
+/* The chain of a random key is a sample of the average chain length */
+static void grow(struct hash *h, uint32_t key)
+{
+	const struct le *le;
+	uint32_t len = 0;
+
+	le = bucket(h, bucket_idx(h, key))->head;
+	for (; le && len < 4 * HASH_LOAD; le = le->next)
+		++len;
+
+	h->load = h->load - h->load / 16 + len;
+
+	if (h->load > 16 * HASH_LOAD && active(h) < HASH_MAX)
+		split(h);
+}
+
+
 /**
  * Allocate a new hashmap table
  *
@@ -35,6 +166,22 @@ static void hash_destructor(void *data)
  * @return 0 if success, otherwise errorcode
  */
 int hash_alloc(struct hash **hp, uint32_t bsize)
+{
+	return hash_alloc_arena(hp, bsize, NULL);
+}
+
+
+/**
+ * Allocate a new hashmap table from a memory arena
+ *
+ * @param hp     Address of hashmap pointer
+ * @param bsize  Bucket size
+ * @param arena  Memory arena, NULL for regular memory objects
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int hash_alloc_arena(struct hash **hp, uint32_t bsize,
+		     struct mem_arena *arena)
 {
 	struct hash *h;
 	int err = 0;
@@ -46,13 +193,14 @@ int hash_alloc(struct hash **hp, uint32_t bsize)
 	if (bsize & (bsize-1))
 		return EINVAL;
 
-	h = mem_zalloc(sizeof(*h), hash_destructor);
+	h = mem_arena_zalloc(arena, sizeof(*h), hash_destructor);
 	if (!h)
 		return ENOMEM;
 
 	h->bsize = bsize;
+	h->n     = bsize;
 
-	h->bucket = mem_zalloc(bsize*sizeof(*h->bucket), NULL);
+	h->bucket = mem_arena_zalloc(arena, bsize*sizeof(*h->bucket), NULL);
 	if (!h->bucket) {
 		err = ENOMEM;
 		goto out;
@@ -68,6 +216,43 @@ int hash_alloc(struct hash **hp, uint32_t bsize)
 }
 
 
+/**
+ * Allocate a new hashmap table that grows with the number of elements.
+ * Elements are moved to new buckets a few at a time, using their key as
+ * returned by the key handler, which must be the key they were added with.
+ *
+ * @param hp     Address of hashmap pointer
+ * @param bsize  Initial bucket size
+ * @param keyh   Element key handler
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int hash_alloc_autogrow(struct hash **hp, uint32_t bsize, hash_key_h *keyh)
+{
+	struct hash *h;
+	int err;
+
+	if (!hp || !keyh)
+		return EINVAL;
+
+	err = hash_alloc(&h, bsize);
+	if (err)
+		return err;
+
+	h->segv = mem_zalloc(HASH_SEGS * sizeof(*h->segv), NULL);
+	if (!h->segv) {
+		mem_deref(h);
+		return ENOMEM;
+	}
+
+	h->keyh = keyh;
+
+	*hp = h;
+
+	return 0;
+}
+
+
 /**
  * Add an element to the hashmap table
  *
@@ -81,7 +266,11 @@ void hash_append(struct hash *h, uint32_t key, struct le *le, void *data)
 	if (!h || !le)
 		return;
 
-	list_append(&h->bucket[key & (h->bsize-1)], le, data);
+	/* Split before adding, the new element may not be complete yet */
+	if (h->keyh)
+		grow(h, key);
+
+	list_append(bucket(h, bucket_idx(h, key)), le, data);
 }
 
 
@@ -112,7 +301,7 @@ struct le *hash_lookup(const struct hash *h, uint32_t key, list_apply_h *ah,
 	if (!h || !ah)
 		return NULL;
 
-	return list_apply(&h->bucket[key & (h->bsize-1)], true, ah, arg);
+	return list_apply(bucket(h, bucket_idx(h, key)), true, ah, arg);
 }
 
 
@@ -133,8 +322,8 @@ struct le *hash_apply(const struct hash *h, list_apply_h *ah, void *arg)
 	if (!h || !ah)
 		return NULL;
 
-	for (i=0; (i<h->bsize) && !le; i++)
-		le = list_apply(&h->bucket[i], true, ah, arg);
+	for (i=0; (i<active(h)) && !le; i++)
+		le = list_apply(bucket(h, i), true, ah, arg);
 
 	return le;
 }
@@ -150,10 +339,10 @@ struct le *hash_apply(const struct hash *h, list_apply_h *ah, void *arg)
  */
 struct list *hash_list_idx(const struct hash *h, uint32_t i)
 {
-	if (!h || i >= h->bsize)
+	if (!h || i >= active(h))
 		return NULL;
 
-	return &h->bucket[i];
+	return bucket(h, i);
 }
 
 
@@ -167,12 +356,12 @@ struct list *hash_list_idx(const struct hash *h, uint32_t i)
  */
 struct list *hash_list(const struct hash *h, uint32_t key)
 {
-	return h ? &h->bucket[key & (h->bsize - 1)] : NULL;
+	return h ? bucket(h, bucket_idx(h, key)) : NULL;
 }
 
 
 /**
- * Get hash bucket size
+ * Get hash bucket size, which is not a power of two while growing
  *
  * @param h Hashmap table
  *
@@ -180,7 +369,7 @@ struct list *hash_list(const struct hash *h, uint32_t key)
  */
 uint32_t hash_bsize(const struct hash *h)
 {
-	return h ? h->bsize : 0;
+	return h ? active(h) : 0;
 }
 
 
@@ -196,8 +385,8 @@ void hash_flush(struct hash *h)
 	if (!h)
 		return;
 
-	for (i=0; i<h->bsize; i++)
-		list_flush(&h->bucket[i]);
+	for (i=0; i<active(h); i++)
+		list_flush(bucket(h, i));
 }
 
 
@@ -213,8 +402,8 @@ void hash_clear(struct hash *h)
 	if (!h)
 		return;
 
-	for (i=0; i<h->bsize; i++)
-		list_clear(&h->bucket[i]);
+	for (i=0; i<active(h); i++)
+		list_clear(bucket(h, i));
 }
 
 
@@ -251,8 +440,8 @@ int hash_debug(struct re_printf *pf, struct hash *h)
 	if (!h)
 		return EINVAL;
 
-	err = re_hprintf(pf, "hash (bsize %u) list entries:\n", h->bsize);
-	for (uint32_t i = 0; i < h->bsize; i++) {
+	err = re_hprintf(pf, "hash (bsize %u) list entries:\n", active(h));
+	for (uint32_t i = 0; i < active(h); i++) {
 		struct le *he = hash_list_idx(h, i)->head;
 
 		if (!he)
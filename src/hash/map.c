@@ -0,0 +1,528 @@
+/**
+ * @file map.c  Open-addressing hash map
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re/re_types.h>
+#include <re/re_mem.h>
+#include <re/re_list.h>
+#include <re/re_hash.h>
+
+
+/*
+ * The map is a table of slots with one control byte per slot, probed in
+ * groups of 8 control bytes. A control byte is either EMPTY, DELETED or
+ * holds 7 bits of the mixed key, so most non-matching slots are skipped
+ * without touching the slot array. Probing stops at the first group with
+ * an EMPTY byte.
+ *
+ * When the table is full it is not rehashed at once. A new table is
+ * allocated and every insert moves a few groups of the old table to it.
+ * Until the old table is empty, lookups search both tables.
+ */
+
+enum {
+	GROUP       = 8,          /**< Slots per control group        */
+	MIGRATE     = 2,          /**< Groups moved per insert        */
+	CTRL_EMPTY  = 0x80,
+	CTRL_DELETE = 0xfe,
+};
+
+#define LSBS 0x0101010101010101ULL
+#define MSBS 0x8080808080808080ULL
+
+struct slot {
+	void *data;
+	uint32_t key;
+};
+
+struct table {
+	struct slot *slotv;       /**< Slots, followed by control bytes */
+	uint8_t *ctrl;            /**< Control bytes                    */
+	uint32_t cap;             /**< Number of slots, power of two    */
+	uint32_t used;            /**< Full and deleted slots           */
+	uint32_t count;           /**< Full slots                       */
+};
+
+/** Defines an open-addressing hash map */
+struct hmap {
+	struct table cur;         /**< Current table                    */
+	struct table old;         /**< Table being moved, if any        */
+	uint32_t mig;             /**< Next group of the old table      */
+};
+
+
+static void hmap_destructor(void *arg)
+{
+	struct hmap *m = arg;
+
+	mem_deref(m->cur.slotv);
+	mem_deref(m->old.slotv);
+}
+
+
+/* MurmurHash3 finalizer, spreads sequential keys over the table */
+static inline uint32_t mix(uint32_t h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+
+	return h;
+}
+
+
+static inline uint64_t group_load(const uint8_t *c)
+{
+	return  (uint64_t)c[0]        | (uint64_t)c[1] << 8  |
+		(uint64_t)c[2] << 16  | (uint64_t)c[3] << 24 |
+		(uint64_t)c[4] << 32  | (uint64_t)c[5] << 40 |
+		(uint64_t)c[6] << 48  | (uint64_t)c[7] << 56;
+}
+
+
+/* May report false positives, the key is compared anyway */
+static inline uint64_t match_h2(uint64_t g, uint8_t h2)
+{
+	const uint64_t x = g ^ (LSBS * h2);
+
+	return (x - LSBS) & ~x & MSBS;
+}
+
+
+static inline uint64_t match_empty(uint64_t g)
+{
+	return g & ~(g << 6) & MSBS;
+}
+
+
+static inline uint64_t match_free(uint64_t g)
+{
+	return g & MSBS;
+}
+
+
+static inline uint32_t first_idx(uint64_t m)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return (uint32_t)__builtin_ctzll(m) / 8;
+#else
+	uint32_t n = 0;
+
+	while (!(m & 0xff)) {
+		m >>= 8;
+		++n;
+	}
+
+	return n;
+#endif
+}
+
+
+static int table_init(struct table *t, uint32_t cap)
+{
+	struct slot *slotv;
+
+	slotv = mem_zalloc(cap * (sizeof(*slotv) + 1), NULL);
+	if (!slotv)
+		return ENOMEM;
+
+	t->slotv = slotv;
+	t->ctrl  = (uint8_t *)(slotv + cap);
+	t->cap   = cap;
+	t->used  = 0;
+	t->count = 0;
+
+	memset(t->ctrl, CTRL_EMPTY, cap);
+
+	return 0;
+}
+
+
+static void table_reset(struct table *t)
+{
+	if (!t->slotv)
+		return;
+
+	memset(t->ctrl, CTRL_EMPTY, t->cap);
+	t->used  = 0;
+	t->count = 0;
+}
+
+
+static bool table_find(const struct table *t, uint32_t key, uint32_t h,
+		       hmap_apply_h *ah, void *arg, uint32_t *idxp)
+{
+	const uint32_t gmask = t->cap / GROUP - 1;
+	uint32_t g = (h >> 7) & gmask;
+
+	if (!t->count)
+		return false;
+
+	for (uint32_t i = 0; i <= gmask; i++) {
+
+		const uint64_t w = group_load(&t->ctrl[g * GROUP]);
+		uint64_t m = match_h2(w, (uint8_t)(h & 0x7f));
+
+		while (m) {
+			const uint32_t j = g * GROUP + first_idx(m);
+			const struct slot *s = &t->slotv[j];
+
+			m &= m - 1;
+
+			if (t->ctrl[j] & CTRL_EMPTY || s->key != key)
+				continue;
+
+			if (!ah || ah(s->data, arg)) {
+				*idxp = j;
+				return true;
+			}
+		}
+
+		if (match_empty(w))
+			break;
+
+		g = (g + i + 1) & gmask;
+	}
+
+	return false;
+}
+
+
+static void table_put(struct table *t, uint32_t key, uint32_t h, void *data)
+{
+	const uint32_t gmask = t->cap / GROUP - 1;
+	uint32_t g = (h >> 7) & gmask;
+
+	for (uint32_t i = 0; i <= gmask; i++) {
+
+		const uint64_t m = match_free(group_load(&t->ctrl[g * GROUP]));
+
+		if (m) {
+			const uint32_t j = g * GROUP + first_idx(m);
+
+			if (t->ctrl[j] == CTRL_EMPTY)
+				++t->used;
+
+			t->ctrl[j] = (uint8_t)(h & 0x7f);
+			t->slotv[j].key  = key;
+			t->slotv[j].data = data;
+			++t->count;
+			return;
+		}
+
+		g = (g + i + 1) & gmask;
+	}
+}
+
+
+static void table_erase(struct table *t, uint32_t j)
+{
+	const uint32_t g = j / GROUP;
+
+	/* No probe went past a group that has an empty slot */
+	if (match_empty(group_load(&t->ctrl[g * GROUP]))) {
+		t->ctrl[j] = CTRL_EMPTY;
+		--t->used;
+	}
+	else {
+		t->ctrl[j] = CTRL_DELETE;
+	}
+
+	t->slotv[j].data = NULL;
+	--t->count;
+}
+
+
+static void migrate(struct hmap *m, uint32_t groups)
+{
+	struct table *old = &m->old;
+
+	while (groups-- && m->mig < old->cap / GROUP) {
+
+		for (uint32_t j = m->mig * GROUP; j < (m->mig+1) * GROUP; j++) {
+
+			const struct slot *s = &old->slotv[j];
+
+			if (old->ctrl[j] & CTRL_EMPTY)
+				continue;
+
+			table_put(&m->cur, s->key, mix(s->key), s->data);
+
+			old->ctrl[j] = CTRL_DELETE;
+			--old->count;
+		}
+
+		++m->mig;
+	}
+
+	if (m->mig == old->cap / GROUP) {
+		old->slotv = mem_deref(old->slotv);
+		memset(old, 0, sizeof(*old));
+		m->mig = 0;
+	}
+}
+
+
+static int grow(struct hmap *m)
+{
+	struct table t;
+	uint32_t cap = m->cur.cap;
+	int err;
+
+	/* Finish a pending move first, then rehash into a new table */
+	if (m->old.slotv)
+		migrate(m, UINT32_MAX);
+
+	/* Rehash at the same size if the table is full of deleted slots */
+	if (m->cur.count >= cap / 2) {
+		if (cap > UINT32_MAX / 2)
+			return ENOMEM;
+
+		cap *= 2;
+	}
+
+	err = table_init(&t, cap);
+	if (err)
+		return err;
+
+	m->old = m->cur;
+	m->cur = t;
+	m->mig = 0;
+
+	return 0;
+}
+
+
+static bool data_cmp(void *data, void *arg)
+{
+	return data == arg;
+}
+
+
+/**
+ * Allocate a new open-addressing hash map
+ *
+ * @param mp   Address of hash map pointer
+ * @param size Expected number of elements
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int hmap_alloc(struct hmap **mp, uint32_t size)
+{
+	struct hmap *m;
+	uint32_t cap;
+	int err;
+
+	if (!mp)
+		return EINVAL;
+
+	if (size > UINT32_MAX / 2)
+		return EINVAL;
+
+	cap = hash_valid_size(max(size + size / 7, (uint32_t)GROUP));
+
+	m = mem_zalloc(sizeof(*m), hmap_destructor);
+	if (!m)
+		return ENOMEM;
+
+	err = table_init(&m->cur, cap);
+	if (err)
+		mem_deref(m);
+	else
+		*mp = m;
+
+	return err;
+}
+
+
+/**
+ * Insert an element into the hash map. Several elements may have the same
+ * key. The map does not hold a reference to the element.
+ *
+ * @param m    Hash map
+ * @param key  Hash key
+ * @param data Element data, must not be NULL
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int hmap_insert(struct hmap *m, uint32_t key, void *data)
+{
+	int err;
+
+	if (!m || !data)
+		return EINVAL;
+
+	if (m->old.slotv)
+		migrate(m, MIGRATE);
+
+	if (m->cur.used >= m->cur.cap - m->cur.cap / 8) {
+		err = grow(m);
+		if (err)
+			return err;
+	}
+
+	table_put(&m->cur, key, mix(key), data);
+
+	return 0;
+}
+
+
+/**
+ * Remove an element from the hash map
+ *
+ * @param m    Hash map
+ * @param key  Hash key the element was inserted with
+ * @param data Element data
+ *
+ * @return True if the element was found and removed, otherwise false
+ */
+bool hmap_remove(struct hmap *m, uint32_t key, const void *data)
+{
+	const uint32_t h = mix(key);
+	uint32_t j;
+
+	if (!m || !data)
+		return false;
+
+	if (table_find(&m->cur, key, h, data_cmp, (void *)data, &j)) {
+		table_erase(&m->cur, j);
+		return true;
+	}
+
+	if (table_find(&m->old, key, h, data_cmp, (void *)data, &j)) {
+		table_erase(&m->old, j);
+		return true;
+	}
+
+	return false;
+}
+
+
+/**
+ * Find an element with a matching key in the hash map
+ *
+ * @param m   Hash map
+ * @param key Hash key
+ * @param ah  Compare handler, NULL to match on the key only
+ * @param arg Handler argument
+ *
+ * @return Element data if found, otherwise NULL
+ */
+void *hmap_lookup(const struct hmap *m, uint32_t key, hmap_apply_h *ah,
+		  void *arg)
+{
+	const uint32_t h = mix(key);
+	uint32_t j;
+
+	if (!m)
+		return NULL;
+
+	if (table_find(&m->cur, key, h, ah, arg, &j))
+		return m->cur.slotv[j].data;
+
+	if (table_find(&m->old, key, h, ah, arg, &j))
+		return m->old.slotv[j].data;
+
+	return NULL;
+}
+
+
+/**
+ * Apply a handler function to all elements in the hash map. The handler
+ * may remove the current element, but must not insert elements.
+ *
+ * @param m   Hash map
+ * @param ah  Apply handler
+ * @param arg Handler argument
+ *
+ * @return Element data if traversing stopped, otherwise NULL
+ */
+void *hmap_apply(const struct hmap *m, hmap_apply_h *ah, void *arg)
+{
+	if (!m || !ah)
+		return NULL;
+
+	for (uint32_t i = 0; i < 2; i++) {
+
+		const struct table *t = i ? &m->old : &m->cur;
+
+		for (uint32_t j = 0; j < t->cap; j++) {
+
+			void *data = t->slotv[j].data;
+
+			if (t->ctrl[j] & CTRL_EMPTY)
+				continue;
+
+			if (ah(data, arg))
+				return data;
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Get the number of elements in the hash map
+ *
+ * @param m Hash map
+ *
+ * @return Number of elements
+ */
+uint32_t hmap_count(const struct hmap *m)
+{
+	return m ? m->cur.count + m->old.count : 0;
+}
+
+
+/**
+ * Flush the hash map and dereference all elements
+ *
+ * @param m Hash map
+ */
+void hmap_flush(struct hmap *m)
+{
+	if (!m)
+		return;
+
+	for (uint32_t i = 0; i < 2; i++) {
+
+		struct table *t = i ? &m->old : &m->cur;
+
+		for (uint32_t j = 0; j < t->cap; j++) {
+
+			void *data = t->slotv[j].data;
+
+			if (t->ctrl[j] & CTRL_EMPTY)
+				continue;
+
+			/* The destructor may remove the element itself */
+			table_erase(t, j);
+			mem_deref(data);
+		}
+	}
+
+	hmap_clear(m);
+}
+
+
+/**
+ * Clear the hash map without dereferencing the elements
+ *
+ * @param m Hash map
+ */
+void hmap_clear(struct hmap *m)
+{
+	if (!m)
+		return;
+
+	table_reset(&m->cur);
+
+	m->old.slotv = mem_deref(m->old.slotv);
+	memset(&m->old, 0, sizeof(m->old));
+	m->mig = 0;
+}
@@ -16,6 +16,7 @@
 
 enum {
 	STARTLINE_MAX = 8192,
+	ARENA_SIZE    = 2048,
 };
 
 
@@ -92,13 +93,14 @@ static inline bool hdr_comma_separated(enum http_hdrid id)
 }
 
 
-static inline int hdr_add(struct http_msg *msg, const struct pl *name,
-			  enum http_hdrid id, const char *p, ssize_t l)
+static inline int hdr_add(struct mem_arena *arena, struct http_msg *msg,
+			  const struct pl *name, enum http_hdrid id,
+			  const char *p, ssize_t l)
 {
 	struct http_hdr *hdr;
 	int err = 0;
 
-	hdr = mem_zalloc(sizeof(*hdr), hdr_destructor);
+	hdr = mem_arena_zalloc(arena, sizeof(*hdr), hdr_destructor);
 	if (!hdr)
 		return ENOMEM;
 
@@ -144,6 +146,7 @@ int http_msg_decode(struct http_msg **msgp, struct mbuf *mb, bool req)
 {
 	struct pl b, s, e, name, scode;
 	const char *p, *cv;
+	struct mem_arena *arena;
 	struct http_msg *msg;
 	bool comsep, quote;
 	enum http_hdrid id = HTTP_HDR_NONE;
@@ -160,7 +163,13 @@ int http_msg_decode(struct http_msg **msgp, struct mbuf *mb, bool req)
 	if (re_regex(p, l, "[\r\n]*[^\r\n]+[\r]*[\n]1", &b, &s, NULL, &e))
 		return (l > STARTLINE_MAX) ? EBADMSG : ENODATA;
 
-	msg = mem_zalloc(sizeof(*msg), destructor);
+	/* The message and its headers share one arena */
+	err = mem_arena_alloc(&arena, ARENA_SIZE);
+	if (err)
+		return err;
+
+	msg = mem_arena_zalloc(arena, sizeof(*msg), destructor);
+	mem_deref(arena);
 	if (!msg)
 		return ENOMEM;
 
@@ -237,7 +246,8 @@ int http_msg_decode(struct http_msg **msgp, struct mbuf *mb, bool req)
 					goto out;
 				}
 
-				err = hdr_add(msg, &name, id, cv ? cv : p,
+				err = hdr_add(arena, msg, &name, id,
+					      cv ? cv : p,
 					      cv ? p - cv - ws : 0);
 				if (err)
 					goto out;
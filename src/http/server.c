@@ -230,7 +230,7 @@ static void recv_handler(struct mbuf *mb, void *arg)
 	}
 
 	while (conn->mb) {
-		size_t end, pos = conn->mb->pos;
+		size_t pos = conn->mb->pos;
 		struct http_msg *msg;
 
 		err = http_msg_decode(&msg, conn->mb, true);
@@ -250,32 +250,21 @@ static void recv_handler(struct mbuf *mb, void *arg)
 			break;
 		}
 
-		mem_deref(msg->mb);
-		msg->mb = mem_ref(msg->_mb);
-
-		mb = conn->mb;
-
-		end     = mb->end;
-		mb->end = mb->pos + msg->clen;
+		/* The body is a view, the buffer keeps the next request */
+		mb = mbuf_alloc_slice(conn->mb, msg->clen);
+		if (!mb) {
+			mem_deref(msg);
+			err = ENOMEM;
+			goto out;
+		}
 
-		if (end > mb->end) {
-			struct mbuf *mbn = mbuf_alloc(end - mb->end);
-			if (!mbn) {
-				mem_deref(msg);
-				err = ENOMEM;
-				goto out;
-			}
+		mem_deref(msg->mb);
+		msg->mb = mb;
 
-			(void)mbuf_write_mem(mbn, mb->buf + mb->end,
-					     end - mb->end);
-			mbn->pos = 0;
+		conn->mb->pos += msg->clen;
 
-			mem_deref(conn->mb);
-			conn->mb = mbn;
-		}
-		else {
+		if (!mbuf_get_left(conn->mb))
 			conn->mb = mem_deref(conn->mb);
-		}
 
 		if (verify_msg(conn, msg) == HTTPS_MSG_OK) {
 			conn->sock->reqh(conn, msg, conn->sock->arg);
@@ -290,6 +279,23 @@ static void recv_handler(struct mbuf *mb, void *arg)
 		tmr_start(&conn->tmr, TIMEOUT_IDLE, timeout_handler, conn);
 	}
 
+	/* Keep only the partial request, once per segment */
+	if (conn->mb && conn->mb->pos) {
+
+		mb = mbuf_alloc(mbuf_get_left(conn->mb));
+		if (!mb) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		(void)mbuf_write_mem(mb, mbuf_buf(conn->mb),
+				     mbuf_get_left(conn->mb));
+		mb->pos = 0;
+
+		mem_deref(conn->mb);
+		conn->mb = mb;
+	}
+
  out:
 	if (err) {
 		conn_close(conn);
@@ -0,0 +1,514 @@
+/**
+ * @file rbtree.c  Intrusive red-black tree implementation
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re/re_types.h>
+#include <re/re_list.h>
+#include <re/re_mem.h>
+
+
+/*
+ * The tree is intrusive like the linked list: the node is embedded in the
+ * element and the tree never allocates. Insert and unlink are O(log n),
+ * the first node is cached so rbtree_min() is O(1). Nodes that compare
+ * equal keep their insertion order.
+ */
+
+
+static inline bool is_red(const struct rbnode *n)
+{
+	return n && n->red;
+}
+
+
+static void change_child(struct rbtree *tree, struct rbnode *parent,
+			 struct rbnode *old, struct rbnode *new)
+{
+	if (!parent)
+		tree->root = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+}
+
+
+static void rotate_left(struct rbtree *tree, struct rbnode *x)
+{
+	struct rbnode *y = x->right;
+
+	x->right = y->left;
+	if (y->left)
+		y->left->parent = x;
+
+	y->parent = x->parent;
+	change_child(tree, x->parent, x, y);
+
+	y->left   = x;
+	x->parent = y;
+}
+
+
+static void rotate_right(struct rbtree *tree, struct rbnode *x)
+{
+	struct rbnode *y = x->left;
+
+	x->left = y->right;
+	if (y->right)
+		y->right->parent = x;
+
+	y->parent = x->parent;
+	change_child(tree, x->parent, x, y);
+
+	y->right  = x;
+	x->parent = y;
+}
+
+
+static void insert_fixup(struct rbtree *tree, struct rbnode *n)
+{
+	struct rbnode *p;
+
+	while ((p = n->parent) && p->red) {
+
+		struct rbnode *g = p->parent;  /* a red node is never root */
+		struct rbnode *u;
+
+		if (p == g->left) {
+
+			u = g->right;
+			if (is_red(u)) {
+				p->red = u->red = false;
+				g->red = true;
+				n = g;
+				continue;
+			}
+
+			if (n == p->right) {
+				rotate_left(tree, p);
+				p = n;
+			}
+
+			p->red = false;
+			g->red = true;
+			rotate_right(tree, g);
+			break;
+		}
+		else {
+			u = g->left;
+			if (is_red(u)) {
+				p->red = u->red = false;
+				g->red = true;
+				n = g;
+				continue;
+			}
+
+			if (n == p->left) {
+				rotate_right(tree, p);
+				p = n;
+			}
+
+			p->red = false;
+			g->red = true;
+			rotate_left(tree, g);
+			break;
+		}
+	}
+
+	tree->root->red = false;
+}
+
+
+/* x replaces a removed black node below p, x may be NULL */
+static void unlink_fixup(struct rbtree *tree, struct rbnode *x,
+			 struct rbnode *p)
+{
+	while (x != tree->root && !is_red(x)) {
+
+		struct rbnode *w;
+
+		if (x == p->left) {
+
+			w = p->right;
+			if (w->red) {
+				w->red = false;
+				p->red = true;
+				rotate_left(tree, p);
+				w = p->right;
+			}
+
+			if (!is_red(w->left) && !is_red(w->right)) {
+				w->red = true;
+				x = p;
+				p = x->parent;
+				continue;
+			}
+
+			if (!is_red(w->right)) {
+				w->left->red = false;
+				w->red = true;
+				rotate_right(tree, w);
+				w = p->right;
+			}
+
+			w->red = p->red;
+			p->red = false;
+			w->right->red = false;
+			rotate_left(tree, p);
+		}
+		else {
+			w = p->left;
+			if (w->red) {
+				w->red = false;
+				p->red = true;
+				rotate_right(tree, p);
+				w = p->left;
+			}
+
+			if (!is_red(w->left) && !is_red(w->right)) {
+				w->red = true;
+				x = p;
+				p = x->parent;
+				continue;
+			}
+
+			if (!is_red(w->left)) {
+				w->right->red = false;
+				w->red = true;
+				rotate_left(tree, w);
+				w = p->left;
+			}
+
+			w->red = p->red;
+			p->red = false;
+			w->left->red = false;
+			rotate_right(tree, p);
+		}
+
+		x = tree->root;
+	}
+
+	if (x)
+		x->red = false;
+}
+
+
+static void transplant(struct rbtree *tree, struct rbnode *u,
+		       struct rbnode *v)
+{
+	change_child(tree, u->parent, u, v);
+	if (v)
+		v->parent = u->parent;
+}
+
+
+/**
+ * Initialise a red-black tree
+ *
+ * @param tree Red-black tree
+ * @param cmph Compare handler
+ */
+void rbtree_init(struct rbtree *tree, rbtree_cmp_h *cmph)
+{
+	if (!tree)
+		return;
+
+	tree->root  = NULL;
+	tree->min   = NULL;
+	tree->cmph  = cmph;
+	tree->count = 0;
+}
+
+
+/**
+ * Flush a red-black tree and free all elements
+ *
+ * @param tree Red-black tree
+ */
+void rbtree_flush(struct rbtree *tree)
+{
+	struct rbnode *node;
+
+	if (!tree)
+		return;
+
+	while ((node = tree->min)) {
+		void *data = node->data;
+
+		rbtree_unlink(node);
+		node->data = NULL;
+		mem_deref(data);
+	}
+}
+
+
+/**
+ * Clear a red-black tree without dereferencing the elements
+ *
+ * @param tree Red-black tree
+ */
+void rbtree_clear(struct rbtree *tree)
+{
+	struct rbnode *node;
+
+	if (!tree)
+		return;
+
+	node = tree->root;
+
+	/* Post-order walk, a node is reset after both of its subtrees */
+	while (node) {
+		struct rbnode *parent;
+
+		if (node->left) {
+			node = node->left;
+			continue;
+		}
+
+		if (node->right) {
+			node = node->right;
+			continue;
+		}
+
+		parent = node->parent;
+		if (parent) {
+			if (parent->left == node)
+				parent->left = NULL;
+			else
+				parent->right = NULL;
+		}
+
+		node->parent = NULL;
+		node->tree   = NULL;
+		node->data   = NULL;
+		node->red    = false;
+		node = parent;
+	}
+
+	tree->root  = NULL;
+	tree->min   = NULL;
+	tree->count = 0;
+}
+
+
+/**
+ * Insert a node into a red-black tree, ordered by the compare handler.
+ * The node is placed after all nodes that compare equal to it.
+ *
+ * @param tree Red-black tree
+ * @param node Tree node
+ * @param data Element data
+ */
+void rbtree_insert(struct rbtree *tree, struct rbnode *node, void *data)
+{
+	struct rbnode **link, *parent = NULL;
+	bool first = true;
+
+	if (!tree || !node || !tree->cmph)
+		return;
+
+	node->data = data;
+	link = &tree->root;
+
+	while (*link) {
+		parent = *link;
+
+		if (tree->cmph(node, parent) < 0) {
+			link = &parent->left;
+		}
+		else {
+			link = &parent->right;
+			first = false;
+		}
+	}
+
+	node->parent = parent;
+	node->left   = NULL;
+	node->right  = NULL;
+	node->tree   = tree;
+	node->red    = true;
+
+	*link = node;
+
+	if (first)
+		tree->min = node;
+
+	++tree->count;
+
+	insert_fixup(tree, node);
+}
+
+
+/**
+ * Remove a node from its red-black tree
+ *
+ * @param node Tree node
+ */
+void rbtree_unlink(struct rbnode *node)
+{
+	struct rbtree *tree;
+	struct rbnode *x, *p;
+	bool red;
+
+	if (!node || !node->tree)
+		return;
+
+	tree = node->tree;
+
+	if (tree->min == node)
+		tree->min = rbtree_next(node);
+
+	if (!node->left || !node->right) {
+
+		x   = node->left ? node->left : node->right;
+		p   = node->parent;
+		red = node->red;
+
+		transplant(tree, node, x);
+	}
+	else {
+		struct rbnode *y = node->right;
+
+		/* Successor takes the place and color of the node */
+		while (y->left)
+			y = y->left;
+
+		x   = y->right;
+		red = y->red;
+
+		if (y->parent == node) {
+			p = y;
+		}
+		else {
+			p = y->parent;
+			transplant(tree, y, x);
+			y->right = node->right;
+			y->right->parent = y;
+		}
+
+		transplant(tree, node, y);
+		y->left = node->left;
+		y->left->parent = y;
+		y->red = node->red;
+	}
+
+	if (!red)
+		unlink_fixup(tree, x, p);
+
+	--tree->count;
+
+	node->parent = NULL;
+	node->left   = NULL;
+	node->right  = NULL;
+	node->tree   = NULL;
+}
+
+
+/**
+ * Get the next node in tree order
+ *
+ * @param node Tree node
+ *
+ * @return Next tree node (NULL if last)
+ */
+struct rbnode *rbtree_next(const struct rbnode *node)
+{
+	if (!node)
+		return NULL;
+
+	if (node->right) {
+		node = node->right;
+		while (node->left)
+			node = node->left;
+
+		return (struct rbnode *)node;
+	}
+
+	while (node->parent && node == node->parent->right)
+		node = node->parent;
+
+	return node->parent;
+}
+
+
+/**
+ * Get the previous node in tree order
+ *
+ * @param node Tree node
+ *
+ * @return Previous tree node (NULL if first)
+ */
+struct rbnode *rbtree_prev(const struct rbnode *node)
+{
+	if (!node)
+		return NULL;
+
+	if (node->left) {
+		node = node->left;
+		while (node->right)
+			node = node->right;
+
+		return (struct rbnode *)node;
+	}
+
+	while (node->parent && node == node->parent->left)
+		node = node->parent;
+
+	return node->parent;
+}
+
+
+/**
+ * Get the last node of a red-black tree
+ *
+ * @param tree Red-black tree
+ *
+ * @return Last tree node (NULL if empty)
+ */
+struct rbnode *rbtree_max(const struct rbtree *tree)
+{
+	struct rbnode *node;
+
+	if (!tree || !tree->root)
+		return NULL;
+
+	for (node = tree->root; node->right; node = node->right)
+		;
+
+	return node;
+}
+
+
+/**
+ * Call the apply handler for each node in a red-black tree. The handler
+ * may unlink the current node.
+ *
+ * @param tree Red-black tree
+ * @param fwd  true to traverse in tree order, false for reverse
+ * @param ah   Apply handler
+ * @param arg  Handler argument
+ *
+ * @return Current tree node if handler returned true
+ */
+struct rbnode *rbtree_apply(const struct rbtree *tree, bool fwd,
+			    rbtree_apply_h *ah, void *arg)
+{
+	struct rbnode *node;
+
+	if (!tree || !ah)
+		return NULL;
+
+	node = fwd ? tree->min : rbtree_max(tree);
+
+	while (node) {
+		struct rbnode *cur = node;
+
+		node = fwd ? rbtree_next(cur) : rbtree_prev(cur);
+
+		if (ah(cur, arg))
+			return cur;
+	}
+
+	return NULL;
+}
@@ -0,0 +1,434 @@
+/**
+ * @file group.c  Reactor group of cooperating main loops
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <re/re_types.h>
+#include <re/re_fmt.h>
+#include <re/re_mem.h>
+#include <re/re_atomic.h>
+#include <re/re_thread.h>
+#include <re/re_main.h>
+#include <re/re_mqueue.h>
+
+
+#define DEBUG_MODULE "group"
+#define DEBUG_LEVEL 5
+#include <re/re_dbg.h>
+
+
+/**
+ * Defines a Reactor Group
+ *
+ * A reactor group runs a fixed number of re_main() loops, each in its own
+ * thread with its own poll state and timers. Nothing is shared between the
+ * loops; objects created in one loop must only be used and destroyed from
+ * that loop. Work is handed to a loop with re_group_post() or
+ * re_group_call().
+ */
+
+enum {
+	GROUP_WORK = 0,
+	GROUP_STOP,
+};
+
+struct re_loop {
+	struct re_group *grp;   /**< Parent group (weak)               */
+	unsigned idx;           /**< Loop index                        */
+	thrd_t tid;             /**< Loop thread                       */
+	struct mqueue *mq;      /**< Work queue of the loop            */
+	char name[16];          /**< Thread name                       */
+	bool started;           /**< Thread was created                */
+	bool ready;             /**< Loop is initialized               */
+	bool stopping;          /**< Stop was received, loop only      */
+	int err;                /**< Initialization error              */
+};
+
+struct re_group {
+	struct re_loop *loopv;  /**< Loops                             */
+	unsigned n;             /**< Number of loops                   */
+	bool pin;               /**< Pin loops to CPU cores            */
+	mtx_t mtx;              /**< Protects ready and call state     */
+	cnd_t cnd;              /**< Signals ready and call completion */
+	RE_ATOMIC unsigned rr;  /**< Round-robin counter               */
+};
+
+struct group_work {
+	re_group_h *h;
+	void *arg;
+};
+
+struct group_call {
+	struct re_group *grp;
+	re_group_h *h;
+	void *arg;
+	int err;
+	bool done;
+};
+
+
+static unsigned cpu_count(void)
+{
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (n > 0)
+		return (unsigned)n;
+#endif
+	return 1;
+}
+
+
+static void call_complete(struct group_call *call, int err)
+{
+	mtx_lock(&call->grp->mtx);
+	call->err  = err;
+	call->done = true;
+	cnd_broadcast(&call->grp->cnd);
+	mtx_unlock(&call->grp->mtx);
+}
+
+
+static void call_handler(void *arg)
+{
+	struct group_call *call = arg;
+
+	call->h(call->arg);
+
+	call_complete(call, 0);
+}
+
+
+static void mqueue_handler(int id, void *data, void *arg)
+{
+	struct group_work *work = data;
+	struct re_loop *loop = arg;
+
+	switch (id) {
+
+	case GROUP_WORK:
+		/* Work posted during shutdown is dropped, a waiting
+		 * re_group_call() is released */
+		if (!loop->stopping)
+			work->h(work->arg);
+		else if (work->h == call_handler)
+			call_complete(work->arg, ECANCELED);
+
+		mem_deref(work);
+		break;
+
+	case GROUP_STOP:
+		loop->stopping = true;
+		re_cancel();
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+static int loop_thread(void *arg)
+{
+	struct re_loop *loop = arg;
+	struct re_group *grp = loop->grp;
+	int err;
+
+	err = re_thread_init();
+	if (err)
+		goto out;
+
+	err = mqueue_alloc(&loop->mq, mqueue_handler, loop);
+	if (err)
+		goto out;
+
+	if (grp->pin) {
+		int perr = thread_pin(THREAD_KIND_LOOP, loop->idx);
+		if (perr) {
+			DEBUG_WARNING("loop %u: could not pin to cpu (%m)\n",
+				      loop->idx, perr);
+		}
+	}
+
+ out:
+	mtx_lock(&grp->mtx);
+	loop->err   = err;
+	loop->ready = true;
+	cnd_broadcast(&grp->cnd);
+	mtx_unlock(&grp->mtx);
+
+	if (!err) {
+		err = re_main(NULL);
+		if (err) {
+			DEBUG_WARNING("loop %u: re_main (%m)\n",
+				      loop->idx, err);
+		}
+	}
+
+	/* Free the work that was queued behind the stop */
+	loop->stopping = true;
+	mqueue_drain(loop->mq);
+
+	loop->mq = mem_deref(loop->mq);
+	re_thread_close();
+
+	return err;
+}
+
+
+static void group_destructor(void *data)
+{
+	struct re_group *grp = data;
+
+	for (unsigned i = 0; i < grp->n; i++) {
+		struct re_loop *loop = &grp->loopv[i];
+
+		if (!loop->started)
+			continue;
+
+		mtx_lock(&grp->mtx);
+		while (!loop->ready)
+			cnd_wait(&grp->cnd, &grp->mtx);
+		mtx_unlock(&grp->mtx);
+
+		if (loop->mq)
+			(void)mqueue_push(loop->mq, GROUP_STOP, NULL);
+
+		thrd_join(loop->tid, NULL);
+	}
+
+	mem_deref(grp->loopv);
+	cnd_destroy(&grp->cnd);
+	mtx_destroy(&grp->mtx);
+}
+
+
+/**
+ * Allocate a reactor group and start its loops
+ *
+ * @param grpp Pointer to allocated reactor group
+ * @param n    Number of loops, 0 for one loop per online CPU core
+ * @param pin  True to pin each loop thread to one CPU core, taken from
+ *             the THREAD_KIND_LOOP policy, see thread_pin()
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_group_alloc(struct re_group **grpp, unsigned n, bool pin)
+{
+	struct re_group *grp;
+	int err = 0;
+
+	if (!grpp)
+		return EINVAL;
+
+	if (!n)
+		n = cpu_count();
+
+	grp = mem_zalloc(sizeof(*grp), NULL);
+	if (!grp)
+		return ENOMEM;
+
+	if (mtx_init(&grp->mtx, mtx_plain) != thrd_success) {
+		mem_deref(grp);
+		return ENOMEM;
+	}
+
+	if (cnd_init(&grp->cnd) != thrd_success) {
+		mtx_destroy(&grp->mtx);
+		mem_deref(grp);
+		return ENOMEM;
+	}
+
+	mem_destructor(grp, group_destructor);
+
+	grp->loopv = mem_zalloc(n * sizeof(*grp->loopv), NULL);
+	if (!grp->loopv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	grp->n	 = n;
+	grp->pin = pin;
+
+	for (unsigned i = 0; i < n; i++) {
+		struct re_loop *loop = &grp->loopv[i];
+
+		loop->grp = grp;
+		loop->idx = i;
+		(void)re_snprintf(loop->name, sizeof(loop->name),
+				  "re_loop_%u", i);
+
+		err = thread_create_kind(&loop->tid, THREAD_KIND_LOOP,
+					 loop->name, loop_thread, loop);
+		if (err)
+			goto out;
+
+		loop->started = true;
+	}
+
+	/* Wait for all loops to be ready */
+	mtx_lock(&grp->mtx);
+	for (unsigned i = 0; i < n; i++) {
+		struct re_loop *loop = &grp->loopv[i];
+
+		while (!loop->ready)
+			cnd_wait(&grp->cnd, &grp->mtx);
+
+		if (loop->err && !err)
+			err = loop->err;
+	}
+	mtx_unlock(&grp->mtx);
+
+ out:
+	if (err)
+		mem_deref(grp);
+	else
+		*grpp = grp;
+
+	return err;
+}
+
+
+/**
+ * Get the number of loops in a reactor group
+ *
+ * @param grp Reactor group
+ *
+ * @return Number of loops
+ */
+unsigned re_group_count(const struct re_group *grp)
+{
+	return grp ? grp->n : 0;
+}
+
+
+/**
+ * Get the next loop index in round-robin order
+ *
+ * @param grp Reactor group
+ *
+ * @return Loop index
+ */
+unsigned re_group_next(struct re_group *grp)
+{
+	if (!grp)
+		return 0;
+
+	return re_atomic_rlx_add(&grp->rr, 1u) % grp->n;
+}
+
+
+/**
+ * Get the loop index of the calling thread
+ *
+ * @param grp Reactor group
+ * @param idx Pointer to returned loop index
+ *
+ * @return 0 if success, ENOENT if not called from a loop of the group
+ */
+int re_group_index(const struct re_group *grp, unsigned *idx)
+{
+	if (!grp || !idx)
+		return EINVAL;
+
+	for (unsigned i = 0; i < grp->n; i++) {
+		if (thrd_equal(grp->loopv[i].tid, thrd_current())) {
+			*idx = i;
+			return 0;
+		}
+	}
+
+	return ENOENT;
+}
+
+
+/**
+ * Post work to a loop of a reactor group. The handler is called from the
+ * thread of the loop, in the order the work was posted.
+ *
+ * @param grp Reactor group
+ * @param idx Loop index
+ * @param h   Work handler
+ * @param arg Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_group_post(struct re_group *grp, unsigned idx, re_group_h *h,
+		  void *arg)
+{
+	struct group_work *work;
+	int err;
+
+	if (!grp || idx >= grp->n || !h)
+		return EINVAL;
+
+	work = mem_zalloc(sizeof(*work), NULL);
+	if (!work)
+		return ENOMEM;
+
+	work->h	  = h;
+	work->arg = arg;
+
+	err = mqueue_push(grp->loopv[idx].mq, GROUP_WORK, work);
+	if (err)
+		mem_deref(work);
+
+	return err;
+}
+
+
+/**
+ * Call a handler from a loop of a reactor group and wait for it to return.
+ * If the calling thread is the target loop, the handler is called directly.
+ *
+ * The caller is blocked until the handler has run, so this is meant for
+ * threads outside of the group. A loop of the group would stall its own
+ * reactor and deadlock with a loop calling it back; it gets EDEADLK and
+ * must use re_group_post() instead.
+ *
+ * @param grp Reactor group
+ * @param idx Loop index
+ * @param h   Handler
+ * @param arg Handler argument
+ *
+ * @return 0 if success, EDEADLK if called from another loop of the group,
+ *         ECANCELED if the loop stopped first, otherwise errorcode
+ */
+int re_group_call(struct re_group *grp, unsigned idx, re_group_h *h,
+		  void *arg)
+{
+	struct group_call call;
+	unsigned cur;
+	int err;
+
+	if (!grp || idx >= grp->n || !h)
+		return EINVAL;
+
+	if (0 == re_group_index(grp, &cur)) {
+		if (cur != idx)
+			return EDEADLK;
+
+		h(arg);
+		return 0;
+	}
+
+	call.grp  = grp;
+	call.h	  = h;
+	call.arg  = arg;
+	call.err  = 0;
+	call.done = false;
+
+	err = re_group_post(grp, idx, call_handler, &call);
+	if (err)
+		return err;
+
+	mtx_lock(&grp->mtx);
+	while (!call.done)
+		cnd_wait(&grp->cnd, &grp->mtx);
+	mtx_unlock(&grp->mtx);
+
+	return call.err;
+}
@@ -0,0 +1,274 @@
+/**
+ * @file hstat.c  Handler latency statistics
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re/re_types.h>
+#include <re/re_fmt.h>
+#include <re/re_mem.h>
+#include <re/re_main.h>
+#include "main.h"
+
+
+/*
+ * Samples are counted in log2 buckets, keyed by handler function and type.
+ * Recording a sample is a hash probe and a few increments, no allocation.
+ * When the table is full, new handlers are accounted to a catch-all entry
+ * with a NULL handler.
+ */
+
+enum {
+	HSTAT_SIZE  = 128,                  /**< Table slots, power of two */
+	HSTAT_LIMIT = HSTAT_SIZE / 4 * 3,   /**< Maximum used slots        */
+};
+
+struct re_hstats {
+	struct re_hstat tblv[HSTAT_SIZE];   /**< Handler entries           */
+	struct re_hstat otherv[2];          /**< Overflow, fd and timer    */
+	struct re_hstat loop;               /**< Loop iteration time       */
+	struct re_hstat events;             /**< Events per wakeup         */
+	unsigned used;                      /**< Used table slots          */
+};
+
+
+static unsigned bucket(uint64_t val)
+{
+	unsigned i = 0;
+
+#if defined(__GNUC__) || defined(__clang__)
+	if (val)
+		i = 64 - __builtin_clzll(val);
+#else
+	while (val) {
+		val >>= 1;
+		++i;
+	}
+#endif
+
+	return min(i, (unsigned)RE_HSTAT_BUCKETS - 1);
+}
+
+
+static void sample(struct re_hstat *st, uint64_t val)
+{
+	++st->count;
+	st->total += val;
+	if (val > st->max)
+		st->max = val;
+
+	++st->bucketv[bucket(val)];
+}
+
+
+static inline unsigned hash_fn(re_fn_h *h)
+{
+	/* Fibonacci hashing, the low bits of code addresses are aligned */
+	return (unsigned)(((uint64_t)(uintptr_t)h * 0x9e3779b97f4a7c15ULL)
+			  >> 32) & (HSTAT_SIZE - 1);
+}
+
+
+static void init_entry(struct re_hstat *st, enum re_hstat_type type,
+		       re_fn_h *h)
+{
+	memset(st, 0, sizeof(*st));
+	st->type = type;
+	st->h    = h;
+}
+
+
+int hstats_alloc(struct re_hstats **hsp)
+{
+	struct re_hstats *hs;
+
+	if (!hsp)
+		return EINVAL;
+
+	hs = mem_zalloc(sizeof(*hs), NULL);
+	if (!hs)
+		return ENOMEM;
+
+	hstats_reset(hs);
+
+	*hsp = hs;
+
+	return 0;
+}
+
+
+void hstats_reset(struct re_hstats *hs)
+{
+	if (!hs)
+		return;
+
+	memset(hs->tblv, 0, sizeof(hs->tblv));
+	hs->used = 0;
+
+	init_entry(&hs->otherv[0], RE_HSTAT_FD, NULL);
+	init_entry(&hs->otherv[1], RE_HSTAT_TMR, NULL);
+	init_entry(&hs->loop, RE_HSTAT_LOOP, NULL);
+	init_entry(&hs->events, RE_HSTAT_EVENTS, NULL);
+}
+
+
+void hstats_add(struct re_hstats *hs, enum re_hstat_type type, re_fn_h *h,
+		uint64_t val)
+{
+	struct re_hstat *st;
+	unsigned i;
+
+	if (!hs)
+		return;
+
+	switch (type) {
+
+	case RE_HSTAT_LOOP:
+		sample(&hs->loop, val);
+		return;
+
+	case RE_HSTAT_EVENTS:
+		sample(&hs->events, val);
+		return;
+
+	default:
+		break;
+	}
+
+	if (!h)
+		goto other;
+
+	for (i = hash_fn(h);; i = (i + 1) & (HSTAT_SIZE - 1)) {
+
+		st = &hs->tblv[i];
+
+		if (!st->h)
+			break;
+
+		if (st->h == h && st->type == type) {
+			sample(st, val);
+			return;
+		}
+	}
+
+	if (hs->used >= HSTAT_LIMIT)
+		goto other;
+
+	init_entry(st, type, h);
+	++hs->used;
+	sample(st, val);
+	return;
+
+ other:
+	sample(&hs->otherv[type == RE_HSTAT_TMR], val);
+}
+
+
+int hstats_apply(const struct re_hstats *hs, re_hstat_h *h, void *arg)
+{
+	const struct re_hstat *fixv[4];
+
+	if (!hs || !h)
+		return EINVAL;
+
+	fixv[0] = &hs->loop;
+	fixv[1] = &hs->events;
+	fixv[2] = &hs->otherv[0];
+	fixv[3] = &hs->otherv[1];
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(fixv); i++) {
+
+		if (fixv[i]->count && h(fixv[i], arg))
+			return 0;
+	}
+
+	for (size_t i = 0; i < HSTAT_SIZE; i++) {
+
+		const struct re_hstat *st = &hs->tblv[i];
+
+		if (st->count && h(st, arg))
+			return 0;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Get a percentile of a statistics entry
+ *
+ * @param st  Statistics entry
+ * @param pct Percentile, 0-100
+ *
+ * @return Upper bound of the bucket holding the percentile, or the maximum
+ *         sample if it falls into the last bucket
+ */
+uint64_t re_hstat_percentile(const struct re_hstat *st, unsigned pct)
+{
+	uint64_t rank, sum = 0;
+
+	if (!st || !st->count)
+		return 0;
+
+	rank = (st->count * min(pct, 100u) + 99) / 100;
+	if (!rank)
+		rank = 1;
+
+	for (unsigned i = 0; i < RE_HSTAT_BUCKETS - 1; i++) {
+
+		sum += st->bucketv[i];
+		if (sum >= rank)
+			return min((uint64_t)1 << i, st->max);
+	}
+
+	return st->max;
+}
+
+
+static const char *type_name(enum re_hstat_type type)
+{
+	switch (type) {
+
+	case RE_HSTAT_FD:     return "fd";
+	case RE_HSTAT_TMR:    return "tmr";
+	case RE_HSTAT_LOOP:   return "loop";
+	case RE_HSTAT_EVENTS: return "events";
+	default:              return "?";
+	}
+}
+
+
+struct debug {
+	struct re_printf *pf;
+	int err;
+};
+
+
+static bool debug_handler(const struct re_hstat *st, void *arg)
+{
+	struct debug *dbg = arg;
+
+	dbg->err = re_hprintf(dbg->pf, "    %-6s %10p n=%-8llu avg=%-6llu"
+			      " p50=%-6llu p99=%-6llu max=%llu\n",
+			      type_name(st->type), st->h, st->count,
+			      st->total / st->count,
+			      re_hstat_percentile(st, 50),
+			      re_hstat_percentile(st, 99), st->max);
+
+	return dbg->err != 0;
+}
+
+
+int hstats_debug(struct re_printf *pf, const struct re_hstats *hs)
+{
+	struct debug dbg = {pf, 0};
+	int err;
+
+	err = re_hprintf(pf, "  handler stats [us] (events in [n]):\n");
+	if (err || !hs)
+		return err;
+
+	err = hstats_apply(hs, debug_handler, &dbg);
+
+	return err ? err : dbg.err;
+}
@@ -5,6 +5,7 @@
  * Copyright (C) Sebastian Reimers
  */
 #include <stdlib.h>
+#include <limits.h>
 #ifdef HAVE_SYS_TIME_H
 #include <sys/time.h>
 #endif
@@ -27,6 +28,16 @@
 #endif
 #ifdef HAVE_EPOLL
 #include <sys/epoll.h>
+#ifdef HAVE_TIMERFD
+#include <sys/timerfd.h>
+#endif
+#endif
+#ifdef HAVE_IO_URING
+#include <poll.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
 #endif
 #ifdef HAVE_KQUEUE
 #include <sys/types.h>
@@ -58,6 +69,9 @@
 enum {
 	RE_THREAD_WORKERS = 4,
 	MAX_BLOCKING	  = 500, /**< Maximum time spent in handler in [ms] */
+#ifdef HAVE_IO_URING
+	URING_MAX_ENTRIES = 1024, /**< Maximum submission queue entries */
+#endif
 #if defined(FD_SETSIZE)
 	DEFAULT_MAXFDS = FD_SETSIZE
 #else
@@ -72,7 +86,42 @@ struct re_fhs {
 	int flags;           /**< Polling flags (Read, Write, etc.) */
 	fd_h* fh;            /**< Event handler                     */
 	void* arg;           /**< Handler argument                  */
+#ifdef HAVE_EPOLL
+	int eflags;          /**< Flags registered with epoll_ctl   */
+	bool queued;         /**< On the epoll change list          */
+#endif
+#ifdef HAVE_IO_URING
+	uint32_t umask;      /**< Armed io_uring poll mask          */
+	bool armed;          /**< io_uring poll request in flight   */
+	bool ucancel;        /**< io_uring poll remove in flight    */
+#endif
+};
+
+#ifdef HAVE_IO_URING
+/** io_uring instance with mapped submission and completion rings */
+struct re_uring {
+	int fd;                      /**< Ring file descriptor              */
+	void *sq_ring;               /**< Mapped submission ring            */
+	size_t sq_ring_sz;           /**< Submission ring mapping size      */
+	void *cq_ring;               /**< Mapped completion ring            */
+	size_t cq_ring_sz;           /**< Completion ring mapping size      */
+	struct io_uring_sqe *sqes;   /**< Mapped submission queue entries   */
+	size_t sqes_sz;              /**< SQE array mapping size            */
+	unsigned *sq_head;           /**< Submission ring head (kernel)     */
+	unsigned *sq_tail;           /**< Submission ring tail (user)       */
+	unsigned *sq_array;          /**< Submission index array            */
+	unsigned sq_mask;            /**< Submission ring mask              */
+	unsigned sq_entries;         /**< Submission ring entries           */
+	unsigned *cq_head;           /**< Completion ring head (user)       */
+	unsigned *cq_tail;           /**< Completion ring tail (kernel)     */
+	struct io_uring_cqe *cqes;   /**< Completion queue entries          */
+	unsigned cq_mask;            /**< Completion ring mask              */
+	unsigned cq_entries;         /**< Completion ring entries           */
+	unsigned pending;            /**< Queued but not submitted SQEs     */
+	int fault;                   /**< Simulated submit error, or 0      */
+	struct io_uring_cqe *events; /**< Reaped completions for fd_poll()  */
 };
+#endif
 
 /** Polling loop data */
 struct re {
@@ -89,11 +138,24 @@ struct re {
 #ifdef HAVE_EPOLL
 	struct epoll_event *events;  /**< Event set for epoll()             */
 	int epfd;                    /**< epoll control file descriptor     */
+	struct mbuf *fhscl;          /**< epoll change list, NULL if off    */
+#ifdef HAVE_TIMERFD
+	int tfd;                     /**< timerfd for [us] timers or -1     */
+	uint64_t tfd_expire;         /**< Armed timerfd expire time in [us] */
 #endif
+#endif
+	uint32_t busy_us;            /**< Busy-poll budget in [us], 0 = off */
+	uint64_t spin_us;            /**< Time spent busy-polling in [us]   */
+	uint64_t block_us;           /**< Time spent blocked in [us]        */
+	struct re_hstats *hstats;    /**< Handler statistics, may be NULL   */
+	uint64_t wake_us;            /**< Last wake-up from polling in [us] */
 
 #ifdef HAVE_KQUEUE
 	struct kevent *evlist;
 	int kqfd;
+#endif
+#ifdef HAVE_IO_URING
+	struct re_uring uring;       /**< io_uring instance                 */
 #endif
 	mtx_t *mutex;                /**< Mutex for thread synchronization  */
 	mtx_t *mutexp;               /**< Pointer to active mutex           */
@@ -109,20 +171,55 @@ static once_flag flag = ONCE_FLAG_INIT;
 static void poll_close(struct re *re);
 
 
+/**
+ * Check if a closed fhs is still referenced by the polling backend
+ *
+ * @param re  Poll state
+ * @param fhs File descriptor handler struct
+ *
+ * @return true if the fhs must not be freed yet
+ */
+static inline bool fhs_inflight(const struct re *re, const struct re_fhs *fhs)
+{
+#ifdef HAVE_IO_URING
+	/* the kernel owns a poll request with fhs as user_data */
+	return fhs->armed && re->uring.fd >= 0;
+#else
+	(void)re;
+	(void)fhs;
+	return false;
+#endif
+}
+
+
 static void fhsld_flush(struct re *re)
 {
+	uint8_t *buf;
+	size_t wpos = 0;
+
 	if (!re->fhsld)
 		return;
 
-	re->fhsld->pos = 0;
+	buf = re->fhsld->buf;
+
+	for (size_t rpos = 0; rpos < re->fhsld->end;
+	     rpos += sizeof(intptr_t)) {
+		struct re_fhs *fhs;
+
+		memcpy(&fhs, buf + rpos, sizeof(fhs));
+
+		if (fhs_inflight(re, fhs)) {
+			/* keep for the next flush */
+			memcpy(buf + wpos, &fhs, sizeof(fhs));
+			wpos += sizeof(intptr_t);
+			continue;
+		}
 
-	while (re->fhsld->pos < re->fhsld->end) {
-		intptr_t p = mbuf_read_ptr(re->fhsld);
-		mem_deref((void *)p);
+		mem_deref(fhs);
 	}
 
-	re->fhsld->pos = 0;
-	re->fhsld->end = 0;
+	re->fhsld->pos = wpos;
+	re->fhsld->end = wpos;
 }
 
 
@@ -136,6 +233,10 @@ static void re_destructor(void *arg)
 	mem_deref(re->async);
 	mem_deref(re->tmrl);
 	mem_deref(re->fhsld);
+#ifdef HAVE_EPOLL
+	mem_deref(re->fhscl);
+#endif
+	mem_deref(re->hstats);
 }
 
 
@@ -163,6 +264,22 @@ int re_alloc(struct re **rep)
 	if (!re)
 		return ENOMEM;
 
+	/* before any error path, the destructor closes valid fds */
+#ifdef HAVE_EPOLL
+	re->epfd = -1;
+#ifdef HAVE_TIMERFD
+	re->tfd = -1;
+#endif
+#endif
+
+#ifdef HAVE_KQUEUE
+	re->kqfd = -1;
+#endif
+
+#ifdef HAVE_IO_URING
+	re->uring.fd = -1;
+#endif
+
 	re->fhsld = mbuf_alloc(64 * sizeof(void *));
 	if (!re->fhsld) {
 		err = ENOMEM;
@@ -186,14 +303,6 @@ int re_alloc(struct re **rep)
 	re->async = NULL;
 	re->tid = thrd_current();
 
-#ifdef HAVE_EPOLL
-	re->epfd = -1;
-#endif
-
-#ifdef HAVE_KQUEUE
-	re->kqfd = -1;
-#endif
-
 out:
 	if (err)
 		mem_deref(re);
@@ -250,32 +359,42 @@ static inline void re_unlock(struct re *re)
 }
 
 
-#if MAIN_DEBUG
 /**
- * Call the application event handler
+ * Call the application event handler and account its duration. The end
+ * time of one handler is the start time of the next, so each event costs
+ * a single clock read.
  *
  * @param re     Poll state
- * @param i	 File descriptor handler index
+ * @param fhs    File descriptor handler struct
  * @param flags  Event flags
+ * @param tick   Start time in [us], updated to the end time
  */
-static void fd_handler(struct re_fhs *fhs, int flags)
+static void fd_handler(struct re *re, struct re_fhs *fhs, int flags,
+		       uint64_t *tick)
 {
-	const uint64_t tick = tmr_jiffies();
-	uint32_t diff;
+	fd_h *fh = fhs->fh;
+	uint64_t now, diff;
 
+#if MAIN_DEBUG
 	DEBUG_INFO("event on fd=%d (flags=0x%02x)...\n", fhs->fd, flags);
+#endif
+
+	fh(flags, fhs->arg);
 
-	fhs->fh(flags, fhs->arg);
+	now   = tmr_jiffies_usec();
+	diff  = now - *tick;
+	*tick = now;
 
-	diff = (uint32_t)(tmr_jiffies() - tick);
+	hstats_add(re->hstats, RE_HSTAT_FD, (re_fn_h *)fh, diff);
 
-	if (diff > MAX_BLOCKING) {
-		DEBUG_WARNING("long async blocking: %u>%u ms (h=%p arg=%p)\n",
-			      diff, MAX_BLOCKING,
-			      fhs->fh, fhs->arg);
+#if MAIN_DEBUG
+	if (diff > MAX_BLOCKING * 1000) {
+		DEBUG_WARNING("long async blocking: %llu>%u ms (h=%p arg=%p)\n",
+			      diff / 1000, MAX_BLOCKING,
+			      fh, fhs->arg);
 	}
-}
 #endif
+}
 
 
 #ifdef HAVE_SELECT
@@ -318,25 +437,25 @@ static int set_select_fds(struct re *re, struct re_fhs *fhs)
 
 
 #ifdef HAVE_EPOLL
-static int set_epoll_fds(struct re *re, struct re_fhs *fhs)
+static int epoll_apply(struct re *re, struct re_fhs *fhs)
 {
 	struct epoll_event event;
 	int err = 0;
 
-	if (!re || !fhs)
-		return EINVAL;
-
 	re_sock_t fd = fhs->fd;
 	int flags    = fhs->flags;
 
-	if (re->epfd < 0)
-		return EBADFD;
+	/* Nothing to do if the kernel already has this interest set */
+	if (flags == fhs->eflags)
+		return 0;
 
 	memset(&event, 0, sizeof(event));
 
-	DEBUG_INFO("set_epoll_fds: fd=%d flags=0x%02x\n", fd, flags);
+	DEBUG_INFO("epoll_apply: fd=%d flags=0x%02x\n", fd, flags);
 
 	if (flags) {
+		int op = fhs->eflags ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
 		event.data.ptr = fhs;
 
 		if (flags & FD_READ)
@@ -346,26 +465,22 @@ static int set_epoll_fds(struct re *re, struct re_fhs *fhs)
 		if (flags & FD_EXCEPT)
 			event.events |= EPOLLERR;
 
-		/* Try to add it first */
-		if (-1 == epoll_ctl(re->epfd, EPOLL_CTL_ADD, fd, &event)) {
+		if (-1 == epoll_ctl(re->epfd, op, fd, &event)) {
 
-			/* If already exist then modify it */
-			if (EEXIST == errno) {
+			/* Fall back if the registration state was lost */
+			if (op == EPOLL_CTL_ADD && EEXIST == errno)
+				op = EPOLL_CTL_MOD;
+			else if (op == EPOLL_CTL_MOD && ENOENT == errno)
+				op = EPOLL_CTL_ADD;
+			else
+				op = -1;
 
-				if (-1 == epoll_ctl(re->epfd, EPOLL_CTL_MOD,
-						    fd, &event)) {
-					err = errno;
-					DEBUG_WARNING("epoll_ctl:"
-						      " EPOLL_CTL_MOD:"
-						      " fd=%d (%m)\n",
-						      fd, err);
-				}
-			}
-			else {
+			if (op < 0 || -1 == epoll_ctl(re->epfd, op, fd,
+						      &event)) {
 				err = errno;
-				DEBUG_WARNING("epoll_ctl: EPOLL_CTL_ADD:"
-					      " fd=%d (%m)\n",
+				DEBUG_WARNING("epoll_ctl: fd=%d (%m)\n",
 					      fd, err);
+				return err;
 			}
 		}
 	}
@@ -377,53 +492,733 @@ static int set_epoll_fds(struct re *re, struct re_fhs *fhs)
 		}
 	}
 
+	fhs->eflags = flags;
+
 	return err;
 }
-#endif
 
 
-#ifdef HAVE_KQUEUE
-static int set_kqueue_fds(struct re *re, struct re_fhs *fhs)
+/**
+ * Apply all queued interest changes, in the order they were made
+ *
+ * @param re Poll state
+ */
+static void epoll_flush(struct re *re)
+{
+	struct mbuf *cl = re->fhscl;
+
+	if (!cl || !cl->end)
+		return;
+
+	for (size_t pos = 0; pos < cl->end; pos += sizeof(intptr_t)) {
+		struct re_fhs *fhs;
+
+		memcpy(&fhs, cl->buf + pos, sizeof(fhs));
+
+		fhs->queued = false;
+		(void)epoll_apply(re, fhs);
+	}
+
+	cl->pos = 0;
+	cl->end = 0;
+}
+
+
+static int set_epoll_fds(struct re *re, struct re_fhs *fhs)
+{
+	int err;
+
+	if (!re || !fhs)
+		return EINVAL;
+
+	if (re->epfd < 0)
+		return EBADFD;
+
+	/* Removals are applied at once, since the caller closes the fd
+	 * right after. Changes from other threads are not deferred. */
+	if (!re->fhscl || !fhs->flags ||
+	    !thrd_equal(re->tid, thrd_current()))
+		return epoll_apply(re, fhs);
+
+	if (fhs->queued)
+		return 0;
+
+	/* Collapse all changes of one poll iteration into one epoll_ctl */
+	err = mbuf_write_ptr(re->fhscl, (intptr_t)fhs);
+	if (err)
+		return epoll_apply(re, fhs);
+
+	fhs->queued = true;
+
+	return 0;
+}
+#endif
+
+
+#ifdef HAVE_KQUEUE
+static int set_kqueue_fds(struct re *re, struct re_fhs *fhs)
+{
+	struct kevent kev[2];
+	int r, n = 0;
+
+	if (!fhs)
+		return EINVAL;
+
+	re_sock_t fd = fhs->fd;
+	int flags    = fhs->flags;
+
+	memset(kev, 0, sizeof(kev));
+
+	/* always delete the events */
+	EV_SET(&kev[0], fd, EVFILT_READ,  EV_DELETE, 0, 0, 0);
+	EV_SET(&kev[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, 0);
+	kevent(re->kqfd, kev, 2, NULL, 0, NULL);
+
+	memset(kev, 0, sizeof(kev));
+
+	if (flags & FD_WRITE) {
+		EV_SET(&kev[n], fd, EVFILT_WRITE, EV_ADD, 0, 0, fhs);
+		++n;
+	}
+	if (flags & FD_READ) {
+		EV_SET(&kev[n], fd, EVFILT_READ, EV_ADD, 0, 0, fhs);
+		++n;
+	}
+
+	if (n) {
+		r = kevent(re->kqfd, kev, n, NULL, 0, NULL);
+		if (r < 0) {
+			int err = errno;
+
+			DEBUG_WARNING("set: [fd=%d, flags=%x] kevent: %m\n",
+				      fd, flags, err);
+			return err;
+		}
+	}
+
+	return 0;
+}
+#endif
+
+
+#if defined(HAVE_EPOLL) && defined(HAVE_TIMERFD)
+/**
+ * Open the timerfd used to wake epoll for microsecond precision timers.
+ * Without it, such timers fall back to millisecond epoll timeouts.
+ *
+ * @param re Poll state
+ */
+static void timerfd_open(struct re *re)
+{
+	struct epoll_event event;
+
+	re->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (re->tfd < 0) {
+		DEBUG_WARNING("timerfd_create: %m\n", errno);
+		return;
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.events   = EPOLLIN;
+	event.data.ptr = NULL;
+
+	if (-1 == epoll_ctl(re->epfd, EPOLL_CTL_ADD, re->tfd, &event)) {
+		DEBUG_WARNING("timerfd: epoll_ctl: %m\n", errno);
+		(void)close(re->tfd);
+		re->tfd = -1;
+		return;
+	}
+
+	re->tfd_expire = 0;
+}
+
+
+/**
+ * Arm the timerfd for the next timer
+ *
+ * @param re     Poll state
+ * @param expire Expire time in [us]
+ * @param to     Timeout in [us], not 0
+ *
+ * @return true if the timerfd is armed, otherwise false
+ */
+static bool timerfd_arm(struct re *re, uint64_t expire, uint64_t to)
+{
+	struct itimerspec its;
+
+	if (re->tfd < 0)
+		return false;
+
+	if (expire == re->tfd_expire)
+		return true;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec  = (time_t)(to / 1000000);
+	its.it_value.tv_nsec = (long)(to % 1000000) * 1000;
+
+	if (timerfd_settime(re->tfd, 0, &its, NULL)) {
+		DEBUG_WARNING("timerfd_settime: %m\n", errno);
+		return false;
+	}
+
+	re->tfd_expire = expire;
+
+	return true;
+}
+
+
+static void timerfd_drain(struct re *re)
+{
+	uint64_t cnt;
+	ssize_t n;
+
+	n = read(re->tfd, &cnt, sizeof(cnt));
+	if (n < 0) {
+		DEBUG_INFO("timerfd read: %m\n", errno);
+	}
+
+	re->tfd_expire = 0;
+}
+#endif
+
+
+/**
+ * Spin on the poll backend without blocking, for at most the busy-poll
+ * budget or until the next timer is due. Called without the re lock.
+ *
+ * @param re Poll state
+ * @param to Timeout of the next timer in [us], 0 for none
+ *
+ * @return Number of ready events, 0 if none, -1 on error
+ */
+static int busy_poll(struct re *re, uint64_t to)
+{
+	uint64_t start, now, limit = re->busy_us;
+	int n;
+
+	if (!limit)
+		return 0;
+
+	if (to && to < limit)
+		limit = to;
+
+	start = tmr_jiffies_usec();
+
+	do {
+		switch (re->method) {
+
+#ifdef HAVE_EPOLL
+		case METHOD_EPOLL:
+			n = epoll_wait(re->epfd, re->events, re->maxfds, 0);
+			break;
+#endif
+
+#ifdef HAVE_IO_URING
+		case METHOD_IOURING:
+			n = __atomic_load_n(re->uring.cq_tail,
+					    __ATOMIC_ACQUIRE) !=
+			    *re->uring.cq_head;
+			break;
+#endif
+
+		default:
+			return 0;
+		}
+
+		now = tmr_jiffies_usec();
+
+	} while (n == 0 && now - start < limit);
+
+	re->spin_us += now - start;
+
+	return n;
+}
+
+
+static inline uint64_t busy_tick(const struct re *re)
+{
+	return re->busy_us ? tmr_jiffies_usec() : 0;
+}
+
+
+static inline void busy_blocked(struct re *re, uint64_t tick)
+{
+	if (re->busy_us)
+		re->block_us += tmr_jiffies_usec() - tick;
+}
+
+
+#ifdef HAVE_IO_URING
+static inline int sys_io_uring_setup(unsigned entries,
+				     struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+
+static inline int sys_io_uring_enter(int fd, unsigned to_submit,
+				     unsigned min_complete, unsigned flags,
+				     const void *arg, size_t argsz)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			    flags, arg, argsz);
+}
+
+
+static void uring_close(struct re_uring *ur)
+{
+	if (ur->sqes)
+		(void)munmap(ur->sqes, ur->sqes_sz);
+
+	if (ur->cq_ring && ur->cq_ring != ur->sq_ring)
+		(void)munmap(ur->cq_ring, ur->cq_ring_sz);
+
+	if (ur->sq_ring)
+		(void)munmap(ur->sq_ring, ur->sq_ring_sz);
+
+	if (ur->fd >= 0)
+		(void)close(ur->fd);
+
+	mem_deref(ur->events);
+
+	memset(ur, 0, sizeof(*ur));
+	ur->fd = -1;
+}
+
+
+static int uring_init(struct re_uring *ur, unsigned entries)
+{
+	struct io_uring_params p;
+	uint8_t *sq, *cq;
+	int err;
+
+	memset(&p, 0, sizeof(p));
+	p.flags	     = IORING_SETUP_CQSIZE;
+	p.cq_entries = entries * 2;
+
+	ur->fd = sys_io_uring_setup(entries, &p);
+	if (ur->fd < 0) {
+		ur->fd = -1;
+		return errno;
+	}
+
+	/* Required for timed waits and overflow-safe completions */
+	if (!(p.features & IORING_FEAT_EXT_ARG) ||
+	    !(p.features & IORING_FEAT_NODROP)) {
+		err = ENOSYS;
+		goto out;
+	}
+
+	ur->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ur->cq_ring_sz = p.cq_off.cqes +
+			 p.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ur->sq_ring_sz = max(ur->sq_ring_sz, ur->cq_ring_sz);
+		ur->cq_ring_sz = ur->sq_ring_sz;
+	}
+
+	ur->sq_ring = mmap(NULL, ur->sq_ring_sz, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, ur->fd,
+			   IORING_OFF_SQ_RING);
+	if (ur->sq_ring == MAP_FAILED) {
+		ur->sq_ring = NULL;
+		err = errno;
+		goto out;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ur->cq_ring = ur->sq_ring;
+	}
+	else {
+		ur->cq_ring = mmap(NULL, ur->cq_ring_sz,
+				   PROT_READ | PROT_WRITE,
+				   MAP_SHARED | MAP_POPULATE, ur->fd,
+				   IORING_OFF_CQ_RING);
+		if (ur->cq_ring == MAP_FAILED) {
+			ur->cq_ring = NULL;
+			err = errno;
+			goto out;
+		}
+	}
+
+	ur->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	ur->sqes = mmap(NULL, ur->sqes_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQES);
+	if (ur->sqes == MAP_FAILED) {
+		ur->sqes = NULL;
+		err = errno;
+		goto out;
+	}
+
+	sq = ur->sq_ring;
+	cq = ur->cq_ring;
+
+	ur->sq_head    = (unsigned *)(void *)(sq + p.sq_off.head);
+	ur->sq_tail    = (unsigned *)(void *)(sq + p.sq_off.tail);
+	ur->sq_array   = (unsigned *)(void *)(sq + p.sq_off.array);
+	ur->sq_mask    = *(unsigned *)(void *)(sq + p.sq_off.ring_mask);
+	ur->sq_entries = p.sq_entries;
+
+	ur->cq_head    = (unsigned *)(void *)(cq + p.cq_off.head);
+	ur->cq_tail    = (unsigned *)(void *)(cq + p.cq_off.tail);
+	ur->cqes       = (struct io_uring_cqe *)(void *)(cq + p.cq_off.cqes);
+	ur->cq_mask    = *(unsigned *)(void *)(cq + p.cq_off.ring_mask);
+	ur->cq_entries = p.cq_entries;
+
+	err = 0;
+
+ out:
+	if (err)
+		uring_close(ur);
+
+	return err;
+}
+
+
+static void uring_probe(void);
+static once_flag uring_flag = ONCE_FLAG_INIT;
+static bool uring_ok;
+
+
+static void uring_probe(void)
+{
+	struct re_uring ur;
+
+	memset(&ur, 0, sizeof(ur));
+	ur.fd = -1;
+
+	uring_ok = (0 == uring_init(&ur, 1));
+
+	uring_close(&ur);
+}
+
+
+/**
+ * Check if the running kernel provides a usable io_uring
+ *
+ * @return true if supported, otherwise false
+ */
+bool poll_uring_supported(void)
+{
+	call_once(&uring_flag, uring_probe);
+
+	return uring_ok;
+}
+
+
+/**
+ * Reap all available completions into the events array
+ *
+ * @param ur  io_uring instance
+ *
+ * @return Number of reaped completions
+ */
+static int uring_reap(struct re_uring *ur)
+{
+	unsigned head, tail, n = 0;
+
+	head = *ur->cq_head;
+	tail = __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE);
+
+	while (head != tail && n < ur->cq_entries) {
+		ur->events[n++] = ur->cqes[head & ur->cq_mask];
+		++head;
+	}
+
+	__atomic_store_n(ur->cq_head, head, __ATOMIC_RELEASE);
+
+	return (int)n;
+}
+
+
+static int uring_submit(struct re_uring *ur)
+{
+	int n;
+
+	if (!ur->pending)
+		return 0;
+
+	if (ur->fault) {
+		const int err = ur->fault;
+
+		ur->fault = 0;
+		return err;
+	}
+
+	/* On EAGAIN/EBUSY the SQEs stay queued for the next wait */
+	n = sys_io_uring_enter(ur->fd, ur->pending, 0, 0, NULL, 0);
+	if (n < 0)
+		return errno == EAGAIN || errno == EBUSY ? 0 : errno;
+
+	ur->pending -= min((unsigned)n, ur->pending);
+
+	return 0;
+}
+
+
+/**
+ * Submit all queued SQEs and wait for at least one completion
+ *
+ * @param re  Poll state
+ * @param to  Timeout in [us], 0 for infinite
+ *
+ * @return Number of reaped completions or -1 on error (errno is set)
+ */
+static int uring_wait(struct re *re, uint64_t to)
+{
+	struct re_uring *ur = &re->uring;
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned pending = ur->pending;
+	unsigned submitted = 0;
+	uint64_t tick;
+	int n = 0, err = 0;
+
+	memset(&arg, 0, sizeof(arg));
+
+	if (to) {
+		ts.tv_sec  = (int64_t)(to / 1000000);
+		ts.tv_nsec = (long long)(to % 1000000) * 1000;
+		arg.ts	   = (uint64_t)(uintptr_t)&ts;
+	}
+
+	/* Other threads may queue and submit while the lock is released */
+	ur->pending = 0;
+
+	re_unlock(re);
+
+	if (re->busy_us) {
+		/* Submit first, so re-armed requests can complete */
+		n = sys_io_uring_enter(ur->fd, pending, 0, 0, NULL, 0);
+		if (n > 0)
+			submitted = (unsigned)n;
+
+		n = busy_poll(re, to);
+	}
+
+	if (n <= 0) {
+		tick = busy_tick(re);
+		n = sys_io_uring_enter(ur->fd, pending - submitted, 1,
+				       IORING_ENTER_GETEVENTS |
+				       IORING_ENTER_EXT_ARG,
+				       &arg, sizeof(arg));
+		if (n < 0)
+			err = errno;
+		else
+			submitted += (unsigned)n;
+		busy_blocked(re, tick);
+	}
+
+	re_lock(re);
+
+	ur->pending += pending - min(submitted, pending);
+
+	if (err && err != ETIME && err != EBUSY) {
+		errno = err;
+		return -1;
+	}
+
+	return uring_reap(ur);
+}
+
+
+static struct io_uring_sqe *uring_sqe_get(struct re_uring *ur)
+{
+	struct io_uring_sqe *sqe;
+	unsigned head, tail, idx;
+
+	tail = *ur->sq_tail;
+	head = __atomic_load_n(ur->sq_head, __ATOMIC_ACQUIRE);
+
+	if (tail - head >= ur->sq_entries) {
+		/* Submission ring is full, flush it first */
+		if (uring_submit(ur))
+			return NULL;
+
+		head = __atomic_load_n(ur->sq_head, __ATOMIC_ACQUIRE);
+		if (tail - head >= ur->sq_entries)
+			return NULL;
+	}
+
+	idx = tail & ur->sq_mask;
+	sqe = &ur->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+
+	ur->sq_array[idx] = idx;
+
+	return sqe;
+}
+
+
+static void uring_sqe_commit(struct re_uring *ur)
+{
+	__atomic_store_n(ur->sq_tail, *ur->sq_tail + 1, __ATOMIC_RELEASE);
+	++ur->pending;
+}
+
+
+static uint32_t uring_poll_mask(int flags)
+{
+	uint32_t mask = 0;
+
+	if (flags & FD_READ)
+		mask |= POLLIN;
+	if (flags & FD_WRITE)
+		mask |= POLLOUT;
+	if (flags & FD_EXCEPT)
+		mask |= POLLERR;
+
+	return mask;
+}
+
+
+static int uring_arm(struct re_uring *ur, struct re_fhs *fhs)
+{
+	struct io_uring_sqe *sqe;
+	uint32_t mask = uring_poll_mask(fhs->flags);
+
+	sqe = uring_sqe_get(ur);
+	if (!sqe)
+		return EBUSY;
+
+	sqe->opcode	   = IORING_OP_POLL_ADD;
+	sqe->fd		   = fhs->fd;
+	sqe->user_data	   = (uint64_t)(uintptr_t)fhs;
+#if __BYTE_ORDER == __BIG_ENDIAN
+	sqe->poll32_events = (mask << 16) | (mask >> 16);
+#else
+	sqe->poll32_events = mask;
+#endif
+	uring_sqe_commit(ur);
+
+	fhs->umask = mask;
+	fhs->armed = true;
+
+	return 0;
+}
+
+
+static int uring_disarm(struct re_uring *ur, struct re_fhs *fhs)
+{
+	struct io_uring_sqe *sqe;
+
+	if (fhs->ucancel)
+		return 0;
+
+	sqe = uring_sqe_get(ur);
+	if (!sqe)
+		return EBUSY;
+
+	/* The completion of the removed poll request re-arms if needed */
+	sqe->opcode    = IORING_OP_POLL_REMOVE;
+	sqe->fd	       = -1;
+	sqe->addr      = (uint64_t)(uintptr_t)fhs;
+	sqe->user_data = 0;
+	uring_sqe_commit(ur);
+
+	fhs->ucancel = true;
+
+	return 0;
+}
+
+
+static int set_uring_fds(struct re *re, struct re_fhs *fhs)
+{
+	struct re_uring *ur = &re->uring;
+	int err;
+
+	if (!re || !fhs)
+		return EINVAL;
+
+	if (ur->fd < 0)
+		return EBADFD;
+
+	DEBUG_INFO("set_uring_fds: fd=%d flags=0x%02x\n", fhs->fd,
+		   fhs->flags);
+
+	if (!fhs->flags) {
+		err = fhs->armed ? uring_disarm(ur, fhs) : 0;
+	}
+	else if (!fhs->armed) {
+		err = uring_arm(ur, fhs);
+	}
+	else if (fhs->umask != uring_poll_mask(fhs->flags)) {
+		err = uring_disarm(ur, fhs);
+	}
+	else {
+		err = 0;
+	}
+
+	if (err)
+		return err;
+
+	/* The polling thread submits all queued requests with its next
+	 * wait, other callers must not delay the interest change */
+	if (re_atomic_rlx(&re->polling) && thrd_equal(re->tid, thrd_current()))
+		return 0;
+
+	return uring_submit(ur);
+}
+
+
+/** Re-arm the one-shot poll request after the fd handler returned */
+static void uring_rearm(struct re *re, struct re_fhs *fhs)
+{
+	if (!fhs->flags || fhs->armed)
+		return;
+
+	if (uring_arm(&re->uring, fhs)) {
+		DEBUG_WARNING("io_uring: could not re-arm fd=%d\n", fhs->fd);
+	}
+}
+
+
+/**
+ * Decode a reaped completion
+ *
+ * @param re    Poll state
+ * @param cqe   Completion queue entry
+ * @param flags Returned event flags
+ *
+ * @return File descriptor handler struct or NULL for internal requests
+ */
+static struct re_fhs *uring_event(struct re *re,
+				  const struct io_uring_cqe *cqe, int *flags)
 {
-	struct kevent kev[2];
-	int r, n = 0;
-
-	if (!fhs)
-		return EINVAL;
-
-	re_sock_t fd = fhs->fd;
-	int flags    = fhs->flags;
+	struct re_fhs *fhs = (struct re_fhs *)(uintptr_t)cqe->user_data;
 
-	memset(kev, 0, sizeof(kev));
+	*flags = 0;
 
-	/* always delete the events */
-	EV_SET(&kev[0], fd, EVFILT_READ,  EV_DELETE, 0, 0, 0);
-	EV_SET(&kev[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, 0);
-	kevent(re->kqfd, kev, 2, NULL, 0, NULL);
+	if (!fhs)
+		return NULL;
 
-	memset(kev, 0, sizeof(kev));
+	fhs->armed   = false;
+	fhs->ucancel = false;
 
-	if (flags & FD_WRITE) {
-		EV_SET(&kev[n], fd, EVFILT_WRITE, EV_ADD, 0, 0, fhs);
-		++n;
-	}
-	if (flags & FD_READ) {
-		EV_SET(&kev[n], fd, EVFILT_READ, EV_ADD, 0, 0, fhs);
-		++n;
+	if (cqe->res < 0) {
+		/* The fd of a closed fhs may be gone before submission */
+		if (cqe->res != -ECANCELED && fhs->fh) {
+			DEBUG_WARNING("io_uring: poll fd=%d (%m)\n", fhs->fd,
+				      -cqe->res);
+		}
 	}
+	else {
+		if (cqe->res & POLLIN)
+			*flags |= FD_READ;
+		if (cqe->res & POLLOUT)
+			*flags |= FD_WRITE;
+		if (cqe->res & (POLLERR | POLLHUP))
+			*flags |= FD_EXCEPT;
 
-	if (n) {
-		r = kevent(re->kqfd, kev, n, NULL, 0, NULL);
-		if (r < 0) {
-			int err = errno;
-
-			DEBUG_WARNING("set: [fd=%d, flags=%x] kevent: %m\n",
-				      fd, flags, err);
-			return err;
-		}
+		/* Interest may have changed while the request was armed */
+		*flags &= fhs->flags | FD_EXCEPT;
 	}
 
-	return 0;
+	if (!*flags && (cqe->res >= 0 || cqe->res == -ECANCELED))
+		uring_rearm(re, fhs);
+
+	return fhs;
 }
 #endif
 
@@ -471,6 +1266,11 @@ static int poll_init(struct re *re)
 			return err;
 		}
 		DEBUG_INFO("init: epoll_create() epfd=%d\n", re->epfd);
+
+#ifdef HAVE_TIMERFD
+		if (re->tfd < 0)
+			timerfd_open(re);
+#endif
 		break;
 #endif
 
@@ -494,6 +1294,38 @@ static int poll_init(struct re *re)
 		break;
 #endif
 
+#ifdef HAVE_IO_URING
+	case METHOD_IOURING: {
+		unsigned entries = 1;
+		int err;
+
+		if (re->uring.fd >= 0)
+			return 0;
+
+		while (entries < (unsigned)min(re->maxfds, URING_MAX_ENTRIES))
+			entries <<= 1;
+
+		err = uring_init(&re->uring, entries);
+		if (!err) {
+			re->uring.events = mem_zalloc(re->uring.cq_entries *
+						      sizeof(*re->uring.events),
+						      NULL);
+			if (!re->uring.events) {
+				uring_close(&re->uring);
+				err = ENOMEM;
+			}
+		}
+		if (err) {
+			DEBUG_WARNING("io_uring setup: %m (entries=%u)\n",
+				      err, entries);
+			return err;
+		}
+		DEBUG_INFO("init: io_uring fd=%d entries=%u\n",
+			   re->uring.fd, entries);
+	}
+		break;
+#endif
+
 	default:
 		DEBUG_WARNING("poll init: no method\n");
 		return EINVAL;
@@ -527,6 +1359,27 @@ static void poll_close(struct re *re)
 		re->epfd = -1;
 	}
 
+#ifdef HAVE_TIMERFD
+	if (re->tfd >= 0) {
+		(void)close(re->tfd);
+		re->tfd = -1;
+	}
+#endif
+
+	/* The registrations are gone with the epoll instance */
+	if (re->fhscl) {
+		for (size_t pos = 0; pos < re->fhscl->end;
+		     pos += sizeof(intptr_t)) {
+			struct re_fhs *fhs;
+
+			memcpy(&fhs, re->fhscl->buf + pos, sizeof(fhs));
+			fhs->queued = false;
+		}
+
+		re->fhscl->pos = 0;
+		re->fhscl->end = 0;
+	}
+
 	re->events = mem_deref(re->events);
 #endif
 
@@ -538,6 +1391,10 @@ static void poll_close(struct re *re)
 
 	re->evlist = mem_deref(re->evlist);
 #endif
+
+#ifdef HAVE_IO_URING
+	uring_close(&re->uring);
+#endif
 }
 
 
@@ -655,15 +1512,32 @@ int fd_listen(struct re_fhs **fhsp, re_sock_t fd, int flags, fd_h fh,
 		break;
 #endif
 
+#ifdef HAVE_IO_URING
+	case METHOD_IOURING:
+		err = set_uring_fds(re, fhs);
+		break;
+#endif
+
 	default:
 		err = ENOTSUP;
 		break;
 	}
 
 	if (err) {
-		mem_deref(fhs);
 		DEBUG_WARNING("fd_listen err: fd=%d flags=0x%02x (%m)\n", fd,
 			      flags, err);
+
+		/* A queued or armed poll request still refers to fhs, so it
+		 * is cancelled and freed after its completion */
+		if (fhs_inflight(re, fhs)) {
+			(void)fd_close(fhs);
+		}
+		else {
+			mem_deref(fhs);
+			--re->nfds;
+		}
+
+		*fhsp = NULL;
 	}
 	else {
 		*fhsp = fhs;
@@ -710,6 +1584,12 @@ struct re_fhs *fd_close(struct re_fhs *fhs)
 		break;
 #endif
 
+#ifdef HAVE_IO_URING
+	case METHOD_IOURING:
+		err = set_uring_fds(re, fhs);
+		break;
+#endif
+
 	default:
 		err = ENOTSUP;
 		break;
@@ -738,7 +1618,10 @@ struct re_fhs *fd_close(struct re_fhs *fhs)
  */
 static int fd_poll(struct re *re)
 {
-	const uint64_t to = tmr_next_timeout(re->tmrl);
+	bool prec;
+	const uint64_t expire = tmrl_next_expire_us(re->tmrl, &prec);
+	uint64_t to = 0;
+	uint64_t tick;
 	int i, n;
 	int nfds = re->nfds;
 	struct re_fhs *fhs = NULL;
@@ -746,7 +1629,17 @@ static int fd_poll(struct re *re)
 	fd_set rfds, wfds, efds;
 #endif
 
-	DEBUG_INFO("next timer: %llu ms\n", to);
+	/* Timeout in [us], 0 for infinite */
+	if (expire) {
+		tick = tmr_jiffies_usec();
+		to = expire > tick ? expire - tick : 1;
+	}
+
+	DEBUG_INFO("next timer: %llu us\n", to);
+
+#ifdef HAVE_EPOLL
+	epoll_flush(re);
+#endif
 
 	/* Wait for I/O */
 	switch (re->method) {
@@ -787,11 +1680,11 @@ static int fd_poll(struct re *re)
 		nfds = re->maxfds;
 
 #ifdef WIN32
-		tv.tv_sec  = (long) to / 1000;
+		tv.tv_sec  = (long) (to / 1000000);
 #else
-		tv.tv_sec  = (time_t) to / 1000;
+		tv.tv_sec  = (time_t) (to / 1000000);
 #endif
-		tv.tv_usec = (uint32_t) (to % 1000) * 1000;
+		tv.tv_usec = (uint32_t) (to % 1000000);
 
 		re_unlock(re);
 		n = select(max_fd_plus_1, &rfds, &wfds, &efds,
@@ -801,11 +1694,29 @@ static int fd_poll(struct re *re)
 		break;
 #endif
 #ifdef HAVE_EPOLL
-	case METHOD_EPOLL:
+	case METHOD_EPOLL: {
+		int ms = to ? (int)min((to + 999) / 1000, (uint64_t)INT_MAX)
+			    : -1;
+
+#ifdef HAVE_TIMERFD
+		if (prec && timerfd_arm(re, expire, to))
+			ms = -1;
+#else
+		(void)prec;
+#endif
+
 		re_unlock(re);
-		n = epoll_wait(re->epfd, re->events, re->maxfds,
-			       to ? (int)to : -1);
+		n = busy_poll(re, to);
+		if (n == 0) {
+			tick = busy_tick(re);
+			n = epoll_wait(re->epfd, re->events, re->maxfds, ms);
+			busy_blocked(re, tick);
+		}
 		re_lock(re);
+
+		/* The timerfd may add one event to the fds */
+		nfds = n;
+	}
 		break;
 #endif
 
@@ -813,8 +1724,8 @@ static int fd_poll(struct re *re)
 	case METHOD_KQUEUE: {
 		struct timespec timeout;
 
-		timeout.tv_sec = (time_t) (to / 1000);
-		timeout.tv_nsec = (to % 1000) * 1000000;
+		timeout.tv_sec = (time_t) (to / 1000000);
+		timeout.tv_nsec = (to % 1000000) * 1000;
 
 		re_unlock(re);
 		n = kevent(re->kqfd, NULL, 0, re->evlist, re->maxfds,
@@ -824,6 +1735,13 @@ static int fd_poll(struct re *re)
 		break;
 #endif
 
+#ifdef HAVE_IO_URING
+	case METHOD_IOURING:
+		n = uring_wait(re, to);
+		nfds = n;
+		break;
+#endif
+
 	default:
 		(void)to;
 		DEBUG_WARNING("no polling method set\n");
@@ -833,6 +1751,10 @@ static int fd_poll(struct re *re)
 	if (n < 0)
 		return RE_ERRNO_SOCK;
 
+	tick = tmr_jiffies_usec();
+	re->wake_us = tick;
+	hstats_add(re->hstats, RE_HSTAT_EVENTS, NULL, (uint64_t)n);
+
 	/* Check for events */
 	for (i=0; (n > 0) && (i < nfds); i++) {
 		re_sock_t fd;
@@ -858,6 +1780,12 @@ static int fd_poll(struct re *re)
 #ifdef HAVE_EPOLL
 		case METHOD_EPOLL:
 			fhs = re->events[i].data.ptr;
+#ifdef HAVE_TIMERFD
+			if (!fhs) {
+				timerfd_drain(re);
+				break;
+			}
+#endif
 			fd = fhs->fd;
 
 			if (re->events[i].events & EPOLLIN)
@@ -871,6 +1799,10 @@ static int fd_poll(struct re *re)
 				DEBUG_WARNING("epoll: no flags fd=%d\n", fd);
 			}
 
+			/* Registration may lag behind with the change list */
+			if (re->fhscl)
+				flags &= fhs->flags | FD_EXCEPT;
+
 			break;
 #endif
 
@@ -907,6 +1839,12 @@ static int fd_poll(struct re *re)
 			break;
 #endif
 
+#ifdef HAVE_IO_URING
+		case METHOD_IOURING:
+			fhs = uring_event(re, &re->uring.events[i], &flags);
+			break;
+#endif
+
 		default:
 			return EINVAL;
 		}
@@ -914,18 +1852,22 @@ static int fd_poll(struct re *re)
 		if (!flags)
 			continue;
 
-		if (fhs && fhs->fh) {
-#if MAIN_DEBUG
-			fd_handler(fhs, flags);
-#else
-			fhs->fh(flags, fhs->arg);
+		if (fhs && fhs->fh)
+			fd_handler(re, fhs, flags, &tick);
+
+#ifdef HAVE_IO_URING
+		if (fhs && re->method == METHOD_IOURING)
+			uring_rearm(re, fhs);
 #endif
-		}
 
 		/* Handle only active events */
 		--n;
 	}
 
+#ifdef HAVE_EPOLL
+	epoll_flush(re);
+#endif
+
 	/* Delayed fhs deref to avoid dangling fhs pointers */
 	fhsld_flush(re);
 
@@ -983,6 +1925,166 @@ int fd_setsize(int maxfds)
 }
 
 
+/**
+ * Enable or disable the epoll change list of the current thread. When
+ * enabled, interest changes made by fd_listen() are recorded and applied
+ * once per polling iteration, so toggling a flag back and forth costs at
+ * most one epoll_ctl() call. Removals are always applied at once.
+ *
+ * @param enable True to enable, false to disable
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int fd_changelist_set(bool enable)
+{
+	struct re *re = re_get();
+
+	if (!re) {
+		DEBUG_WARNING("fd_changelist_set: re not ready\n");
+		return EINVAL;
+	}
+
+#ifdef HAVE_EPOLL
+	if (enable) {
+		if (re->fhscl)
+			return 0;
+
+		re->fhscl = mbuf_alloc(64 * sizeof(void *));
+		if (!re->fhscl)
+			return ENOMEM;
+	}
+	else if (re->fhscl) {
+		epoll_flush(re);
+		re->fhscl = mem_deref(re->fhscl);
+	}
+
+	return 0;
+#else
+	return enable ? ENOSYS : 0;
+#endif
+}
+
+
+/**
+ * Set the busy-poll budget of the current thread. Before blocking, the
+ * main loop polls without waiting for up to this long, trading CPU time
+ * for lower wake-up latency. UDP sockets attached to the loop afterwards
+ * get SO_BUSY_POLL with the same value. Used by epoll and io_uring.
+ *
+ * @param usec Busy-poll time in [us], 0 to disable
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_busy_poll_set(uint32_t usec)
+{
+	struct re *re = re_get();
+
+	if (!re) {
+		DEBUG_WARNING("re_busy_poll_set: re not ready\n");
+		return EINVAL;
+	}
+
+	re->busy_us = usec;
+
+	return 0;
+}
+
+
+/**
+ * Get the busy-poll budget of the current thread
+ *
+ * @return Busy-poll time in [us], 0 if disabled
+ */
+uint32_t re_busy_poll_get(void)
+{
+	struct re *re = re_get();
+
+	return re ? re->busy_us : 0;
+}
+
+
+/**
+ * Get the time the current thread's main loop spent busy-polling and
+ * blocked, accounted while busy-polling is enabled
+ *
+ * @param spin_us  Returned busy-poll time in [us] (optional)
+ * @param block_us Returned blocking time in [us] (optional)
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_busy_poll_stats(uint64_t *spin_us, uint64_t *block_us)
+{
+	struct re *re = re_get();
+
+	if (!re)
+		return EINVAL;
+
+	if (spin_us)
+		*spin_us = re->spin_us;
+	if (block_us)
+		*block_us = re->block_us;
+
+	return 0;
+}
+
+
+/**
+ * Apply a handler to the handler statistics of the current thread. Entries
+ * without samples are skipped.
+ *
+ * @param h   Apply handler
+ * @param arg Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_hstat_apply(re_hstat_h *h, void *arg)
+{
+	struct re *re = re_get();
+
+	if (!re || !h)
+		return EINVAL;
+
+	if (!re->hstats)
+		return 0;
+
+	return hstats_apply(re->hstats, h, arg);
+}
+
+
+/**
+ * Reset the handler statistics of the current thread
+ */
+void re_hstat_reset(void)
+{
+	struct re *re = re_get();
+
+	if (!re)
+		return;
+
+	hstats_reset(re->hstats);
+}
+
+
+/**
+ * Add a sample to the handler statistics of the current thread
+ *
+ * @param type Statistics type
+ * @param h    Handler function (optional)
+ * @param val  Sample value, duration in [us] or number of events
+ *
+ * @note used by tmr module
+ */
+void re_hstat_add(enum re_hstat_type type, re_fn_h *h, uint64_t val)
+{
+	struct re *re = re_get();
+
+	if (!re)
+		return;
+
+	hstats_add(re->hstats, type, h, val);
+}
+
+
 #ifdef HAVE_SIGNAL
 /* Thread-safe signal handling */
 static void signal_handler(int sig)
@@ -1038,6 +2140,10 @@ int re_main(re_signal_h *signalh)
 	DEBUG_INFO("Using async I/O polling method: `%s'\n",
 		   poll_method_name(re->method));
 
+	/* Statistics are best effort, polling works without them */
+	if (!re->hstats)
+		(void)hstats_alloc(&re->hstats);
+
 	re_atomic_rlx_set(&re->polling, true);
 
 	re_lock(re);
@@ -1077,6 +2183,9 @@ int re_main(re_signal_h *signalh)
 		}
 
 		tmr_poll(re->tmrl);
+
+		hstats_add(re->hstats, RE_HSTAT_LOOP, NULL,
+			   tmr_jiffies_usec() - re->wake_us);
 	}
 	re_unlock(re);
 
@@ -1137,6 +2246,15 @@ int re_debug(struct re_printf *pf, void *unused)
 	err |= re_hprintf(pf, "  thread_enter: %d\n",
 			  re_atomic_rlx(&re->thread_enter));
 	err |= re_hprintf(pf, "  async:        %p\n", re->async);
+#ifdef HAVE_EPOLL
+	err |= re_hprintf(pf, "  changelist:   %s\n",
+			  re->fhscl ? "on" : "off");
+#endif
+	err |= re_hprintf(pf, "  busy_poll:    %u us (spin %llu us,"
+			  " blocked %llu us)\n", re->busy_us,
+			  re->spin_us, re->block_us);
+	err |= hstats_debug(pf, re->hstats);
+	err |= thread_debug(pf, NULL);
 
 	return err;
 }
@@ -1168,6 +2286,26 @@ enum poll_method poll_method_get(void)
 }
 
 
+/**
+ * Fail the next submission of the polling backend of the current thread.
+ * This is only used for debugging and failure simulation, currently only
+ * io_uring submits requests.
+ *
+ * @param err Error code returned by the next submission, 0 to clear
+ */
+void poll_fault_set(int err)
+{
+#ifdef HAVE_IO_URING
+	struct re *re = re_get();
+
+	if (re)
+		re->uring.fault = err;
+#else
+	(void)err;
+#endif
+}
+
+
 /**
  * Set async I/O polling method. This function can only called once, before
  * poll init/setup.
@@ -1212,6 +2350,12 @@ int poll_method_set(enum poll_method method)
 #ifdef HAVE_KQUEUE
 	case METHOD_KQUEUE:
 		break;
+#endif
+#ifdef HAVE_IO_URING
+	case METHOD_IOURING:
+		if (!poll_uring_supported())
+			return ENOSYS;
+		break;
 #endif
 	default:
 		DEBUG_WARNING("poll method not supported: '%s'\n",
@@ -1615,6 +2759,33 @@ int re_thread_async_main_id(intptr_t id, re_async_work_h *work, re_async_h *cb,
 }
 
 
+/**
+ * Allocate an async job graph for current event loop
+ *
+ * @param graphp  Pointer to allocated graph
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_thread_async_graph(struct re_async_graph **graphp)
+{
+	struct re *re = re_get();
+	int err;
+
+	if (unlikely(!re)) {
+		DEBUG_WARNING("re_thread_async_graph: re not ready\n");
+		return EAGAIN;
+	}
+
+	if (unlikely(!re->async)) {
+		err = re_async_alloc(&re->async, RE_THREAD_WORKERS);
+		if (err)
+			return err;
+	}
+
+	return re_async_graph_alloc(graphp, re->async);
+}
+
+
 /**
  * Cancel pending async work and callback
  *
@@ -13,6 +13,20 @@ extern "C" {
 int  openssl_init(void);
 #endif
 
+#ifdef HAVE_IO_URING
+bool poll_uring_supported(void);
+#endif
+
+struct re_hstats;
+
+int  hstats_alloc(struct re_hstats **hsp);
+void hstats_reset(struct re_hstats *hs);
+void hstats_add(struct re_hstats *hs, enum re_hstat_type type, re_fn_h *h,
+		uint64_t val);
+int  hstats_apply(const struct re_hstats *hs, re_hstat_h *h, void *arg);
+int  hstats_debug(struct re_printf *pf, const struct re_hstats *hs);
+void re_hstat_add(enum re_hstat_type type, re_fn_h *h, uint64_t val);
+
 #ifdef __cplusplus
 }
 #endif
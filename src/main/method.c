@@ -14,6 +14,7 @@
 static const char str_select[] = "select";   /**< POSIX.1-2001 select     */
 static const char str_epoll[]  = "epoll";    /**< Linux epoll             */
 static const char str_kqueue[] = "kqueue";
+static const char str_iouring[] = "io_uring"; /**< Linux io_uring        */
 
 
 /**
@@ -23,6 +24,12 @@ static const char str_kqueue[] = "kqueue";
  */
 enum poll_method poll_method_best(void)
 {
+#ifdef HAVE_IO_URING
+	/* Supported from Linux 5.11, may be disabled by seccomp/sysctl */
+	if (poll_uring_supported())
+		return METHOD_IOURING;
+#endif
+
 #ifdef HAVE_EPOLL
 	/* Supported from Linux 2.5.66 */
 	return METHOD_EPOLL;
@@ -54,6 +61,7 @@ const char *poll_method_name(enum poll_method method)
 	case METHOD_SELECT:    return str_select;
 	case METHOD_EPOLL:     return str_epoll;
 	case METHOD_KQUEUE:    return str_kqueue;
+	case METHOD_IOURING:   return str_iouring;
 	default:               return "???";
 	}
 }
@@ -78,6 +86,8 @@ int poll_method_type(enum poll_method *method, const struct pl *name)
 		*method = METHOD_EPOLL;
 	else if (0 == pl_strcasecmp(name, str_kqueue))
 		*method = METHOD_KQUEUE;
+	else if (0 == pl_strcasecmp(name, str_iouring))
+		*method = METHOD_IOURING;
 	else
 		return ENOENT;
 
@@ -8,6 +8,8 @@
 #endif
 #include <openssl/ssl.h>
 #include <re/re_types.h>
+#include <re/re_fmt.h>
+#include <re/re_main.h>
 #include "main.h"
 
 
@@ -0,0 +1,136 @@
+/**
+ * @file mbuf/chain.c  Chain of memory buffer segments
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re/re_types.h>
+#include <re/re_mem.h>
+#include <re/re_mbuf.h>
+
+
+/**
+ * Initialize an empty memory buffer chain
+ *
+ * @param ch Memory buffer chain
+ */
+void mbuf_chain_init(struct mbuf_chain *ch)
+{
+	if (!ch)
+		return;
+
+	ch->segc = 0;
+	ch->len  = 0;
+}
+
+
+/**
+ * Reset a memory buffer chain and release all of its buffers
+ *
+ * @param ch Memory buffer chain
+ */
+void mbuf_chain_reset(struct mbuf_chain *ch)
+{
+	if (!ch)
+		return;
+
+	while (ch->segc)
+		mem_deref(ch->segv[--ch->segc].mb);
+
+	ch->len = 0;
+}
+
+
+static void seg_set(struct mbuf_chain *ch, struct mbuf_seg *seg,
+		    struct mbuf *mb)
+{
+	seg->mb  = mem_ref(mb);
+	seg->pos = mb->pos;
+	seg->end = mb->end;
+
+	++ch->segc;
+	ch->len += mb->end - mb->pos;
+}
+
+
+/**
+ * Append the unread part of a memory buffer to a chain. The chain takes a
+ * reference to the buffer, which must not be changed while it is chained.
+ *
+ * @param ch Memory buffer chain
+ * @param mb Memory buffer
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mbuf_chain_append(struct mbuf_chain *ch, struct mbuf *mb)
+{
+	if (!ch || !mb)
+		return EINVAL;
+
+	if (ch->segc >= MBUF_CHAIN_MAX)
+		return ENOSPC;
+
+	seg_set(ch, &ch->segv[ch->segc], mb);
+
+	return 0;
+}
+
+
+/**
+ * Prepend the unread part of a memory buffer to a chain, e.g. a protocol
+ * header in front of the payload
+ *
+ * @param ch Memory buffer chain
+ * @param mb Memory buffer
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mbuf_chain_prepend(struct mbuf_chain *ch, struct mbuf *mb)
+{
+	if (!ch || !mb)
+		return EINVAL;
+
+	if (ch->segc >= MBUF_CHAIN_MAX)
+		return ENOSPC;
+
+	memmove(&ch->segv[1], &ch->segv[0], ch->segc * sizeof(ch->segv[0]));
+
+	seg_set(ch, &ch->segv[0], mb);
+
+	return 0;
+}
+
+
+/**
+ * Write all segments of a memory buffer chain to a memory buffer
+ *
+ * @param mb Memory buffer
+ * @param ch Memory buffer chain
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mbuf_write_chain(struct mbuf *mb, const struct mbuf_chain *ch)
+{
+	size_t i;
+	int err;
+
+	if (!mb || !ch)
+		return EINVAL;
+
+	if (mb->pos + ch->len > mb->size) {
+		err = mbuf_resize(mb, mb->pos + ch->len);
+		if (err)
+			return err;
+	}
+
+	for (i = 0; i < ch->segc; i++) {
+		const struct mbuf_seg *seg = &ch->segv[i];
+
+		err = mbuf_write_mem(mb, seg->mb->buf + seg->pos,
+				     seg->end - seg->pos);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
@@ -103,6 +103,37 @@ struct mbuf *mbuf_alloc_ref(struct mbuf *mbr)
 }
 
 
+/**
+ * Allocate a read-only view of the next bytes of another mbuf. The view
+ * shares the buffer memory and ends after the given length, so it cannot
+ * read past its window. Writing beyond the window copies the buffer,
+ * while bytes inside the window must not be changed.
+ *
+ * @param mbr Memory buffer to reference
+ * @param len Number of bytes from the current position
+ *
+ * @return New memory buffer, NULL if no memory or out of bounds
+ */
+struct mbuf *mbuf_alloc_slice(struct mbuf *mbr, size_t len)
+{
+	struct mbuf *mb;
+
+	if (!mbr || len > mbuf_get_left(mbr))
+		return NULL;
+
+	mb = mem_zalloc(sizeof(*mb), mbuf_destructor);
+	if (!mb)
+		return NULL;
+
+	mb->buf  = mem_ref(mbr->buf);
+	mb->pos  = mbr->pos;
+	mb->end  = mbr->pos + len;
+	mb->size = mb->end;
+
+	return mb;
+}
+
+
 /**
  * Initialize a memory buffer
  *
@@ -0,0 +1,228 @@
+/**
+ * @file mbuf/pool.c  Pool of fixed-size memory buffers
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re/re_types.h>
+#include <re/re_list.h>
+#include <re/re_mem.h>
+#include <re/re_mbuf.h>
+#include <re/re_thread.h>
+
+
+/*
+ * Pooled buffers are memory objects with their own destructor. On the last
+ * mem_deref() the destructor puts the buffer back on the free list and
+ * takes a new reference, which keeps the object alive. Buffers that were
+ * resized or share their memory are freed instead.
+ *
+ * The free list lives in a shared core, referenced by the pool handle and
+ * by every buffer, so buffers may outlive the pool.
+ */
+
+struct pool_core {
+	struct list freel;     /**< Free buffers              */
+	mtx_t *lock;           /**< Protects the free list    */
+	size_t bufsz;          /**< Buffer size               */
+	size_t max;            /**< Maximum free buffers      */
+	size_t nfree;          /**< Number of free buffers    */
+	bool closed;           /**< Pool handle is gone       */
+};
+
+struct mbuf_pool {
+	struct pool_core *core;
+};
+
+struct pool_mbuf {
+	struct mbuf mb;        /**< Must be first             */
+	struct le le;          /**< Member of the free list   */
+	struct pool_core *core;
+};
+
+
+static void core_destructor(void *arg)
+{
+	struct pool_core *core = arg;
+
+	mem_deref(core->lock);
+}
+
+
+static void pool_destructor(void *arg)
+{
+	struct mbuf_pool *pool = arg;
+	struct pool_core *core = pool->core;
+
+	if (!core || !core->lock) {
+		mem_deref(core);
+		return;
+	}
+
+	mtx_lock(core->lock);
+	core->closed = true;
+	mtx_unlock(core->lock);
+
+	/* Buffers are freed by their destructor now */
+	for (;;) {
+		struct pool_mbuf *pm;
+
+		mtx_lock(core->lock);
+		pm = list_ledata(list_head(&core->freel));
+		if (pm) {
+			list_unlink(&pm->le);
+			--core->nfree;
+		}
+		mtx_unlock(core->lock);
+
+		if (!pm)
+			break;
+
+		mem_deref(pm);
+	}
+
+	mem_deref(core);
+}
+
+
+static void mbuf_destructor(void *arg)
+{
+	struct pool_mbuf *pm = arg;
+	struct pool_core *core = pm->core;
+
+	mtx_lock(core->lock);
+
+	if (!core->closed && core->nfree < core->max &&
+	    pm->mb.size == core->bufsz && mem_nrefs(pm->mb.buf) == 1) {
+
+		pm->mb.pos = 0;
+		pm->mb.end = 0;
+
+		list_append(&core->freel, &pm->le, pm);
+		++core->nfree;
+		mem_ref(pm);
+
+		mtx_unlock(core->lock);
+		return;
+	}
+
+	mtx_unlock(core->lock);
+
+	mem_deref(pm->mb.buf);
+	mem_deref(core);
+}
+
+
+/**
+ * Allocate a pool of fixed-size memory buffers
+ *
+ * @param poolp Pointer to allocated pool
+ * @param bufsz Buffer size in [bytes]
+ * @param max   Maximum number of free buffers kept in the pool
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mbuf_pool_alloc(struct mbuf_pool **poolp, size_t bufsz, size_t max)
+{
+	struct mbuf_pool *pool;
+	struct pool_core *core;
+	int err;
+
+	if (!poolp || !bufsz)
+		return EINVAL;
+
+	pool = mem_zalloc(sizeof(*pool), pool_destructor);
+	if (!pool)
+		return ENOMEM;
+
+	core = mem_zalloc(sizeof(*core), core_destructor);
+	if (!core) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	pool->core = core;
+
+	err = mutex_alloc(&core->lock);
+	if (err)
+		goto out;
+
+	core->bufsz = bufsz;
+	core->max   = max;
+
+ out:
+	if (err)
+		mem_deref(pool);
+	else
+		*poolp = pool;
+
+	return err;
+}
+
+
+/**
+ * Get a memory buffer from a pool. The buffer goes back to the pool when
+ * it is dereferenced for the last time.
+ *
+ * @param pool Memory buffer pool
+ *
+ * @return Empty memory buffer of the pool size, NULL if no memory
+ */
+struct mbuf *mbuf_pool_get(struct mbuf_pool *pool)
+{
+	struct pool_core *core;
+	struct pool_mbuf *pm;
+
+	if (!pool)
+		return NULL;
+
+	core = pool->core;
+
+	mtx_lock(core->lock);
+	pm = list_ledata(list_head(&core->freel));
+	if (pm) {
+		list_unlink(&pm->le);
+		--core->nfree;
+	}
+	mtx_unlock(core->lock);
+
+	if (pm)
+		return &pm->mb;
+
+	pm = mem_zalloc(sizeof(*pm), NULL);
+	if (!pm)
+		return NULL;
+
+	pm->mb.buf = mem_alloc(core->bufsz, NULL);
+	if (!pm->mb.buf)
+		return mem_deref(pm);
+
+	pm->mb.size = core->bufsz;
+	pm->core    = mem_ref(core);
+
+	mem_destructor(pm, mbuf_destructor);
+
+	return &pm->mb;
+}
+
+
+/**
+ * Get the number of free buffers in a pool
+ *
+ * @param pool Memory buffer pool
+ *
+ * @return Number of free buffers
+ */
+size_t mbuf_pool_count(const struct mbuf_pool *pool)
+{
+	size_t n;
+
+	if (!pool)
+		return 0;
+
+	mtx_lock(pool->core->lock);
+	n = pool->core->nfree;
+	mtx_unlock(pool->core->lock);
+
+	return n;
+}
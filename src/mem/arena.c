@@ -0,0 +1,162 @@
+/**
+ * @file mem/arena.c  Arena for memory objects with a common lifetime
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <re/re_types.h>
+#include <re/re_mem.h>
+#include "mem.h"
+
+
+/*
+ * An arena hands out blocks from large chunks, in address order. The first
+ * chunk is allocated together with the arena. Each block is prefixed with
+ * its arena and holds a reference to it, so the chunks are freed when the
+ * arena handle and all objects of the arena are gone. Freeing a single
+ * object does not return its space to the arena.
+ */
+
+enum {
+	ARENA_ALIGN = 16,            /**< Block alignment             */
+	ARENA_MIN   = 256,           /**< Minimum chunk size          */
+	ARENA_MAX   = 64 * 1024,     /**< Maximum chunk growth        */
+};
+
+/** Chunk header, must keep blocks aligned */
+struct chunk {
+	struct chunk *next;
+};
+
+/** Block prefix, must keep blocks aligned */
+struct ablk {
+	struct mem_arena *arena;
+};
+
+/** Defines a memory arena */
+struct mem_arena {
+	struct chunk *chunkl;        /**< Allocated chunks            */
+	uint8_t *pos;                /**< Next free byte              */
+	uint8_t *end;                /**< End of current chunk        */
+	size_t csize;                /**< Size of next chunk          */
+};
+
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+enum {
+	ARENA_HDR = ARENA_ROUND(sizeof(struct mem_arena)),
+	CHUNK_HDR = ARENA_ROUND(sizeof(struct chunk)),
+	ABLK_HDR  = ARENA_ROUND(sizeof(struct ablk)),
+};
+
+
+static void arena_destructor(void *arg)
+{
+	struct mem_arena *arena = arg;
+
+	while (arena->chunkl) {
+		struct chunk *c = arena->chunkl;
+
+		arena->chunkl = c->next;
+		free(c);
+	}
+}
+
+
+static int chunk_add(struct mem_arena *arena, size_t need)
+{
+	size_t size = max(arena->csize, CHUNK_HDR + need);
+	struct chunk *c;
+
+	c = malloc(size);
+	if (!c)
+		return ENOMEM;
+
+	c->next = arena->chunkl;
+	arena->chunkl = c;
+
+	arena->pos = (uint8_t *)c + CHUNK_HDR;
+	arena->end = (uint8_t *)c + size;
+
+	arena->csize = min(2 * arena->csize, (size_t)ARENA_MAX);
+
+	return 0;
+}
+
+
+/**
+ * Allocate a memory arena. Objects are allocated from the arena with
+ * mem_arena_zalloc() and freed with mem_deref() as usual, but their storage
+ * is only released when the arena and all of its objects are dereferenced.
+ *
+ * @param arenap Pointer to allocated arena
+ * @param size   Size of the first chunk in [bytes], allocated with the arena
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note An arena must only be used by one thread at a time. Objects of
+ *       the arena may be dereferenced from any thread.
+ */
+int mem_arena_alloc(struct mem_arena **arenap, size_t size)
+{
+	struct mem_arena *arena;
+
+	if (!arenap)
+		return EINVAL;
+
+	size = max(size, (size_t)ARENA_MIN);
+
+	arena = mem_alloc(ARENA_HDR + size, arena_destructor);
+	if (!arena)
+		return ENOMEM;
+
+	arena->chunkl = NULL;
+	arena->pos    = (uint8_t *)arena + ARENA_HDR;
+	arena->end    = arena->pos + size;
+	arena->csize  = 2 * size;
+
+	*arenap = arena;
+
+	return 0;
+}
+
+
+/**
+ * Allocate a block from an arena
+ *
+ * @param arena Memory arena
+ * @param size  Block size, including the memory object header
+ *
+ * @return Pointer to block, NULL if no memory
+ */
+void *mem_arena_get(struct mem_arena *arena, size_t size)
+{
+	struct ablk *b;
+	size_t need;
+
+	need = ARENA_ROUND(ABLK_HDR + size);
+
+	if ((size_t)(arena->end - arena->pos) < need &&
+	    chunk_add(arena, need))
+		return NULL;
+
+	b = (void *)arena->pos;
+	arena->pos += need;
+
+	b->arena = mem_ref(arena);
+
+	return (uint8_t *)b + ABLK_HDR;
+}
+
+
+/**
+ * Release a block of an arena
+ *
+ * @param p Block from mem_arena_get()
+ */
+void mem_arena_put(void *p)
+{
+	struct ablk *b = (void *)((uint8_t *)p - ABLK_HDR);
+
+	mem_deref(b->arena);
+}
@@ -14,6 +14,7 @@
 #include <re/re_btrace.h>
 #include <re/re_thread.h>
 #include <re/re_atomic.h>
+#include "mem.h"
 
 
 #define DEBUG_MODULE "mem"
@@ -29,71 +30,84 @@
 /** Defines a reference-counting memory object */
 struct mem {
 	RE_ATOMIC uint32_t nrefs; /**< Number of references  */
-	uint32_t size;         /**< Size of memory object */
+	uint32_t sizef;        /**< Size and MEM_FLAGS    */
 	mem_destroy_h *dh;     /**< Destroy handler       */
 #if MEM_DEBUG
 	size_t magic;          /**< Magic number          */
 	struct le le;          /**< Linked list element   */
 	struct btrace btraces; /**< Backtrace array       */
+	thrd_t owner;          /**< Allocating thread     */
 #endif
 };
 
+/*
+ * The flags take the top bits of the size word, so the object header stays
+ * at 16 bytes. Use mem_size() and mem_flags() to read the word.
+ */
+
+/** Flag of memory objects allocated from a pool */
+#define MEM_POOLED  0x80000000u
+
+/** Flag of memory objects allocated from an arena */
+#define MEM_ARENA   0x40000000u
+
+/** Flag of memory objects sampled by the heap profiler */
+#define MEM_SAMPLED 0x20000000u
+
+/** Flag of memory objects confined to the allocating thread */
+#define MEM_LOCAL   0x10000000u
+
+#define MEM_FLAGS   (MEM_POOLED | MEM_ARENA | MEM_SAMPLED | MEM_LOCAL)
+#define MEM_SIZE_MASK (~MEM_FLAGS)
+
+#if !MEM_DEBUG
+_Static_assert(sizeof(struct mem) <= 16, "struct mem exceeds 16 bytes");
+#endif
+
 #if MEM_DEBUG
 /* Memory debugging */
-static struct list meml = LIST_INIT;
-static const size_t mem_magic = 0xe7fb9ac4;
-static ssize_t threshold = -1;  /**< Memory threshold, disabled by default */
-
-static struct memstat memstat = {
-	0,0,0,0
+enum {
+	MEM_SHARDS = 16,        /**< Number of registry shards, power of 2 */
+	CACHE_LINE = 128,       /**< Shard size, covers a cache line       */
 };
 
-static once_flag flag = ONCE_FLAG_INIT;
-static mtx_t mtx;
+/**
+ * Shard of the registry of live objects. Objects are assigned to a shard
+ * by address, so threads allocating and freeing memory rarely contend for
+ * the same lock.
+ */
+struct mem_shard {
+	mtx_t mtx;                    /**< Protects the shard          */
+	struct list meml;             /**< Live memory objects         */
+};
 
-static void mem_lock_init(void)
-{
-	mtx_init(&mtx, mtx_plain);
-}
+static union {
+	struct mem_shard s;
+	uint8_t pad[CACHE_LINE];
+} shardv[MEM_SHARDS];
 
-static inline void mem_lock(void)
-{
-	call_once(&flag, mem_lock_init);
+static const size_t mem_magic = 0xe7fb9ac4;
+/** Memory threshold, disabled by default */
+static RE_ATOMIC ssize_t threshold = -1;
+static RE_ATOMIC size_t bytes_cur;
+static RE_ATOMIC size_t blocks_cur;
+static RE_ATOMIC size_t bytes_peak;
+static RE_ATOMIC size_t blocks_peak;
 
-	mtx_lock(&mtx);
-}
+static once_flag flag = ONCE_FLAG_INIT;
 
-static inline void mem_unlock(void)
+static void mem_lock_init(void)
 {
-	mtx_unlock(&mtx);
+	for (size_t i = 0; i < MEM_SHARDS; i++)
+		mtx_init(&shardv[i].s.mtx, mtx_plain);
 }
 
-/** Update statistics for mem_zalloc() */
-#define STAT_ALLOC(_m, _size) \
-	mem_lock(); \
-	memstat.bytes_cur += (_size); \
-	memstat.bytes_peak = max(memstat.bytes_cur, memstat.bytes_peak); \
-	++memstat.blocks_cur; \
-	memstat.blocks_peak = max(memstat.blocks_cur, memstat.blocks_peak); \
-	mem_unlock(); \
-	(_m)->size = (uint32_t)(_size); \
-	(_m)->magic = mem_magic;
-
 /** Update statistics for mem_realloc() */
-#define STAT_REALLOC(_m, _size) \
-	mem_lock(); \
-	memstat.bytes_cur += ((_size) - (_m)->size); \
-	memstat.bytes_peak = max(memstat.bytes_cur, memstat.bytes_peak); \
-	mem_unlock(); \
-	(_m)->size = (uint32_t)(_size)
-
-/** Update statistics for mem_deref() */
+#define STAT_REALLOC(_m, _size) mem_resize((_m), (_size))
+
+/** Poison memory of a dereferenced object */
 #define STAT_DEREF(_m) \
-	mem_lock(); \
-	memstat.bytes_cur -= (_m)->size; \
-	--memstat.blocks_cur; \
-	mem_unlock(); \
-	memset((_m), 0xb5, (size_t)mem_header_size + (_m)->size)
+	memset((_m), 0xb5, (size_t)mem_header_size + mem_size(_m))
 
 /** Check magic number in memory object */
 #define MAGIC_CHECK(_m) \
@@ -102,11 +116,20 @@ static inline void mem_unlock(void)
 			__func__, (_m)->magic, get_mem_data((_m)));    \
 		RE_BREAKPOINT;					      \
 	}
+
+/** Check that a local memory object is used by its owner thread */
+#define LOCAL_CHECK(_m) \
+	if ((mem_flags(_m) & MEM_LOCAL) && \
+	    !thrd_equal((_m)->owner, thrd_current())) { \
+		DEBUG_WARNING("%s: local object used by other thread (%p)\n",\
+			__func__, get_mem_data((_m)));			      \
+		re_assert(0 && "mem: local object used by other thread");    \
+	}
 #else
-#define STAT_ALLOC(_m, _size) (_m)->size = (uint32_t)(_size);
-#define STAT_REALLOC(_m, _size) (_m)->size = (uint32_t)(_size);
+#define STAT_REALLOC(_m, _size) mem_size_set((_m), (_size))
 #define STAT_DEREF(_m)
 #define MAGIC_CHECK(_m)
+#define LOCAL_CHECK(_m)
 #endif
 
 
@@ -122,9 +145,140 @@ enum {
 		(~(size_t)alignment_mask)
 };
 
-#define MEM_SIZE_MAX \
-	(size_t)(sizeof(size_t) > sizeof(uint32_t) ? \
-		(~(uint32_t)0u) : (~(size_t)0u) - mem_header_size)
+#define MEM_SIZE_MAX (size_t)(MEM_SIZE_MASK - mem_header_size)
+
+
+static inline uint32_t mem_size(const struct mem *m)
+{
+	return m->sizef & MEM_SIZE_MASK;
+}
+
+
+static inline uint32_t mem_flags(const struct mem *m)
+{
+	return m->sizef & MEM_FLAGS;
+}
+
+
+static inline void mem_size_set(struct mem *m, size_t size)
+{
+	m->sizef = (uint32_t)size | mem_flags(m);
+}
+
+
+#if MEM_DEBUG
+static inline struct mem_shard *mem_shard(const struct mem *m)
+{
+	const uint32_t a = (uint32_t)((uintptr_t)m >> 4);
+
+	call_once(&flag, mem_lock_init);
+
+	return &shardv[((a * 2654435761u) >> 28) & (MEM_SHARDS - 1)].s;
+}
+
+
+/* Read the current totals and their peaks */
+static void stat_get(struct memstat *stat)
+{
+	stat->bytes_cur   = re_atomic_rlx(&bytes_cur);
+	stat->blocks_cur  = re_atomic_rlx(&blocks_cur);
+	stat->bytes_peak  = max(stat->bytes_cur,  re_atomic_rlx(&bytes_peak));
+	stat->blocks_peak = max(stat->blocks_cur, re_atomic_rlx(&blocks_peak));
+}
+
+
+static void peak_set(RE_ATOMIC size_t *peak, size_t val)
+{
+	size_t cur = re_atomic_rlx(peak);
+
+	while (val > cur &&
+	       !re_atomic_compare_exchange_weak(peak, &cur, val,
+						re_memory_order_relaxed,
+						re_memory_order_relaxed))
+		;
+}
+
+
+/*
+ * The totals are running atomic sums. Every value a total takes is seen
+ * by the thread that produced it, so the peaks are exact.
+ */
+static void stat_add(ssize_t bytes, ssize_t blocks)
+{
+	const size_t b = re_atomic_rlx_add(&bytes_cur,  (size_t)bytes)
+		+ (size_t)bytes;
+	const size_t n = re_atomic_rlx_add(&blocks_cur, (size_t)blocks)
+		+ (size_t)blocks;
+
+	if (bytes > 0)
+		peak_set(&bytes_peak, b);
+
+	if (blocks > 0)
+		peak_set(&blocks_peak, n);
+}
+
+
+/* Add a memory object to the registry and the statistics */
+static void mem_link(struct mem *m)
+{
+	struct mem_shard *sh = mem_shard(m);
+
+	mtx_lock(&sh->mtx);
+	list_append(&sh->meml, &m->le, m);
+	mtx_unlock(&sh->mtx);
+
+	stat_add((ssize_t)mem_size(m), 1);
+}
+
+
+/* Remove a memory object from the registry and the statistics */
+static void mem_unlink(struct mem *m)
+{
+	struct mem_shard *sh = mem_shard(m);
+
+	mtx_lock(&sh->mtx);
+	list_unlink(&m->le);
+	mtx_unlock(&sh->mtx);
+
+	stat_add(-(ssize_t)mem_size(m), -1);
+}
+
+
+/* Resize a memory object in place */
+static void mem_resize(struct mem *m, size_t size)
+{
+	struct mem_shard *sh = mem_shard(m);
+
+	stat_add((ssize_t)size - (ssize_t)mem_size(m), 0);
+
+	mtx_lock(&sh->mtx);
+	mem_size_set(m, size);
+	mtx_unlock(&sh->mtx);
+}
+#endif
+
+
+/* Free the storage of a memory object, without calling the destructor */
+static void mem_free(struct mem *m)
+{
+	const uint32_t flags = mem_flags(m);
+
+	if (flags & MEM_SAMPLED)
+		mem_prof_free(m);
+
+#if MEM_DEBUG
+	mem_unlink(m);
+#endif
+
+	STAT_DEREF(m);
+
+	if (flags & MEM_POOLED)
+		mem_pool_free(m);
+	else if (flags & MEM_ARENA)
+		mem_arena_put(m);
+	else
+		free(m);
+}
 
 
 static inline struct mem *get_mem(void *p)
@@ -139,6 +293,66 @@ static inline void *get_mem_data(struct mem *m)
 }
 
 
+/* Simulate OOM */
+static inline bool mem_oom(void)
+{
+#if MEM_DEBUG
+	const ssize_t t = re_atomic_rlx(&threshold);
+	struct memstat stat;
+
+	if (-1 == t)
+		return false;
+
+	stat_get(&stat);
+
+	return stat.blocks_cur >= (size_t)t;
+#else
+	return false;
+#endif
+}
+
+
+static void *mem_init(struct mem *m, size_t size, mem_destroy_h *dh,
+		      uint32_t flags)
+{
+	re_atomic_rlx_set(&m->nrefs, 1u);
+	m->dh    = dh;
+	m->sizef = (uint32_t)size | flags;
+
+#if MEM_DEBUG
+	m->magic = mem_magic;
+	m->owner = thrd_current();
+	btrace(&m->btraces);
+	memset(&m->le, 0, sizeof(struct le));
+	mem_link(m);
+#endif
+
+	if (mem_prof_alloc(m, size))
+		m->sizef |= MEM_SAMPLED;
+
+	return get_mem_data(m);
+}
+
+
+static void *mem_alloc_flags(size_t size, mem_destroy_h *dh, uint32_t flags)
+{
+	struct mem *m;
+
+	if (size > MEM_SIZE_MAX || mem_oom())
+		return NULL;
+
+	m = mem_pool_alloc(mem_header_size + size);
+	if (m)
+		return mem_init(m, size, dh, flags | MEM_POOLED);
+
+	m = malloc(mem_header_size + size);
+	if (!m)
+		return NULL;
+
+	return mem_init(m, size, dh, flags);
+}
+
+
 /**
  * Allocate a new reference-counted memory object
  *
@@ -149,53 +363,64 @@ static inline void *get_mem_data(struct mem *m)
  */
 void *mem_alloc(size_t size, mem_destroy_h *dh)
 {
-	struct mem *m;
+	return mem_alloc_flags(size, dh, 0);
+}
 
-	if (size > MEM_SIZE_MAX)
-		return NULL;
 
-#if MEM_DEBUG
-	mem_lock();
-	if (-1 != threshold && (memstat.blocks_cur >= (size_t)threshold)) {
-		mem_unlock();
-		return NULL;
-	}
-	mem_unlock();
-#endif
+/**
+ * Allocate a new reference-counted memory object. Memory is zeroed.
+ *
+ * @param size Size of memory object
+ * @param dh   Optional destructor, called when destroyed
+ *
+ * @return Pointer to allocated object
+ */
+void *mem_zalloc(size_t size, mem_destroy_h *dh)
+{
+	void *p;
 
-	m = malloc(mem_header_size + size);
-	if (!m)
+	p = mem_alloc(size, dh);
+	if (!p)
 		return NULL;
 
-#if MEM_DEBUG
-	btrace(&m->btraces);
-	memset(&m->le, 0, sizeof(struct le));
-	mem_lock();
-	list_append(&meml, &m->le, m);
-	mem_unlock();
-#endif
-	re_atomic_rlx_set(&m->nrefs, 1u);
-	m->dh    = dh;
+	memset(p, 0, size);
 
-	STAT_ALLOC(m, size);
+	return p;
+}
 
-	return get_mem_data(m);
+
+/**
+ * Allocate a new reference-counted memory object, which is only used by
+ * the calling thread. References are counted without atomic operations.
+ *
+ * @param size Size of memory object
+ * @param dh   Optional destructor, called when destroyed
+ *
+ * @return Pointer to allocated object
+ *
+ * @note Debug builds assert that the object is not referenced,
+ *       dereferenced or resized by other threads
+ */
+void *mem_alloc_local(size_t size, mem_destroy_h *dh)
+{
+	return mem_alloc_flags(size, dh, MEM_LOCAL);
 }
 
 
 /**
- * Allocate a new reference-counted memory object. Memory is zeroed.
+ * Allocate a new reference-counted memory object, which is only used by
+ * the calling thread. Memory is zeroed.
  *
  * @param size Size of memory object
  * @param dh   Optional destructor, called when destroyed
  *
  * @return Pointer to allocated object
  */
-void *mem_zalloc(size_t size, mem_destroy_h *dh)
+void *mem_zalloc_local(size_t size, mem_destroy_h *dh)
 {
 	void *p;
 
-	p = mem_alloc(size, dh);
+	p = mem_alloc_local(size, dh);
 	if (!p)
 		return NULL;
 
@@ -205,6 +430,41 @@ void *mem_zalloc(size_t size, mem_destroy_h *dh)
 }
 
 
+/**
+ * Allocate a new reference-counted memory object from an arena. Memory is
+ * zeroed. The object is dereferenced as usual, but its storage is only
+ * released together with the arena.
+ *
+ * @param arena Memory arena, NULL to use mem_zalloc()
+ * @param size  Size of memory object
+ * @param dh    Optional destructor, called when destroyed
+ *
+ * @return Pointer to allocated object
+ */
+void *mem_arena_zalloc(struct mem_arena *arena, size_t size,
+		       mem_destroy_h *dh)
+{
+	struct mem *m;
+	void *p;
+
+	if (!arena)
+		return mem_zalloc(size, dh);
+
+	if (size > MEM_SIZE_MAX || mem_oom())
+		return NULL;
+
+	m = mem_arena_get(arena, mem_header_size + size);
+	if (!m)
+		return NULL;
+
+	p = mem_init(m, size, dh, MEM_ARENA);
+
+	memset(p, 0, size);
+
+	return p;
+}
+
+
 /**
  * Re-allocate a reference-counted memory object
  *
@@ -228,46 +488,64 @@ void *mem_realloc(void *data, size_t size)
 	m = get_mem(data);
 
 	MAGIC_CHECK(m);
+	LOCAL_CHECK(m);
 
 	if (re_atomic_acq(&m->nrefs) > 1u) {
-		void* p = mem_alloc(size, m->dh);
+		const uint32_t flags = mem_flags(m) & MEM_LOCAL;
+		void* p = mem_alloc_flags(size, m->dh, flags);
 		if (p) {
-			memcpy(p, data, m->size);
+			memcpy(p, data, min(size, (size_t)mem_size(m)));
 			mem_deref(data);
 		}
 		return p;
 	}
 
-#if MEM_DEBUG
-	mem_lock();
+	if (size > mem_size(m) && mem_oom())
+		return NULL;
 
-	/* Simulate OOM */
-	if (-1 != threshold && size > m->size) {
-		if (memstat.blocks_cur >= (size_t)threshold) {
-			mem_unlock();
-			return NULL;
+	if (mem_flags(m) & (MEM_POOLED | MEM_ARENA)) {
+		const size_t avail = (mem_flags(m) & MEM_POOLED) ?
+			mem_pool_bsize(m) - mem_header_size : mem_size(m);
+		void *p;
+
+		if (size <= avail) {
+			STAT_REALLOC(m, size);
+			return data;
 		}
+
+		/* Pool and arena blocks do not grow, move the object */
+		p = mem_alloc_flags(size, m->dh, mem_flags(m) & MEM_LOCAL);
+		if (!p)
+			return NULL;
+
+		memcpy(p, data, mem_size(m));
+		mem_free(m);
+
+		return p;
 	}
 
-	list_unlink(&m->le);
+	/* The moved object is no longer sampled */
+	if (mem_flags(m) & MEM_SAMPLED) {
+		mem_prof_free(m);
+		m->sizef &= ~MEM_SAMPLED;
+	}
 
-	mem_unlock();
+#if MEM_DEBUG
+	mem_unlink(m);
 #endif
 
 	m2 = realloc(m, mem_header_size + size);
+	if (m2)
+		mem_size_set(m2, size);
 
 #if MEM_DEBUG
-	mem_lock();
-	list_append(&meml, m2 ? &m2->le : &m->le, m2 ? m2 : m);
-	mem_unlock();
+	mem_link(m2 ? m2 : m);
 #endif
 
 	if (!m2) {
 		return NULL;
 	}
 
-	STAT_REALLOC(m2, size);
-
 	return get_mem_data(m2);
 }
 
@@ -340,8 +618,12 @@ void *mem_ref(void *data)
 	m = get_mem(data);
 
 	MAGIC_CHECK(m);
+	LOCAL_CHECK(m);
 
-	re_atomic_rlx_add(&m->nrefs, 1u);
+	if (mem_flags(m) & MEM_LOCAL)
+		re_atomic_rlx_set(&m->nrefs, re_atomic_rlx(&m->nrefs) + 1u);
+	else
+		re_atomic_rlx_add(&m->nrefs, 1u);
 
 	return data;
 }
@@ -367,8 +649,16 @@ void *mem_deref(void *data)
 	m = get_mem(data);
 
 	MAGIC_CHECK(m);
+	LOCAL_CHECK(m);
+
+	if (mem_flags(m) & MEM_LOCAL) {
+		const uint32_t n = re_atomic_rlx(&m->nrefs) - 1u;
 
-	if (re_atomic_acq_sub(&m->nrefs, 1u) > 1u) {
+		re_atomic_rlx_set(&m->nrefs, n);
+		if (n > 0u)
+			return NULL;
+	}
+	else if (re_atomic_acq_sub(&m->nrefs, 1u) > 1u) {
 		return NULL;
 	}
 
@@ -379,15 +669,7 @@ void *mem_deref(void *data)
 	if (re_atomic_rlx(&m->nrefs) > 0u)
 		return NULL;
 
-#if MEM_DEBUG
-	mem_lock();
-	list_unlink(&m->le);
-	mem_unlock();
-#endif
-
-	STAT_DEREF(m);
-
-	free(m);
+	mem_free(m);
 
 	return NULL;
 }
@@ -416,6 +698,25 @@ uint32_t mem_nrefs(const void *data)
 
 
 #if MEM_DEBUG
+/* Count the live memory objects */
+static uint32_t mem_count(void)
+{
+	uint32_t n = 0;
+
+	call_once(&flag, mem_lock_init);
+
+	for (size_t i = 0; i < MEM_SHARDS; i++) {
+		struct mem_shard *sh = &shardv[i].s;
+
+		mtx_lock(&sh->mtx);
+		n += list_count(&sh->meml);
+		mtx_unlock(&sh->mtx);
+	}
+
+	return n;
+}
+
+
 static bool debug_handler(struct le *le, void *arg)
 {
 	struct mem *m = le->data;
@@ -427,12 +728,12 @@ static bool debug_handler(struct le *le, void *arg)
 	(void)re_fprintf(stderr, "  %p: nrefs=%-2u", p,
 		(uint32_t)re_atomic_rlx(&m->nrefs));
 
-	(void)re_fprintf(stderr, " size=%-7u", m->size);
+	(void)re_fprintf(stderr, " size=%-7u", mem_size(m));
 
 	(void)re_fprintf(stderr, " [");
 
 	for (i=0; i<16; i++) {
-		if (i >= m->size)
+		if (i >= mem_size(m))
 			(void)re_fprintf(stderr, "   ");
 		else
 			(void)re_fprintf(stderr, "%02x ", p[i]);
@@ -441,7 +742,7 @@ static bool debug_handler(struct le *le, void *arg)
 	(void)re_fprintf(stderr, "] [");
 
 	for (i=0; i<16; i++) {
-		if (i >= m->size)
+		if (i >= mem_size(m))
 			(void)re_fprintf(stderr, " ");
 		else
 			(void)re_fprintf(stderr, "%c",
@@ -469,18 +770,19 @@ void mem_debug(void)
 #if MEM_DEBUG
 	uint32_t n;
 
-	mem_lock();
-	n = list_count(&meml);
-	mem_unlock();
-
+	n = mem_count();
 	if (!n)
 		return;
 
 	DEBUG_WARNING("Memory leaks (%u):\n", n);
 
-	mem_lock();
-	(void)list_apply(&meml, true, debug_handler, NULL);
-	mem_unlock();
+	for (size_t i = 0; i < MEM_SHARDS; i++) {
+		struct mem_shard *sh = &shardv[i].s;
+
+		mtx_lock(&sh->mtx);
+		(void)list_apply(&sh->meml, true, debug_handler, NULL);
+		mtx_unlock(&sh->mtx);
+	}
 #endif
 }
 
@@ -494,9 +796,7 @@ void mem_debug(void)
 void mem_threshold_set(ssize_t n)
 {
 #if MEM_DEBUG
-	mem_lock();
-	threshold = n;
-	mem_unlock();
+	re_atomic_rlx_set(&threshold, n);
 #else
 	(void)n;
 #endif
@@ -520,10 +820,8 @@ int mem_status(struct re_printf *pf, void *unused)
 
 	(void)unused;
 
-	mem_lock();
-	memcpy(&stat, &memstat, sizeof(stat));
-	c = list_count(&meml);
-	mem_unlock();
+	stat_get(&stat);
+	c = mem_count();
 
 	err |= re_hprintf(pf,
 			  "Memory status: (%zu bytes overhead per block)\n",
@@ -539,12 +837,13 @@ int mem_status(struct re_printf *pf, void *unused)
 			  stat.bytes_peak
 			  + (stat.blocks_peak * (size_t)mem_header_size));
 	err |= re_hprintf(pf, " Total %u blocks allocated\n", c);
+	err |= mem_pool_debug(pf);
+	err |= mem_prof_debug(pf);
 
 	return err;
 #else
-	(void)pf;
 	(void)unused;
-	return 0;
+	return mem_pool_debug(pf) | mem_prof_debug(pf);
 #endif
 }
 
@@ -561,9 +860,7 @@ int mem_get_stat(struct memstat *mstat)
 	if (!mstat)
 		return EINVAL;
 #if MEM_DEBUG
-	mem_lock();
-	memcpy(mstat, &memstat, sizeof(*mstat));
-	mem_unlock();
+	stat_get(mstat);
 	return 0;
 #else
 	return ENOSYS;
@@ -0,0 +1,18 @@
+/**
+ * @file mem.h  Internal interface to memory management
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+
+void  *mem_pool_alloc(size_t size);
+void   mem_pool_free(void *p);
+size_t mem_pool_bsize(const void *p);
+int    mem_pool_debug(struct re_printf *pf);
+
+void  *mem_arena_get(struct mem_arena *arena, size_t size);
+void   mem_arena_put(void *p);
+
+bool   mem_prof_alloc(const void *p, size_t size);
+void   mem_prof_free(const void *p);
+int    mem_prof_debug(struct re_printf *pf);
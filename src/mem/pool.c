@@ -0,0 +1,376 @@
+/**
+ * @file mem/pool.c  Per-thread size-class pool for memory objects
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <re/re_types.h>
+#include <re/re_list.h>
+#include <re/re_fmt.h>
+#include <re/re_mem.h>
+#include <re/re_thread.h>
+#include <re/re_atomic.h>
+#include "mem.h"
+
+
+#define DEBUG_MODULE "mempool"
+#define DEBUG_LEVEL 5
+#include <re/re_dbg.h>
+
+
+/*
+ * Small blocks are carved from slabs owned by the allocating thread. Each
+ * block is prefixed with its pool and size class. Blocks freed by the
+ * owner go straight back to the free list of their class; blocks freed by
+ * other threads are pushed to a lock-free inbox of the pool, which the
+ * owner collects when a free list runs empty.
+ *
+ * Slabs are never returned to the system. When a thread exits its pool is
+ * orphaned, and adopted by the next thread that needs a pool.
+ */
+
+enum {
+	POOL_CLASSES = 10,           /**< Number of size classes      */
+	SLAB_SIZE    = 64 * 1024,    /**< Slab size in [bytes]        */
+	BLK_ALIGN    = 16,           /**< Block alignment             */
+};
+
+/** Block sizes, including the memory object header */
+static const uint32_t classv[POOL_CLASSES] = {
+	64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536
+};
+
+struct mem_pool;
+
+/** Block prefix, must keep blocks aligned */
+struct blk {
+	struct mem_pool *pool;   /**< Owner pool                  */
+	uint32_t cls;            /**< Size class                  */
+};
+
+/** Free block, overlays the block data */
+struct fblk {
+	struct fblk *next;
+};
+
+struct pool_class {
+	struct fblk *freel;      /**< Free blocks                 */
+	RE_ATOMIC size_t inuse;  /**< Blocks in use               */
+	RE_ATOMIC size_t total;  /**< Blocks carved from slabs    */
+};
+
+struct mem_pool {
+	struct pool_class classv[POOL_CLASSES]; /**< Size classes   */
+	RE_ATOMIC uintptr_t inbox; /**< Blocks freed by other threads */
+	bool orphaned;             /**< Owner thread has exited       */
+	struct le le;              /**< Member of pool list           */
+};
+
+enum {
+	BLK_HDR = (sizeof(struct blk) + BLK_ALIGN - 1) & ~(BLK_ALIGN - 1),
+};
+
+static RE_ATOMIC bool enabled;
+static struct list pooll = LIST_INIT;
+static once_flag flag = ONCE_FLAG_INIT;
+static tss_t key;
+static mtx_t mtx;
+static bool ready;
+
+
+/* Return blocks freed by other threads to their free lists */
+static void pool_collect(struct mem_pool *pool)
+{
+	struct fblk *f, *next;
+
+	if (!re_atomic_rlx(&pool->inbox))
+		return;
+
+	f = (struct fblk *)re_atomic_exchange(&pool->inbox, (uintptr_t)0,
+					      re_memory_order_acquire);
+
+	for (; f; f = next) {
+		struct blk *b = (void *)((uint8_t *)f - BLK_HDR);
+		struct pool_class *c = &pool->classv[b->cls];
+
+		next = f->next;
+
+		f->next  = c->freel;
+		c->freel = f;
+
+		re_atomic_rlx_set(&c->inuse, re_atomic_rlx(&c->inuse) - 1);
+	}
+}
+
+
+static void thread_destructor(void *arg)
+{
+	struct mem_pool *pool = arg;
+
+	mtx_lock(&mtx);
+	pool->orphaned = true;
+	mtx_unlock(&mtx);
+}
+
+
+static void pool_once(void)
+{
+	if (tss_create(&key, thread_destructor) != thrd_success) {
+		DEBUG_WARNING("pool init failed\n");
+		return;
+	}
+
+	if (mtx_init(&mtx, mtx_plain) != thrd_success) {
+		DEBUG_WARNING("pool init failed\n");
+		tss_delete(key);
+		return;
+	}
+
+	ready = true;
+}
+
+
+static struct mem_pool *pool_get(void)
+{
+	struct mem_pool *pool;
+
+	call_once(&flag, pool_once);
+
+	/* Without init allocations use the plain malloc path */
+	if (!ready)
+		return NULL;
+
+	pool = tss_get(key);
+	if (pool)
+		return pool;
+
+	mtx_lock(&mtx);
+
+	for (struct le *le = pooll.head; le; le = le->next) {
+		struct mem_pool *p = le->data;
+
+		if (p->orphaned) {
+			pool = p;
+			break;
+		}
+	}
+
+	if (!pool) {
+		pool = calloc(1, sizeof(*pool));
+		if (!pool)
+			goto out;
+
+		list_append(&pooll, &pool->le, pool);
+	}
+
+	if (tss_set(key, pool) != thrd_success) {
+		pool->orphaned = true;
+		pool = NULL;
+		goto out;
+	}
+
+	pool->orphaned = false;
+
+ out:
+	mtx_unlock(&mtx);
+
+	return pool;
+}
+
+
+static int slab_refill(struct mem_pool *pool, unsigned cls)
+{
+	struct pool_class *c = &pool->classv[cls];
+	const size_t bsize = BLK_HDR + classv[cls];
+	uint8_t *slab;
+	size_t n;
+
+	slab = malloc(SLAB_SIZE);
+	if (!slab)
+		return ENOMEM;
+
+	n = SLAB_SIZE / bsize;
+
+	/* Hand out in address order */
+	for (size_t i = n; i-- > 0;) {
+		uint8_t *p = slab + i * bsize;
+		struct blk *b = (struct blk *)(void *)p;
+		struct fblk *f = (void *)(p + BLK_HDR);
+
+		b->pool = pool;
+		b->cls	= cls;
+
+		f->next  = c->freel;
+		c->freel = f;
+	}
+
+	re_atomic_rlx_set(&c->total, re_atomic_rlx(&c->total) + n);
+
+	return 0;
+}
+
+
+static inline unsigned class_of(size_t size)
+{
+	unsigned i = 0;
+
+	while (classv[i] < size)
+		++i;
+
+	return i;
+}
+
+
+/**
+ * Enable or disable the memory pool. Objects allocated while the pool is
+ * enabled may be freed at any time, from any thread.
+ *
+ * @param enable True to allocate small objects from per-thread pools
+ */
+void mem_pool_enable(bool enable)
+{
+	re_atomic_rls_set(&enabled, enable);
+}
+
+
+/**
+ * Allocate a block from the pool of the current thread
+ *
+ * @param size Block size, including the memory object header
+ *
+ * @return Pointer to block, NULL if disabled or not a pool size
+ */
+void *mem_pool_alloc(size_t size)
+{
+	struct mem_pool *pool;
+	struct pool_class *c;
+	struct fblk *f;
+	unsigned cls;
+
+	if (size > classv[POOL_CLASSES - 1] || !re_atomic_rlx(&enabled))
+		return NULL;
+
+	pool = pool_get();
+	if (!pool)
+		return NULL;
+
+	cls = class_of(size);
+	c   = &pool->classv[cls];
+
+	if (!c->freel) {
+		pool_collect(pool);
+
+		if (!c->freel && slab_refill(pool, cls))
+			return NULL;
+	}
+
+	f = c->freel;
+	c->freel = f->next;
+
+	re_atomic_rlx_set(&c->inuse, re_atomic_rlx(&c->inuse) + 1);
+
+	return f;
+}
+
+
+/**
+ * Return a block to its pool
+ *
+ * @param p Block from mem_pool_alloc()
+ */
+void mem_pool_free(void *p)
+{
+	struct blk *b = (void *)((uint8_t *)p - BLK_HDR);
+	struct mem_pool *pool = b->pool;
+	struct fblk *f = p;
+	uintptr_t head;
+
+	if (pool == tss_get(key)) {
+		struct pool_class *c = &pool->classv[b->cls];
+
+		f->next  = c->freel;
+		c->freel = f;
+
+		re_atomic_rlx_set(&c->inuse, re_atomic_rlx(&c->inuse) - 1);
+		return;
+	}
+
+	head = re_atomic_rlx(&pool->inbox);
+	do {
+		f->next = (struct fblk *)head;
+	} while (!re_atomic_compare_exchange_weak(&pool->inbox, &head,
+						  (uintptr_t)f,
+						  re_memory_order_release,
+						  re_memory_order_relaxed));
+}
+
+
+/**
+ * Get the usable size of a pool block
+ *
+ * @param p Block from mem_pool_alloc()
+ *
+ * @return Block size in [bytes]
+ */
+size_t mem_pool_bsize(const void *p)
+{
+	const struct blk *b = (const void *)((const uint8_t *)p - BLK_HDR);
+
+	return classv[b->cls];
+}
+
+
+/**
+ * Print the usage of all pools, per size class
+ *
+ * @param pf Print handler for debug output
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mem_pool_debug(struct re_printf *pf)
+{
+	size_t inusev[POOL_CLASSES] = {0};
+	size_t totalv[POOL_CLASSES] = {0};
+	unsigned n;
+	int err;
+
+	call_once(&flag, pool_once);
+
+	if (!ready)
+		return re_hprintf(pf, "Memory pool: not initialized\n");
+
+	mtx_lock(&mtx);
+
+	n = list_count(&pooll);
+
+	for (struct le *le = pooll.head; le; le = le->next) {
+		struct mem_pool *pool = le->data;
+
+		for (unsigned i = 0; i < POOL_CLASSES; i++) {
+			const struct pool_class *c = &pool->classv[i];
+
+			inusev[i] += re_atomic_rlx(&c->inuse);
+			totalv[i] += re_atomic_rlx(&c->total);
+		}
+	}
+
+	mtx_unlock(&mtx);
+
+	err = re_hprintf(pf, "Memory pool: %s (%u pools)\n",
+			 re_atomic_rlx(&enabled) ? "enabled" : "disabled", n);
+
+	for (unsigned i = 0; i < POOL_CLASSES; i++) {
+
+		if (!totalv[i])
+			continue;
+
+		/* In-use counts are updated by other threads meanwhile */
+		err |= re_hprintf(pf, " %5u bytes: %zu/%zu blocks in use"
+				  " (%zu bytes reserved)\n", classv[i],
+				  min(inusev[i], totalv[i]), totalv[i],
+				  totalv[i] * (BLK_HDR + classv[i]));
+	}
+
+	return err;
+}
@@ -0,0 +1,529 @@
+/**
+ * @file mem/prof.c  Sampling heap profiler
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_EXECINFO
+#include <execinfo.h>
+#endif
+#include <re/re_types.h>
+#include <re/re_list.h>
+#include <re/re_fmt.h>
+#include <re/re_mem.h>
+#include <re/re_btrace.h>
+#include <re/re_thread.h>
+#include <re/re_atomic.h>
+#include "mem.h"
+
+
+#define DEBUG_MODULE "memprof"
+#define DEBUG_LEVEL 5
+#include <re/re_dbg.h>
+
+
+/*
+ * Each thread counts down the bytes it allocates. When the count runs out,
+ * the allocation is sampled: its call stack is captured and the object is
+ * added to the call site with that stack. A sampled object stands for
+ * about one sampling interval of allocated bytes, which gives the
+ * estimated bytes and blocks of a call site.
+ *
+ * The profiler keeps its own records in malloc'd memory, and never holds
+ * its lock while printing, since printing may allocate.
+ */
+
+enum {
+	SITE_BUCKETS = 256,          /**< Call site hash buckets      */
+	OBJ_BUCKETS  = 1024,         /**< Sampled object hash buckets */
+	STATUS_SITES = 5,            /**< Call sites in mem_status()  */
+};
+
+/** Allocation counters */
+struct prof_count {
+	size_t bytes;                /**< Estimated bytes             */
+	size_t blocks;               /**< Estimated blocks            */
+};
+
+/** Defines a call site, never freed */
+struct prof_site {
+	struct le he;                /**< Member of site hash         */
+	struct btrace bt;            /**< Call stack                  */
+	uint32_t key;                /**< Hash of call stack          */
+	struct prof_count inuse;     /**< Live sampled objects        */
+	struct prof_count alloc;     /**< All sampled objects         */
+};
+
+/** Defines a sampled object */
+struct prof_obj {
+	struct le he;                /**< Member of object hash       */
+	const void *p;               /**< Memory object               */
+	struct prof_site *site;      /**< Call site                   */
+	struct prof_count est;       /**< Estimate of this sample     */
+};
+
+static struct list sitev[SITE_BUCKETS];
+static struct list objv[OBJ_BUCKETS];
+static RE_ATOMIC size_t rate;
+static RE_ATOMIC uint32_t nsites;
+static once_flag flag = ONCE_FLAG_INIT;
+static tss_t key;
+static mtx_t mtx;
+static bool ready;
+
+
+static void prof_once(void)
+{
+	if (tss_create(&key, NULL) != thrd_success) {
+		DEBUG_WARNING("profiler init failed\n");
+		return;
+	}
+
+	if (mtx_init(&mtx, mtx_plain) != thrd_success) {
+		DEBUG_WARNING("profiler init failed\n");
+		tss_delete(key);
+		return;
+	}
+
+	ready = true;
+}
+
+
+static inline uint32_t ptr_hash(const void *p)
+{
+	return (uint32_t)((uintptr_t)p >> 4) * 2654435761u;
+}
+
+
+static uint32_t bt_hash(const struct btrace *bt)
+{
+	uint32_t h = 0;
+
+	for (size_t i = 0; i < bt->len; i++)
+		h = (h ^ ptr_hash(bt->stack[i])) * 16777619u;
+
+	return h;
+}
+
+
+/* Capture the call stack, starting at the frame of return address ra */
+static void bt_capture(struct btrace *bt, const void *ra)
+{
+#ifdef HAVE_EXECINFO
+	/* Also in release builds, where btrace() does nothing */
+	bt->len = (size_t)backtrace(bt->stack, BTRACE_SZ);
+#else
+	bt->len = 0;
+	(void)btrace(bt);
+#endif
+
+	/* Drop the frames of the profiler */
+	for (size_t i = 0; ra && i < bt->len; i++) {
+
+		if (bt->stack[i] != ra)
+			continue;
+
+		bt->len -= i;
+		memmove(bt->stack, &bt->stack[i],
+			bt->len * sizeof(bt->stack[0]));
+		break;
+	}
+}
+
+
+static struct prof_site *site_get(const struct btrace *bt)
+{
+	const uint32_t h = bt_hash(bt);
+	struct list *lst = &sitev[h & (SITE_BUCKETS - 1)];
+	struct prof_site *site;
+
+	for (struct le *le = lst->head; le; le = le->next) {
+
+		site = le->data;
+
+		if (site->key == h && site->bt.len == bt->len &&
+		    !memcmp(site->bt.stack, bt->stack,
+			    bt->len * sizeof(bt->stack[0])))
+			return site;
+	}
+
+	site = calloc(1, sizeof(*site));
+	if (!site)
+		return NULL;
+
+	site->bt  = *bt;
+	site->key = h;
+
+	list_append(lst, &site->he, site);
+	re_atomic_rlx_set(&nsites, re_atomic_rlx(&nsites) + 1);
+
+	return site;
+}
+
+
+static inline void count_add(struct prof_count *c,
+			     const struct prof_count *est)
+{
+	c->bytes  += est->bytes;
+	c->blocks += est->blocks;
+}
+
+
+static void sample(const void *p, size_t size, size_t r, const void *ra)
+{
+	struct prof_site *site;
+	struct prof_obj *obj;
+	struct btrace bt;
+
+	bt_capture(&bt, ra);
+
+	obj = calloc(1, sizeof(*obj));
+	if (!obj)
+		return;
+
+	obj->p = p;
+
+	/* Objects smaller than the interval are sampled size/r of the time */
+	obj->est.bytes  = max(size, r);
+	obj->est.blocks = size && size < r ? r / size : 1;
+
+	mtx_lock(&mtx);
+
+	site = site_get(&bt);
+	if (!site) {
+		mtx_unlock(&mtx);
+		free(obj);
+		return;
+	}
+
+	obj->site = site;
+	count_add(&site->inuse, &obj->est);
+	count_add(&site->alloc, &obj->est);
+
+	list_append(&objv[ptr_hash(p) & (OBJ_BUCKETS - 1)], &obj->he, obj);
+
+	mtx_unlock(&mtx);
+}
+
+
+/**
+ * Enable or disable the sampling heap profiler. Call sites and their
+ * counters are kept when the profiler is disabled.
+ *
+ * @param interval Number of allocated bytes between samples, 0 to disable
+ *
+ * @note The profiler stays disabled if it cannot be initialized
+ */
+void mem_prof_enable(size_t interval)
+{
+	call_once(&flag, prof_once);
+
+	if (!ready)
+		return;
+
+	re_atomic_rls_set(&rate, interval);
+}
+
+
+/**
+ * Account an allocated memory object, and sample it when the byte count
+ * of the current thread runs out
+ *
+ * @param p    Memory object
+ * @param size Size of memory object
+ *
+ * @return True if the object was sampled
+ */
+bool mem_prof_alloc(const void *p, size_t size)
+{
+	const size_t r = re_atomic_acq(&rate);
+	uintptr_t left;
+	void *v;
+
+	if (!r)
+		return false;
+
+	v = tss_get(key);
+	left = (uintptr_t)v;
+	if (!left)
+		left = r;
+
+	if (size < left) {
+		(void)tss_set(key, (void *)(left - size));
+		return false;
+	}
+
+	(void)tss_set(key, (void *)(uintptr_t)r);
+
+#if defined(__GNUC__)
+	sample(p, size, r, __builtin_return_address(0));
+#else
+	sample(p, size, r, NULL);
+#endif
+
+	return true;
+}
+
+
+/**
+ * Remove a sampled memory object
+ *
+ * @param p Memory object, which was sampled by mem_prof_alloc()
+ */
+void mem_prof_free(const void *p)
+{
+	struct list *lst = &objv[ptr_hash(p) & (OBJ_BUCKETS - 1)];
+	struct prof_obj *obj = NULL;
+
+	mtx_lock(&mtx);
+
+	for (struct le *le = lst->head; le; le = le->next) {
+
+		struct prof_obj *o = le->data;
+
+		if (o->p == p) {
+			obj = o;
+			break;
+		}
+	}
+
+	if (obj) {
+		list_unlink(&obj->he);
+		obj->site->inuse.bytes  -= obj->est.bytes;
+		obj->site->inuse.blocks -= obj->est.blocks;
+	}
+
+	mtx_unlock(&mtx);
+
+	free(obj);
+}
+
+
+static int site_cmp(const void *a, const void *b)
+{
+	const struct prof_site *sa = a, *sb = b;
+
+	if (sa->inuse.bytes != sb->inuse.bytes)
+		return sa->inuse.bytes < sb->inuse.bytes ? 1 : -1;
+
+	return 0;
+}
+
+
+/* Copy the call sites, largest in-use bytes first */
+static int sites_copy(struct prof_site **sitesp, uint32_t *np)
+{
+	struct prof_site *sites;
+	uint32_t n = 0;
+
+	call_once(&flag, prof_once);
+
+	if (!ready)
+		return ENOMEM;
+
+	mtx_lock(&mtx);
+
+	sites = calloc(max(re_atomic_rlx(&nsites), 1u), sizeof(*sites));
+	if (!sites) {
+		mtx_unlock(&mtx);
+		return ENOMEM;
+	}
+
+	for (size_t i = 0; i < SITE_BUCKETS; i++) {
+
+		for (struct le *le = sitev[i].head; le; le = le->next)
+			sites[n++] = *(struct prof_site *)le->data;
+	}
+
+	mtx_unlock(&mtx);
+
+	qsort(sites, n, sizeof(*sites), site_cmp);
+
+	*sitesp = sites;
+	*np     = n;
+
+	return 0;
+}
+
+
+/* Print a call stack root first, with frames separated by semicolons */
+static int folded_print(struct re_printf *pf, const struct btrace *bt)
+{
+	char **symv = NULL;
+	int err = 0;
+
+#ifdef HAVE_EXECINFO
+	if (bt->len)
+		symv = backtrace_symbols(bt->stack, (int)bt->len);
+#endif
+
+	for (size_t i = bt->len; i-- > 0;) {
+		struct pl name = PL_INIT;
+
+		/* "binary(function+0x1f) [0x...]" */
+		if (symv)
+			(void)re_regex(symv[i], str_len(symv[i]),
+				       "([^+)]+", &name);
+
+		if (pl_isset(&name))
+			err |= re_hprintf(pf, "%r", &name);
+		else
+			err |= re_hprintf(pf, "%p", bt->stack[i]);
+
+		if (i)
+			err |= re_hprintf(pf, ";");
+	}
+
+	free(symv);
+
+	return err;
+}
+
+
+/**
+ * Print the in-use bytes of all call sites, in the folded stack format
+ * used by flame graph tools
+ *
+ * @param pf     Print handler
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mem_prof_folded(struct re_printf *pf, void *unused)
+{
+	struct prof_site *sites;
+	uint32_t n;
+	int err;
+	(void)unused;
+
+	err = sites_copy(&sites, &n);
+	if (err)
+		return err;
+
+	for (uint32_t i = 0; i < n && !err; i++) {
+
+		if (!sites[i].inuse.bytes)
+			break;
+
+		err  = folded_print(pf, &sites[i].bt);
+		err |= re_hprintf(pf, " %zu\n", sites[i].inuse.bytes);
+	}
+
+	free(sites);
+
+	return err;
+}
+
+
+/**
+ * Print all call sites in the legacy text format of pprof heap profiles
+ *
+ * @param pf     Print handler
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mem_prof_pprof(struct re_printf *pf, void *unused)
+{
+	struct prof_count inuse = {0, 0}, alloc = {0, 0};
+	struct prof_site *sites;
+	uint32_t n;
+	int err;
+	(void)unused;
+
+	err = sites_copy(&sites, &n);
+	if (err)
+		return err;
+
+	for (uint32_t i = 0; i < n; i++) {
+		count_add(&inuse, &sites[i].inuse);
+		count_add(&alloc, &sites[i].alloc);
+	}
+
+	/* Counters are already scaled to estimates */
+	err = re_hprintf(pf, "heap profile: %zu: %zu [%zu: %zu] @ heap\n",
+			 inuse.blocks, inuse.bytes, alloc.blocks, alloc.bytes);
+
+	for (uint32_t i = 0; i < n && !err; i++) {
+		const struct prof_site *site = &sites[i];
+
+		err = re_hprintf(pf, "%zu: %zu [%zu: %zu] @",
+				 site->inuse.blocks, site->inuse.bytes,
+				 site->alloc.blocks, site->alloc.bytes);
+
+		for (size_t j = 0; j < site->bt.len; j++)
+			err |= re_hprintf(pf, " %p", site->bt.stack[j]);
+
+		err |= re_hprintf(pf, "\n");
+	}
+
+	free(sites);
+
+#ifdef LINUX
+	/* Lets pprof map addresses to binaries */
+	if (!err) {
+		char buf[512];
+		FILE *f;
+
+		f = fopen("/proc/self/maps", "r");
+		if (!f)
+			return 0;
+
+		err = re_hprintf(pf, "\nMAPPED_LIBRARIES:\n");
+
+		while (!err && fgets(buf, sizeof(buf), f))
+			err = re_hprintf(pf, "%s", buf);
+
+		(void)fclose(f);
+	}
+#endif
+
+	return err;
+}
+
+
+/**
+ * Print the profiler state and the largest call sites
+ *
+ * @param pf Print handler for debug output
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mem_prof_debug(struct re_printf *pf)
+{
+	struct prof_site *sites;
+	size_t bytes = 0;
+	uint32_t n;
+	int err;
+
+	if (!re_atomic_rlx(&rate) && !re_atomic_rlx(&nsites))
+		return 0;
+
+	err = sites_copy(&sites, &n);
+	if (err)
+		return err;
+
+	for (uint32_t i = 0; i < n; i++)
+		bytes += sites[i].inuse.bytes;
+
+	err = re_hprintf(pf, "Memory profile: every %zu bytes, %u call sites,"
+			 " %zu bytes in use (estimated)\n",
+			 re_atomic_rlx(&rate), n, bytes);
+
+	for (uint32_t i = 0; i < min(n, (uint32_t)STATUS_SITES) && !err; i++) {
+
+		if (!sites[i].inuse.bytes)
+			break;
+
+		err  = re_hprintf(pf, " %10zu bytes %8zu blocks: ",
+				  sites[i].inuse.bytes, sites[i].inuse.blocks);
+		err |= folded_print(pf, &sites[i].bt);
+		err |= re_hprintf(pf, "\n");
+	}
+
+	free(sites);
+
+	return err;
+}
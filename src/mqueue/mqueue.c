@@ -6,18 +6,19 @@
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
 #include <re/re_types.h>
 #include <re/re_fmt.h>
 #include <re/re_mem.h>
 #include <re/re_net.h>
 #include <re/re_main.h>
+#include <re/re_atomic.h>
 #include <re/re_mqueue.h>
 #include "mqueue.h"
 
 
-#define MAGIC 0x14553399
-
-
 #ifdef WIN32
 #include <winsock2.h>
 #include <ws2tcpip.h>
@@ -25,6 +26,30 @@
 #endif
 
 
+enum {
+	QSIZE = 4096,  /**< Ring slots, power of two */
+};
+
+
+/*
+ * Messages are kept in a bounded lock-free ring with one sequence number
+ * per slot, so any number of threads can push while the thread running
+ * the re_main() loop pops. A producer claims a slot by moving the tail,
+ * writes the message and then publishes it by setting the slot sequence.
+ *
+ * The depth counter is raised after a message is published. Only the
+ * producer that raises it from zero wakes up the loop, with an eventfd on
+ * Linux or a pipe elsewhere. The loop drains the messages that were
+ * counted when it woke up and wakes itself up again if more have arrived.
+ */
+
+struct slot {
+	RE_ATOMIC unsigned seq;  /**< Slot sequence number     */
+	int id;                  /**< Message identifier       */
+	void *data;              /**< Message data             */
+};
+
+
 /**
  * Defines a Thread-safe Message Queue
  *
@@ -33,18 +58,18 @@
  * incoming messages from other threads. The sender thread can be any thread.
  */
 struct mqueue {
+	struct slot *slotv;          /**< Message ring                   */
+	RE_ATOMIC unsigned tail;     /**< Next slot to claim             */
+	unsigned head;               /**< Next slot to pop, loop only    */
+	RE_ATOMIC unsigned depth;    /**< Published, not popped messages */
+	RE_ATOMIC unsigned hwm;      /**< High-watermark of depth        */
+	RE_ATOMIC unsigned full;     /**< Pushes refused, ring full      */
 	re_sock_t pfd[2];
 	struct re_fhs *fhs;
 	mqueue_h *h;
 	void *arg;
 };
 
-struct msg {
-	void *data;
-	uint32_t magic;
-	int id;
-};
-
 
 static void destructor(void *arg)
 {
@@ -54,37 +79,95 @@ static void destructor(void *arg)
 		q->fhs = fd_close(q->fhs);
 		(void)close(q->pfd[0]);
 	}
-	if (q->pfd[1] != RE_BAD_SOCK)
+	if (q->pfd[1] != RE_BAD_SOCK && q->pfd[1] != q->pfd[0])
 		(void)close(q->pfd[1]);
+
+	mem_deref(q->slotv);
+}
+
+
+static void wakeup(struct mqueue *mq)
+{
+#ifdef HAVE_EVENTFD
+	const uint64_t one = 1;
+#else
+	const uint8_t one = 1;
+#endif
+
+	/* A full pipe is already readable, the error can be ignored */
+	(void)pipe_write(mq->pfd[1], &one, sizeof(one));
+}
+
+
+static void wakeup_clear(struct mqueue *mq)
+{
+#ifdef HAVE_EVENTFD
+	uint64_t cnt;
+
+	(void)pipe_read(mq->pfd[0], &cnt, sizeof(cnt));
+#else
+	uint8_t buf[64];
+	ssize_t n;
+
+	do {
+		n = pipe_read(mq->pfd[0], buf, sizeof(buf));
+	} while (n == (ssize_t)sizeof(buf));
+#endif
+}
+
+
+static bool ring_pop(struct mqueue *mq, int *id, void **data)
+{
+	struct slot *s = &mq->slotv[mq->head & (QSIZE - 1)];
+
+	/* Claimed but not yet published */
+	if (re_atomic_acq(&s->seq) != mq->head + 1)
+		return false;
+
+	*id   = s->id;
+	*data = s->data;
+
+	re_atomic_rls_set(&s->seq, mq->head + QSIZE);
+	++mq->head;
+
+	return true;
 }
 
 
 static void event_handler(int flags, void *arg)
 {
 	struct mqueue *mq = arg;
-	struct msg msg;
-	ssize_t n;
+	unsigned n, k = 0;
 
 	if (!(flags & FD_READ))
 		return;
 
-	n = pipe_read(mq->pfd[0], &msg, sizeof(msg));
-	if (n < 0)
-		return;
+	/* Clear the wakeup before counting, a later push wakes up again */
+	wakeup_clear(mq);
 
-	if (n != sizeof(msg)) {
-		(void)re_fprintf(stderr, "mqueue: short read of %d bytes\n",
-				 n);
-		return;
-	}
+	n = re_atomic_acq(&mq->depth);
 
-	if (msg.magic != MAGIC) {
-		(void)re_fprintf(stderr, "mqueue: bad magic on read (%08x)\n",
-				 msg.magic);
-		return;
+	/* The handler may dereference the queue */
+	mem_ref(mq);
+
+	while (k < n) {
+		void *data;
+		int id;
+
+		if (!ring_pop(mq, &id, &data))
+			break;
+
+		++k;
+		mq->h(id, data, mq->arg);
+
+		if (mem_nrefs(mq) == 1)
+			break;
 	}
 
-	mq->h(msg.id, msg.data, mq->arg);
+	if (re_atomic_acq_sub(&mq->depth, k) != k && mem_nrefs(mq) > 1)
+		wakeup(mq);
+
+	mem_deref(mq);
 }
 
 
@@ -114,6 +197,26 @@ int mqueue_alloc(struct mqueue **mqp, mqueue_h *h, void *arg)
 	mq->arg = arg;
 
 	mq->pfd[0] = mq->pfd[1] = RE_BAD_SOCK;
+
+	mq->slotv = mem_zalloc(QSIZE * sizeof(*mq->slotv), NULL);
+	if (!mq->slotv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (unsigned i = 0; i < QSIZE; i++)
+		re_atomic_rlx_set(&mq->slotv[i].seq, i);
+
+#ifdef HAVE_EVENTFD
+	mq->pfd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (mq->pfd[0] < 0) {
+		mq->pfd[0] = RE_BAD_SOCK;
+		err = errno;
+		goto out;
+	}
+
+	mq->pfd[1] = mq->pfd[0];
+#else
 	if (pipe(mq->pfd) < 0) {
 		err = RE_ERRNO_SOCK;
 		goto out;
@@ -126,6 +229,7 @@ int mqueue_alloc(struct mqueue **mqp, mqueue_h *h, void *arg)
 	err = net_sockopt_blocking_set(mq->pfd[1], false);
 	if (err)
 		goto out;
+#endif
 
 	err = fd_listen(&mq->fhs, mq->pfd[0], FD_READ, event_handler, mq);
 	if (err)
@@ -142,29 +246,104 @@ int mqueue_alloc(struct mqueue **mqp, mqueue_h *h, void *arg)
 
 
 /**
- * Push a new message onto the Message Queue
+ * Call the handler for the messages left in the Message Queue. Must be
+ * called from the thread that owns the queue, e.g. after its re_main()
+ * loop has returned, so that no message data is leaked.
+ *
+ * @param mq Message Queue
+ */
+void mqueue_drain(struct mqueue *mq)
+{
+	void *data;
+	int id;
+
+	if (!mq)
+		return;
+
+	while (ring_pop(mq, &id, &data)) {
+		(void)re_atomic_acq_sub(&mq->depth, 1u);
+		mq->h(id, data, mq->arg);
+	}
+}
+
+
+/**
+ * Push a new message onto the Message Queue. Can be called from any
+ * thread, it does not block.
  *
  * @param mq   Message Queue
  * @param id   General purpose Identifier
  * @param data Application data
  *
- * @return 0 if success, otherwise errorcode
+ * @return 0 if success, EAGAIN if the queue is full, otherwise errorcode
  */
 int mqueue_push(struct mqueue *mq, int id, void *data)
 {
-	struct msg msg;
-	ssize_t n;
+	unsigned pos, depth, hwm;
+	struct slot *s;
 
 	if (!mq)
 		return EINVAL;
 
-	msg.id    = id;
-	msg.data  = data;
-	msg.magic = MAGIC;
+	pos = re_atomic_rlx(&mq->tail);
+
+	for (;;) {
+		int dif;
+
+		s   = &mq->slotv[pos & (QSIZE - 1)];
+		dif = (int)(re_atomic_acq(&s->seq) - pos);
+
+		if (dif == 0) {
+			if (re_atomic_compare_exchange_weak(
+				    &mq->tail, &pos, pos + 1,
+				    re_memory_order_relaxed,
+				    re_memory_order_relaxed))
+				break;
+		}
+		else if (dif < 0) {
+			re_atomic_rlx_add(&mq->full, 1u);
+			return EAGAIN;
+		}
+		else {
+			pos = re_atomic_rlx(&mq->tail);
+		}
+	}
+
+	s->id   = id;
+	s->data = data;
+	re_atomic_rls_set(&s->seq, pos + 1);
+
+	depth = re_atomic_acq_add(&mq->depth, 1u);
+	if (depth == 0)
+		wakeup(mq);
+
+	hwm = re_atomic_rlx(&mq->hwm);
+	while (depth + 1 > hwm &&
+	       !re_atomic_compare_exchange_weak(&mq->hwm, &hwm, depth + 1,
+						re_memory_order_relaxed,
+						re_memory_order_relaxed))
+		;
+
+	return 0;
+}
+
+
+/**
+ * Get the statistics of a Message Queue
+ *
+ * @param mq    Message Queue
+ * @param mstat Pointer to statistics to fill in
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mqueue_get_stat(const struct mqueue *mq, struct mqueue_stat *mstat)
+{
+	if (!mq || !mstat)
+		return EINVAL;
 
-	n = pipe_write(mq->pfd[1], &msg, sizeof(msg));
-	if (n < 0)
-		return errno;
+	mstat->depth = re_atomic_rlx(&mq->depth);
+	mstat->hwm   = re_atomic_rlx(&mq->hwm);
+	mstat->full  = re_atomic_rlx(&mq->full);
 
-	return (n != sizeof(msg)) ? EPIPE : 0;
+	return 0;
 }
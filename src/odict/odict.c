@@ -24,6 +24,14 @@ static void destructor(void *arg)
 }
 
 
+static uint32_t entry_key(const void *data)
+{
+	const struct odict_entry *e = data;
+
+	return hash_wy_str(e->key);
+}
+
+
 int odict_alloc(struct odict **op, uint32_t hash_size)
 {
 	struct odict *o;
@@ -36,7 +44,8 @@ int odict_alloc(struct odict **op, uint32_t hash_size)
 	if (!o)
 		return ENOMEM;
 
-	err = hash_alloc(&o->ht, hash_valid_size(hash_size));
+	err = hash_alloc_autogrow(&o->ht, hash_valid_size(hash_size),
+				  entry_key);
 	if (err)
 		goto out;
 
@@ -57,7 +66,7 @@ const struct odict_entry *odict_lookup(const struct odict *o, const char *key)
 	if (!o || !key)
 		return NULL;
 
-	le = list_head(hash_list(o->ht, hash_fast_str(key)));
+	le = list_head(hash_list(o->ht, hash_wy_str(key)));
 
 	while (le) {
 		const struct odict_entry *e = le->data;
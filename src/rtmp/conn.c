@@ -228,7 +228,8 @@ static int rtmp_dechunk_handler(const struct rtmp_header *hdr,
 		if (strm) {
 			if (strm->auh) {
 				strm->auh(hdr->timestamp,
-					  mb->buf, mb->end,
+					  mbuf_buf(mb),
+					  mbuf_get_left(mb),
 					  strm->arg);
 			}
 		}
@@ -239,7 +240,8 @@ static int rtmp_dechunk_handler(const struct rtmp_header *hdr,
 		if (strm) {
 			if (strm->vidh) {
 				strm->vidh(hdr->timestamp,
-					   mb->buf, mb->end,
+					   mbuf_buf(mb),
+					   mbuf_get_left(mb),
 					   strm->arg);
 			}
 		}
@@ -172,16 +172,28 @@ int rtmp_dechunker_receive(struct rtmp_dechunker *rd, struct mbuf *mb)
 			return ENODATA;
 
 		mem_deref(chunk->mb);
-		chunk->mb = mbuf_alloc(msg_len);
-		if (!chunk->mb)
-			return ENOMEM;
 
-		err = mbuf_read_mem(mb, chunk->mb->buf, chunk_sz);
-		if (err)
-			return err;
+		if (msg_len && chunk_sz == msg_len) {
+
+			/* a single-chunk message is a view of the input */
+			chunk->mb = mbuf_alloc_slice(mb, chunk_sz);
+			if (!chunk->mb)
+				return ENOMEM;
 
-		chunk->mb->pos = chunk_sz;
-		chunk->mb->end = chunk_sz;
+			mb->pos += chunk_sz;
+		}
+		else {
+			chunk->mb = mbuf_alloc(msg_len);
+			if (!chunk->mb)
+				return ENOMEM;
+
+			err = mbuf_read_mem(mb, chunk->mb->buf, chunk_sz);
+			if (err)
+				return err;
+
+			chunk->mb->pos = chunk_sz;
+			chunk->mb->end = chunk_sz;
+		}
 
 		chunk->hdr.format = hdr.format;
 		chunk->hdr.ext_ts = hdr.ext_ts;
@@ -239,11 +251,12 @@ int rtmp_dechunker_receive(struct rtmp_dechunker *rd, struct mbuf *mb)
 		return EPROTO;
 	}
 
-	if (chunk->mb->pos >= chunk->mb->size) {
+	if (chunk->mb->end >= chunk->mb->size) {
 
 		struct mbuf *buf;
 
-		chunk->mb->pos = 0;
+		/* rewind to the start of the message */
+		chunk->mb->pos = chunk->mb->end - chunk->hdr.length;
 
 		buf = chunk->mb;
 		chunk->mb = NULL;
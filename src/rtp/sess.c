@@ -552,7 +552,8 @@ static void timeout(void *arg)
 
 static void schedule(struct rtcp_sess *sess)
 {
-	tmr_start(&sess->tmr, sess->interval, timeout, sess);
+	tmr_start_slack(&sess->tmr, sess->interval, sess->interval / 16,
+			timeout, sess);
 }
 
 
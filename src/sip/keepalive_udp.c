@@ -102,8 +102,12 @@ static void stun_response_handler(int err, uint16_t scode, const char *reason,
 		mem_deref(uc);
 	}
 	else {
-		tmr_start(&uc->tmr_ka, sip_keepalive_wait(uc->ka_interval),
-			  udpconn_keepalive_handler, uc);
+		const uint64_t wait = sip_keepalive_wait(uc->ka_interval);
+
+		/* Never later than the interval */
+		tmr_start_slack(&uc->tmr_ka, wait,
+				(uc->ka_interval * 1000ULL - wait) / 2,
+				udpconn_keepalive_handler, uc);
 	}
 }
 
@@ -22,6 +22,7 @@
 enum {
 	HDR_HASH_SIZE = 32,
 	STARTLINE_MAX = 8192,
+	ARENA_SIZE    = 4096,
 };
 
 
@@ -149,14 +150,14 @@ static inline bool hdr_comma_separated(enum sip_hdrid id)
 }
 
 
-static inline int hdr_add(struct sip_msg *msg, const struct pl *name,
-			  enum sip_hdrid id, const char *p, ssize_t l,
-			  bool atomic, bool line)
+static inline int hdr_add(struct mem_arena *arena, struct sip_msg *msg,
+			  const struct pl *name, enum sip_hdrid id,
+			  const char *p, ssize_t l, bool atomic, bool line)
 {
 	struct sip_hdr *hdr;
 	int err = 0;
 
-	hdr = mem_zalloc(sizeof(*hdr), hdr_destructor);
+	hdr = mem_arena_zalloc(arena, sizeof(*hdr), hdr_destructor);
 	if (!hdr)
 		return ENOMEM;
 
@@ -269,6 +270,7 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 {
 	struct pl x, y, z, e, name;
 	const char *p, *v, *cv;
+	struct mem_arena *arena;
 	struct sip_msg *msg;
 	bool comsep, quote;
 	enum sip_hdrid id = SIP_HDR_NONE;
@@ -286,11 +288,17 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 		     &x, &y, &z, NULL, &e) || x.p != (char *)mbuf_buf(mb))
 		return (l > STARTLINE_MAX) ? EBADMSG : ENODATA;
 
-	msg = mem_zalloc(sizeof(*msg), destructor);
+	/* The message, its headers and hash table share one arena */
+	err = mem_arena_alloc(&arena, ARENA_SIZE);
+	if (err)
+		return err;
+
+	msg = mem_arena_zalloc(arena, sizeof(*msg), destructor);
+	mem_deref(arena);
 	if (!msg)
 		return ENOMEM;
 
-	err = hash_alloc(&msg->hdrht, HDR_HASH_SIZE);
+	err = hash_alloc_arena(&msg->hdrht, HDR_HASH_SIZE, arena);
 	if (err)
 		goto out;
 
@@ -360,7 +368,8 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 					goto out;
 				}
 
-				err = hdr_add(msg, &name, id, cv ? cv : p,
+				err = hdr_add(arena, msg, &name, id,
+					      cv ? cv : p,
 					      cv ? p - cv - ws : 0,
 					      true, cv == v && lf);
 				if (err)
@@ -372,7 +381,7 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 				}
 
 				if (cv != v) {
-					err = hdr_add(msg, &name, id,
+					err = hdr_add(arena, msg, &name, id,
 						      v ? v : p,
 						      v ? p - v - ws : 0,
 						      false, true);
@@ -171,7 +171,7 @@ static bool ack_handler(struct sip *sip, const struct sip_msg *msg)
 	struct sip_strans *st;
 
 	st = list_ledata(hash_lookup(sip->ht_strans,
-				     hash_joaat_pl(&msg->via.branch),
+				     hash_wy_pl(&msg->via.branch),
 				     cmp_ack_handler, (void *)msg));
 	if (!st)
 		return false;
@@ -206,7 +206,7 @@ static bool cancel_handler(struct sip *sip, const struct sip_msg *msg)
 	struct sip_strans *st;
 
 	st = list_ledata(hash_lookup(sip->ht_strans,
-				     hash_joaat_pl(&msg->via.branch),
+				     hash_wy_pl(&msg->via.branch),
 				     cmp_cancel_handler, (void *)msg));
 	if (!st)
 		return false;
@@ -239,7 +239,7 @@ static bool request_handler(const struct sip_msg *msg, void *arg)
 		return ack_handler(sip, msg);
 
 	st = list_ledata(hash_lookup(sip->ht_strans,
-				     hash_joaat_pl(&msg->via.branch),
+				     hash_wy_pl(&msg->via.branch),
 				     cmp_handler, (void *)msg));
 	if (st) {
 		switch (st->state) {
@@ -259,7 +259,7 @@ static bool request_handler(const struct sip_msg *msg, void *arg)
 	else if (!pl_isset(&msg->to.tag)) {
 
 		st = list_ledata(hash_lookup(sip->ht_strans_mrg,
-					     hash_joaat_pl(&msg->callid),
+					     hash_wy_pl(&msg->callid),
 					     cmp_merge_handler, (void *)msg));
 		if (st) {
 			(void)sip_reply(sip, msg, 482, "Loop Detected");
@@ -298,10 +298,10 @@ int sip_strans_alloc(struct sip_strans **stp, struct sip *sip,
 	if (!st)
 		return ENOMEM;
 
-	hash_append(sip->ht_strans, hash_joaat_pl(&msg->via.branch),
+	hash_append(sip->ht_strans, hash_wy_pl(&msg->via.branch),
 		    &st->he, st);
 
-	hash_append(sip->ht_strans_mrg, hash_joaat_pl(&msg->callid),
+	hash_append(sip->ht_strans_mrg, hash_wy_pl(&msg->callid),
 		    &st->he_mrg, st);
 
 	st->invite  = !pl_strcmp(&msg->met, "INVITE");
@@ -462,7 +462,6 @@ static void tcp_recv_handler(struct mbuf *mb, void *arg)
 	for (;;) {
 		struct sip_msg *msg;
 		uint32_t clen;
-		size_t end;
 
 		if (mbuf_get_left(conn->mb) < 2)
 			break;
@@ -524,9 +523,19 @@ static void tcp_recv_handler(struct mbuf *mb, void *arg)
 		tmr_start(&conn->tmr, TCP_IDLE_TIMEOUT * 1000,
 			  conn_tmr_handler, conn);
 
-		end = conn->mb->end;
+		/* The body is a view, the buffer keeps the next message */
+		mb = mbuf_alloc_slice(conn->mb, clen);
+		if (!mb) {
+			mem_deref(msg);
+			err = ENOMEM;
+			goto out;
+		}
+
+		mem_deref(msg->mb);
+		msg->mb = mb;
+
+		conn->mb->pos += clen;
 
-		msg->mb->end = msg->mb->pos + clen;
 		msg->sock = mem_ref(conn);
 		msg->src = conn->paddr;
 		msg->dst = conn->laddr;
@@ -535,19 +544,23 @@ static void tcp_recv_handler(struct mbuf *mb, void *arg)
 		sip_recv(conn->sip, msg, 0);
 		mem_deref(msg);
 
-		if (end <= conn->mb->end) {
+		if (!mbuf_get_left(conn->mb)) {
 			conn->mb = mem_deref(conn->mb);
 			break;
 		}
+	}
 
-		mb = mbuf_alloc(end - conn->mb->end);
+	/* Keep only the partial message, once per segment */
+	if (!err && conn->mb && conn->mb->pos) {
+
+		mb = mbuf_alloc(mbuf_get_left(conn->mb));
 		if (!mb) {
 			err = ENOMEM;
 			goto out;
 		}
 
-		(void)mbuf_write_mem(mb, &conn->mb->buf[conn->mb->end],
-				     end - conn->mb->end);
+		(void)mbuf_write_mem(mb, mbuf_buf(conn->mb),
+				     mbuf_get_left(conn->mb));
 
 		mb->pos = 0;
 
@@ -1118,12 +1131,28 @@ static int dst_set_scopeid(struct sip *sip, struct sa *dst, enum sip_transp tp)
 #endif
 
 
+static uint32_t conn_key(const void *data)
+{
+	const struct sip_conn *conn = data;
+
+	return sa_hash(&conn->paddr, SA_ALL);
+}
+
+
+static uint32_t conncfg_key(const void *data)
+{
+	const struct sip_conncfg *cfg = data;
+
+	return sa_hash(&cfg->paddr, SA_ALL);
+}
+
+
 int sip_transp_init(struct sip *sip, uint32_t sz)
 {
 	int err;
 
-	err  = hash_alloc(&sip->ht_conn, sz);
-	err |= hash_alloc(&sip->ht_conncfg, sz);
+	err  = hash_alloc_autogrow(&sip->ht_conn, sz, conn_key);
+	err |= hash_alloc_autogrow(&sip->ht_conncfg, sz, conncfg_key);
 	return err;
 }
 
@@ -106,7 +106,7 @@ static struct sipnot *sipnot_find(struct sipevent_sock *sock,
 	cmp.evt = evt;
 
 	return list_ledata(hash_lookup(sock->ht_not,
-				       hash_joaat_pl(&msg->callid),
+				       hash_wy_pl(&msg->callid),
 				       not_cmp_handler, &cmp));
 }
 
@@ -121,7 +121,7 @@ struct sipsub *sipsub_find(struct sipevent_sock *sock,
 	cmp.evt = evt;
 
 	return list_ledata(hash_lookup(sock->ht_sub,
-				       hash_joaat_pl(&msg->callid), full ?
+				       hash_wy_pl(&msg->callid), full ?
 				       sub_cmp_handler : sub_cmp_half_handler,
 				       &cmp));
 }
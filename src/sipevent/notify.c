@@ -362,7 +362,7 @@ int sipevent_accept(struct sipnot **notp, struct sipevent_sock *sock,
 	}
 
 	hash_append(sock->ht_not,
-		    hash_joaat_str(sip_dialog_callid(not->dlg)),
+		    hash_wy_str(sip_dialog_callid(not->dlg)),
 		    &not->he, not);
 
 	err = sip_auth_alloc(&not->auth, authh, aarg, aref);
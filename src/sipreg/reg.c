@@ -193,6 +193,7 @@ static void response_handler(int err, const struct sip_msg *msg, void *arg)
 {
 	const struct sip_hdr *minexp;
 	struct sipreg *reg = arg;
+	uint64_t slack = 0;
 
 	reg->wait = failwait(reg->failc + 1);
 	if (err || !msg || sip_request_loops(&reg->ls, msg->scode)) {
@@ -212,6 +213,10 @@ static void response_handler(int err, const struct sip_msg *msg, void *arg)
 		reg->wait *= reg->rwait * (1000 / 100);
 		reg->failc = 0;
 
+		/* Refreshes may coalesce within half of the remaining time */
+		if (reg->pexpires * 1000ULL > reg->wait)
+			slack = (reg->pexpires * 1000ULL - reg->wait) / 2;
+
 		if (reg->regid > 0 && !reg->terminated && !reg->ka)
 			start_outbound(reg, msg);
 	}
@@ -281,7 +286,7 @@ static void response_handler(int err, const struct sip_msg *msg, void *arg)
 			mem_deref(reg);
 	}
 	else {
-		tmr_start(&reg->tmr, reg->wait, tmr_handler, reg);
+		tmr_start_slack(&reg->tmr, reg->wait, slack, tmr_handler, reg);
 		reg->resph(err, msg, reg->arg);
 	}
 }
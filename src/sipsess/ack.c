@@ -91,7 +91,7 @@ int sipsess_ack(struct sipsess_sock *sock, struct sip_dialog *dlg,
 		return ENOMEM;
 
 	hash_append(sock->ht_ack,
-		    hash_joaat_str(sip_dialog_callid(dlg)),
+		    hash_wy_str(sip_dialog_callid(dlg)),
 		    &ack->he, ack);
 
 	ack->dlg  = mem_ref(dlg);
@@ -140,7 +140,7 @@ int sipsess_ack_again(struct sipsess_sock *sock, const struct sip_msg *msg)
 	struct sipsess_ack *ack;
 
 	ack = list_ledata(hash_lookup(sock->ht_ack,
-				      hash_joaat_pl(&msg->callid),
+				      hash_wy_pl(&msg->callid),
 				      cmp_handler, (void *)msg));
 	if (!ack)
 		return ENOENT;
@@ -12,6 +12,7 @@
 #endif
 #if !defined(WIN32)
 #include <netdb.h>
+#include <sys/uio.h>
 #endif
 #include <string.h>
 #include <re/re_types.h>
@@ -1203,6 +1204,104 @@ int tcp_send(struct tcp_conn *tc, struct mbuf *mb)
 }
 
 
+static int chain_copy(struct tcp_conn *tc, const struct mbuf_chain *ch,
+		      size_t skip, bool queue)
+{
+	struct mbuf *mb;
+	int err;
+
+	mb = mbuf_alloc(ch->len);
+	if (!mb)
+		return ENOMEM;
+
+	err = mbuf_write_chain(mb, ch);
+	if (err)
+		goto out;
+
+	mb->pos = skip;
+
+	if (queue)
+		err = enqueue(tc, mb);
+	else
+		err = tcp_send(tc, mb);
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/**
+ * Send a chain of memory buffers on a TCP Connection to a remote peer.
+ * Without TCP helpers and queued data the segments are passed to the
+ * kernel as they are, and only an unsent remainder is copied.
+ *
+ * @param tc TCP Connection
+ * @param ch Memory buffer chain to send
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int tcp_send_chain(struct tcp_conn *tc, const struct mbuf_chain *ch)
+{
+#ifndef WIN32
+	struct iovec iov[MBUF_CHAIN_MAX];
+	struct msghdr msg;
+	ssize_t n;
+	size_t i;
+#ifdef MSG_NOSIGNAL
+	const int flags = MSG_NOSIGNAL; /* disable SIGPIPE signal */
+#else
+	const int flags = 0;
+#endif
+#endif
+
+	if (!tc || !ch)
+		return EINVAL;
+
+	if (tc->fdc == RE_BAD_SOCK)
+		return ENOTCONN;
+
+	if (!ch->len)
+		return EINVAL;
+
+#ifdef WIN32
+	return chain_copy(tc, ch, 0, false);
+#else
+	if (tc->helpers.head || tc->sendq.head)
+		return chain_copy(tc, ch, 0, false);
+
+	for (i = 0; i < ch->segc; i++) {
+		const struct mbuf_seg *seg = &ch->segv[i];
+
+		iov[i].iov_base = seg->mb->buf + seg->pos;
+		iov[i].iov_len  = seg->end - seg->pos;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov    = iov;
+	msg.msg_iovlen = ch->segc;
+
+	n = sendmsg(tc->fdc, &msg, flags);
+	if (n < 0) {
+		int err = RE_ERRNO_SOCK;
+
+		if (err == EAGAIN)
+			return chain_copy(tc, ch, 0, true);
+
+		DEBUG_WARNING("send: sendmsg(): %m (fdc=%d)\n", err, tc->fdc);
+
+		return err;
+	}
+
+	if ((size_t)n < ch->len)
+		return chain_copy(tc, ch, (size_t)n, true);
+
+	return 0;
+#endif
+}
+
+
 /**
  * Send data on a TCP Connection to a remote peer bypassing this
  * helper and the helpers above it.
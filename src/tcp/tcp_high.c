@@ -6,12 +6,37 @@
 #include <re/re_types.h>
 #include <re/re_mem.h>
 #include <re/re_mbuf.h>
+#include <re/re_sa.h>
+#include <re/re_main.h>
 #include <re/re_tcp.h>
 
 #ifndef RE_TCP_BACKLOG
 #define RE_TCP_BACKLOG 5
 #endif
 
+
+/** Defines a TCP Socket distributing connections to a reactor group */
+struct tcp_group {
+	struct re_group *grp;   /**< Reactor group              */
+	struct tcp_sock *ts;    /**< Listening socket in loop 0 */
+	tcp_group_conn_h *ch;   /**< Incoming connection handler */
+	void *arg;              /**< Handler argument           */
+};
+
+struct group_conn {
+	struct tcp_sock *ts;
+	struct sa peer;
+	tcp_group_conn_h *ch;
+	void *arg;
+};
+
+struct group_listen {
+	struct tcp_group *tg;
+	const struct sa *local;
+	int err;
+};
+
+
 /**
  * Create and listen on a TCP Socket
  *
@@ -149,3 +174,152 @@ int tcp_local_get(const struct tcp_sock *ts, struct sa *local)
 {
 	return tcp_sock_local_get(ts, local);
 }
+
+
+static void group_conn_destructor(void *data)
+{
+	struct group_conn *gc = data;
+
+	mem_deref(gc->ts);
+}
+
+
+static void group_accept_handler(void *arg)
+{
+	struct group_conn *gc = arg;
+
+	gc->ch(gc->ts, &gc->peer, gc->arg);
+
+	mem_deref(gc);
+}
+
+
+static void group_conn_handler(const struct sa *peer, void *arg)
+{
+	struct tcp_group *tg = arg;
+	struct group_conn *gc;
+	int err;
+
+	gc = mem_zalloc(sizeof(*gc), group_conn_destructor);
+	if (!gc)
+		goto reject;
+
+	/* Take over the accepted connection */
+	gc->ts = tcp_sock_dup(tg->ts);
+	if (!gc->ts)
+		goto reject;
+
+	gc->peer = *peer;
+	gc->ch	 = tg->ch;
+	gc->arg	 = tg->arg;
+
+	err = re_group_post(tg->grp, re_group_next(tg->grp),
+			    group_accept_handler, gc);
+	if (err)
+		mem_deref(gc);
+
+	return;
+
+ reject:
+	mem_deref(gc);
+	tcp_reject(tg->ts);
+}
+
+
+static void group_listen_handler(void *arg)
+{
+	struct group_listen *gl = arg;
+
+	gl->err = tcp_listen(&gl->tg->ts, gl->local, group_conn_handler,
+			     gl->tg);
+}
+
+
+static void group_close_handler(void *arg)
+{
+	struct tcp_group *tg = arg;
+
+	tg->ts = mem_deref(tg->ts);
+}
+
+
+static void group_deref_handler(void *arg)
+{
+	mem_deref(arg);
+}
+
+
+static void tcp_group_destructor(void *data)
+{
+	struct tcp_group *tg = data;
+
+	/* fd_close() must run in the loop of the socket, another loop of
+	 * the group cannot wait for it and hands the socket over */
+	if (tg->ts &&
+	    re_group_call(tg->grp, 0, group_close_handler, tg) == EDEADLK)
+		(void)re_group_post(tg->grp, 0, group_deref_handler, tg->ts);
+
+	mem_deref(tg->grp);
+}
+
+
+/**
+ * Create a TCP Socket listening in the first loop of a reactor group.
+ * Incoming connections are accepted there and handed to the loops in
+ * round-robin order. Must not be called from another loop of the group,
+ * as it waits for the first loop.
+ *
+ * @param tgp   Pointer to returned TCP Socket group
+ * @param grp   Reactor group
+ * @param local Local listen address (NULL for any)
+ * @param ch    Incoming connection handler, called from the chosen loop
+ * @param arg   Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int tcp_listen_group(struct tcp_group **tgp, struct re_group *grp,
+		     const struct sa *local, tcp_group_conn_h *ch, void *arg)
+{
+	struct group_listen gl;
+	struct tcp_group *tg;
+	int err;
+
+	if (!tgp || !grp || !ch)
+		return EINVAL;
+
+	tg = mem_zalloc(sizeof(*tg), tcp_group_destructor);
+	if (!tg)
+		return ENOMEM;
+
+	tg->grp = mem_ref(grp);
+	tg->ch	= ch;
+	tg->arg = arg;
+
+	gl.tg	 = tg;
+	gl.local = local;
+	gl.err	 = 0;
+
+	err = re_group_call(grp, 0, group_listen_handler, &gl);
+	if (!err)
+		err = gl.err;
+
+	if (err)
+		mem_deref(tg);
+	else
+		*tgp = tg;
+
+	return err;
+}
+
+
+/**
+ * Get the listening TCP Socket of a TCP Socket group
+ *
+ * @param tg  TCP Socket group
+ *
+ * @return TCP Socket
+ */
+struct tcp_sock *tcp_group_sock(const struct tcp_group *tg)
+{
+	return tg ? tg->ts : NULL;
+}
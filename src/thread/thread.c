@@ -1,6 +1,20 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#endif
+#ifdef HAVE_SET_MEMPOLICY
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
 #include <re/re_types.h>
 #include <re/re_fmt.h>
 #include <re/re_mem.h>
+#include <re/re_atomic.h>
 #include <re/re_thread.h>
 #include <re/re_trace.h>
 #ifdef HAVE_PRCTL
@@ -20,14 +34,49 @@
 #endif
 #endif
 
+#define DEBUG_MODULE "thread"
+#define DEBUG_LEVEL 5
+#include <re/re_dbg.h>
+
+
+enum {
+	SET_BITS  = 1024,  /**< Highest CPU or node number + 1 */
+	LONG_BITS = 8 * sizeof(unsigned long),
+};
+
+/** Set of CPU or memory node numbers */
+struct numset {
+	unsigned long bits[SET_BITS / LONG_BITS];
+	bool any;                    /**< At least one number is set */
+};
+
+/** Placement policy and statistics of a thread kind */
+struct policy {
+	struct numset cpus;
+	struct numset nodes;
+	RE_ATOMIC unsigned started;  /**< Threads started            */
+	RE_ATOMIC unsigned placed;   /**< Threads placed by policy   */
+	RE_ATOMIC unsigned pinned;   /**< Threads pinned to one CPU  */
+	RE_ATOMIC unsigned failed;   /**< Threads not placed         */
+	RE_ATOMIC int err;           /**< Last placement error       */
+};
 
 struct thread {
 	thrd_t *thr;
 	const char *name;
 	thrd_start_t func;
 	void *arg;
+	enum thread_kind kind;
+};
+
+static const char *kind_names[THREAD_KIND_MAX] = {
+	"default", "async", "loop", "aumix", "vidmix"
 };
 
+static once_flag placement_once = ONCE_FLAG_INIT;
+static mtx_t placement_mtx;  /**< Protects the sets of policyv */
+static struct policy policyv[THREAD_KIND_MAX];
+
 
 static void mutex_destructor(void *data)
 {
@@ -79,6 +128,174 @@ int mutex_alloc_tp(mtx_t **mtx, int type)
 }
 
 
+static void placement_init(void)
+{
+	mtx_init(&placement_mtx, mtx_plain);
+}
+
+
+static inline bool numset_isset(const struct numset *set, unsigned n)
+{
+	return (set->bits[n / LONG_BITS] >> (n % LONG_BITS)) & 1;
+}
+
+
+static inline void numset_set(struct numset *set, unsigned n)
+{
+	set->bits[n / LONG_BITS] |= 1UL << (n % LONG_BITS);
+	set->any = true;
+}
+
+
+static unsigned cpu_count(void)
+{
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (n > 0)
+		return (unsigned)min(n, (long)SET_BITS);
+#endif
+	return 1;
+}
+
+
+static int numset_parse(struct numset *set, const char *str)
+{
+	memset(set, 0, sizeof(*set));
+
+	if (!str)
+		return 0;
+
+	while (*str) {
+		unsigned long lo, hi;
+		char *end;
+
+		if (!isdigit((unsigned char)*str))
+			return EINVAL;
+
+		lo = hi = strtoul(str, &end, 10);
+
+		if (*end == '-') {
+			if (!isdigit((unsigned char)end[1]))
+				return EINVAL;
+
+			hi = strtoul(end + 1, &end, 10);
+		}
+
+		if (lo > hi || hi >= SET_BITS)
+			return EINVAL;
+
+		for (; lo <= hi; lo++)
+			numset_set(set, (unsigned)lo);
+
+		if (*end == ',' && end[1])
+			++end;
+		else if (*end)
+			return EINVAL;
+
+		str = end;
+	}
+
+	return 0;
+}
+
+
+static int numset_print(struct re_printf *pf, const struct numset *set)
+{
+	bool first = true;
+	int err = 0;
+
+	if (!set->any)
+		return re_hprintf(pf, "all");
+
+	for (unsigned i = 0; i < SET_BITS; i++) {
+
+		unsigned j = i;
+
+		if (!numset_isset(set, i))
+			continue;
+
+		while (j + 1 < SET_BITS && numset_isset(set, j + 1))
+			++j;
+
+		err |= re_hprintf(pf, first ? "%u" : ",%u", i);
+		if (j > i)
+			err |= re_hprintf(pf, "-%u", j);
+
+		first = false;
+		i = j;
+	}
+
+	return err;
+}
+
+
+/* Place the calling thread */
+static int numset_apply(const struct numset *cpus,
+			const struct numset *nodes)
+{
+#ifdef __linux__
+	if (cpus->any) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+
+		for (unsigned i = 0; i < SET_BITS && i < CPU_SETSIZE; i++) {
+			if (numset_isset(cpus, i))
+				CPU_SET(i, &set);
+		}
+
+		if (sched_setaffinity(0, sizeof(set), &set))
+			return errno;
+	}
+#else
+	if (cpus->any)
+		return ENOTSUP;
+#endif
+
+#ifdef HAVE_SET_MEMPOLICY
+	if (nodes->any) {
+		if (syscall(SYS_set_mempolicy, MPOL_BIND, nodes->bits,
+			    (unsigned long)SET_BITS + 1))
+			return errno;
+	}
+#else
+	if (nodes->any)
+		return ENOTSUP;
+#endif
+
+	return 0;
+}
+
+
+static void placement_apply(enum thread_kind kind, const char *name)
+{
+	struct policy *pol = &policyv[kind];
+	struct numset cpus, nodes;
+	int err;
+
+	mtx_lock(&placement_mtx);
+	cpus  = pol->cpus;
+	nodes = pol->nodes;
+	mtx_unlock(&placement_mtx);
+
+	re_atomic_rlx_add(&pol->started, 1u);
+
+	if (!cpus.any && !nodes.any)
+		return;
+
+	err = numset_apply(&cpus, &nodes);
+	if (err) {
+		DEBUG_WARNING("%s: could not place thread (%m)\n", name, err);
+		re_atomic_rlx_set(&pol->err, err);
+		re_atomic_rlx_add(&pol->failed, 1u);
+		return;
+	}
+
+	re_atomic_rlx_add(&pol->placed, 1u);
+}
+
+
 static int handler(void *p)
 {
 	struct thread th = *(struct thread *)p;
@@ -100,19 +317,30 @@ static int handler(void *p)
 #endif
 	RE_TRACE_THREAD_NAME(th.name);
 
+	placement_apply(th.kind, th.name);
+
 	return th.func(th.arg);
 }
 
 
 int thread_create_name(thrd_t *thr, const char *name, thrd_start_t func,
 		       void *arg)
+{
+	return thread_create_kind(thr, THREAD_KIND_DEFAULT, name, func, arg);
+}
+
+
+int thread_create_kind(thrd_t *thr, enum thread_kind kind, const char *name,
+		       thrd_start_t func, void *arg)
 {
 	struct thread *th;
 	int ret;
 
-	if (!thr || !func)
+	if (!thr || !func || (unsigned)kind >= THREAD_KIND_MAX)
 		return EINVAL;
 
+	call_once(&placement_once, placement_init);
+
 	th = mem_alloc(sizeof(struct thread), NULL);
 	if (!th)
 		return ENOMEM;
@@ -121,6 +349,7 @@ int thread_create_name(thrd_t *thr, const char *name, thrd_start_t func,
 	th->name = name;
 	th->func = func;
 	th->arg	 = arg;
+	th->kind = kind;
 
 	ret = thrd_create(thr, handler, th);
 	if (ret == thrd_success)
@@ -133,3 +362,115 @@ int thread_create_name(thrd_t *thr, const char *name, thrd_start_t func,
 
 	return EAGAIN;
 }
+
+
+int thread_policy_set(enum thread_kind kind, const char *cpus,
+		      const char *nodes)
+{
+	struct numset cset, nset;
+	int err;
+
+	if ((unsigned)kind >= THREAD_KIND_MAX)
+		return EINVAL;
+
+	err  = numset_parse(&cset, cpus);
+	err |= numset_parse(&nset, nodes);
+	if (err)
+		return EINVAL;
+
+	call_once(&placement_once, placement_init);
+
+	mtx_lock(&placement_mtx);
+	policyv[kind].cpus  = cset;
+	policyv[kind].nodes = nset;
+	mtx_unlock(&placement_mtx);
+
+	return 0;
+}
+
+
+int thread_pin(enum thread_kind kind, unsigned idx)
+{
+	struct numset cpus, cpu, nodes;
+	struct policy *pol;
+	unsigned n = 0;
+	int err;
+
+	if ((unsigned)kind >= THREAD_KIND_MAX)
+		return EINVAL;
+
+	call_once(&placement_once, placement_init);
+
+	pol = &policyv[kind];
+
+	mtx_lock(&placement_mtx);
+	cpus = pol->cpus;
+	mtx_unlock(&placement_mtx);
+
+	memset(&cpu, 0, sizeof(cpu));
+	memset(&nodes, 0, sizeof(nodes));
+
+	if (cpus.any) {
+		for (unsigned i = 0; i < SET_BITS; i++)
+			n += numset_isset(&cpus, i);
+
+		idx %= n;
+
+		for (unsigned i = 0; i < SET_BITS; i++) {
+			if (numset_isset(&cpus, i) && !idx--) {
+				numset_set(&cpu, i);
+				break;
+			}
+		}
+	}
+	else {
+		numset_set(&cpu, idx % cpu_count());
+	}
+
+	err = numset_apply(&cpu, &nodes);
+	if (err) {
+		re_atomic_rlx_set(&pol->err, err);
+		re_atomic_rlx_add(&pol->failed, 1u);
+		return err;
+	}
+
+	re_atomic_rlx_add(&pol->pinned, 1u);
+
+	return 0;
+}
+
+
+int thread_debug(struct re_printf *pf, void *unused)
+{
+	int err;
+	(void)unused;
+
+	call_once(&placement_once, placement_init);
+
+	err = re_hprintf(pf, "  thread placement:\n");
+
+	for (int i = 0; i < THREAD_KIND_MAX; i++) {
+		const struct policy *pol = &policyv[i];
+		int perr = re_atomic_rlx(&pol->err);
+
+		mtx_lock(&placement_mtx);
+		err |= re_hprintf(pf, "    %-8s cpus %H, nodes %H",
+				  kind_names[i], numset_print, &pol->cpus,
+				  numset_print, &pol->nodes);
+		mtx_unlock(&placement_mtx);
+
+		err |= re_hprintf(pf, " (started %u, placed %u, pinned %u,"
+				  " failed %u)",
+				  re_atomic_rlx(&pol->started),
+				  re_atomic_rlx(&pol->placed),
+				  re_atomic_rlx(&pol->pinned),
+				  re_atomic_rlx(&pol->failed));
+
+		if (perr)
+			err |= re_hprintf(pf, " last error: %m", perr);
+
+		err |= re_hprintf(pf, "\n");
+	}
+
+	return err;
+}
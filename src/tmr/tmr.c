@@ -12,10 +12,12 @@
 #include <re/re_list.h>
 #include <re/re_fmt.h>
 #include <re/re_mem.h>
+#include <re/re_atomic.h>
 #include <re/re_thread.h>
 #include <re/re_tmr.h>
 #include <re/re_net.h>
 #include <re/re_main.h>
+#include "../main/main.h"
 
 
 #define DEBUG_MODULE "tmr"
@@ -32,31 +34,286 @@
 
 /** Timer values */
 enum {
-	MAX_BLOCKING = 500   /**< Maximum time spent in handler [ms] */
+	MAX_BLOCKING = 500,               /**< Maximum time spent in handler [ms] */
+	WHEEL_BITS   = 6,                 /**< Slot index bits per level         */
+	WHEEL_SLOTS  = 1 << WHEEL_BITS,   /**< Slots per level                   */
+	WHEEL_LEVELS = 6,                 /**< Number of levels                  */
 };
 
+/**
+ * Defines a timer list
+ *
+ * Timers are kept in a hierarchical timing wheel with 1 ms resolution. A
+ * timer is stored on the level of the highest 6-bit group in which its
+ * expire time differs from the wheel time, in the slot selected by that
+ * group. Timers with the same expire time therefore always share a slot and
+ * keep their start order. When the wheel time enters the range of a slot,
+ * its timers are moved to lower levels; level 0 slots hold a single expire
+ * time and move to the expired list when due.
+ *
+ * The wheel is owned by the thread that allocated the list. The owner
+ * enters the list by raising its busy flag, and only takes the mutex while
+ * another thread is inside. Other threads take the mutex, announce
+ * themselves and wait for the owner to leave. Timers armed from other
+ * threads are pushed to a lock-free inbox instead, which the owner moves
+ * into the wheel before polling.
+ */
 struct tmrl {
-	struct list list;
-	mtx_t *lock;
+	struct list wheel[WHEEL_LEVELS][WHEEL_SLOTS]; /**< Timer slots        */
+	uint64_t slotmap[WHEEL_LEVELS]; /**< Possibly non-empty slots          */
+	struct list far;      /**< Timers beyond the last level              */
+	struct list expired;  /**< Due timers, ordered by expire time        */
+	uint64_t now;         /**< Wheel time in [ms]                        */
+	const struct tmr *first; /**< Cached earliest timer in the wheel    */
+	bool first_valid;     /**< The cached timer is valid                 */
+	uint32_t count;       /**< Number of timers                          */
+	thrd_t owner;         /**< Owner thread                              */
+	RE_ATOMIC bool busy;  /**< Owner is inside without the mutex        */
+	RE_ATOMIC unsigned foreign; /**< Other threads inside or waiting    */
+	RE_ATOMIC uintptr_t inbox;  /**< Timers armed by other threads      */
+	mtx_t mtx;            /**< List mutex                                */
+	mtx_t *lock;          /**< Points to mtx, shared with timers         */
 };
 
 
-static void tmrl_destructor(void *arg)
+static inline struct tmrl *tmrl_of(mtx_t *lock)
 {
-	struct tmrl *tmrl = arg;
+	return (struct tmrl *)(void *)((char *)lock -
+				       offsetof(struct tmrl, mtx));
+}
+
+
+static inline unsigned fls64(uint64_t v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return v ? 64 - (unsigned)__builtin_clzll(v) : 0;
+#else
+	unsigned n = 0;
+
+	while (v) {
+		v >>= 1;
+		++n;
+	}
+
+	return n;
+#endif
+}
+
+
+static inline unsigned ffs64(uint64_t v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned)__builtin_ctzll(v);
+#else
+	unsigned n = 0;
+
+	while (!(v & 1)) {
+		v >>= 1;
+		++n;
+	}
+
+	return n;
+#endif
+}
+
+
+static inline uint64_t expire_us(const struct tmr *tmr)
+{
+	return tmr->jfs * 1000 + tmr->usec;
+}
+
+
+static inline unsigned slot_idx(uint64_t jfs, unsigned lvl)
+{
+	return (unsigned)(jfs >> (lvl * WHEEL_BITS)) & (WHEEL_SLOTS - 1);
+}
+
+
+static inline bool tmrl_owned(const struct tmrl *tmrl)
+{
+	return thrd_equal(tmrl->owner, thrd_current());
+}
 
+
+/**
+ * Enter a timer list for modification
+ *
+ * @param tmrl Timer list
+ *
+ * @return true if the mutex was taken, false for the owner fast path
+ */
+static bool tmrl_enter(struct tmrl *tmrl)
+{
+	if (tmrl_owned(tmrl)) {
+
+		re_atomic_seq_set(&tmrl->busy, true);
+		if (!re_atomic_seq(&tmrl->foreign))
+			return false;
+
+		/* Contended, queue up on the mutex */
+		re_atomic_rls_set(&tmrl->busy, false);
+		mtx_lock(tmrl->lock);
+
+		return true;
+	}
+
+	re_atomic_seq_add(&tmrl->foreign, 1u);
 	mtx_lock(tmrl->lock);
-	list_clear(&tmrl->list);
+
+	/* The owner leaves quickly, it never waits inside */
+	while (re_atomic_seq(&tmrl->busy))
+		;
+
+	return true;
+}
+
+
+static void tmrl_leave(struct tmrl *tmrl, bool locked)
+{
+	if (!locked) {
+		re_atomic_rls_set(&tmrl->busy, false);
+		return;
+	}
+
 	mtx_unlock(tmrl->lock);
 
-	mem_deref(tmrl->lock);
+	if (!tmrl_owned(tmrl))
+		re_atomic_seq_sub(&tmrl->foreign, 1u);
+}
+
+
+/* Place a timer by its expire time, relative to the wheel time */
+static void wheel_place(struct tmrl *tmrl, struct tmr *tmr)
+{
+	unsigned lvl, idx;
+
+	if (tmr->jfs <= tmrl->now) {
+		struct le *le = tmrl->expired.tail;
+
+		/* Insert after the last timer expiring at the same time */
+		while (le && expire_us(le->data) > expire_us(tmr))
+			le = le->prev;
+
+		if (le)
+			list_insert_after(&tmrl->expired, le, &tmr->le, tmr);
+		else
+			list_prepend(&tmrl->expired, &tmr->le, tmr);
+
+		return;
+	}
+
+	lvl = (fls64(tmr->jfs ^ tmrl->now) - 1) / WHEEL_BITS;
+	if (lvl >= WHEEL_LEVELS) {
+		list_append(&tmrl->far, &tmr->le, tmr);
+		return;
+	}
+
+	idx = slot_idx(tmr->jfs, lvl);
+
+	list_append(&tmrl->wheel[lvl][idx], &tmr->le, tmr);
+	tmrl->slotmap[lvl] |= 1ULL << idx;
+}
+
+
+static void tmrl_insert(struct tmrl *tmrl, struct tmr *tmr)
+{
+	wheel_place(tmrl, tmr);
+	++tmrl->count;
+
+	if (tmrl->first_valid && expire_us(tmr) < expire_us(tmrl->first))
+		tmrl->first = tmr;
+}
+
+
+static void tmrl_unlink(struct tmrl *tmrl, struct tmr *tmr)
+{
+	list_unlink(&tmr->le);
+	--tmrl->count;
+
+	if (tmrl->first_valid && tmr == tmrl->first)
+		tmrl->first_valid = false;
+}
+
+
+/* Push a timer armed by another thread, lock-free */
+static void inbox_push(struct tmrl *tmrl, struct tmr *tmr)
+{
+	uintptr_t head = re_atomic_rlx(&tmrl->inbox);
+
+	do {
+		tmr->qnext = (struct tmr *)head;
+	} while (!re_atomic_compare_exchange_weak(&tmrl->inbox, &head,
+						  (uintptr_t)tmr,
+						  re_memory_order_release,
+						  re_memory_order_relaxed));
+}
+
+
+/* Move armed timers from the inbox into the wheel, inside the list */
+static void inbox_drain(struct tmrl *tmrl)
+{
+	struct tmr *tmr, *next, *prev = NULL;
+
+	if (!re_atomic_rlx(&tmrl->inbox))
+		return;
+
+	tmr = (struct tmr *)re_atomic_exchange(&tmrl->inbox, (uintptr_t)0,
+					       re_memory_order_acquire);
+
+	/* Restore arming order */
+	for (; tmr; tmr = next) {
+		next = tmr->qnext;
+		tmr->qnext = prev;
+		prev = tmr;
+	}
+
+	for (tmr = prev; tmr; tmr = next) {
+		next = tmr->qnext;
+		tmr->qnext = NULL;
+		tmrl_insert(tmrl, tmr);
+	}
+}
+
+
+/* Detach all timers of a list, they stay idle until restarted */
+static void list_detach(struct list *list)
+{
+	struct le *le;
+
+	while ((le = list->head)) {
+		struct tmr *tmr = le->data;
+
+		list_unlink(le);
+		re_atomic_rls_set(&tmr->active, false);
+	}
+}
+
+
+static void tmrl_destructor(void *arg)
+{
+	struct tmrl *tmrl = arg;
+	bool locked;
+
+	locked = tmrl_enter(tmrl);
+	inbox_drain(tmrl);
+
+	for (unsigned lvl = 0; lvl < WHEEL_LEVELS; lvl++) {
+		for (unsigned i = 0; i < WHEEL_SLOTS; i++)
+			list_detach(&tmrl->wheel[lvl][i]);
+	}
+
+	list_detach(&tmrl->far);
+	list_detach(&tmrl->expired);
+
+	tmrl_leave(tmrl, locked);
+
+	mtx_destroy(&tmrl->mtx);
 }
 
 
 int tmrl_alloc(struct tmrl **tmrl)
 {
 	struct tmrl *l;
-	int err;
 
 	if (!tmrl)
 		return EINVAL;
@@ -65,14 +322,15 @@ int tmrl_alloc(struct tmrl **tmrl)
 	if (!l)
 		return ENOMEM;
 
-	list_init(&l->list);
-
-	err = mutex_alloc(&l->lock);
-	if (err) {
+	if (mtx_init(&l->mtx, mtx_plain) != thrd_success) {
 		mem_deref(l);
-		return err;
+		return ENOMEM;
 	}
 
+	l->lock	 = &l->mtx;
+	l->now	 = tmr_jiffies();
+	l->owner = thrd_current();
+
 	mem_destructor(l, tmrl_destructor);
 
 	*tmrl = l;
@@ -81,41 +339,151 @@ int tmrl_alloc(struct tmrl **tmrl)
 }
 
 
-static bool inspos_handler(struct le *le, void *arg)
+/*
+ * Find the first non-empty slot after the wheel time. Lower levels always
+ * expire before higher levels, so the first hit holds the earliest timers.
+ */
+static struct list *wheel_first(struct tmrl *tmrl, uint64_t *start)
 {
-	struct tmr *tmr = le->data;
-	const uint64_t now = *(uint64_t *)arg;
+	const uint64_t now = tmrl->now;
+
+	for (unsigned lvl = 0; lvl < WHEEL_LEVELS; lvl++) {
+		const unsigned shift = lvl * WHEEL_BITS;
+		const unsigned cur = slot_idx(now, lvl);
+		uint64_t map = tmrl->slotmap[lvl] & ~((2ULL << cur) - 1);
+
+		while (map) {
+			const unsigned idx = ffs64(map);
+			struct list *slot = &tmrl->wheel[lvl][idx];
+
+			if (slot->head) {
+				*start = (now >> (shift + WHEEL_BITS)
+					  << (shift + WHEEL_BITS)) |
+					 ((uint64_t)idx << shift);
+				return slot;
+			}
+
+			/* Slots are cleared lazily */
+			tmrl->slotmap[lvl] &= ~(1ULL << idx);
+			map &= map - 1;
+		}
+	}
 
-	return tmr->jfs <= now;
+	if (tmrl->far.head) {
+		const unsigned shift = WHEEL_LEVELS * WHEEL_BITS;
+
+		*start = ((now >> shift) + 1) << shift;
+		return &tmrl->far;
+	}
+
+	return NULL;
 }
 
 
-static bool inspos_handler_0(struct le *le, void *arg)
+static void wheel_cascade(struct tmrl *tmrl, struct list *slot)
 {
-	struct tmr *tmr = le->data;
-	const uint64_t now = *(uint64_t *)arg;
+	struct le *le;
 
-	return tmr->jfs > now;
+	while ((le = slot->head)) {
+		list_unlink(le);
+		wheel_place(tmrl, le->data);
+	}
 }
 
 
-#if TMR_DEBUG
-static void call_handler(tmr_h *th, void *arg)
+/* Move the wheel time forward, due timers go to the expired list */
+static void wheel_advance(struct tmrl *tmrl, uint64_t to)
 {
-	const uint64_t tick = tmr_jiffies();
-	uint32_t diff;
+	while (tmrl->now < to) {
+		uint64_t start = 0;
+		struct list *slot = wheel_first(tmrl, &start);
+
+		if (!slot || start > to) {
+			tmrl->now = to;
+			break;
+		}
+
+		tmrl->now = start;
+		tmrl->first_valid = false;
+
+		if (slot == &tmrl->far) {
+			wheel_cascade(tmrl, slot);
+			continue;
+		}
+
+		/* Enter the slot from its own level down to level 0 */
+		for (unsigned lvl = WHEEL_LEVELS; lvl-- > 0;) {
+			const uint64_t mask = (1ULL << (lvl * WHEEL_BITS)) - 1;
+			const unsigned idx = slot_idx(start, lvl);
+
+			if (start & mask)
+				continue;
+
+			wheel_cascade(tmrl, &tmrl->wheel[lvl][idx]);
+			tmrl->slotmap[lvl] &= ~(1ULL << idx);
+		}
+	}
+}
+
+
+/* Earliest timer, NULL if the list is empty */
+static const struct tmr *tmrl_first(struct tmrl *tmrl)
+{
+	const struct tmr *tmr = list_ledata(tmrl->expired.head);
+	uint64_t start;
+	struct list *slot;
+
+	if (tmr)
+		return tmr;
+
+	if (tmrl->first_valid)
+		return tmrl->first;
+
+	slot = wheel_first(tmrl, &start);
+	if (!slot)
+		return NULL;
+
+	tmr = slot->head->data;
+
+	for (struct le *le = slot->head->next; le; le = le->next) {
+		if (expire_us(le->data) < expire_us(tmr))
+			tmr = le->data;
+	}
+
+	tmrl->first	  = tmr;
+	tmrl->first_valid = true;
+
+	return tmr;
+}
+
+
+/**
+ * Call a timeout handler and account its duration
+ *
+ * @param th   Timeout handler
+ * @param arg  Handler argument
+ * @param tick Start time in [us], updated to the end time
+ */
+static void call_handler(tmr_h *th, void *arg, uint64_t *tick)
+{
+	uint64_t now, diff;
 
 	/* Call handler */
 	th(arg);
 
-	diff = (uint32_t)(tmr_jiffies() - tick);
+	now   = tmr_jiffies_usec();
+	diff  = now - *tick;
+	*tick = now;
+
+	re_hstat_add(RE_HSTAT_TMR, (re_fn_h *)th, diff);
 
-	if (diff > MAX_BLOCKING) {
-		DEBUG_WARNING("long async blocking: %u>%u ms (h=%p arg=%p)\n",
-			      diff, MAX_BLOCKING, th, arg);
+#if TMR_DEBUG
+	if (diff > MAX_BLOCKING * 1000) {
+		DEBUG_WARNING("long async blocking: %llu>%u ms (h=%p arg=%p)\n",
+			      diff / 1000, MAX_BLOCKING, th, arg);
 	}
-}
 #endif
+}
 
 
 /**
@@ -125,21 +493,28 @@ static void call_handler(tmr_h *th, void *arg)
  */
 void tmr_poll(struct tmrl *tmrl)
 {
-	const uint64_t jfs = tmr_jiffies();
+	const uint64_t now = tmr_jiffies_usec();
+	uint64_t tick = now;
+	bool locked;
 
 	if (!tmrl)
 		return;
 
+	locked = tmrl_enter(tmrl);
+	inbox_drain(tmrl);
+	wheel_advance(tmrl, now / 1000);
+	tmrl_leave(tmrl, locked);
+
 	for (;;) {
 		struct tmr *tmr;
 		tmr_h *th;
 		void *th_arg;
 
-		mtx_lock(tmrl->lock);
-		tmr = list_ledata(tmrl->list.head);
+		locked = tmrl_enter(tmrl);
+		tmr = list_ledata(tmrl->expired.head);
 
-		if (!tmr || (tmr->jfs > jfs)) {
-			mtx_unlock(tmrl->lock);
+		if (!tmr || (expire_us(tmr) > now)) {
+			tmrl_leave(tmrl, locked);
 			break;
 		}
 
@@ -148,17 +523,14 @@ void tmr_poll(struct tmrl *tmrl)
 
 		tmr->th = NULL;
 
-		list_unlink(&tmr->le);
-		mtx_unlock(tmrl->lock);
+		tmrl_unlink(tmrl, tmr);
+		re_atomic_rls_set(&tmr->active, false);
+		tmrl_leave(tmrl, locked);
 
 		if (!th)
 			continue;
 
-#if TMR_DEBUG
-		call_handler(th, th_arg);
-#else
-		th(th_arg);
-#endif
+		call_handler(th, th_arg, &tick);
 	}
 }
 
@@ -300,13 +672,15 @@ uint64_t tmr_next_timeout(struct tmrl *tmrl)
 	const uint64_t jif = tmr_jiffies();
 	const struct tmr *tmr;
 	uint64_t ret = 0;
+	bool locked;
 
 	if (!tmrl)
 		return 0;
 
-	mtx_lock(tmrl->lock);
+	locked = tmrl_enter(tmrl);
+	inbox_drain(tmrl);
 
-	tmr = list_ledata(tmrl->list.head);
+	tmr = tmrl_first(tmrl);
 	if (!tmr)
 		goto out;
 
@@ -316,16 +690,69 @@ uint64_t tmr_next_timeout(struct tmrl *tmrl)
 		ret = tmr->jfs - jif;
 
 out:
-	mtx_unlock(tmrl->lock);
+	tmrl_leave(tmrl, locked);
+
+	return ret;
+}
+
+
+/**
+ * Get the expire time of the next timer
+ *
+ * @param tmrl Timer-list
+ * @param prec Returns true if the timer has microsecond precision (optional)
+ *
+ * @return Expire time in [us] on the tmr_jiffies_usec() clock, or 0 if no
+ *         active timers
+ */
+uint64_t tmrl_next_expire_us(struct tmrl *tmrl, bool *prec)
+{
+	const struct tmr *tmr;
+	uint64_t ret = 0;
+	bool locked;
+
+	if (prec)
+		*prec = false;
+
+	if (!tmrl)
+		return 0;
+
+	locked = tmrl_enter(tmrl);
+	inbox_drain(tmrl);
+
+	tmr = tmrl_first(tmrl);
+	if (tmr) {
+		ret = expire_us(tmr);
+		if (prec)
+			*prec = tmr->prec;
+	}
+
+	tmrl_leave(tmrl, locked);
 
 	return ret;
 }
 
 
+static int status_list(struct re_printf *pf, const struct list *list)
+{
+	int err = 0;
+
+	for (struct le *le = list->head; le; le = le->next) {
+		const struct tmr *tmr = le->data;
+		err |= re_hprintf(pf, "  %p: th=%p expire=%llums file=%s:%d\n",
+				  tmr, tmr->th,
+				  (unsigned long long)tmr_get_expire(tmr),
+				  tmr->file, tmr->line);
+	}
+
+	return err;
+}
+
+
 int tmr_status(struct re_printf *pf, void *unused)
 {
 	struct tmrl *tmrl = re_tmrl_get();
-	struct le *le;
+	bool locked;
 	uint32_t n;
 	int err = 0;
 
@@ -334,27 +761,35 @@ int tmr_status(struct re_printf *pf, void *unused)
 	if (!tmrl)
 		return EINVAL;
 
-	mtx_lock(tmrl->lock);
+	locked = tmrl_enter(tmrl);
+	inbox_drain(tmrl);
 
-	n = list_count(&tmrl->list);
+	n = tmrl->count;
 	if (!n)
 		goto out;
 
 	err = re_hprintf(pf, "Timers (%u):\n", n);
 
-	for (le = tmrl->list.head; le; le = le->next) {
-		const struct tmr *tmr = le->data;
-		err |= re_hprintf(pf, "  %p: th=%p expire=%llums file=%s:%d\n",
-				  tmr, tmr->th,
-				  (unsigned long long)tmr_get_expire(tmr),
-				  tmr->file, tmr->line);
+	/* Roughly in expire order, slots above level 0 are unsorted */
+	err |= status_list(pf, &tmrl->expired);
+
+	for (unsigned lvl = 0; lvl < WHEEL_LEVELS; lvl++) {
+		const unsigned cur = slot_idx(tmrl->now, lvl);
+
+		for (unsigned i = 1; i <= WHEEL_SLOTS; i++) {
+			const unsigned idx = (cur + i) % WHEEL_SLOTS;
+
+			err |= status_list(pf, &tmrl->wheel[lvl][idx]);
+		}
 	}
 
+	err |= status_list(pf, &tmrl->far);
+
 	if (n > 100)
 		err |= re_hprintf(pf, "    (Dumped Timers: %u)\n", n);
 
 out:
-	mtx_unlock(tmrl->lock);
+	tmrl_leave(tmrl, locked);
 	return err;
 }
 
@@ -382,92 +817,159 @@ void tmr_init(struct tmr *tmr)
 }
 
 
-static void tmr_startcont_dbg(struct tmr *tmr, uint64_t delay, bool syncnow,
-                   tmr_h *th, void *arg,
-		   const char *file, int line)
+/**
+ * Pick the expire time with the coarsest alignment in [jfs, jfs + slack].
+ * Timers with overlapping windows tend to pick the same time and expire
+ * together.
+ *
+ * @param jfs   Earliest expire time in [ms]
+ * @param slack Tolerated delay in [ms]
+ *
+ * @return Expire time in [ms]
+ */
+static uint64_t slack_round(uint64_t jfs, uint64_t slack)
 {
-	struct tmrl *tmrl = re_tmrl_get();
-	struct le *le;
-	mtx_t *lock;
+	const uint64_t limit = jfs + slack;
+	uint64_t mask;
 
-	if (!tmr || !tmrl)
-		return;
+	if (limit < jfs)
+		return jfs;
 
-	/* Prevent multiple cancel race conditions */
-	if (!re_atomic_acq(&tmr->active) && !th)
-		return;
+	mask = jfs ^ limit;
+	if (!mask)
+		return jfs;
 
-	re_atomic_rls_set(&tmr->active, false);
+	mask = (1ULL << (fls64(mask) - 1)) - 1;
 
-	if (!tmr->llock || !tmr->le.list)
-		lock = tmrl->lock; /* use current list lock */
-	else
-		lock = tmr->llock; /* use old list lock for unlinking */
+	return limit & ~mask;
+}
 
-	mtx_lock(lock);
 
-	if (tmr->th)
-		list_unlink(&tmr->le);
+/* Remove an active timer from the wheel or inbox of its list */
+static void tmr_remove(struct tmr *tmr)
+{
+	struct tmrl *tmrl = tmrl_of(tmr->llock);
+	bool locked;
+
+	locked = tmrl_enter(tmrl);
+
+	/* Recheck, the timer may have expired meanwhile */
+	if (re_atomic_rlx(&tmr->active)) {
+
+		if (!tmr->le.list)
+			inbox_drain(tmrl);
+
+		if (tmr->le.list)
+			tmrl_unlink(tmrl, tmr);
+
+		re_atomic_rls_set(&tmr->active, false);
+	}
+
+	tmrl_leave(tmrl, locked);
+}
 
-	mtx_unlock(lock);
 
-	lock = tmrl->lock;
+static void tmr_startcont_dbg(struct tmr *tmr, uint64_t delay,
+			      uint64_t slack, bool syncnow, bool prec,
+			      tmr_h *th, void *arg, const char *file, int line)
+{
+	struct tmrl *tmrl = re_tmrl_get();
+	bool locked;
+
+	if (!tmr || !tmrl)
+		return;
 
-	mtx_lock(lock);
+	if (re_atomic_acq(&tmr->active) && tmr->llock)
+		tmr_remove(tmr);
+	else if (!th && !tmr->th)
+		return; /* Prevent multiple cancel race conditions */
 
+	/* The timer is idle now, only this thread refers to it */
 	tmr->th	  = th;
 	tmr->arg  = arg;
 	tmr->file = file;
 	tmr->line = line;
-	tmr->llock = tmrl->lock;
 
 	if (!th) {
 		tmr->llock = NULL;
-		mtx_unlock(lock);
 		return;
 	}
 
-	if (syncnow)
-		tmr->jfs = tmr_jiffies();
-	tmr->jfs += delay;
+	if (prec) {
+		uint64_t us;
 
-	if (delay == 0) {
-		le = list_apply(&tmrl->list, true, inspos_handler_0,
-				&tmr->jfs);
-		if (le) {
-			list_insert_before(&tmrl->list, le, &tmr->le, tmr);
-		}
-		else {
-			list_append(&tmrl->list, &tmr->le, tmr);
+		if (syncnow) {
+			us = tmr_jiffies_usec();
+			tmr->jfs = us / 1000;
+			tmr->usec = (uint16_t)(us % 1000);
 		}
+
+		us = tmr->usec + delay;
+		tmr->jfs += us / 1000;
+		tmr->usec = (uint16_t)(us % 1000);
 	}
 	else {
-		le = list_apply(&tmrl->list, false, inspos_handler, &tmr->jfs);
-		if (le) {
-			list_insert_after(&tmrl->list, le, &tmr->le, tmr);
-		}
-		else {
-			list_prepend(&tmrl->list, &tmr->le, tmr);
+		if (syncnow) {
+			tmr->jfs = tmr_jiffies();
+			tmr->usec = 0;
 		}
+
+		tmr->jfs += delay;
+
+		if (slack)
+			tmr->jfs = slack_round(tmr->jfs, slack);
 	}
 
+	tmr->prec  = prec;
+	tmr->llock = tmrl->lock;
+
+	if (!tmrl_owned(tmrl)) {
+		re_atomic_rls_set(&tmr->active, true);
+		inbox_push(tmrl, tmr);
+		return;
+	}
+
+	locked = tmrl_enter(tmrl);
+
+	tmrl_insert(tmrl, tmr);
 	re_atomic_rls_set(&tmr->active, true);
 
-	mtx_unlock(lock);
+	tmrl_leave(tmrl, locked);
 }
 
 
 void tmr_start_dbg(struct tmr *tmr, uint64_t delay, tmr_h *th, void *arg,
 		   const char *file, int line)
 {
-	tmr_startcont_dbg(tmr, delay, true, th, arg, file, line);
+	tmr_startcont_dbg(tmr, delay, 0, true, false, th, arg, file, line);
+}
+
+
+void tmr_start_slack_dbg(struct tmr *tmr, uint64_t delay, uint64_t slack,
+			 tmr_h *th, void *arg, const char *file, int line)
+{
+	tmr_startcont_dbg(tmr, delay, slack, true, false, th, arg, file, line);
 }
 
 
 void tmr_continue_dbg(struct tmr *tmr, uint64_t delay, tmr_h *th, void *arg,
 		   const char *file, int line)
 {
-	tmr_startcont_dbg(tmr, delay, false, th, arg, file, line);
+	tmr_startcont_dbg(tmr, delay, 0, false, false, th, arg, file, line);
+}
+
+
+void tmr_start_us_dbg(struct tmr *tmr, uint64_t delay, tmr_h *th, void *arg,
+		      const char *file, int line)
+{
+	tmr_startcont_dbg(tmr, delay, 0, true, true, th, arg, file, line);
+}
+
+
+void tmr_continue_us_dbg(struct tmr *tmr, uint64_t delay, tmr_h *th,
+			 void *arg, const char *file, int line)
+{
+	tmr_startcont_dbg(tmr, delay, 0, false, true, th, arg, file, line);
 }
 
 
@@ -502,6 +1004,27 @@ uint64_t tmr_get_expire(const struct tmr *tmr)
 }
 
 
+/**
+ * Get the time left until timer expires, in microseconds
+ *
+ * @param tmr Timer object
+ *
+ * @return Time in [us] until expiration
+ */
+uint64_t tmr_get_expire_us(const struct tmr *tmr)
+{
+	uint64_t now, exp;
+
+	if (!tmr || !tmr->th)
+		return 0;
+
+	now = tmr_jiffies_usec();
+	exp = expire_us(tmr);
+
+	return (exp > now) ? (exp - now) : 0;
+}
+
+
 /**
  * Get current timer list count
  *
@@ -511,14 +1034,16 @@ uint64_t tmr_get_expire(const struct tmr *tmr)
  */
 uint32_t tmrl_count(struct tmrl *tmrl)
 {
+	bool locked;
 	uint32_t c;
 
 	if (!tmrl)
 		return 0;
 
-	mtx_lock(tmrl->lock);
-	c = list_count(&tmrl->list);
-	mtx_unlock(tmrl->lock);
+	locked = tmrl_enter(tmrl);
+	inbox_drain(tmrl);
+	c = tmrl->count;
+	tmrl_leave(tmrl, locked);
 
 	return c;
 }
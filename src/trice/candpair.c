@@ -50,6 +50,7 @@ static void candpair_destructor(void *arg)
 	struct ice_candpair *cp = arg;
 
 	list_unlink(&cp->le);
+	rbtree_unlink(&cp->rn);
 	mem_deref(cp->lcand);
 	mem_deref(cp->rcand);
 	mem_deref(cp->tc);
@@ -58,12 +59,15 @@ static void candpair_destructor(void *arg)
 }
 
 
-static bool sort_handler(struct le *le1, struct le *le2, void *arg)
+/* Highest pair priority is ordered first */
+int trice_candpair_prio_cmp(const struct rbnode *n1, const struct rbnode *n2)
 {
-	const struct ice_candpair *cp1 = le1->data, *cp2 = le2->data;
-	(void)arg;
+	const struct ice_candpair *cp1 = n1->data, *cp2 = n2->data;
 
-	return cp1->pprio >= cp2->pprio;
+	if (cp1->pprio > cp2->pprio)
+		return -1;
+
+	return cp1->pprio < cp2->pprio;
 }
 
 
@@ -85,23 +89,25 @@ static void candpair_set_pprio(struct ice_candpair *cp, bool controlling)
 
 
 /**
- * Add candidate pair to list, sorted by pair priority (highest is first)
+ * Add candidate pair to list, sorted by pair priority (highest is first).
+ * The index tree finds the slot, the pair follows its tree predecessor.
  */
-static void list_add_sorted(struct list *list, struct ice_candpair *cp)
+static void list_add_sorted(struct list *list, struct rbtree *index,
+			    struct ice_candpair *cp)
 {
-	struct le *le;
+	struct rbnode *prev;
 
-	/* find our slot */
-	for (le = list_tail(list); le; le = le->prev) {
-		struct ice_candpair *cp0 = le->data;
+	rbtree_insert(index, &cp->rn, cp);
 
-		if (cp->pprio < cp0->pprio) {
-			list_insert_after(list, le, &cp->le, cp);
-			return;
-		}
-	}
+	prev = rbtree_prev(&cp->rn);
+	if (prev) {
+		struct ice_candpair *cp0 = prev->data;
 
-	list_prepend(list, &cp->le, cp);
+		list_insert_after(list, &cp0->le, &cp->le, cp);
+	}
+	else {
+		list_prepend(list, &cp->le, cp);
+	}
 }
 
 
@@ -128,7 +134,7 @@ int trice_candpair_alloc(struct ice_candpair **cpp, struct trice *icem,
 
 	candpair_set_pprio(cp, icem->lrole == ICE_ROLE_CONTROLLING);
 
-	list_add_sorted(&icem->checkl, cp);
+	list_add_sorted(&icem->checkl, &icem->checkt, cp);
 
 	if (cpp)
 		*cpp = cp;
@@ -138,17 +144,28 @@ int trice_candpair_alloc(struct ice_candpair **cpp, struct trice *icem,
 
 
 /* Computing Pair Priority and Ordering Pairs */
-void trice_candpair_prio_order(struct list *lst, bool controlling)
+void trice_candpair_prio_order(struct trice *icem, bool controlling)
 {
+	struct rbnode *rn;
 	struct le *le;
 
-	for (le = list_head(lst); le; le = le->next) {
+	rbtree_clear(&icem->checkt);
+
+	for (le = list_head(&icem->checkl); le; le = le->next) {
 		struct ice_candpair *cp = le->data;
 
 		candpair_set_pprio(cp, controlling);
+		rbtree_insert(&icem->checkt, &cp->rn, cp);
 	}
 
-	list_sort(lst, sort_handler, NULL);
+	/* Relink the list in index order, pairs of equal priority keep
+	   their order */
+	RBTREE_FOREACH(&icem->checkt, rn) {
+		struct ice_candpair *cp = rn->data;
+
+		list_unlink(&cp->le);
+		list_append(&icem->checkl, &cp->le, cp);
+	}
 }
 
 
@@ -169,7 +186,8 @@ void trice_candpair_make_valid(struct trice *icem, struct ice_candpair *pair)
 	trice_candpair_set_state(pair, ICE_CANDPAIR_SUCCEEDED);
 
 	list_unlink(&pair->le);
-	list_add_sorted(&icem->validl, pair);
+	rbtree_unlink(&pair->rn);
+	list_add_sorted(&icem->validl, &icem->validt, pair);
 }
 
 
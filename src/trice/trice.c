@@ -89,6 +89,8 @@ int trice_alloc(struct trice **icemp, const struct trice_conf *conf,
 	list_init(&icem->rcandl);
 	list_init(&icem->checkl);
 	list_init(&icem->validl);
+	rbtree_init(&icem->checkt, trice_candpair_prio_cmp);
+	rbtree_init(&icem->validt, trice_candpair_prio_cmp);
 
 	icem->lrole = role;
 	icem->tiebrk = rand_u64();
@@ -249,7 +251,7 @@ int trice_set_role(struct trice *trice, enum ice_role role)
 
 	/* Create candidate pairs and process pending requests */
 	if (refresh) {
-		trice_candpair_prio_order(&trice->checkl,
+		trice_candpair_prio_order(trice,
 					  role == ICE_ROLE_CONTROLLING);
 	}
 	else {
@@ -445,8 +447,7 @@ void trice_switch_local_role(struct trice *ice)
 	ice->lrole = new_role;
 
 	/* recompute pair priorities for all media streams */
-	trice_candpair_prio_order(&ice->checkl,
-				  ice->lrole == ICE_ROLE_CONTROLLING);
+	trice_candpair_prio_order(ice, ice->lrole == ICE_ROLE_CONTROLLING);
 }
 
 
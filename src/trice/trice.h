@@ -53,6 +53,8 @@ struct trice {
 	struct list rcandl;          /**< remote candidates (add order)      */
 	struct list checkl;          /**< Check List of cand pairs (sorted)  */
 	struct list validl;          /**< Valid List of cand pairs (sorted)  */
+	struct rbtree checkt;        /**< Priority index of the Check List   */
+	struct rbtree validt;        /**< Priority index of the Valid List   */
 	struct list reqbufl;         /**< buffered incoming requests         */
 
 	struct ice_checklist *checklist;
@@ -137,7 +139,9 @@ int trice_rcands_debug(struct re_printf *pf, const struct list *lst);
 /* candpair */
 int  trice_candpair_alloc(struct ice_candpair **cpp, struct trice *icem,
 			 struct ice_lcand *lcand, struct ice_rcand *rcand);
-void trice_candpair_prio_order(struct list *lst, bool controlling);
+void trice_candpair_prio_order(struct trice *icem, bool controlling);
+int  trice_candpair_prio_cmp(const struct rbnode *n1,
+			    const struct rbnode *n2);
 void trice_candpair_make_valid(struct trice *icem, struct ice_candpair *pair);
 void trice_candpair_failed(struct ice_candpair *cp, int err, uint16_t scode);
 void trice_candpair_set_state(struct ice_candpair *cp,
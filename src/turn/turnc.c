@@ -468,6 +468,150 @@ int turnc_alloc(struct turnc **turncp, const struct stun_conf *conf, int proto,
 }
 
 
+/* Encode the TURN header in front of the payload, into its own buffer */
+static int hdr_encode(struct turnc *turnc, const struct sa *dst,
+		      struct chan *chan, struct mbuf *hdr, size_t len,
+		      size_t *padp)
+{
+	size_t pad = (4 - (len & 0x03)) & 0x03;
+	int err;
+
+	if (chan) {
+		struct chan_hdr ch;
+
+		ch.nr  = turnc_chan_numb(chan);
+		ch.len = (uint16_t)len;
+
+		/* ChannelData is only padded over TCP */
+		if (turnc->proto != IPPROTO_TCP)
+			pad = 0;
+
+		*padp = pad;
+
+		return turnc_chan_hdr_encode(&ch, hdr);
+	}
+
+	err = stun_msg_encode(hdr, STUN_METHOD_SEND, STUN_CLASS_INDICATION,
+			      sendind_tid, NULL, NULL, 0, false, 0x00, 1,
+			      STUN_ATTR_XOR_PEER_ADDR, dst);
+
+	/* The value of the DATA attribute is the payload */
+	err |= mbuf_write_u16(hdr, htons(STUN_ATTR_DATA));
+	err |= mbuf_write_u16(hdr, htons((uint16_t)len));
+
+	/* Message length, including the payload and its padding */
+	hdr->pos = 2;
+	err |= mbuf_write_u16(hdr, htons((uint16_t)(hdr->end -
+						    STUN_HEADER_SIZE +
+						    len + pad)));
+	hdr->pos = hdr->end;
+
+	*padp = pad;
+
+	return err;
+}
+
+
+#ifdef USE_DTLS
+/* DTLS records are sent from a single buffer */
+static int dtls_send_chain(struct tls_conn *tc, const struct mbuf_chain *ch)
+{
+	struct mbuf *mb;
+	int err;
+
+	mb = mbuf_alloc(ch->len);
+	if (!mb)
+		return ENOMEM;
+
+	err = mbuf_write_chain(mb, ch);
+	if (err)
+		goto out;
+
+	mb->pos = 0;
+	err = dtls_send(tc, mb);
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+#endif
+
+
+/*
+ * Send a payload without headroom for the TURN header. The header is sent
+ * in a chain with the payload, which is not copied.
+ */
+static int send_chain(struct turnc *turnc, const struct sa *dst,
+		      struct chan *chan, struct mbuf *mb)
+{
+	const size_t len = mbuf_get_left(mb);
+	struct mbuf_chain ch;
+	struct mbuf *hdr;
+	size_t hdrlen, pad = 0;
+	int err;
+
+	hdr = mbuf_alloc(STUN_HEADER_SIZE + 64);
+	if (!hdr)
+		return ENOMEM;
+
+	mbuf_chain_init(&ch);
+
+	err = hdr_encode(turnc, dst, chan, hdr, len, &pad);
+	if (err)
+		goto out;
+
+	/* The padding follows the header in the same buffer */
+	hdrlen = hdr->end;
+	if (pad) {
+		err = mbuf_fill(hdr, 0x00, pad);
+		if (err)
+			goto out;
+	}
+
+	hdr->pos = 0;
+	hdr->end = hdrlen;
+	err  = mbuf_chain_append(&ch, hdr);
+	err |= mbuf_chain_append(&ch, mb);
+
+	if (pad) {
+		hdr->pos = hdrlen;
+		hdr->end = hdrlen + pad;
+		err |= mbuf_chain_append(&ch, hdr);
+	}
+
+	if (err)
+		goto out;
+
+	switch (turnc->proto) {
+
+	case IPPROTO_UDP:
+		err = udp_send_chain(turnc->sock, &turnc->srv, &ch);
+		break;
+
+	case IPPROTO_TCP:
+		err = tcp_send_chain(turnc->sock, &ch);
+		break;
+
+#ifdef USE_DTLS
+	case STUN_TRANSP_DTLS:
+		err = dtls_send_chain(turnc->sock, &ch);
+		break;
+#endif
+
+	default:
+		err = EPROTONOSUPPORT;
+		break;
+	}
+
+ out:
+	mbuf_chain_reset(&ch);
+	mem_deref(hdr);
+
+	return err;
+}
+
+
 int turnc_send(struct turnc *turnc, const struct sa *dst, struct mbuf *mb)
 {
 	size_t pos, indlen;
@@ -482,7 +626,7 @@ int turnc_send(struct turnc *turnc, const struct sa *dst, struct mbuf *mb)
 		struct chan_hdr hdr;
 
 		if (mb->pos < CHAN_HDR_SIZE)
-			return EINVAL;
+			return send_chain(turnc, dst, chan, mb);
 
 		hdr.nr  = turnc_chan_numb(chan);
 		hdr.len = (uint16_t)mbuf_get_left(mb);
@@ -512,7 +656,7 @@ int turnc_send(struct turnc *turnc, const struct sa *dst, struct mbuf *mb)
 		indlen = stun_indlen(dst);
 
 		if (mb->pos < indlen)
-			return EINVAL;
+			return send_chain(turnc, dst, NULL, mb);
 
 		mb->pos -= indlen;
 		pos = mb->pos;
@@ -12,6 +12,7 @@
 #endif
 #if !defined(WIN32)
 #include <netdb.h>
+#include <sys/uio.h>
 #endif
 #include <string.h>
 #ifdef HAVE_STRINGS_H
@@ -60,7 +61,8 @@ typedef UINT32 *PQOS_FLOWID;
 
 
 enum {
-	UDP_RXSZ_DEFAULT = 8192
+	UDP_RXSZ_DEFAULT = 8192,
+	UDP_RXPOOL_MAX	 = 8,     /**< Free receive buffers kept */
 };
 
 
@@ -76,6 +78,7 @@ struct udp_sock {
 	bool conn;           /**< Connected socket flag       */
 	size_t rxsz;         /**< Maximum receive chunk size  */
 	size_t rx_presz;     /**< Preallocated rx buffer size */
+	struct mbuf_pool *rxpool; /**< Receive buffer pool    */
 #ifdef WIN32
 	HANDLE qos;          /**< QOS subsystem handle        */
 	QOS_FLOWID qos_id;   /**< QOS flow id                 */
@@ -83,6 +86,13 @@ struct udp_sock {
 	mtx_t *lock;         /**< A lock for helpers list     */
 };
 
+/** Defines a group of UDP sockets, one per reactor group loop */
+struct udp_group {
+	struct re_group *grp;   /**< Reactor group               */
+	struct udp_sock **usv;  /**< UDP Sockets by loop index   */
+	unsigned n;             /**< Number of UDP Sockets       */
+};
+
 /** Defines a UDP helper */
 struct udp_helper {
 	struct le le;
@@ -131,6 +141,7 @@ static void udp_destructor(void *data)
 	list_flush(&us->helpers);
 
 	mem_deref(us->lock);
+	mem_deref(us->rxpool);
 
 #ifdef WIN32
 	if (us->qos && us->qos_id)
@@ -148,12 +159,18 @@ static void udp_destructor(void *data)
 
 static void udp_read(struct udp_sock *us, re_sock_t fd)
 {
-	struct mbuf *mb = mbuf_alloc(us->rxsz);
+	struct mbuf *mb;
 	struct sa src;
 	struct le *le;
 	int err = 0;
 	ssize_t n;
 
+	if (!us->rxpool &&
+	    mbuf_pool_alloc(&us->rxpool, us->rxsz, UDP_RXPOOL_MAX))
+		return;
+
+	/* Buffers go back to the pool, they are not shrunk */
+	mb = mbuf_pool_get(us->rxpool);
 	if (!mb)
 		return;
 
@@ -185,8 +202,6 @@ static void udp_read(struct udp_sock *us, re_sock_t fd)
 	mb->pos = us->rx_presz;
 	mb->end = n + us->rx_presz;
 
-	(void)mbuf_resize(mb, mb->end);
-
 	/* call helpers */
 	mtx_lock(us->lock);
 	le = us->helpers.head;
@@ -211,6 +226,25 @@ static void udp_read(struct udp_sock *us, re_sock_t fd)
 }
 
 
+static void udp_busy_poll_set(const struct udp_sock *us)
+{
+#ifdef SO_BUSY_POLL
+	int usec = (int)re_busy_poll_get();
+
+	if (!usec)
+		return;
+
+	/* Raising it above net.core.busy_read needs CAP_NET_ADMIN */
+	if (0 != setsockopt(us->fd, SOL_SOCKET, SO_BUSY_POLL,
+			    BUF_CAST &usec, sizeof(usec))) {
+		DEBUG_INFO("SO_BUSY_POLL: %m\n", RE_ERRNO_SOCK);
+	}
+#else
+	(void)us;
+#endif
+}
+
+
 static void udp_read_handler(int flags, void *arg)
 {
 	struct udp_sock *us = arg;
@@ -221,6 +255,20 @@ static void udp_read_handler(int flags, void *arg)
 }
 
 
+static void sock_deref_handler(void *arg)
+{
+	struct udp_sock **usp = arg;
+
+	*usp = mem_deref(*usp);
+}
+
+
+static void group_deref_handler(void *arg)
+{
+	mem_deref(arg);
+}
+
+
 static int udp_alloc(struct udp_sock **usp)
 {
 	int err;
@@ -252,18 +300,8 @@ static int udp_alloc(struct udp_sock **usp)
 }
 
 
-/**
- * Create and listen on a UDP Socket
- *
- * @param usp   Pointer to returned UDP Socket
- * @param local Local network address
- * @param rh    Receive handler
- * @param arg   Handler argument
- *
- * @return 0 if success, otherwise errorcode
- */
-int udp_listen(struct udp_sock **usp, const struct sa *local,
-	       udp_recv_h *rh, void *arg)
+static int udp_listen_sock(struct udp_sock **usp, const struct sa *local,
+			   udp_recv_h *rh, void *arg, bool reuse)
 {
 	struct addrinfo hints, *res = NULL, *r;
 	struct udp_sock *us;
@@ -337,6 +375,15 @@ int udp_listen(struct udp_sock **usp, const struct sa *local,
 		if (r->ai_family == AF_INET6)
 			(void)net_sockopt_v6only(fd, false);
 
+		if (reuse) {
+			err = net_sockopt_reuse_set(fd, true);
+			if (err) {
+				DEBUG_WARNING("listen: reuse set: %m\n", err);
+				(void)close(fd);
+				continue;
+			}
+		}
+
 		if (bind(fd, r->ai_addr, SIZ_CAST r->ai_addrlen) < 0) {
 			err = RE_ERRNO_SOCK;
 			DEBUG_INFO("listen: bind(): %m (%J)\n", err, local);
@@ -376,6 +423,149 @@ int udp_listen(struct udp_sock **usp, const struct sa *local,
 }
 
 
+/**
+ * Create and listen on a UDP Socket
+ *
+ * @param usp   Pointer to returned UDP Socket
+ * @param local Local network address
+ * @param rh    Receive handler
+ * @param arg   Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_listen(struct udp_sock **usp, const struct sa *local,
+	       udp_recv_h *rh, void *arg)
+{
+	return udp_listen_sock(usp, local, rh, arg, false);
+}
+
+
+struct group_listen {
+	struct udp_sock **usp;
+	struct sa local;
+	udp_recv_h *rh;
+	void *arg;
+	int err;
+};
+
+
+static void udp_group_destructor(void *data)
+{
+	struct udp_group *ug = data;
+
+	for (unsigned i = 0; i < ug->n; i++) {
+		int err;
+
+		/* fd_close() must run in the loop of the socket, another
+		 * loop of the group cannot wait for it and hands it over */
+		err = re_group_call(ug->grp, i, sock_deref_handler,
+				    &ug->usv[i]);
+		if (err == EDEADLK)
+			(void)re_group_post(ug->grp, i, group_deref_handler,
+					    ug->usv[i]);
+	}
+
+	mem_deref(ug->usv);
+	mem_deref(ug->grp);
+}
+
+
+static void sock_listen_handler(void *arg)
+{
+	struct group_listen *gl = arg;
+
+	gl->err = udp_listen_sock(gl->usp, &gl->local, gl->rh, gl->arg, true);
+}
+
+
+/**
+ * Create one UDP Socket per loop of a reactor group, all bound to the same
+ * local address with SO_REUSEPORT. The kernel distributes incoming
+ * datagrams between the sockets, and each receive handler is called from
+ * the loop that owns the socket. Must be called from a thread outside of
+ * the group, as it waits for each loop.
+ *
+ * @param ugp   Pointer to returned UDP Socket group
+ * @param grp   Reactor group
+ * @param local Local network address, port 0 picks one port for all loops
+ * @param rh    Receive handler
+ * @param arg   Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_listen_group(struct udp_group **ugp, struct re_group *grp,
+		     const struct sa *local, udp_recv_h *rh, void *arg)
+{
+	struct group_listen gl;
+	struct udp_group *ug;
+	int err = 0;
+
+	if (!ugp || !grp || !local)
+		return EINVAL;
+
+	ug = mem_zalloc(sizeof(*ug), udp_group_destructor);
+	if (!ug)
+		return ENOMEM;
+
+	ug->grp = mem_ref(grp);
+	ug->usv = mem_zalloc(re_group_count(grp) * sizeof(*ug->usv), NULL);
+	if (!ug->usv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	/* set after usv exists, the destructor walks usv[0..n) */
+	ug->n = re_group_count(grp);
+
+	gl.local = *local;
+	gl.rh	 = rh;
+	gl.arg	 = arg;
+
+	for (unsigned i = 0; i < ug->n; i++) {
+		gl.usp = &ug->usv[i];
+		gl.err = 0;
+
+		err = re_group_call(grp, i, sock_listen_handler, &gl);
+		if (!err)
+			err = gl.err;
+		if (err)
+			goto out;
+
+		/* the other loops share the port of the first socket */
+		if (i == 0) {
+			err = udp_local_get(ug->usv[0], &gl.local);
+			if (err)
+				goto out;
+		}
+	}
+
+ out:
+	if (err)
+		mem_deref(ug);
+	else
+		*ugp = ug;
+
+	return err;
+}
+
+
+/**
+ * Get the UDP Socket of a loop in a UDP Socket group
+ *
+ * @param ug  UDP Socket group
+ * @param idx Loop index
+ *
+ * @return UDP Socket, NULL if not found
+ */
+struct udp_sock *udp_group_sock(const struct udp_group *ug, unsigned idx)
+{
+	if (!ug || idx >= ug->n)
+		return NULL;
+
+	return ug->usv[idx];
+}
+
+
 int udp_alloc_sockless(struct udp_sock **usp,
 		       udp_send_h *sendh, udp_recv_h *recvh, void *arg)
 {
@@ -553,6 +743,89 @@ int udp_send(struct udp_sock *us, const struct sa *dst, struct mbuf *mb)
 }
 
 
+static int send_chain_copy(struct udp_sock *us, const struct sa *dst,
+			   const struct mbuf_chain *ch)
+{
+	struct mbuf *mb;
+	int err;
+
+	mb = mbuf_alloc(ch->len);
+	if (!mb)
+		return ENOMEM;
+
+	err = mbuf_write_chain(mb, ch);
+	if (err)
+		goto out;
+
+	mb->pos = 0;
+
+	err = udp_send(us, dst, mb);
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/**
+ * Send a chain of memory buffers as one UDP Datagram to a peer. Without
+ * UDP helpers the segments are passed to the kernel as they are, without
+ * copying them into one buffer.
+ *
+ * @param us  UDP Socket
+ * @param dst Destination network address
+ * @param ch  Memory buffer chain to send
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_send_chain(struct udp_sock *us, const struct sa *dst,
+		   const struct mbuf_chain *ch)
+{
+#ifndef WIN32
+	struct iovec iov[MBUF_CHAIN_MAX];
+	struct msghdr msg;
+	bool helpers;
+	size_t i;
+#endif
+
+	if (!us || !dst || !ch)
+		return EINVAL;
+
+#ifdef WIN32
+	return send_chain_copy(us, dst, ch);
+#else
+	mtx_lock(us->lock);
+	helpers = !list_isempty(&us->helpers);
+	mtx_unlock(us->lock);
+
+	if (helpers || us->sendh)
+		return send_chain_copy(us, dst, ch);
+
+	for (i = 0; i < ch->segc; i++) {
+		const struct mbuf_seg *seg = &ch->segv[i];
+
+		iov[i].iov_base = seg->mb->buf + seg->pos;
+		iov[i].iov_len  = seg->end - seg->pos;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov    = iov;
+	msg.msg_iovlen = ch->segc;
+
+	if (!us->conn) {
+		msg.msg_name    = (void *)&dst->u.sa;
+		msg.msg_namelen = dst->len;
+	}
+
+	if (sendmsg(us->fd, &msg, 0) < 0)
+		return RE_ERRNO_SOCK;
+
+	return 0;
+#endif
+}
+
+
 /**
  * Get the local network address on the UDP Socket
  *
@@ -680,7 +953,8 @@ void udp_rxsz_set(struct udp_sock *us, size_t rxsz)
 	if (!us)
 		return;
 
-	us->rxsz = rxsz;
+	us->rxsz   = rxsz;
+	us->rxpool = mem_deref(us->rxpool);
 }
 
 
@@ -768,6 +1042,8 @@ int udp_thread_attach(struct udp_sock *us)
 				us);
 		if (err)
 			goto out;
+
+		udp_busy_poll_set(us);
 	}
 
  out:
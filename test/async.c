@@ -13,6 +13,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <re/re.h>
+#include <re/re_atomic.h>
 #include "test.h"
 
 #define DEBUG_MODULE "async"
@@ -156,6 +157,351 @@ out:
 }
 
 
+enum {
+	SERIAL_IDS   = 4,
+	SERIAL_WORKS = 400,
+};
+
+struct serial {
+	RE_ATOMIC unsigned busy[SERIAL_IDS];
+	RE_ATOMIC unsigned next[SERIAL_IDS];
+	RE_ATOMIC unsigned bad;
+	unsigned done;
+};
+
+struct serial_work {
+	struct serial *s;
+	unsigned id;
+	unsigned seq;
+};
+
+
+static int serial_work(void *arg)
+{
+	struct serial_work *w = arg;
+	struct serial *s = w->s;
+
+	if (re_atomic_acq_add(&s->busy[w->id], 1u))
+		re_atomic_rlx_add(&s->bad, 1u);
+
+	if (re_atomic_rlx(&s->next[w->id]) != w->seq)
+		re_atomic_rlx_add(&s->bad, 1u);
+
+	re_atomic_rlx_set(&s->next[w->id], w->seq + 1);
+
+	if (w->seq % 16 == 0)
+		sys_usleep(100);
+
+	re_atomic_acq_sub(&s->busy[w->id], 1u);
+
+	return 0;
+}
+
+
+static void serial_done(int err, void *arg)
+{
+	struct serial_work *w = arg;
+	(void)err;
+
+	if (++w->s->done == SERIAL_WORKS)
+		re_cancel();
+}
+
+
+/* Work with the same id never overlaps and keeps submission order */
+static int test_async_serial(void)
+{
+	struct re_async *async = NULL;
+	struct serial s;
+	struct serial_work *wv;
+	int err;
+
+	memset(&s, 0, sizeof(s));
+
+	wv = mem_zalloc(SERIAL_WORKS * sizeof(*wv), NULL);
+	if (!wv)
+		return ENOMEM;
+
+	err = re_async_alloc(&async, 4);
+	TEST_ERR(err);
+
+	for (unsigned i = 0; i < SERIAL_WORKS; i++) {
+		struct serial_work *w = &wv[i];
+
+		w->s   = &s;
+		w->id  = i % SERIAL_IDS;
+		w->seq = i / SERIAL_IDS;
+
+		err = re_async(async, w->id + 1, serial_work, serial_done, w);
+		TEST_ERR(err);
+	}
+
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+
+	TEST_EQUALS(SERIAL_WORKS, s.done);
+	TEST_EQUALS(0, re_atomic_rlx(&s.bad));
+
+	for (unsigned i = 0; i < SERIAL_IDS; i++)
+		TEST_EQUALS(SERIAL_WORKS / SERIAL_IDS,
+			    re_atomic_rlx(&s.next[i]));
+
+out:
+	mem_deref(async);
+	mem_deref(wv);
+	return err;
+}
+
+
+struct prio {
+	RE_ATOMIC bool open;
+	RE_ATOMIC unsigned n;
+	enum re_async_prio order[3];
+	unsigned done;
+};
+
+struct prio_work {
+	struct prio *p;
+	enum re_async_prio prio;
+};
+
+
+static int prio_gate(void *arg)
+{
+	struct prio *p = arg;
+
+	while (!re_atomic_acq(&p->open))
+		sys_usleep(1000);
+
+	return 0;
+}
+
+
+static int prio_work(void *arg)
+{
+	struct prio_work *w = arg;
+	unsigned n = re_atomic_rlx_add(&w->p->n, 1u);
+
+	if (n < RE_ARRAY_SIZE(w->p->order))
+		w->p->order[n] = w->prio;
+
+	return 0;
+}
+
+
+static void prio_done(int err, void *arg)
+{
+	struct prio *p = arg;
+	(void)err;
+
+	if (++p->done == RE_ARRAY_SIZE(p->order) + 1)
+		re_cancel();
+}
+
+
+static void prio_work_done(int err, void *arg)
+{
+	struct prio_work *w = arg;
+
+	prio_done(err, w->p);
+}
+
+
+/* Queued work is started highest priority first */
+static int test_async_prio(void)
+{
+	struct re_async *async = NULL;
+	struct prio p;
+	struct prio_work wv[] = {
+		{&p, RE_ASYNC_PRIO_LOW},
+		{&p, RE_ASYNC_PRIO_NORMAL},
+		{&p, RE_ASYNC_PRIO_HIGH},
+	};
+	int err;
+
+	memset(&p, 0, sizeof(p));
+
+	err = re_async_alloc(&async, 1);
+	TEST_ERR(err);
+
+	/* Keep the only worker busy until all work is queued */
+	err = re_async(async, 0, prio_gate, prio_done, &p);
+	TEST_ERR(err);
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(wv); i++) {
+		err = re_async_prio(async, 0, wv[i].prio, prio_work,
+				    prio_work_done, &wv[i]);
+		TEST_ERR(err);
+	}
+
+	err = re_async_prio(async, 0, RE_ASYNC_PRIO_HIGH + 1, prio_work,
+			    prio_work_done, &wv[0]);
+	TEST_EQUALS(EINVAL, err);
+
+	re_atomic_rls_set(&p.open, true);
+
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+
+	TEST_EQUALS(RE_ARRAY_SIZE(p.order), re_atomic_rlx(&p.n));
+	TEST_EQUALS(RE_ASYNC_PRIO_HIGH, p.order[0]);
+	TEST_EQUALS(RE_ASYNC_PRIO_NORMAL, p.order[1]);
+	TEST_EQUALS(RE_ASYNC_PRIO_LOW, p.order[2]);
+
+out:
+	mem_deref(async);
+	return err;
+}
+
+
+struct graph_test {
+	RE_ATOMIC unsigned seq;
+	unsigned order[4];
+	bool ran[4];
+	int fail;                   /**< Job that returns EPROTO, or -1 */
+	int err;
+	unsigned done;
+};
+
+struct graph_job {
+	struct graph_test *t;
+	int idx;
+};
+
+
+static int graph_work(void *arg)
+{
+	struct graph_job *j = arg;
+
+	j->t->ran[j->idx]   = true;
+	j->t->order[j->idx] = re_atomic_rlx_add(&j->t->seq, 1u);
+
+	return j->idx == j->t->fail ? EPROTO : 0;
+}
+
+
+static void graph_done(int err, void *arg)
+{
+	struct graph_test *t = arg;
+
+	t->err = err;
+	++t->done;
+	re_cancel();
+}
+
+
+/*
+ * Diamond graph: 0 -> 1, 0 -> 2, {1, 2} -> 3. Only the final result is
+ * posted to the loop, a failed job skips the jobs that depend on it.
+ */
+static int test_async_graph(void)
+{
+	struct re_async *async = NULL;
+	struct re_async_graph *graph = NULL, *other = NULL;
+	struct re_async_job *jobv[4], *ojob, *ojob2;
+	struct graph_test t;
+	struct graph_job jv[4];
+	int err;
+
+	memset(&t, 0, sizeof(t));
+
+	err = re_async_alloc(&async, 4);
+	TEST_ERR(err);
+
+	err = re_async_graph_alloc(&graph, async);
+	TEST_ERR(err);
+
+	err = re_async_graph_run(graph, graph_done, &t);
+	TEST_EQUALS(EINVAL, err);
+
+	for (int i = 0; i < 4; i++) {
+		jv[i].t   = &t;
+		jv[i].idx = i;
+
+		err = re_async_graph_job(graph, &jobv[i], graph_work, &jv[i]);
+		TEST_ERR(err);
+	}
+
+	err  = re_async_graph_depend(jobv[1], jobv[0]);
+	err |= re_async_graph_depend(jobv[2], jobv[0]);
+	err |= re_async_graph_depend(jobv[3], jobv[1]);
+	err |= re_async_graph_depend(jobv[3], jobv[2]);
+	TEST_ERR(err);
+
+	err = re_async_graph_depend(jobv[0], jobv[0]);
+	TEST_EQUALS(EINVAL, err);
+
+	err = re_async_graph_alloc(&other, async);
+	TEST_ERR(err);
+	err = re_async_graph_job(other, &ojob, graph_work, &jv[0]);
+	TEST_ERR(err);
+	err = re_async_graph_depend(ojob, jobv[0]);
+	TEST_EQUALS(EINVAL, err);
+
+	/* Cycle 0 -> 1 -> 0 */
+	err = re_async_graph_job(other, &ojob2, graph_work, &jv[1]);
+	TEST_ERR(err);
+	err  = re_async_graph_depend(ojob2, ojob);
+	err |= re_async_graph_depend(ojob, ojob2);
+	TEST_ERR(err);
+	err = re_async_graph_run(other, graph_done, &t);
+	TEST_EQUALS(ELOOP, err);
+
+	/* Success */
+	t.fail = -1;
+	err = re_async_graph_run(graph, graph_done, &t);
+	TEST_ERR(err);
+
+	err = re_async_graph_run(graph, graph_done, &t);
+	TEST_EQUALS(EBUSY, err);
+
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+
+	TEST_EQUALS(1, t.done);
+	TEST_ERR(t.err);
+	for (int i = 0; i < 4; i++)
+		TEST_ASSERT(t.ran[i]);
+	TEST_ASSERT(t.order[0] < t.order[1]);
+	TEST_ASSERT(t.order[0] < t.order[2]);
+	TEST_ASSERT(t.order[1] < t.order[3]);
+	TEST_ASSERT(t.order[2] < t.order[3]);
+
+	/* Run again, job 1 fails and job 3 is skipped */
+	memset(t.ran, 0, sizeof(t.ran));
+	t.fail = 1;
+	err = re_async_graph_run(graph, graph_done, &t);
+	TEST_ERR(err);
+
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+
+	TEST_EQUALS(2, t.done);
+	TEST_EQUALS(EPROTO, t.err);
+	TEST_ASSERT(t.ran[0] && t.ran[1] && t.ran[2]);
+	TEST_ASSERT(!t.ran[3]);
+
+	/* The graph keeps the async object alive */
+	t.fail = -1;
+	err = re_async_graph_run(graph, graph_done, &t);
+	TEST_ERR(err);
+
+	async = mem_deref(async);
+
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+
+	TEST_EQUALS(3, t.done);
+	TEST_ERR(t.err);
+
+out:
+	mem_deref(other);
+	mem_deref(graph);
+	mem_deref(async);
+	return err;
+}
+
+
 int test_async(void)
 {
 	int err;
@@ -166,6 +512,15 @@ int test_async(void)
 	err = test_re_thread_async_cancel();
 	TEST_ERR(err);
 
+	err = test_async_serial();
+	TEST_ERR(err);
+
+	err = test_async_prio();
+	TEST_ERR(err);
+
+	err = test_async_graph();
+	TEST_ERR(err);
+
 out:
 	return err;
 }
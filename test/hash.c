@@ -3,6 +3,7 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <ctype.h>
 #include <string.h>
 #include <re/re.h>
 #include "test.h"
@@ -215,6 +216,178 @@ static int test_hash_large(void)
 }
 
 
+static uint32_t obj_key(const void *data)
+{
+	const struct object *obj = data;
+
+	return obj->key;
+}
+
+
+static int test_hash_autogrow(void)
+{
+	enum { N = 1000 };
+	struct hash *ht = NULL;
+	uint32_t i, n = 0;
+	int err;
+
+	err = hash_alloc_autogrow(&ht, 4, obj_key);
+	TEST_ERR(err);
+
+	for (i=0; i<N; i++) {
+
+		struct object *obj;
+
+		obj = mem_zalloc(sizeof(*obj), obj_destructor);
+		if (!obj) {
+			err = ENOMEM;
+			goto out;
+		}
+		obj->magic1 = MAGIC1;
+		obj->magic2 = MAGIC2;
+		obj->key = hash_joaat((uint8_t *)&i, sizeof(i));
+
+		hash_append(ht, obj->key, &obj->he, obj);
+	}
+
+	/* Grows towards two elements per bucket */
+	TEST_ASSERT(hash_bsize(ht) >= N / 4);
+	TEST_ASSERT(hash_bsize(ht) <= N);
+
+	for (i=0; i<N; i++) {
+
+		const uint32_t key = hash_joaat((uint8_t *)&i, sizeof(i));
+		struct object *obj;
+
+		obj = list_ledata(hash_lookup(ht, key, cmp_handler,
+					      (void *)&key));
+		TEST_ASSERT(obj != NULL);
+		TEST_EQUALS(key, obj->key);
+		TEST_ASSERT(hash_list(ht, key) == obj->he.list);
+	}
+
+	/* Every element is in exactly one bucket */
+	for (i=0; i<hash_bsize(ht); i++)
+		n += list_count(hash_list_idx(ht, i));
+
+	TEST_EQUALS(N, n);
+	TEST_ASSERT(NULL == hash_list_idx(ht, hash_bsize(ht)));
+
+ out:
+	hash_flush(ht);
+	mem_deref(ht);
+
+	return err;
+}
+
+
+struct hmap_obj {
+	struct hmap *m;
+	uint32_t key;
+};
+
+
+static void hmap_obj_destructor(void *arg)
+{
+	struct hmap_obj *obj = arg;
+
+	/* A no-op when the map is being flushed */
+	(void)hmap_remove(obj->m, obj->key, obj);
+}
+
+
+static bool hmap_key_cmp(void *data, void *arg)
+{
+	const struct hmap_obj *obj = data;
+
+	return obj->key == *(uint32_t *)arg;
+}
+
+
+static int test_hmap(void)
+{
+	enum { N = 2000 };
+	struct hmap *m = NULL;
+	struct hmap_obj *objv[N] = {NULL};
+	struct hmap_obj *obj;
+	uint32_t i, key;
+	int err;
+
+	err = hmap_alloc(&m, 4);
+	TEST_ERR(err);
+
+	TEST_ASSERT(NULL == hmap_lookup(m, 1, NULL, NULL));
+	TEST_EQUALS(EINVAL, hmap_insert(m, 1, NULL));
+
+	/* Sequential keys, grows several times while inserting */
+	for (i = 0; i < N; i++) {
+
+		objv[i] = mem_zalloc(sizeof(*obj), hmap_obj_destructor);
+		if (!objv[i]) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		objv[i]->m   = m;
+		objv[i]->key = i;
+
+		err = hmap_insert(m, i, objv[i]);
+		TEST_ERR(err);
+
+		/* Earlier elements stay visible while the table moves */
+		key = i / 2;
+		obj = hmap_lookup(m, key, hmap_key_cmp, &key);
+		TEST_ASSERT(obj == objv[key]);
+	}
+
+	TEST_EQUALS(N, hmap_count(m));
+
+	for (i = 0; i < N; i++) {
+		obj = hmap_lookup(m, i, hmap_key_cmp, &i);
+		TEST_ASSERT(obj == objv[i]);
+	}
+
+	/* Remove every other element, then insert a duplicate key */
+	for (i = 0; i < N; i += 2)
+		objv[i] = mem_deref(objv[i]);
+
+	TEST_EQUALS(N / 2, hmap_count(m));
+	TEST_ASSERT(NULL == hmap_lookup(m, 0, NULL, NULL));
+	TEST_ASSERT(!hmap_remove(m, 1, objv[3]));
+
+	objv[0] = mem_zalloc(sizeof(*obj), hmap_obj_destructor);
+	if (!objv[0]) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	objv[0]->m   = m;
+	objv[0]->key = 1;
+
+	err = hmap_insert(m, 1, objv[0]);
+	TEST_ERR(err);
+
+	TEST_EQUALS(N / 2 + 1, hmap_count(m));
+	TEST_ASSERT(hmap_remove(m, 1, objv[0]));
+	TEST_ASSERT(objv[1] == hmap_lookup(m, 1, NULL, NULL));
+
+	err = hmap_insert(m, 1, objv[0]);
+	TEST_ERR(err);
+
+	/* The map does not own its elements until it is flushed */
+	hmap_flush(m);
+	TEST_EQUALS(0, hmap_count(m));
+	memset(objv, 0, sizeof(objv));
+
+ out:
+	for (i = 0; i < N; i++)
+		mem_deref(objv[i]);
+	mem_deref(m);
+
+	return err;
+}
+
+
 int test_hash(void)
 {
 	int err;
@@ -231,5 +404,169 @@ int test_hash(void)
 	if (err)
 		return err;
 
+	err = test_hash_autogrow();
+	if (err)
+		return err;
+
+	err = test_hmap();
+	if (err)
+		return err;
+
 	return 0;
 }
+
+
+static uint32_t lower_wy(const char *str, size_t len)
+{
+	char buf[128];
+
+	for (size_t i = 0; i < len; i++)
+		buf[i] = (char)tolower((unsigned char)str[i]);
+
+	return hash_wy((uint8_t *)buf, len);
+}
+
+
+/* Chi-square of a hash over sequential SIP-like Call-IDs */
+static unsigned chi_square(uint32_t (*hash)(const char *str))
+{
+	enum { BUCKETS = 256, KEYS = 16 * BUCKETS };
+	uint32_t bucketv[BUCKETS] = {0};
+	double chi = 0;
+
+	for (uint32_t i = 0; i < KEYS; i++) {
+		char key[64];
+
+		(void)re_snprintf(key, sizeof(key), "%08x@host.example.com", i);
+		++bucketv[hash(key) & (BUCKETS - 1)];
+	}
+
+	for (uint32_t i = 0; i < BUCKETS; i++) {
+		const double d = (double)bucketv[i] - KEYS / BUCKETS;
+
+		chi += d * d / (KEYS / BUCKETS);
+	}
+
+	return (unsigned)chi;
+}
+
+
+int test_hash_wy(void)
+{
+	const char *str = "Via: SIP/2.0/UDP pc33.atlanta.com;"
+		"branch=z9hG4bK776asdhds@[]`{}";
+	const struct pl pl = PL("z9hG4bK776asdhds");
+	char mixed[128];
+	int err = 0;
+
+	TEST_EQUALS(0, hash_wy(NULL, 0));
+	TEST_EQUALS(hash_wy_str(""), hash_wy((uint8_t *)"", 0));
+	TEST_EQUALS(hash_wy_str("z9hG4bK776asdhds"), hash_wy_pl(&pl));
+
+	/* All lengths and alignments of the short and long paths */
+	for (size_t len = 0; len <= strlen(str); len++) {
+
+		const size_t off = len % 8;
+
+		for (size_t i = 0; i < len; i++) {
+			const char c = str[i];
+
+			mixed[off + i] = (char)(i & 1 ? toupper(c) : c);
+		}
+
+		TEST_EQUALS(lower_wy(str, len),
+			    hash_wy_ci(&mixed[off], len));
+
+		if (len > 0)
+			TEST_ASSERT(hash_wy((uint8_t *)str, len) !=
+				    hash_wy((uint8_t *)str, len - 1));
+	}
+
+	TEST_EQUALS(hash_wy_str_ci("SIP/2.0"), hash_wy_str("sip/2.0"));
+
+	/* Only ASCII letters are folded */
+	for (unsigned c = 1; c < 256; c++) {
+		const char k[2] = {(char)c, 0};
+		const int lc = c < 0x80 ? tolower((int)c) : (int)c;
+		const char l[2] = {(char)lc, 0};
+
+		TEST_EQUALS(hash_wy_str(l), hash_wy_str_ci(k));
+	}
+
+	/* 255 degrees of freedom, 99.9% quantile is about 330 */
+	TEST_ASSERT(chi_square(hash_wy_str) < 330);
+
+ out:
+	return err;
+}
+
+
+static unsigned hash_mbps(uint32_t (*hash)(const char *str, size_t len),
+			const char *buf, size_t len)
+{
+	const uint64_t start = tmr_jiffies_usec();
+	volatile uint32_t sum = 0;
+	size_t n = 0;
+	uint64_t usec;
+
+	do {
+		for (uint32_t i = 0; i < 1000; i++)
+			sum += hash(buf + (i & 7), len);
+
+		n += 1000;
+		usec = tmr_jiffies_usec() - start;
+	} while (usec < 20000);
+
+	(void)sum;
+
+	return (unsigned)(n * len / usec);
+}
+
+
+static uint32_t joaat(const char *str, size_t len)
+{
+	return hash_joaat((const uint8_t *)str, len);
+}
+
+
+static uint32_t wy(const char *str, size_t len)
+{
+	return hash_wy((const uint8_t *)str, len);
+}
+
+
+int test_hash_perf(void)
+{
+	static const size_t lenv[] = {8, 24, 64, 256};
+	char buf[264];
+	int err = 0;
+
+	for (size_t i = 0; i < sizeof(buf); i++)
+		buf[i] = (char)('A' + i % 26);
+
+	(void)re_printf("%8s %10s %10s %10s %10s %10s\n", "bytes",
+			"joaat", "joaat_ci", "fast", "wy", "wy_ci");
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(lenv); i++) {
+
+		const unsigned j = hash_mbps(joaat, buf, lenv[i]);
+		const unsigned w = hash_mbps(wy, buf, lenv[i]);
+
+		(void)re_printf("%8zu %10u %10u %10u %10u %10u MB/s\n",
+				lenv[i], j,
+				hash_mbps(hash_joaat_ci, buf, lenv[i]),
+				hash_mbps(hash_fast, buf, lenv[i]), w,
+				hash_mbps(hash_wy_ci, buf, lenv[i]));
+
+		if (lenv[i] >= 64)
+			TEST_ASSERT(w > j);
+	}
+
+	(void)re_printf("chi-square: joaat %u, fast %u, wy %u"
+			" (expected 255)\n",
+			chi_square(hash_joaat_str), chi_square(hash_fast_str),
+			chi_square(hash_wy_str));
+
+ out:
+	return err;
+}
@@ -273,3 +273,179 @@ int test_list_flush(void)
 out:
 	return err;
 }
+
+
+struct tnode {
+	struct rbnode rn;
+	int value;
+	unsigned seq;
+};
+
+
+static int tnode_cmp(const struct rbnode *n1, const struct rbnode *n2)
+{
+	const struct tnode *t1 = n1->data, *t2 = n2->data;
+
+	return t1->value - t2->value;
+}
+
+
+/* Black height of a subtree, -1 if the red-black rules are broken */
+static int rb_check(const struct rbnode *n, const struct rbnode *parent)
+{
+	int lh, rh;
+
+	if (!n)
+		return 1;
+
+	if (n->parent != parent)
+		return -1;
+
+	if (n->red && ((n->left && n->left->red) ||
+		       (n->right && n->right->red)))
+		return -1;
+
+	lh = rb_check(n->left, n);
+	rh = rb_check(n->right, n);
+	if (lh < 0 || lh != rh)
+		return -1;
+
+	return lh + (n->red ? 0 : 1);
+}
+
+
+static int rb_verify(const struct rbtree *tree, uint32_t count)
+{
+	const struct tnode *prev = NULL;
+	struct rbnode *rn;
+	uint32_t n = 0;
+	int err = 0;
+
+	TEST_ASSERT(rb_check(tree->root, NULL) > 0 || !tree->root);
+	TEST_ASSERT(!tree->root || !tree->root->red);
+	TEST_EQUALS(count, rbtree_count(tree));
+
+	RBTREE_FOREACH(tree, rn) {
+		const struct tnode *t = rn->data;
+
+		TEST_ASSERT(rn->tree == tree);
+
+		/* Equal values keep their insertion order */
+		if (prev) {
+			TEST_ASSERT(prev->value <= t->value);
+			if (prev->value == t->value)
+				TEST_ASSERT(prev->seq < t->seq);
+		}
+
+		prev = t;
+		++n;
+	}
+
+	TEST_EQUALS(count, n);
+	TEST_ASSERT(rbtree_max(tree) == (prev ? &prev->rn : NULL));
+
+ out:
+	return err;
+}
+
+
+static bool tnode_apply(struct rbnode *rn, void *arg)
+{
+	const struct tnode *t = rn->data;
+	int *prev = arg;
+	bool stop = t->value > *prev;
+
+	*prev = t->value;
+
+	return stop;
+}
+
+
+int test_rbtree(void)
+{
+	enum { N = 1000 };
+	struct rbtree tree = RBTREE_INIT(tnode_cmp);
+	struct tnode *tv;
+	uint32_t x = 1, count = 0;
+	unsigned seq = 0;
+	int prev;
+	int err = 0;
+
+	tv = mem_zalloc(N * sizeof(*tv), NULL);
+	if (!tv)
+		return ENOMEM;
+
+	TEST_ASSERT(rbtree_isempty(&tree));
+	TEST_ASSERT(NULL == rbtree_min(&tree));
+	TEST_ASSERT(NULL == rbtree_max(&tree));
+
+	/* Insert with many duplicates */
+	for (unsigned i = 0; i < N; i++) {
+		x = x * 1103515245 + 12345;
+		tv[i].value = (int)((x >> 16) % 200);
+		tv[i].seq   = seq++;
+		rbtree_insert(&tree, &tv[i].rn, &tv[i]);
+	}
+
+	count = N;
+	err = rb_verify(&tree, count);
+	TEST_ERR(err);
+
+	/* Remove every third node, including the first */
+	for (unsigned i = 0; i < N; i += 3) {
+		rbtree_unlink(&tv[i].rn);
+		TEST_ASSERT(tv[i].rn.tree == NULL);
+		--count;
+	}
+
+	err = rb_verify(&tree, count);
+	TEST_ERR(err);
+
+	/* Pop the minimum until half is gone */
+	while (count > N / 4) {
+		struct rbnode *rn = rbtree_min(&tree);
+		const struct tnode *t = rn->data;
+		struct rbnode *next = rbtree_next(rn);
+
+		TEST_ASSERT(NULL == rbtree_prev(rn));
+		rbtree_unlink(rn);
+		--count;
+
+		TEST_ASSERT(rbtree_min(&tree) == next);
+		TEST_ASSERT(!next || ((struct tnode *)next->data)->value
+			    >= t->value);
+	}
+
+	err = rb_verify(&tree, count);
+	TEST_ERR(err);
+
+	/* Re-insert removed nodes, they go after equal values */
+	for (unsigned i = 0; i < N; i++) {
+		if (tv[i].rn.tree)
+			continue;
+
+		tv[i].seq = seq++;
+		rbtree_insert(&tree, &tv[i].rn, &tv[i]);
+		++count;
+	}
+
+	err = rb_verify(&tree, count);
+	TEST_ERR(err);
+
+	/* Reverse apply visits descending values */
+	prev = INT32_MAX;
+	TEST_ASSERT(NULL == rbtree_apply(&tree, false, tnode_apply, &prev));
+	TEST_EQUALS(((struct tnode *)rbtree_min(&tree)->data)->value, prev);
+
+	rbtree_clear(&tree);
+	TEST_ASSERT(rbtree_isempty(&tree));
+	TEST_EQUALS(0, rbtree_count(&tree));
+	for (unsigned i = 0; i < N; i++)
+		TEST_ASSERT(tv[i].rn.tree == NULL);
+
+ out:
+	rbtree_clear(&tree);
+	mem_deref(tv);
+
+	return err;
+}
@@ -160,6 +160,200 @@ out:
 }
 
 
+static int test_mbuf_pool(void)
+{
+	struct mbuf_pool *pool = NULL;
+	struct mbuf *mb = NULL, *mb2 = NULL, *ref = NULL;
+	uint8_t *buf;
+	int err;
+
+	err = mbuf_pool_alloc(&pool, 256, 1);
+	TEST_ERR(err);
+
+	mb = mbuf_pool_get(pool);
+	if (!mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	TEST_EQUALS(256, mb->size);
+	TEST_EQUALS(0, mb->end);
+
+	err = mbuf_write_str(mb, "hello");
+	TEST_ERR(err);
+
+	/* The last deref puts the buffer back, empty */
+	buf = mb->buf;
+	mb = mem_deref(mb);
+	TEST_EQUALS(1, mbuf_pool_count(pool));
+
+	mb = mbuf_pool_get(pool);
+	TEST_ASSERT(mb != NULL);
+	TEST_ASSERT(mb->buf == buf);
+	TEST_EQUALS(0, mb->pos);
+	TEST_EQUALS(0, mb->end);
+	TEST_EQUALS(0, mbuf_pool_count(pool));
+
+	/* Only up to the maximum free buffers are kept */
+	mb2 = mbuf_pool_get(pool);
+	if (!mb2) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	mb2 = mem_deref(mb2);
+	TEST_EQUALS(1, mbuf_pool_count(pool));
+
+	/* Buffers may share memory and outlive the pool */
+	ref = mbuf_alloc_ref(mb);
+	if (!ref) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	pool = mem_deref(pool);
+
+	mb = mem_deref(mb);
+	TEST_EQUALS(0, ref->end);
+
+ out:
+	mem_deref(ref);
+	mem_deref(mb2);
+	mem_deref(mb);
+	mem_deref(pool);
+
+	return err;
+}
+
+
+static int test_mbuf_slice(void)
+{
+	struct mbuf *mb, *sl = NULL;
+	uint8_t *buf;
+	int err;
+
+	mb = mbuf_alloc(16);
+	if (!mb)
+		return ENOMEM;
+
+	err = mbuf_write_str(mb, "head:payload:tail");
+	TEST_ERR(err);
+
+	mb->pos = 5;
+
+	/* Out of bounds */
+	TEST_ASSERT(NULL == mbuf_alloc_slice(mb, 13));
+
+	sl = mbuf_alloc_slice(mb, 7);
+	if (!sl) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	TEST_ASSERT(sl->buf == mb->buf);
+	TEST_EQUALS(7, mbuf_get_left(sl));
+	TEST_EQUALS(sl->end, sl->size);
+	TEST_MEMCMP("payload", 7, mbuf_buf(sl), mbuf_get_left(sl));
+
+	/* Appending to the view copies the buffer */
+	buf = sl->buf;
+	sl->pos = sl->end;
+	err = mbuf_write_u8(sl, '!');
+	TEST_ERR(err);
+
+	TEST_ASSERT(sl->buf != buf);
+	TEST_MEMCMP("head:payload:tail", 17, mb->buf, mb->end);
+	TEST_MEMCMP("head:payload!", 13, sl->buf, sl->end);
+
+	/* The parent may grow and shrink while the view is alive */
+	sl = mem_deref(sl);
+	sl = mbuf_alloc_slice(mb, 4);
+	if (!sl) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	mbuf_trim(mb);
+	mb->pos = mb->end;
+	err = mbuf_fill(mb, 'x', 64);
+	TEST_ERR(err);
+
+	TEST_MEMCMP("payl", 4, mbuf_buf(sl), mbuf_get_left(sl));
+
+ out:
+	mem_deref(sl);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static int test_mbuf_chain(void)
+{
+	struct mbuf_chain ch;
+	struct mbuf *hdr = NULL, *pld = NULL, *mb = NULL;
+	size_t i;
+	int err;
+
+	mbuf_chain_init(&ch);
+
+	hdr = mbuf_alloc(8);
+	pld = mbuf_alloc(8);
+	mb  = mbuf_alloc(8);
+	if (!hdr || !pld || !mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err  = mbuf_write_str(hdr, "head:");
+	err |= mbuf_write_str(pld, "xxpayload");
+	TEST_ERR(err);
+
+	hdr->pos = 0;
+	pld->pos = 2;
+
+	err = mbuf_chain_append(&ch, pld);
+	TEST_ERR(err);
+
+	err = mbuf_chain_prepend(&ch, hdr);
+	TEST_ERR(err);
+
+	TEST_EQUALS(2, ch.segc);
+	TEST_EQUALS(12, ch.len);
+	TEST_EQUALS(2, mem_nrefs(pld));
+	TEST_ASSERT(ch.segv[0].mb == hdr);
+
+	err = mbuf_write_chain(mb, &ch);
+	TEST_ERR(err);
+
+	TEST_MEMCMP("head:payload", 12, mb->buf, mb->end);
+
+	/* A full chain is refused */
+	for (i = ch.segc; i < MBUF_CHAIN_MAX; i++) {
+		err = mbuf_chain_append(&ch, pld);
+		TEST_ERR(err);
+	}
+
+	err = mbuf_chain_prepend(&ch, hdr);
+	TEST_EQUALS(ENOSPC, err);
+
+	mbuf_chain_reset(&ch);
+	TEST_EQUALS(0, ch.segc);
+	TEST_EQUALS(0, ch.len);
+	TEST_EQUALS(1, mem_nrefs(pld));
+
+	err = 0;
+
+ out:
+	mbuf_chain_reset(&ch);
+	mem_deref(mb);
+	mem_deref(pld);
+	mem_deref(hdr);
+
+	return err;
+}
+
+
 int test_mbuf(void)
 {
 	int err;
@@ -173,6 +367,15 @@ int test_mbuf(void)
 	err = test_mbuf_ptr();
 	TEST_ERR(err);
 
+	err = test_mbuf_pool();
+	TEST_ERR(err);
+
+	err = test_mbuf_slice();
+	TEST_ERR(err);
+
+	err = test_mbuf_chain();
+	TEST_ERR(err);
+
 out:
 	return err;
 }
@@ -3,6 +3,7 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <string.h>
 #include <re/re.h>
 #include "test.h"
 
@@ -131,3 +132,431 @@ int test_mem_secure(void)
  out:
 	return err;
 }
+
+
+enum { POOL_OBJS = 256 };
+
+struct pool_test {
+	uint8_t *objv[POOL_OBJS];
+	uint8_t *thrv[POOL_OBJS];
+};
+
+
+static size_t pool_size(unsigned i)
+{
+	return 1 + (i * 37) % 700;
+}
+
+
+static int pool_thread(void *arg)
+{
+	struct pool_test *pt = arg;
+
+	/* Freed here, allocated by the test thread */
+	for (unsigned i = 0; i < POOL_OBJS; i += 2)
+		pt->objv[i] = mem_deref(pt->objv[i]);
+
+	/* Freed by the test thread, after this thread has exited */
+	for (unsigned i = 0; i < POOL_OBJS; i++) {
+		pt->thrv[i] = mem_alloc(pool_size(i), NULL);
+		if (pt->thrv[i])
+			memset(pt->thrv[i], 0xa5, pool_size(i));
+	}
+
+	return 0;
+}
+
+
+int test_mem_pool(void)
+{
+	struct pool_test pt;
+	uint8_t *p, *q;
+	char *status = NULL;
+	thrd_t tid;
+	int err = 0;
+
+	memset(&pt, 0, sizeof(pt));
+
+	mem_pool_enable(true);
+
+	for (unsigned i = 0; i < POOL_OBJS; i++) {
+		pt.objv[i] = mem_alloc(pool_size(i), NULL);
+		if (!pt.objv[i]) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		TEST_ASSERT(re_is_aligned(pt.objv[i], mem_alignment));
+		memset(pt.objv[i], (int)i, pool_size(i));
+	}
+
+	/* Shrink in place, grow within the pool and beyond it */
+	p = mem_realloc(pt.objv[1], 16);
+	TEST_ASSERT(p == pt.objv[1]);
+
+	q = mem_realloc(p, 300);
+	if (!q) {
+		err = ENOMEM;
+		goto out;
+	}
+	pt.objv[1] = q;
+	TEST_EQUALS(1, q[15]);
+	memset(q, 1, 300);
+
+	q = mem_realloc(q, 4096);
+	if (!q) {
+		err = ENOMEM;
+		goto out;
+	}
+	pt.objv[1] = q;
+	TEST_EQUALS(1, q[299]);
+	memset(q, 1, 4096);
+
+	err = thread_create_name(&tid, "mem_pool", pool_thread, &pt);
+	TEST_ERR(err);
+
+	thrd_join(tid, NULL);
+
+	for (unsigned i = 1; i < POOL_OBJS; i += 2) {
+		const size_t sz = i == 1 ? 4096 : pool_size(i);
+
+		for (size_t j = 0; j < sz; j++)
+			TEST_EQUALS((uint8_t)i, pt.objv[i][j]);
+	}
+
+	for (unsigned i = 0; i < POOL_OBJS; i++) {
+		if (!pt.thrv[i]) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		TEST_EQUALS(0xa5, pt.thrv[i][pool_size(i) - 1]);
+	}
+
+	err = re_sdprintf(&status, "%H", mem_status, NULL);
+	TEST_ERR(err);
+
+	TEST_ASSERT(NULL != strstr(status, "Memory pool: enabled"));
+	TEST_ASSERT(NULL != strstr(status, "blocks in use"));
+
+ out:
+	for (unsigned i = 0; i < POOL_OBJS; i++) {
+		mem_deref(pt.objv[i]);
+		mem_deref(pt.thrv[i]);
+	}
+
+	mem_deref(status);
+	mem_pool_enable(false);
+
+	return err;
+}
+
+
+enum { ARENA_OBJS = 8 };
+
+static void arena_destructor(void *arg)
+{
+	unsigned *n = *(unsigned **)arg;
+
+	++*n;
+}
+
+
+int test_mem_arena(void)
+{
+	struct mem_arena *arena = NULL;
+	unsigned **objv[ARENA_OBJS] = {NULL};
+	unsigned ndh = 0;
+	uint8_t *big = NULL, *p;
+	int err;
+
+	err = mem_arena_alloc(&arena, 256);
+	TEST_ERR(err);
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(objv); i++) {
+		objv[i] = mem_arena_zalloc(arena, sizeof(*objv[i]),
+					   arena_destructor);
+		if (!objv[i]) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		TEST_ASSERT(re_is_aligned(objv[i], mem_alignment));
+		TEST_EQUALS(1, mem_nrefs(objv[i]));
+		*objv[i] = &ndh;
+	}
+
+	/* Larger than a chunk */
+	big = mem_arena_zalloc(arena, 1000, NULL);
+	if (!big) {
+		err = ENOMEM;
+		goto out;
+	}
+	TEST_EQUALS(0, big[999]);
+	memset(big, 0xa5, 1000);
+
+	/* Shrink in place, then move out of the arena */
+	p = mem_realloc(big, 100);
+	TEST_ASSERT(p == big);
+
+	p = mem_realloc(big, 2000);
+	if (!p) {
+		err = ENOMEM;
+		goto out;
+	}
+	big = p;
+	TEST_EQUALS(0xa5, big[99]);
+
+	/* Objects keep the arena alive */
+	arena = mem_deref(arena);
+
+	mem_deref(objv[0]);
+	objv[0] = NULL;
+	TEST_EQUALS(1, ndh);
+
+	mem_ref(objv[1]);
+	mem_deref(objv[1]);
+	TEST_EQUALS(1, ndh);
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(objv); i++)
+		objv[i] = mem_deref(objv[i]);
+
+	TEST_EQUALS(ARENA_OBJS, ndh);
+
+ out:
+	for (size_t i = 0; i < RE_ARRAY_SIZE(objv); i++)
+		mem_deref(objv[i]);
+
+	mem_deref(big);
+	mem_deref(arena);
+
+	return err;
+}
+
+
+int test_mem_local(void)
+{
+	struct obj *obj, *p;
+	int err = 0;
+
+	obj = mem_zalloc_local(sizeof(*obj), destructor);
+	if (!obj)
+		return ENOMEM;
+
+	obj->pattern = PATTERN;
+
+	TEST_EQUALS(1, mem_nrefs(obj));
+	TEST_ASSERT(re_is_aligned(obj, mem_alignment));
+
+	mem_ref(obj);
+	mem_ref(obj);
+	TEST_EQUALS(3, mem_nrefs(obj));
+
+	mem_deref(obj);
+	mem_deref(obj);
+	TEST_EQUALS(1, mem_nrefs(obj));
+
+	/* Stays local when resized */
+	p = mem_realloc(obj, 4096);
+	if (!p) {
+		err = ENOMEM;
+		goto out;
+	}
+	obj = p;
+
+	TEST_EQUALS(PATTERN, obj->pattern);
+
+	mem_ref(obj);
+	TEST_EQUALS(2, mem_nrefs(obj));
+	mem_deref(obj);
+
+ out:
+	mem_deref(obj);
+
+	return err;
+}
+
+
+static int prof_inuse(size_t *bytesp)
+{
+	struct pl bytes;
+	char *prof = NULL;
+	int err;
+
+	err = re_sdprintf(&prof, "%H", mem_prof_pprof, NULL);
+	if (err)
+		return err;
+
+	err = re_regex(prof, str_len(prof), "heap profile: [0-9]+: [0-9]+",
+		       NULL, &bytes);
+	if (!err)
+		*bytesp = (size_t)pl_u64(&bytes);
+
+	mem_deref(prof);
+
+	return err;
+}
+
+
+int test_mem_prof(void)
+{
+	enum { PROF_OBJS = 64, PROF_SIZE = 8192, PROF_INTERVAL = 4096 };
+	void *objv[PROF_OBJS] = {NULL};
+	size_t inuse1 = 0, inuse2 = 0;
+	char *str = NULL;
+	int err;
+
+	mem_prof_enable(PROF_INTERVAL);
+
+	/* Objects larger than the interval are always sampled */
+	for (size_t i = 0; i < RE_ARRAY_SIZE(objv); i++) {
+		objv[i] = mem_alloc(PROF_SIZE, NULL);
+		if (!objv[i]) {
+			err = ENOMEM;
+			goto out;
+		}
+	}
+
+	err = prof_inuse(&inuse1);
+	TEST_ERR(err);
+	TEST_ASSERT(inuse1 >= PROF_OBJS * PROF_SIZE);
+
+	err = re_sdprintf(&str, "%H", mem_prof_folded, NULL);
+	TEST_ERR(err);
+	err = re_regex(str, str_len(str), "[^ \n]+ [0-9]+\n", NULL, NULL);
+	TEST_ERR(err);
+	str = mem_deref(str);
+
+	err = re_sdprintf(&str, "%H", mem_status, NULL);
+	TEST_ERR(err);
+	TEST_ASSERT(NULL != strstr(str, "Memory profile: every 4096 bytes"));
+	str = mem_deref(str);
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(objv); i++)
+		objv[i] = mem_deref(objv[i]);
+
+	err = prof_inuse(&inuse2);
+	TEST_ERR(err);
+	TEST_ASSERT(inuse2 + PROF_OBJS * PROF_SIZE <= inuse1);
+
+ out:
+	mem_prof_enable(0);
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(objv); i++)
+		mem_deref(objv[i]);
+
+	mem_deref(str);
+
+	return err;
+}
+
+
+enum { STAT_THREADS = 4, STAT_OBJS = 256, STAT_SIZE = 512 };
+
+struct stat_test {
+	RE_ATOMIC unsigned ready;
+	RE_ATOMIC bool release;
+	void *objv[STAT_THREADS][STAT_OBJS];
+};
+
+struct stat_thread {
+	struct stat_test *st;
+	void **objv;
+};
+
+
+static int stat_thread(void *arg)
+{
+	struct stat_thread *t = arg;
+
+	for (unsigned i = 0; i < STAT_OBJS; i++)
+		t->objv[i] = mem_alloc(STAT_SIZE, NULL);
+
+	re_atomic_acq_add(&t->st->ready, 1);
+
+	/* Keep the objects alive until all threads hold theirs */
+	while (!re_atomic_acq(&t->st->release))
+		sys_usleep(1000);
+
+	for (unsigned i = 0; i < STAT_OBJS; i++)
+		t->objv[i] = mem_deref(t->objv[i]);
+
+	return 0;
+}
+
+
+int test_mem_stat(void)
+{
+	const size_t burst = STAT_THREADS * STAT_OBJS * STAT_SIZE;
+	const size_t blocks = STAT_THREADS * STAT_OBJS;
+	struct stat_thread thrv[STAT_THREADS];
+	struct memstat before, mid, after;
+	thrd_t tidv[STAT_THREADS];
+	struct stat_test *st;
+	unsigned n = 0;
+	int err;
+
+	st = mem_zalloc(sizeof(*st), NULL);
+	if (!st)
+		return ENOMEM;
+
+	err = mem_get_stat(&before);
+	if (err == ENOSYS) {
+		err = 0;
+		goto out;
+	}
+	TEST_ERR(err);
+
+	for (n = 0; n < STAT_THREADS; n++) {
+		thrv[n].st   = st;
+		thrv[n].objv = st->objv[n];
+
+		err = thread_create_name(&tidv[n], "mem_stat", stat_thread,
+					 &thrv[n]);
+		TEST_ERR(err);
+	}
+
+	while (re_atomic_acq(&st->ready) < STAT_THREADS)
+		sys_usleep(1000);
+
+	for (unsigned i = 0; i < STAT_THREADS; i++) {
+		for (unsigned j = 0; j < STAT_OBJS; j++) {
+			if (!st->objv[i][j]) {
+				err = ENOMEM;
+				goto out;
+			}
+		}
+	}
+
+	err = mem_get_stat(&mid);
+	TEST_ERR(err);
+
+	TEST_ASSERT(mid.bytes_cur   >= before.bytes_cur  + burst);
+	TEST_ASSERT(mid.blocks_cur  >= before.blocks_cur + blocks);
+	TEST_ASSERT(mid.bytes_peak  >= mid.bytes_cur);
+	TEST_ASSERT(mid.blocks_peak >= mid.blocks_cur);
+
+	re_atomic_rls_set(&st->release, true);
+
+	for (; n > 0; n--)
+		thrd_join(tidv[n - 1], NULL);
+
+	err = mem_get_stat(&after);
+	TEST_ERR(err);
+
+	/* All objects are gone again, but the peak stays */
+	TEST_EQUALS(before.bytes_cur,  after.bytes_cur);
+	TEST_EQUALS(before.blocks_cur, after.blocks_cur);
+	TEST_ASSERT(after.bytes_peak  >= before.bytes_cur  + burst);
+	TEST_ASSERT(after.blocks_peak >= before.blocks_cur + blocks);
+
+ out:
+	re_atomic_rls_set(&st->release, true);
+
+	for (; n > 0; n--)
+		thrd_join(tidv[n - 1], NULL);
+
+	mem_deref(st);
+
+	return err;
+}
@@ -5,6 +5,7 @@
  */
 #include <string.h>
 #include <re/re.h>
+#include <re/re_atomic.h>
 #include "test.h"
 
 
@@ -71,3 +72,131 @@ int test_mqueue(void)
 
 	return err;
 }
+
+
+enum {
+	PRODUCERS = 4,
+	PRODUCER_MSGS = 5000,
+};
+
+struct producer {
+	struct mqueue *mq;
+	RE_ATOMIC bool *stop;
+	int idx;
+	int err;
+};
+
+struct mt_test {
+	struct producer prodv[PRODUCERS];
+	int nextv[PRODUCERS];
+	RE_ATOMIC bool stop;
+	unsigned count;
+	int err;
+};
+
+
+static int producer_thread(void *arg)
+{
+	struct producer *p = arg;
+
+	for (int i = 0; i < PRODUCER_MSGS; i++) {
+		int err;
+
+		/* Wait for the loop if the queue is full */
+		while ((err = mqueue_push(p->mq, i, &p->idx)) == EAGAIN &&
+		       !re_atomic_rlx(p->stop))
+			sys_usleep(100);
+
+		if (err) {
+			p->err = err;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+
+static void mt_handler(int id, void *data, void *arg)
+{
+	struct mt_test *t = arg;
+	const int idx = *(int *)data;
+
+	/* Messages of one producer arrive in order */
+	if (id != t->nextv[idx]++)
+		t->err = EPROTO;
+
+	if (++t->count == PRODUCERS * PRODUCER_MSGS)
+		re_cancel();
+}
+
+
+int test_mqueue_threads(void)
+{
+	struct mqueue_stat stat;
+	struct mqueue *mq = NULL;
+	thrd_t tidv[PRODUCERS];
+	struct mt_test t;
+	int started = 0;
+	int err;
+
+	memset(&t, 0, sizeof(t));
+
+	err = mqueue_alloc(&mq, mt_handler, &t);
+	TEST_ERR(err);
+
+	/* Queued before the loop runs, handled in one wakeup */
+	for (int i = 0; i < 10; i++) {
+		err = mqueue_push(mq, 0, NULL);
+		TEST_ERR(err);
+	}
+
+	err = mqueue_get_stat(mq, &stat);
+	TEST_ERR(err);
+	TEST_EQUALS(10, stat.depth);
+	TEST_EQUALS(10, stat.hwm);
+	TEST_EQUALS(0, stat.full);
+
+	mem_deref(mq);
+
+	err = mqueue_alloc(&mq, mt_handler, &t);
+	TEST_ERR(err);
+
+	for (int i = 0; i < PRODUCERS; i++) {
+		t.prodv[i].mq   = mq;
+		t.prodv[i].stop = &t.stop;
+		t.prodv[i].idx  = i;
+
+		err = thread_create_name(&tidv[i], "mqueue_producer",
+					 producer_thread, &t.prodv[i]);
+		if (err)
+			break;
+
+		++started;
+	}
+
+	if (!err)
+		err = re_main_timeout(5000);
+
+	re_atomic_rlx_set(&t.stop, true);
+
+	for (int i = 0; i < started; i++) {
+		thrd_join(tidv[i], NULL);
+		if (!err)
+			err = t.prodv[i].err;
+	}
+
+	TEST_ERR(err);
+	TEST_ERR(t.err);
+	TEST_EQUALS(PRODUCERS * PRODUCER_MSGS, t.count);
+
+	err = mqueue_get_stat(mq, &stat);
+	TEST_ERR(err);
+	TEST_EQUALS(0, stat.depth);
+	TEST_ASSERT(stat.hwm >= 1);
+
+ out:
+	mem_deref(mq);
+
+	return err;
+}
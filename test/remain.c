@@ -5,7 +5,11 @@
  */
 
 #include <string.h>
+#ifdef HAVE_IO_URING
+#include <unistd.h>
+#endif
 #include <re/re.h>
+#include <re/re_atomic.h>
 #include "test.h"
 
 
@@ -138,11 +142,777 @@ static int test_remain_thread(void)
 }
 
 
+#ifdef HAVE_IO_URING
+struct uring_data {
+	struct udp_sock *us_a;
+	struct udp_sock *us_b;
+	unsigned recv_called;
+	int err;
+};
+
+
+static void uring_recv_handler(const struct sa *src, struct mbuf *mb,
+			       void *arg)
+{
+	struct uring_data *data = arg;
+	int err = 0;
+	(void)src;
+
+	TEST_EQUALS(4, mbuf_get_left(mb));
+	TEST_EQUALS(data->recv_called, mbuf_read_u32(mb));
+
+	if (++data->recv_called < 3)
+		return;
+
+	/* close the sockets while their poll requests are in flight */
+	data->us_a = mem_deref(data->us_a);
+	data->us_b = mem_deref(data->us_b);
+
+ out:
+	if (err)
+		data->err = err;
+
+	re_cancel();
+}
+
+
+static int uring_thread_handler(void *arg)
+{
+	struct uring_data *data = arg;
+	struct mbuf *mb = NULL;
+	struct sa sa;
+	int err;
+
+	err = re_thread_init();
+	if (err)
+		return err;
+
+	err = poll_method_set(METHOD_IOURING);
+	if (err == ENOSYS) {
+		/* not permitted by the running kernel */
+		err = 0;
+		goto out;
+	}
+	TEST_ERR(err);
+
+	err = sa_set_str(&sa, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err = udp_listen(&data->us_a, &sa, NULL, NULL);
+	TEST_ERR(err);
+
+	err = udp_listen(&data->us_b, &sa, uring_recv_handler, data);
+	TEST_ERR(err);
+
+	err = udp_local_get(data->us_b, &sa);
+	TEST_ERR(err);
+
+	mb = mbuf_alloc(4);
+	if (!mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (uint32_t i = 0; i < 3; i++) {
+		mbuf_rewind(mb);
+		err = mbuf_write_u32(mb, i);
+		TEST_ERR(err);
+
+		mb->pos = 0;
+		err = udp_send(data->us_a, &sa, mb);
+		TEST_ERR(err);
+	}
+
+	err = re_main_timeout(1000);
+	TEST_ERR(err);
+
+	TEST_EQUALS(METHOD_IOURING, poll_method_get());
+	TEST_EQUALS(3, data->recv_called);
+
+ out:
+	mem_deref(mb);
+	data->us_a = mem_deref(data->us_a);
+	data->us_b = mem_deref(data->us_b);
+
+	re_thread_close();
+
+	if (err)
+		data->err = err;
+
+	return err;
+}
+
+
+static void uring_fault_fd_handler(int flags, void *arg)
+{
+	unsigned *calls = arg;
+	(void)flags;
+
+	++*calls;
+}
+
+
+static int uring_fault_thread_handler(void *arg)
+{
+	int *errp = arg;
+	struct re_fhs *fhs = NULL;
+	int fds[2] = {-1, -1};
+	unsigned calls = 0;
+	int nfds;
+	int err;
+
+	err = re_thread_init();
+	if (err)
+		goto out;
+
+	err = poll_method_set(METHOD_IOURING);
+	if (err == ENOSYS) {
+		err = 0;
+		goto out;
+	}
+	TEST_ERR(err);
+
+	if (pipe(fds)) {
+		err = errno;
+		goto out;
+	}
+
+	nfds = re_nfds();
+
+	/* The poll request of a new fhs is queued when the submit fails */
+	poll_fault_set(EIO);
+	err = fd_listen(&fhs, fds[0], FD_READ, uring_fault_fd_handler,
+			&calls);
+	TEST_EQUALS(EIO, err);
+	TEST_ASSERT(fhs == NULL);
+
+	/* The interest change of an armed fhs fails */
+	err = fd_listen(&fhs, fds[0], FD_READ, uring_fault_fd_handler,
+			&calls);
+	TEST_ERR(err);
+
+	poll_fault_set(EIO);
+	err = fd_listen(&fhs, fds[0], FD_READ | FD_WRITE,
+			uring_fault_fd_handler, &calls);
+	TEST_EQUALS(EIO, err);
+	TEST_ASSERT(fhs == NULL);
+
+	/* Let the parked poll requests complete */
+	if (write(fds[1], "x", 1) != 1) {
+		err = errno;
+		goto out;
+	}
+
+	err = re_main_timeout(50);
+	TEST_ERR(err);
+
+	TEST_EQUALS(0, calls);
+	TEST_EQUALS(nfds, re_nfds());
+
+ out:
+	fd_close(fhs);
+
+	if (fds[0] >= 0)
+		(void)close(fds[0]);
+	if (fds[1] >= 0)
+		(void)close(fds[1]);
+
+	re_thread_close();
+
+	*errp = err;
+
+	return err;
+}
+
+
+static int test_remain_uring(void)
+{
+	struct uring_data data = { 0 };
+	thrd_t tid;
+	int ferr = 0;
+	int err;
+
+	err = thread_create_name(&tid, "remain_uring", uring_thread_handler,
+				 &data);
+	TEST_ERR(err);
+
+	thrd_join(tid, NULL);
+
+	TEST_ERR(data.err);
+
+	/* The submit of queued poll requests fails */
+	err = thread_create_name(&tid, "remain_uring_fault",
+				 uring_fault_thread_handler, &ferr);
+	TEST_ERR(err);
+
+	thrd_join(tid, NULL);
+
+	TEST_ERR(ferr);
+
+ out:
+	return err;
+}
+#endif
+
+
+struct changelist_data {
+	unsigned calls;
+	int flags;
+};
+
+
+static void changelist_fd_handler(int flags, void *arg)
+{
+	struct changelist_data *data = arg;
+
+	++data->calls;
+	data->flags |= flags;
+
+	re_cancel();
+}
+
+
+static int test_remain_changelist(void)
+{
+	struct changelist_data data = {0};
+	struct udp_sock *us = NULL;
+	struct re_fhs *fhs = NULL;
+	struct mbuf *mb = NULL;
+	struct sa sa;
+	re_sock_t fd;
+	int err;
+
+	err = fd_changelist_set(true);
+	TEST_ERR(err);
+
+	err = sa_set_str(&sa, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err = udp_listen(&us, &sa, NULL, NULL);
+	TEST_ERR(err);
+
+	err = udp_local_get(us, &sa);
+	TEST_ERR(err);
+
+	udp_thread_detach(us);
+	fd = udp_sock_fd(us, AF_INET);
+
+	/* The socket is writable, but the write interest is withdrawn
+	 * before the next poll and must never be reported */
+	err = fd_listen(&fhs, fd, FD_READ | FD_WRITE, changelist_fd_handler,
+			&data);
+	TEST_ERR(err);
+
+	for (int i = 0; i < 4; i++) {
+		err  = fd_listen(&fhs, fd, FD_READ, changelist_fd_handler,
+				 &data);
+		err |= fd_listen(&fhs, fd, FD_READ | FD_WRITE,
+				 changelist_fd_handler, &data);
+		TEST_ERR(err);
+	}
+
+	err = fd_listen(&fhs, fd, FD_READ, changelist_fd_handler, &data);
+	TEST_ERR(err);
+
+	mb = mbuf_alloc(4);
+	if (!mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = mbuf_write_u32(mb, 42);
+	TEST_ERR(err);
+
+	mb->pos = 0;
+	err = udp_send(us, &sa, mb);
+	TEST_ERR(err);
+
+	err = re_main_timeout(500);
+	TEST_ERR(err);
+
+	TEST_EQUALS(1, data.calls);
+	TEST_EQUALS(FD_READ, data.flags);
+
+ out:
+	fhs = fd_close(fhs);
+	mem_deref(us);
+	mem_deref(mb);
+	(void)fd_changelist_set(false);
+
+	return err;
+}
+
+
+static void busy_tmr_handler(void *arg)
+{
+	(void)arg;
+
+	re_cancel();
+}
+
+
+static int test_remain_busy_poll(void)
+{
+	enum poll_method method = poll_method_get();
+	uint64_t spin = 0, block = 0;
+	struct tmr tmr;
+	int err;
+
+	tmr_init(&tmr);
+
+	err = re_busy_poll_set(200);
+	TEST_ERR(err);
+	TEST_EQUALS(200, re_busy_poll_get());
+
+	tmr_start(&tmr, 5, busy_tmr_handler, NULL);
+
+	err = re_main_timeout(500);
+	TEST_ERR(err);
+
+	err = re_busy_poll_stats(&spin, &block);
+	TEST_ERR(err);
+
+	if (method == METHOD_EPOLL || method == METHOD_IOURING) {
+		TEST_ASSERT(spin >= 200);
+		TEST_ASSERT(block > 0);
+	}
+
+ out:
+	tmr_cancel(&tmr);
+	(void)re_busy_poll_set(0);
+
+	return err;
+}
+
+
+struct hstat_data {
+	re_fn_h *fh;
+	re_fn_h *th;
+	uint64_t fd_count;
+	uint64_t tmr_count;
+	uint64_t tmr_max;
+	uint64_t loops;
+	uint64_t events;
+	bool bad;
+};
+
+
+static void hstat_fd_handler(int flags, void *arg)
+{
+	(void)flags;
+	(void)arg;
+}
+
+
+static void hstat_tmr_handler(void *arg)
+{
+	const uint64_t start = tmr_jiffies_usec();
+	(void)arg;
+
+	/* Block the loop for a measurable time */
+	while (tmr_jiffies_usec() - start < 2000)
+		;
+
+	re_cancel();
+}
+
+
+static bool hstat_apply_handler(const struct re_hstat *st, void *arg)
+{
+	struct hstat_data *data = arg;
+	uint64_t sum = 0;
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(st->bucketv); i++)
+		sum += st->bucketv[i];
+
+	if (sum != st->count) {
+		data->bad = true;
+		return true;
+	}
+
+	switch (st->type) {
+
+	case RE_HSTAT_FD:
+		if (st->h == data->fh)
+			data->fd_count = st->count;
+		break;
+
+	case RE_HSTAT_TMR:
+		if (st->h == data->th) {
+			data->tmr_count = st->count;
+			data->tmr_max	= st->max;
+		}
+		break;
+
+	case RE_HSTAT_LOOP:
+		data->loops = st->count;
+		break;
+
+	case RE_HSTAT_EVENTS:
+		data->events = st->count;
+		break;
+	}
+
+	return false;
+}
+
+
+static int test_remain_hstat(void)
+{
+	struct hstat_data data = {
+		.fh = (re_fn_h *)hstat_fd_handler,
+		.th = (re_fn_h *)hstat_tmr_handler,
+	};
+	struct re_hstat st = {.count = 100, .max = 900};
+	struct udp_sock *us = NULL;
+	struct re_fhs *fhs = NULL;
+	struct sa sa;
+	struct tmr tmr;
+	int err;
+
+	tmr_init(&tmr);
+	re_hstat_reset();
+
+	/* Writable socket, reported on every wakeup */
+	err = sa_set_str(&sa, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err = udp_listen(&us, &sa, NULL, NULL);
+	TEST_ERR(err);
+
+	udp_thread_detach(us);
+
+	err = fd_listen(&fhs, udp_sock_fd(us, AF_INET), FD_WRITE,
+			hstat_fd_handler, NULL);
+	TEST_ERR(err);
+
+	tmr_start(&tmr, 1, hstat_tmr_handler, NULL);
+
+	err = re_main_timeout(500);
+	TEST_ERR(err);
+
+	err = re_hstat_apply(hstat_apply_handler, &data);
+	TEST_ERR(err);
+
+	TEST_ASSERT(!data.bad);
+	TEST_ASSERT(data.fd_count > 0);
+	TEST_EQUALS(1, data.tmr_count);
+	TEST_ASSERT(data.tmr_max >= 2000);
+	TEST_ASSERT(data.loops > 0);
+	TEST_ASSERT(data.events > 0);
+
+	/* 90 samples of 4..7 us, 10 samples of 512..900 us */
+	st.bucketv[3]  = 90;
+	st.bucketv[10] = 10;
+	TEST_EQUALS(8, re_hstat_percentile(&st, 50));
+	TEST_EQUALS(8, re_hstat_percentile(&st, 90));
+	TEST_EQUALS(900, re_hstat_percentile(&st, 99));
+
+	re_hstat_reset();
+	data.fd_count  = 0;
+	data.tmr_count = 0;
+
+	err = re_hstat_apply(hstat_apply_handler, &data);
+	TEST_ERR(err);
+
+	TEST_EQUALS(0, data.fd_count);
+	TEST_EQUALS(0, data.tmr_count);
+
+ out:
+	tmr_cancel(&tmr);
+	fhs = fd_close(fhs);
+	mem_deref(us);
+
+	return err;
+}
+
+
 int test_remain(void)
 {
 	int err = 0;
 
 	err = test_remain_thread();
+	if (err)
+		return err;
+
+	err = test_remain_changelist();
+	if (err)
+		return err;
+
+	err = test_remain_busy_poll();
+	if (err)
+		return err;
+
+	err = test_remain_hstat();
+	if (err)
+		return err;
+
+#ifdef HAVE_IO_URING
+	err = test_remain_uring();
+#endif
+
+	return err;
+}
+
+
+enum { GROUP_LOOPS = 2 };
+
+struct group_data {
+	struct re_group *grp;
+	struct tcp_conn *tcv[GROUP_LOOPS];
+	RE_ATOMIC unsigned posted;
+	RE_ATOMIC unsigned received;
+	RE_ATOMIC unsigned accepted;
+	RE_ATOMIC unsigned loop_mask;
+	unsigned estab;
+	int call_err;
+	int err;
+};
+
+
+static void group_work_handler(void *arg)
+{
+	struct group_data *data = arg;
+	unsigned idx;
+
+	if (0 == re_group_index(data->grp, &idx))
+		re_atomic_rlx_add(&data->posted, 1u << idx);
+}
+
+
+static void group_cross_handler(void *arg)
+{
+	struct group_data *data = arg;
+
+	data->call_err = re_group_call(data->grp, 1, group_work_handler,
+				       data);
+}
+
+
+static void group_late_handler(void *arg)
+{
+	struct group_data *data = arg;
+
+	re_atomic_rlx_add(&data->received, 1u);
+}
+
+
+static void group_stop_handler(void *arg)
+{
+	struct group_data *data = arg;
+
+	/* Queued behind the stop of the loop */
+	sys_msleep(50);
+	data->err = re_group_post(data->grp, 0, group_late_handler, data);
+}
+
+
+static int test_remain_group_stop(void)
+{
+	struct group_data data;
+	int err;
+
+	memset(&data, 0, sizeof(data));
+
+	err = re_group_alloc(&data.grp, 1, false);
+	TEST_ERR(err);
+
+	err = re_group_post(data.grp, 0, group_stop_handler, &data);
+	TEST_ERR(err);
+
+	/* The late work is dropped and freed when the loop stops */
+	data.grp = mem_deref(data.grp);
+
+	TEST_ERR(data.err);
+	TEST_EQUALS(0, re_atomic_rlx(&data.received));
+
+ out:
+	mem_deref(data.grp);
+
+	return err;
+}
+
+
+static void group_recv_handler(const struct sa *src, struct mbuf *mb,
+			       void *arg)
+{
+	struct group_data *data = arg;
+	(void)src;
+	(void)mb;
+
+	re_atomic_rlx_add(&data->received, 1u);
+}
+
+
+static void group_conn_handler(struct tcp_sock *ts, const struct sa *peer,
+			       void *arg)
+{
+	struct group_data *data = arg;
+	unsigned idx;
+	int err;
+	(void)peer;
+
+	err = re_group_index(data->grp, &idx);
+	if (!err)
+		err = tcp_accept(&data->tcv[idx], ts, NULL, NULL, NULL, NULL);
+
+	if (err) {
+		data->err = err;
+		return;
+	}
+
+	re_atomic_rlx_add(&data->loop_mask, 1u << idx);
+	re_atomic_rlx_add(&data->accepted, 1u);
+}
+
+
+static void group_conn_close_handler(void *arg)
+{
+	struct tcp_conn **tcp = arg;
+
+	*tcp = mem_deref(*tcp);
+}
+
+
+static void client_estab_handler(void *arg)
+{
+	struct group_data *data = arg;
+
+	if (++data->estab == GROUP_LOOPS)
+		re_cancel();
+}
+
+
+static void client_close_handler(int err, void *arg)
+{
+	struct group_data *data = arg;
+
+	data->err = err ? err : ECONNRESET;
+	re_cancel();
+}
+
+
+int test_remain_group(void)
+{
+	struct group_data data;
+	struct udp_group *ug = NULL;
+	struct tcp_group *tg = NULL;
+	struct udp_sock *us = NULL;
+	struct tcp_conn *tcv[GROUP_LOOPS] = {NULL};
+	struct mbuf *mb = NULL;
+	struct sa sa;
+	int err;
+
+	memset(&data, 0, sizeof(data));
+
+	err = re_group_alloc(&data.grp, GROUP_LOOPS, false);
+	TEST_ERR(err);
+
+	TEST_EQUALS(GROUP_LOOPS, re_group_count(data.grp));
+	TEST_EQUALS(ENOENT, re_group_index(data.grp, &(unsigned){0}));
+
+	/* Work is run in the thread of the target loop */
+	for (unsigned i = 0; i < GROUP_LOOPS; i++) {
+		err = re_group_call(data.grp, i, group_work_handler, &data);
+		TEST_ERR(err);
+	}
+
+	TEST_EQUALS((1u << GROUP_LOOPS) - 1, re_atomic_rlx(&data.posted));
+
+	/* A loop cannot wait for another loop of the group */
+	err = re_group_call(data.grp, 0, group_cross_handler, &data);
+	TEST_ERR(err);
+	TEST_EQUALS(EDEADLK, data.call_err);
+
+	err = test_remain_group_stop();
+	TEST_ERR(err);
+
+	/* UDP: one SO_REUSEPORT socket per loop on the same port */
+	err = sa_set_str(&sa, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err = udp_listen_group(&ug, data.grp, &sa, group_recv_handler, &data);
+	TEST_ERR(err);
+
+	err = udp_local_get(udp_group_sock(ug, 0), &sa);
+	TEST_ERR(err);
+
+	for (unsigned i = 1; i < GROUP_LOOPS; i++) {
+		struct sa local;
+
+		err = udp_local_get(udp_group_sock(ug, i), &local);
+		TEST_ERR(err);
+		TEST_ASSERT(sa_cmp(&sa, &local, SA_ALL));
+	}
+
+	err = udp_open(&us, AF_INET);
+	TEST_ERR(err);
+
+	mb = mbuf_alloc(8);
+	if (!mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = mbuf_write_u32(mb, 0x01020304);
+	TEST_ERR(err);
+
+	for (unsigned i = 0; i < 4; i++) {
+		mb->pos = 0;
+		err = udp_send(us, &sa, mb);
+		TEST_ERR(err);
+	}
+
+	for (unsigned i = 0; i < 500 && re_atomic_rlx(&data.received) < 4;
+	     i++)
+		sys_msleep(1);
+
+	TEST_EQUALS(4, re_atomic_rlx(&data.received));
+
+	/* TCP: connections are handed to the loops in round-robin order */
+	err = sa_set_str(&sa, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err = tcp_listen_group(&tg, data.grp, &sa, group_conn_handler, &data);
+	TEST_ERR(err);
+
+	err = tcp_local_get(tcp_group_sock(tg), &sa);
+	TEST_ERR(err);
+
+	for (unsigned i = 0; i < GROUP_LOOPS; i++) {
+		err = tcp_connect(&tcv[i], &sa, client_estab_handler, NULL,
+				  client_close_handler, &data);
+		TEST_ERR(err);
+	}
+
+	err = re_main_timeout(1000);
+	TEST_ERR(err);
+	TEST_ERR(data.err);
+
+	for (unsigned i = 0;
+	     i < 500 && re_atomic_rlx(&data.accepted) < GROUP_LOOPS; i++)
+		sys_msleep(1);
+
+	TEST_EQUALS(GROUP_LOOPS, re_atomic_rlx(&data.accepted));
+	TEST_EQUALS((1u << GROUP_LOOPS) - 1, re_atomic_rlx(&data.loop_mask));
+	TEST_ERR(data.err);
+
+ out:
+	for (unsigned i = 0; i < GROUP_LOOPS; i++) {
+		tcv[i] = mem_deref(tcv[i]);
+
+		if (data.grp) {
+			(void)re_group_call(data.grp, i,
+					    group_conn_close_handler,
+					    &data.tcv[i]);
+		}
+	}
+
+	mem_deref(tg);
+	mem_deref(ug);
+	mem_deref(us);
+	mem_deref(mb);
+	mem_deref(data.grp);
 
 	return err;
 }
@@ -88,6 +88,47 @@ static int send_data(struct tcp_conn *tc, const char *data)
 }
 
 
+/* Send the string as a chain of two buffers */
+static int send_chain(struct tcp_conn *tc, const char *data)
+{
+	struct mbuf_chain ch;
+	struct mbuf *mb1, *mb2;
+	const size_t n = strlen(data) / 2;
+	int err;
+
+	mbuf_chain_init(&ch);
+
+	mb1 = mbuf_alloc(n);
+	mb2 = mbuf_alloc(strlen(data) - n);
+	if (!mb1 || !mb2) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err  = mbuf_write_mem(mb1, (const uint8_t *)data, n);
+	err |= mbuf_write_str(mb2, data + n);
+	if (err)
+		goto out;
+
+	mb1->pos = 0;
+	mb2->pos = 0;
+
+	err  = mbuf_chain_append(&ch, mb2);
+	err |= mbuf_chain_prepend(&ch, mb1);
+	if (err)
+		goto out;
+
+	err = tcp_send_chain(tc, &ch);
+
+ out:
+	mbuf_chain_reset(&ch);
+	mem_deref(mb2);
+	mem_deref(mb1);
+
+	return err;
+}
+
+
 static bool mbuf_compare(const struct mbuf *mb, const char *str)
 {
 	if (mbuf_get_left(mb) != strlen(str)) {
@@ -119,7 +160,7 @@ static void tcp_server_recv_handler(struct mbuf *mb, void *arg)
 		return;
 	}
 
-	err = send_data(tt->tc2, pong);
+	err = send_chain(tt->tc2, pong);
 	if (err)
 		abort_test(tt, err);
 }
@@ -107,6 +107,7 @@ static const struct test tests[] = {
 	TEST(test_h265),
 	TEST(test_h265_packet),
 	TEST(test_hash),
+	TEST(test_hash_wy),
 	TEST(test_hmac_sha1),
 	TEST(test_hmac_sha256),
 	TEST(test_http),
@@ -137,17 +138,22 @@ static const struct test tests[] = {
 	TEST(test_list_flush),
 	TEST(test_list_ref),
 	TEST(test_list_sort),
+	TEST(test_rbtree),
 	TEST(test_mbuf),
 	TEST(test_md5),
 	TEST(test_mem),
 	TEST(test_mem_reallocarray),
 	TEST(test_mem_secure),
+	TEST(test_mem_arena),
+	TEST(test_mem_local),
 	TEST(test_net_if),
 	TEST(test_mqueue),
+	TEST(test_mqueue_threads),
 	TEST(test_odict),
 	TEST(test_odict_array),
 	TEST(test_pcp),
 	TEST(test_remain),
+	TEST(test_remain_group),
 	TEST(test_re_assert_se),
 	TEST(test_rtmp_play),
 	TEST(test_rtmp_publish),
@@ -232,6 +238,7 @@ static const struct test tests[] = {
 	TEST(test_try_into),
 	TEST(test_turn),
 	TEST(test_turn_tcp),
+	TEST(test_turn_chain),
 	TEST(test_udp),
 	TEST(test_unixsock),
 	TEST(test_uri),
@@ -259,6 +266,10 @@ static const struct test tests_integration[] = {
 	TEST(test_dns_cache_http_integration),
 	TEST(test_dns_http_integration),
 	TEST(test_dns_integration),
+	TEST(test_hash_perf),
+	TEST(test_mem_pool),
+	TEST(test_mem_prof),
+	TEST(test_mem_stat),
 	TEST(test_net_dst_source_addr_get),
 	TEST(test_rtp_listen),
 	TEST(test_sip_drequestf_network),
@@ -270,8 +281,13 @@ static const struct test tests_integration[] = {
 	TEST(test_sipreg_udp),
 	TEST(test_tmr_jiffies),
 	TEST(test_tmr_jiffies_usec),
+	TEST(test_tmr_wheel),
+	TEST(test_tmr_usec),
+	TEST(test_tmr_slack),
+	TEST(test_tmr_foreign),
 	TEST(test_turn_thread),
 	TEST(test_thread_cnd_timedwait),
+	TEST(test_thread_policy),
 };
 
 
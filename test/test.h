@@ -209,6 +209,8 @@ int test_h264_packet(void);
 int test_h265(void);
 int test_h265_packet(void);
 int test_hash(void);
+int test_hash_perf(void);
+int test_hash_wy(void);
 int test_hmac_sha1(void);
 int test_hmac_sha256(void);
 int test_http(void);
@@ -241,12 +243,19 @@ int test_list(void);
 int test_list_flush(void);
 int test_list_ref(void);
 int test_list_sort(void);
+int test_rbtree(void);
 int test_mbuf(void);
 int test_md5(void);
 int test_mem(void);
 int test_mem_reallocarray(void);
 int test_mem_secure(void);
+int test_mem_pool(void);
+int test_mem_arena(void);
+int test_mem_local(void);
+int test_mem_prof(void);
+int test_mem_stat(void);
 int test_mqueue(void);
+int test_mqueue_threads(void);
 int test_net_if(void);
 int test_net_dst_source_addr_get(void);
 int test_odict(void);
@@ -257,6 +266,7 @@ int test_trice_candpair(void);
 int test_trice_checklist(void);
 int test_trice_loop(void);
 int test_remain(void);
+int test_remain_group(void);
 int test_re_assert_se(void);
 int test_rtmp_play(void);
 int test_rtmp_publish(void);
@@ -333,11 +343,17 @@ int test_telev(void);
 int test_text2pcap(void);
 int test_thread(void);
 int test_thread_cnd_timedwait(void);
+int test_thread_policy(void);
 int test_tmr_jiffies(void);
 int test_tmr_jiffies_usec(void);
+int test_tmr_wheel(void);
+int test_tmr_usec(void);
+int test_tmr_slack(void);
+int test_tmr_foreign(void);
 int test_try_into(void);
 int test_turn(void);
 int test_turn_tcp(void);
+int test_turn_chain(void);
 int test_turn_thread(void);
 int test_udp(void);
 int test_unixsock(void);
@@ -5,6 +5,9 @@
  */
 
 #include <time.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
 #include <re/re.h>
 #include "test.h"
 
@@ -87,3 +90,125 @@ out:
 	mtx_unlock(&mtx);
 	return err;
 }
+
+
+#ifdef __linux__
+static int placed_thread(void *arg)
+{
+	const int *cpu = arg;
+	cpu_set_t set;
+
+	if (sched_getaffinity(0, sizeof(set), &set))
+		return errno;
+
+	if (CPU_COUNT(&set) != 1 || !CPU_ISSET(*cpu, &set))
+		return EPROTO;
+
+	return 0;
+}
+
+
+static int pinned_thread(void *arg)
+{
+	int err;
+
+	/* The 4th CPU of the policy set, wrapping around */
+	err = thread_pin(THREAD_KIND_VIDMIX, 3);
+	if (err)
+		return err;
+
+	return placed_thread(arg);
+}
+#endif
+
+
+int test_thread_policy(void)
+{
+	static const char *invalid[] = {
+		"a", "3-1", "0,", "1-", ",1", "0;1", "1024", "0-1024"
+	};
+	char *str = NULL;
+	int err;
+
+	err = thread_policy_set(THREAD_KIND_MAX, NULL, NULL);
+	TEST_EQUALS(EINVAL, err);
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(invalid); i++) {
+		err = thread_policy_set(THREAD_KIND_VIDMIX, invalid[i], NULL);
+		TEST_EQUALS(EINVAL, err);
+
+		err = thread_policy_set(THREAD_KIND_VIDMIX, NULL, invalid[i]);
+		TEST_EQUALS(EINVAL, err);
+	}
+
+	err = thread_policy_set(THREAD_KIND_VIDMIX, "0-2,5,7-8", "0");
+	TEST_ERR(err);
+
+	err = re_sdprintf(&str, "%H", thread_debug, NULL);
+	TEST_ERR(err);
+
+	TEST_ASSERT(NULL != strstr(str, "vidmix   cpus 0-2,5,7-8, nodes 0"));
+
+#ifdef __linux__
+	{
+		cpu_set_t set;
+		char cpus[32];
+		thrd_t thr;
+		int cpu = 0, cpu2;
+
+		if (sched_getaffinity(0, sizeof(set), &set)) {
+			err = errno;
+			TEST_ERR(err);
+		}
+
+		while (!CPU_ISSET(cpu, &set))
+			++cpu;
+
+		(void)re_snprintf(cpus, sizeof(cpus), "%d", cpu);
+
+		err = thread_policy_set(THREAD_KIND_VIDMIX, cpus, NULL);
+		TEST_ERR(err);
+
+		err = thread_create_kind(&thr, THREAD_KIND_VIDMIX, "placed",
+					 placed_thread, &cpu);
+		TEST_ERR(err);
+
+		thrd_join(thr, &err);
+		TEST_ERR(err);
+
+		/* Pinned within the policy set of two CPUs, if there are */
+		cpu2 = cpu + 1;
+		while (cpu2 < CPU_SETSIZE && !CPU_ISSET(cpu2, &set))
+			++cpu2;
+
+		if (cpu2 < CPU_SETSIZE) {
+			(void)re_snprintf(cpus, sizeof(cpus), "%d,%d",
+					  cpu, cpu2);
+		}
+		else {
+			cpu2 = cpu;
+		}
+
+		err = thread_policy_set(THREAD_KIND_VIDMIX, cpus, NULL);
+		TEST_ERR(err);
+
+		err = thread_create_kind(&thr, THREAD_KIND_VIDMIX, "pinned",
+					 pinned_thread, &cpu2);
+		TEST_ERR(err);
+
+		thrd_join(thr, &err);
+		TEST_ERR(err);
+
+		str = mem_deref(str);
+		err = re_sdprintf(&str, "%H", thread_debug, NULL);
+		TEST_ERR(err);
+
+		TEST_ASSERT(NULL != strstr(str, "pinned 1,"));
+	}
+#endif
+
+out:
+	thread_policy_set(THREAD_KIND_VIDMIX, NULL, NULL);
+	mem_deref(str);
+	return err;
+}
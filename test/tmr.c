@@ -48,3 +48,364 @@ int test_tmr_jiffies_usec(void)
 out:
 	return err;
 }
+
+
+enum { WHEEL_TIMERS = 12 };
+
+struct wheel_test {
+	struct tmr tmrv[WHEEL_TIMERS];
+	unsigned orderv[WHEEL_TIMERS];
+	unsigned fired;
+};
+
+struct wheel_timer {
+	struct wheel_test *wt;
+	unsigned idx;
+};
+
+
+static void wheel_handler(void *arg)
+{
+	struct wheel_timer *wtmr = arg;
+	struct wheel_test *wt = wtmr->wt;
+
+	if (wt->fired < WHEEL_TIMERS)
+		wt->orderv[wt->fired] = wtmr->idx;
+
+	if (++wt->fired == WHEEL_TIMERS)
+		re_cancel();
+}
+
+
+int test_tmr_wheel(void)
+{
+	/* Expire offsets from a common base, spanning two wheel levels */
+	static const int64_t offsetv[WHEEL_TIMERS] = {
+		65, 1, -10, 64, 250, 1, 0, 63, 64, 5, 130, 64
+	};
+	/* Expected order, equal expire times fire in start order */
+	static const unsigned expectv[WHEEL_TIMERS] = {
+		2, 6, 1, 5, 9, 7, 3, 8, 11, 0, 10, 4
+	};
+	struct wheel_timer wtmrv[WHEEL_TIMERS];
+	struct wheel_test wt;
+	struct tmrl *tmrl = re_tmrl_get();
+	struct tmr far, lvl3;
+	uint32_t n;
+	uint64_t base, next;
+	int err = 0;
+
+	memset(&wt, 0, sizeof(wt));
+	tmr_init(&far);
+	tmr_init(&lvl3);
+
+	n = tmrl_count(tmrl);
+
+	/* Timers beyond the first levels are counted and cancelled */
+	tmr_start(&lvl3, 300000, wheel_handler, NULL);
+	tmr_start(&far, 1ULL << 40, wheel_handler, NULL);
+	TEST_EQUALS(n + 2, tmrl_count(tmrl));
+
+	if (n == 0) {
+		next = tmr_next_timeout(tmrl);
+		TEST_ASSERT(next > 299000 && next <= 300000);
+	}
+
+	tmr_cancel(&lvl3);
+	TEST_EQUALS(n + 1, tmrl_count(tmrl));
+
+	if (n == 0) {
+		next = tmr_next_timeout(tmrl);
+		TEST_ASSERT(next > (1ULL << 40) - 1000);
+	}
+
+	tmr_cancel(&far);
+	TEST_EQUALS(n, tmrl_count(tmrl));
+
+	base = tmr_jiffies();
+
+	for (unsigned i = 0; i < WHEEL_TIMERS; i++) {
+		wtmrv[i].wt  = &wt;
+		wtmrv[i].idx = i;
+
+		tmr_init(&wt.tmrv[i]);
+		wt.tmrv[i].jfs = base + offsetv[i];
+		tmr_continue(&wt.tmrv[i], 0, wheel_handler, &wtmrv[i]);
+	}
+
+	TEST_EQUALS(n + WHEEL_TIMERS, tmrl_count(tmrl));
+	TEST_ASSERT(tmr_get_expire(&wt.tmrv[4]) <= 250);
+	TEST_ASSERT(tmr_get_expire(&wt.tmrv[4]) > 200);
+
+	err = re_main_timeout(1000);
+	TEST_ERR(err);
+
+	TEST_EQUALS(WHEEL_TIMERS, wt.fired);
+	TEST_MEMCMP(expectv, sizeof(expectv), wt.orderv, sizeof(wt.orderv));
+	TEST_EQUALS(n, tmrl_count(tmrl));
+
+ out:
+	for (unsigned i = 0; i < WHEEL_TIMERS; i++)
+		tmr_cancel(&wt.tmrv[i]);
+
+	tmr_cancel(&lvl3);
+	tmr_cancel(&far);
+
+	return err;
+}
+
+
+struct usec_test {
+	uint64_t start;
+	uint64_t firedv[3];
+	unsigned orderv[3];
+	unsigned fired;
+};
+
+struct usec_timer {
+	struct usec_test *ut;
+	unsigned idx;
+};
+
+
+static void usec_handler(void *arg)
+{
+	struct usec_timer *utmr = arg;
+	struct usec_test *ut = utmr->ut;
+
+	ut->firedv[utmr->idx] = tmr_jiffies_usec() - ut->start;
+	ut->orderv[ut->fired] = utmr->idx;
+
+	if (++ut->fired == RE_ARRAY_SIZE(ut->orderv))
+		re_cancel();
+}
+
+
+int test_tmr_usec(void)
+{
+	struct usec_timer utmrv[3];
+	struct usec_test ut;
+	struct tmr tmrv[3];
+	int err = 0;
+
+	memset(&ut, 0, sizeof(ut));
+
+	for (unsigned i = 0; i < RE_ARRAY_SIZE(tmrv); i++) {
+		tmr_init(&tmrv[i]);
+		utmrv[i].ut  = &ut;
+		utmrv[i].idx = i;
+	}
+
+	ut.start = tmr_jiffies_usec();
+
+	tmr_start_us(&tmrv[0], 2500, usec_handler, &utmrv[0]);
+	tmr_start(&tmrv[1], 5, usec_handler, &utmrv[1]);
+	tmr_start_us(&tmrv[2], 1200, usec_handler, &utmrv[2]);
+
+	TEST_ASSERT(tmr_isrunning(&tmrv[0]));
+	TEST_ASSERT(tmr_get_expire_us(&tmrv[0]) <= 2500);
+	TEST_ASSERT(tmr_get_expire_us(&tmrv[0]) > 2000);
+	TEST_ASSERT(tmr_get_expire(&tmrv[0]) <= 3);
+
+	err = re_main_timeout(1000);
+	TEST_ERR(err);
+
+	TEST_EQUALS(3, ut.fired);
+	TEST_EQUALS(2, ut.orderv[0]);
+	TEST_EQUALS(0, ut.orderv[1]);
+	TEST_EQUALS(1, ut.orderv[2]);
+
+	/* Never early, and well below millisecond timer granularity */
+	TEST_ASSERT(ut.firedv[2] >= 1200);
+	TEST_ASSERT(ut.firedv[0] >= 2500);
+	TEST_ASSERT(ut.firedv[0] < 2500 + 900);
+
+ out:
+	for (unsigned i = 0; i < RE_ARRAY_SIZE(tmrv); i++)
+		tmr_cancel(&tmrv[i]);
+
+	return err;
+}
+
+
+static void slack_handler(void *arg)
+{
+	(void)arg;
+}
+
+
+int test_tmr_slack(void)
+{
+	enum { N = 32, DELAY = 100, SLACK = 50 };
+	struct tmr tmrv[N];
+	uint64_t before, after;
+	uint64_t jfsv[N];
+	unsigned distinct = 0;
+	int err = 0;
+
+	before = tmr_jiffies();
+
+	for (unsigned i = 0; i < N; i++) {
+		tmr_init(&tmrv[i]);
+		tmr_start_slack(&tmrv[i], DELAY + i, SLACK, slack_handler,
+				NULL);
+	}
+
+	after = tmr_jiffies();
+
+	for (unsigned i = 0; i < N; i++) {
+		unsigned j;
+
+		/* Within the window of the timer */
+		TEST_ASSERT(tmrv[i].jfs >= before + DELAY + i);
+		TEST_ASSERT(tmrv[i].jfs <= after + DELAY + i + SLACK);
+
+		for (j = 0; j < distinct; j++) {
+			if (jfsv[j] == tmrv[i].jfs)
+				break;
+		}
+
+		if (j == distinct)
+			jfsv[distinct++] = tmrv[i].jfs;
+	}
+
+	/* Overlapping windows share few expire times */
+	TEST_ASSERT(distinct <= 4);
+
+	/* Without slack, the delay is exact */
+	tmr_start_slack(&tmrv[0], DELAY, 0, slack_handler, NULL);
+	TEST_ASSERT(tmr_get_expire(&tmrv[0]) <= DELAY);
+	TEST_ASSERT(tmr_get_expire(&tmrv[0]) >= DELAY - 1);
+
+ out:
+	for (unsigned i = 0; i < N; i++)
+		tmr_cancel(&tmrv[i]);
+
+	return err;
+}
+
+
+enum { FOREIGN_TIMERS = 16 };
+
+struct foreign_test {
+	struct tmrl *tmrl;
+	struct tmr ownv[FOREIGN_TIMERS];
+	struct tmr armv[FOREIGN_TIMERS];
+	struct tmr tick;
+	RE_ATOMIC unsigned fired;
+	RE_ATOMIC unsigned bad;
+	RE_ATOMIC bool done;
+	bool skip;
+};
+
+
+static void foreign_fired(void *arg)
+{
+	struct foreign_test *ft = arg;
+
+	re_atomic_rlx_add(&ft->fired, 1u);
+}
+
+
+static void foreign_bad(void *arg)
+{
+	struct foreign_test *ft = arg;
+
+	re_atomic_rlx_add(&ft->bad, 1u);
+}
+
+
+static int foreign_thread(void *arg)
+{
+	struct foreign_test *ft = arg;
+
+	/* Only a thread without a loop arms timers of the global loop */
+	if (re_tmrl_get() != ft->tmrl) {
+		ft->skip = true;
+		goto out;
+	}
+
+	for (unsigned i = 0; i < FOREIGN_TIMERS; i++) {
+
+		/* Timers of the loop thread */
+		tmr_cancel(&ft->ownv[i]);
+
+		/* Armed through the inbox, half cancelled before they run */
+		tmr_start(&ft->armv[i], i % 4,
+			  i % 2 ? foreign_bad : foreign_fired, ft);
+		if (i % 2)
+			tmr_cancel(&ft->armv[i]);
+	}
+
+ out:
+	re_atomic_rls_set(&ft->done, true);
+
+	return 0;
+}
+
+
+static void foreign_tick(void *arg)
+{
+	struct foreign_test *ft = arg;
+
+	if (re_atomic_acq(&ft->done) &&
+	    (ft->skip || re_atomic_rlx(&ft->fired) == FOREIGN_TIMERS / 2)) {
+		re_cancel();
+		return;
+	}
+
+	tmr_start(&ft->tick, 1, foreign_tick, ft);
+}
+
+
+int test_tmr_foreign(void)
+{
+	struct foreign_test *ft;
+	thrd_t tid;
+	uint32_t n;
+	int err = 0;
+
+	ft = mem_zalloc(sizeof(*ft), NULL);
+	if (!ft)
+		return ENOMEM;
+
+	ft->tmrl = re_tmrl_get();
+	n = tmrl_count(ft->tmrl);
+
+	for (unsigned i = 0; i < FOREIGN_TIMERS; i++) {
+		tmr_init(&ft->armv[i]);
+		tmr_init(&ft->ownv[i]);
+		tmr_start(&ft->ownv[i], 20 + i, foreign_bad, ft);
+	}
+
+	tmr_init(&ft->tick);
+	tmr_start(&ft->tick, 1, foreign_tick, ft);
+
+	err = thread_create_name(&tid, "tmr_foreign", foreign_thread, ft);
+	TEST_ERR(err);
+
+	err = re_main_timeout(1000);
+
+	thrd_join(tid, NULL);
+	TEST_ERR(err);
+
+	if (ft->skip) {
+		err = ESKIPPED;
+		goto out;
+	}
+
+	TEST_EQUALS(FOREIGN_TIMERS / 2, re_atomic_rlx(&ft->fired));
+	TEST_EQUALS(0, re_atomic_rlx(&ft->bad));
+	TEST_EQUALS(n, tmrl_count(ft->tmrl));
+
+ out:
+	for (unsigned i = 0; i < FOREIGN_TIMERS; i++) {
+		tmr_cancel(&ft->armv[i]);
+		tmr_cancel(&ft->ownv[i]);
+	}
+
+	tmr_cancel(&ft->tick);
+	mem_deref(ft);
+
+	return err;
+}
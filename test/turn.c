@@ -38,6 +38,7 @@ struct turntest {
 	thrd_t thr;
 	mtx_t *mtx;
 	int proto;
+	bool chain;
 	int err;
 
 	size_t n_alloc_resp;
@@ -82,9 +83,14 @@ static void complete_test(struct turntest *tt, int err)
 static int send_payload(struct turntest *tt, size_t offset,
 			const struct sa *dst, const char *str)
 {
-	struct mbuf *mb = mbuf_alloc(offset + str_len(str));
+	struct mbuf *mb;
 	int err;
 
+	/* No headroom, the TURN header is sent in a chain */
+	if (tt->chain)
+		offset = 0;
+
+	mb = mbuf_alloc(offset + str_len(str));
 	if (!mb)
 		return ENOMEM;
 
@@ -96,6 +102,11 @@ static int send_payload(struct turntest *tt, size_t offset,
 
 	mb->pos = offset;
 
+	if (tt->chain) {
+		err = turnc_send(tt->turnc, dst, mb);
+		goto out;
+	}
+
 	switch (tt->proto) {
 
 	case IPPROTO_UDP:
@@ -483,6 +494,44 @@ int test_turn_tcp(void)
 }
 
 
+int test_turn_chain(void)
+{
+	static const int protov[] = {IPPROTO_UDP, IPPROTO_TCP};
+	struct turntest *tt = NULL;
+	int err = 0;
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(protov); i++) {
+
+		err = turntest_alloc(&tt, protov[i], 600);
+		if (err)
+			return err;
+
+		tt->chain = true;
+
+		err = re_main_timeout(200);
+		TEST_ERR(err);
+
+		err = tt->err;
+		TEST_ERR(err);
+
+		TEST_EQUALS(1, tt->n_alloc_resp);
+		TEST_EQUALS(1, tt->n_chan_resp);
+		TEST_EQUALS(2, tt->n_peer_recv);
+
+		TEST_ASSERT(tt->turnsrv->n_chanbind >= 1);
+		TEST_ASSERT(tt->turnsrv->n_raw >= 1);
+		TEST_EQUALS(1, tt->turnsrv->n_send);
+
+		tt = mem_deref(tt);
+	}
+
+ out:
+	mem_deref(tt);
+
+	return err;
+}
+
+
 static void tmr_handler(void *arg)
 {
 	struct turntest *tt = arg;
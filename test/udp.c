@@ -94,13 +94,40 @@ static void udp_recv_client(const struct sa *src, struct mbuf *mb, void *arg)
 }
 
 
-/* Echo server */
+/* Echo server, sends the first bytes as a separate chain segment */
 static void udp_recv_server(const struct sa *src, struct mbuf *mb, void *arg)
 {
 	struct udp_test *ut = arg;
+	struct mbuf_chain ch;
+	struct mbuf *hdr;
 	int err;
 
-	err = udp_send(ut->uss, src, mb);
+	mbuf_chain_init(&ch);
+
+	hdr = mbuf_alloc(4);
+	if (!hdr) {
+		ut->err = ENOMEM;
+		return;
+	}
+
+	err = mbuf_write_mem(hdr, mbuf_buf(mb), 4);
+	if (err)
+		goto out;
+
+	hdr->pos = 0;
+	mb->pos += 4;
+
+	err  = mbuf_chain_append(&ch, mb);
+	err |= mbuf_chain_prepend(&ch, hdr);
+	if (err)
+		goto out;
+
+	err = udp_send_chain(ut->uss, src, &ch);
+
+ out:
+	mbuf_chain_reset(&ch);
+	mem_deref(hdr);
+
 	if (err)
 		ut->err = err;
 }